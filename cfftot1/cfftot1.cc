@@ -19,7 +19,9 @@
 #include <efont/t1item.hh>
 #include <lcdf/clp.h>
 #include <lcdf/error.hh>
-#include "maket1font.hh"
+#include <lcdf/readfile.hh>
+#include <efont/maket1font.hh>
+#include <efont/t1subrize.hh>
 #include <efont/cff.hh>
 #include <efont/otf.hh>
 #include <stdlib.h>
@@ -45,22 +47,34 @@ using namespace Efont;
 #define PFA_OPT         305
 #define OUTPUT_OPT      306
 #define NAME_OPT        307
+#define JOBS_OPT        308
+#define SUBSET_OPT      309
+#define SUBSET_ENC_OPT  310
+#define SUBROUTINIZE_OPT 311
 
 const Clp_Option options[] = {
     { "ascii", 'a', PFA_OPT, 0, 0 },
     { "binary", 'b', PFB_OPT, 0, 0 },
     { "help", 'h', HELP_OPT, 0, 0 },
+    { "jobs", 'j', JOBS_OPT, Clp_ValInt, 0 },
     { "name", 'n', NAME_OPT, Clp_ValString, 0 },
     { "output", 'o', OUTPUT_OPT, Clp_ValString, 0 },
     { "pfa", 'a', PFA_OPT, 0, 0 },
     { "pfb", 'b', PFB_OPT, 0, 0 },
     { "quiet", 'q', QUIET_OPT, 0, Clp_Negate },
+    { "subset", 0, SUBSET_OPT, Clp_ValString, 0 },
+    { "subset-encoding", 0, SUBSET_ENC_OPT, Clp_ValString, 0 },
+    { "subroutinize", 0, SUBROUTINIZE_OPT, 0, Clp_Negate },
     { "version", 'v', VERSION_OPT, 0, 0 },
 };
 
 
 static const char *program_name;
 static bool binary = true;
+static int njobs = 1;
+static bool subset = false;
+static bool subroutinize = false;
+static Vector<PermString> subset_glyphs;
 
 
 void
@@ -92,9 +106,13 @@ Usage: %s [OPTIONS] [FONTFILE [OUTPUTFILE]]\n\
 Options:\n\
   -a, --pfa                    Output PFA font.\n\
   -b, --pfb                    Output PFB font. This is the default.\n\
+  -j, --jobs=N                 Convert glyphs in N processes at once [1].\n\
   -n, --name=NAME              Select font NAME from CFF.\n\
   -o, --output=FILE            Write output to FILE.\n\
   -q, --quiet                  Do not generate any error messages.\n\
+      --subset=GLYPHS          Output only GLYPHS (comma-separated names).\n\
+      --subset-encoding=FILE   Output only the glyphs in encoding FILE.\n\
+      --subroutinize           Move repeated outline code into subroutines.\n\
   -h, --help                   Print this message and exit.\n\
   -v, --version                Print version number and exit.\n\
 \n\
@@ -102,6 +120,57 @@ Report bugs to <ekohler@gmail.com>.\n", program_name);
 }
 
 
+static void
+add_subset_glyphs(const String &text)
+{
+    const char *s = text.begin(), *end = text.end();
+    while (s != end) {
+        while (s != end && (*s == ',' || isspace((unsigned char) *s)))
+            s++;
+        const char *first = s;
+        while (s != end && *s != ',' && !isspace((unsigned char) *s))
+            s++;
+        if (s != first)
+            subset_glyphs.push_back(text.substring(first, s));
+    }
+    subset = true;
+}
+
+static void
+add_subset_encoding(const char *filename, ErrorHandler *errh)
+{
+    // Collect the glyph names between the brackets of a PostScript
+    // encoding vector, as in a dvips encoding file.
+    String text = read_file(filename, errh);
+    if (errh->nerrors() > 0)
+        return;
+    const char *s = text.begin(), *end = text.end();
+    bool in_vector = false;
+    while (s != end) {
+        if (*s == '%') {
+            while (s != end && *s != '\n' && *s != '\r')
+                s++;
+        } else if (*s == '[' && !in_vector) {
+            in_vector = true;
+            s++;
+        } else if (*s == ']' && in_vector) {
+            subset = true;
+            return;
+        } else if (*s == '/' && in_vector) {
+            const char *first = ++s;
+            while (s != end && !isspace((unsigned char) *s) && *s != '/'
+                   && *s != '[' && *s != ']' && *s != '%' && *s != '('
+                   && *s != '{' && *s != '}')
+                s++;
+            if (s != first)
+                subset_glyphs.push_back(text.substring(first, s));
+        } else
+            s++;
+    }
+    errh->error("%s: parse error, expected %s", filename, in_vector ? "]" : "[");
+}
+
+
 // MAIN
 
 static void
@@ -117,33 +186,23 @@ do_file(const char *infn, const char *outfn, PermString name, ErrorHandler *errh
     } else if (!(f = fopen(infn, "rb")))
         errh->fatal("%s: %s", infn, strerror(errno));
 
-    int c = getc(f);
-    ungetc(c, f);
+    int read_errno;
+    String data = read_file(f, read_errno);
+    if (read_errno)
+        errh->lerror(infn, "%s", strerror(read_errno));
+    if (f != stdin)
+        fclose(f);
 
     Cff::Font *font = 0;
+    int c = (data ? (unsigned char) data[0] : EOF);
 
     if (c == EOF)
         errh->fatal("%s: empty file", infn);
     if (c != 1 && c != 'O')
         errh->fatal("%s: not a CFF or OpenType/CFF font", infn);
 
-    StringAccum sa(150000);
-    int amt;
-    do {
-        if (char *x = sa.reserve(32768)) {
-            amt = fread(x, 1, 32768, f);
-            sa.adjust_length(amt);
-        } else
-            amt = 0;
-    } while (amt != 0);
-    if (!feof(f) || ferror(f))
-        errh->lerror(infn, "%s", strerror(errno));
-    if (f != stdin)
-        fclose(f);
-
     ContextErrorHandler cerrh(errh, "While processing %s:", infn);
     cerrh.set_indent(0);
-    String data = sa.take_string();
     unsigned units_per_em = 0;
     if (c == 'O') {
         Efont::OpenType::Font font(data, &cerrh);
@@ -160,7 +219,11 @@ do_file(const char *infn, const char *outfn, PermString name, ErrorHandler *errh
     if (errh->nerrors() > 0)
         return;
 
-    Type1Font *font1 = create_type1_font(font, &cerrh);
+    Type1Font *font1 = create_type1_font(font, &cerrh, njobs, subset ? &subset_glyphs : 0);
+    if (subroutinize) {
+        Type1Subroutinizer subrizer(font1);
+        subrizer.run();
+    }
 
     if (!outfn || strcmp(outfn, "-") == 0) {
         f = stdout;
@@ -207,6 +270,24 @@ main(int argc, char *argv[])
             binary = true;
             break;
 
+          case JOBS_OPT:
+            if (clp->val.i < 1)
+                usage_error(errh, "%<--jobs%> must be at least 1");
+            njobs = clp->val.i;
+            break;
+
+          case SUBSET_OPT:
+            add_subset_glyphs(clp->vstr);
+            break;
+
+          case SUBSET_ENC_OPT:
+            add_subset_encoding(clp->vstr, errh);
+            break;
+
+          case SUBROUTINIZE_OPT:
+            subroutinize = !clp->negated;
+            break;
+
           case NAME_OPT:
             if (font_name)
                 usage_error(errh, "font name specified twice");
@@ -264,6 +345,8 @@ particular purpose.\n");
     }
 
   done:
+    if (errh->nerrors() > 0)
+        exit(1);
     do_file(input_file, output_file, font_name, errh);
 
     return (errh->nerrors() == 0 ? 0 : 1);
@@ -11,6 +11,7 @@ class Cff { public:
 
     class Dict;
     class IndexIterator;
+    class CharstringCache;
     class Charset;
     class FDSelect;
     class FontParent;
@@ -108,6 +109,34 @@ class Cff { public:
 
     };
 
+    // Charstrings for the entries of an INDEX, created on first use.  Type 2
+    // charstrings are views into the CFF data kept in one array, allocated
+    // when the first is needed and freed in one go, so iterating over a
+    // large font's glyphs doesn't allocate per glyph.
+    class CharstringCache { public:
+
+        CharstringCache()       : _t2(0) { }
+        ~CharstringCache();
+
+        void assign(int n);
+        int size() const        { return _cs.size(); }
+
+        inline Charstring* get(const Cff* cff, const IndexIterator& iiter,
+                               int i, int charstring_type);
+
+      private:
+
+        Vector<Charstring*> _cs;
+        Type2Charstring* _t2;
+
+        void clear();
+        Charstring* create(const Cff*, const IndexIterator&, int, int);
+
+        CharstringCache(const CharstringCache&);
+        CharstringCache& operator=(const CharstringCache&);
+
+    };
+
   private:
 
     String _data_string;
@@ -125,7 +154,7 @@ class Cff { public:
     mutable HashMap<PermString, int> _strings_map;
 
     IndexIterator _gsubrs_index;
-    Vector<Charstring*> _gsubrs_cs;
+    CharstringCache _gsubrs_cs;
     Vector<FontParent*> _fonts;
 
     unsigned _units_per_em;
@@ -242,8 +271,6 @@ class Cff::FontParent : public CharstringProgram { public:
     FontParent(const FontParent&);
     FontParent& operator=(const FontParent&);
 
-    Charstring* charstring(const IndexIterator&, int) const;
-
     friend class Cff;
     friend class Cff::Font;
     friend class Cff::CIDFont;
@@ -283,7 +310,7 @@ class Cff::CIDFont : public Cff::FontParent { public:
     Cff::Charset _charset;
 
     IndexIterator _charstrings_index;
-    mutable Vector<Charstring*> _charstrings_cs;
+    mutable CharstringCache _charstrings_cs;
 
     Vector<ChildFont*> _child_fonts;
     Cff::FDSelect _fdselect;
@@ -326,7 +353,7 @@ class Cff::ChildFont : public Cff::FontParent { public:
     Dict _private_dict;
 
     IndexIterator _subrs_index;
-    mutable Vector<Charstring*> _subrs_cs;
+    mutable CharstringCache _subrs_cs;
 
     double _default_width_x;
     double _nominal_width_x;
@@ -334,8 +361,6 @@ class Cff::ChildFont : public Cff::FontParent { public:
     ChildFont(const ChildFont&); // does not exist
     ChildFont& operator=(const ChildFont&); // does not exist
 
-    Charstring* charstring(const IndexIterator&, int) const;
-
     friend class Cff::Font;
 
 };
@@ -371,7 +396,7 @@ class Cff::Font : public Cff::ChildFont { public:
     Cff::Charset _charset;
 
     IndexIterator _charstrings_index;
-    mutable Vector<Charstring*> _charstrings_cs;
+    mutable CharstringCache _charstrings_cs;
 
     int _encoding_pos;
     int _encoding[256];
@@ -385,6 +410,13 @@ class Cff::Font : public Cff::ChildFont { public:
 };
 
 
+inline Charstring* Cff::CharstringCache::get(const Cff* cff, const IndexIterator& iiter, int i, int charstring_type)
+{
+    if (Charstring* cs = _cs[i])
+        return cs;
+    return create(cff, iiter, i, charstring_type);
+}
+
 inline uint32_t Cff::IndexIterator::offset_at(const uint8_t* x) const
 {
     switch (_offsize) {
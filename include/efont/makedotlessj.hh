@@ -0,0 +1,16 @@
+// -*- related-file-name: "../../libefont/makedotlessj.cc" -*-
+#ifndef EFONT_MAKEDOTLESSJ_HH
+#define EFONT_MAKEDOTLESSJ_HH
+#include <lcdf/permstr.hh>
+namespace Efont {
+class Type1Font;
+
+// also see t1dotlessj/t1dotlessj.cc
+enum { DOTLESSJ_OK = 0, DOTLESSJ_EXISTS = 1, DOTLESSJ_J_NODOT = 2,
+       DOTLESSJ_NO_J = 3 };
+
+Type1Font *create_dotlessj_font(Type1Font *font, PermString font_name,
+                                int *status, PermString *glyph_name = 0);
+
+}
+#endif
@@ -0,0 +1,14 @@
+// -*- related-file-name: "../../libefont/maket1font.cc" -*-
+#ifndef EFONT_MAKET1FONT_HH
+#define EFONT_MAKET1FONT_HH
+#include <efont/cff.hh>
+namespace Efont {
+class Type1Font;
+
+// If glyphs is nonnull, the result contains only those glyphs, .notdef, and
+// any seac components they need.
+Type1Font *create_type1_font(const Cff::Font *, ErrorHandler *, int njobs = 1,
+                             const Vector<PermString> *glyphs = 0);
+
+}
+#endif
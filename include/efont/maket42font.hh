@@ -0,0 +1,13 @@
+// -*- related-file-name: "../../libefont/maket42font.cc" -*-
+#ifndef EFONT_MAKET42FONT_HH
+#define EFONT_MAKET42FONT_HH
+#include <efont/otf.hh>
+#include <stdio.h>
+namespace Efont {
+
+bool check_type42_font(const OpenType::Font &, ErrorHandler *);
+String create_type42_font(const OpenType::Font &, ErrorHandler *);
+bool write_type42_font(const OpenType::Font &, FILE *, ErrorHandler *);
+
+}
+#endif
@@ -46,9 +46,15 @@ inline hashcode_t hashcode(const Tag& t) {
     return t.value();
 }
 
+// A TrueType or OpenType collection ('ttcf') file holds several faces,
+// whose tables can be shared.  A Font is one face: its tables are
+// substrings of the whole file, so faces opened from the same String share
+// its data.  Font(str) opens a collection's first face.
+
 class Font {
   public:
     Font(const String& str, ErrorHandler* errh = 0);
+    Font(const String& str, int face, ErrorHandler* errh);
     // default destructor
 
     bool ok() const                     { return _error >= 0; }
@@ -59,6 +65,9 @@ class Font {
     const uint8_t* data() const         { return _str.udata(); }
     int length() const                  { return _str.length(); }
 
+    int face() const                    { return _face; }
+    int nfaces() const                  { return _nfaces; }
+
     unsigned units_per_em() const       { return _units_per_em; }
 
     int ntables() const;
@@ -77,8 +86,12 @@ class Font {
     String _str;
     int _error;
     unsigned _units_per_em;
+    uint32_t _offset;           // of the face's table directory
+    int _face;                  // -1 unless in a collection
+    int _nfaces;
 
-    int parse_header(ErrorHandler*);
+    int parse_header(int face, ErrorHandler*);
+    const uint8_t* directory() const    { return _str.udata() + _offset; }
 };
 
 class ScriptList {
@@ -157,6 +170,9 @@ class Coverage {
     int coverage_index(Glyph) const noexcept;
     bool covers(Glyph g) const noexcept { return coverage_index(g) >= 0; }
 
+    int accelerate(int max_bytes) noexcept;
+    bool accelerated() const noexcept   { return _map.length() > 0; }
+
     void unparse(StringAccum&) const noexcept;
     String unparse() const noexcept;
 
@@ -201,6 +217,8 @@ class Coverage {
 
   private:
     String _str;
+    String _map;                // native uint16_t coverage index + 1
+    Glyph _map_first;
 
     int check(ErrorHandler*);
 };
@@ -238,6 +256,7 @@ class GlyphSet {
 
 class ClassDef {
   public:
+    ClassDef() noexcept                 : _map_first(0) { }
     ClassDef(const String&, ErrorHandler* = 0) noexcept;
     // default destructor
 
@@ -247,6 +266,9 @@ class ClassDef {
     int lookup(Glyph) const noexcept;
     int operator[](Glyph g) const noexcept { return lookup(g); }
 
+    int accelerate(int max_bytes) noexcept;
+    bool accelerated() const noexcept   { return _map.length() > 0; }
+
     void unparse(StringAccum&) const noexcept;
     String unparse() const noexcept;
 
@@ -295,6 +317,8 @@ class ClassDef {
 
   private:
     String _str;
+    String _map;                // native uint16_t classes
+    Glyph _map_first;
 
     int check(ErrorHandler*);
 };
@@ -16,6 +16,7 @@ class Cmap { public:
 
     inline Glyph map_uni(uint32_t c) const;
     int map_uni(const Vector<uint32_t> &in, Vector<Glyph> &out) const;
+    inline uint32_t unmap(Glyph g) const;
     inline void unmap_all(Vector<std::pair<uint32_t, Glyph> > &ugp) const;
 
   private:
@@ -26,8 +27,16 @@ class Cmap { public:
     mutable int _best_unicode_table;
     mutable Vector<int> _table_error;
 
+    // Built from the best Unicode table on first use. _bmp_pages[c >> 8]
+    // is the offset of c's 256-glyph page in _page_glyphs, whose first page
+    // is empty; _unicodes[g] is the lowest code point mapped to glyph g.
+    mutable Vector<int> _bmp_pages;
+    mutable Vector<Glyph> _page_glyphs;
+    mutable Vector<std::pair<uint32_t, Glyph> > _supplementary;
+    mutable Vector<uint32_t> _unicodes;
+
     enum { HEADER_SIZE = 4, ENCODING_SIZE = 8,
-           HIBYTE_SUBHEADERS = 524 };
+           HIBYTE_SUBHEADERS = 518 };
     enum Format { F_BYTE = 0, F_HIBYTE = 2, F_SEGMENTED = 4, F_TRIMMED = 6,
                   F_HIBYTE32 = 8, F_TRIMMED32 = 10, F_SEGMENTED32 = 12,
                   F_MANYTOONE = 13 };
@@ -40,12 +49,25 @@ class Cmap { public:
     Glyph map_table(int t, uint32_t, ErrorHandler * = 0) const;
     void dump_table(int t, Vector<std::pair<uint32_t, Glyph> > &ugp, ErrorHandler * = 0) const;
     inline const uint8_t* table_data(int t) const;
+    void accelerate() const;
+    Glyph map_supplementary(uint32_t) const;
 
 };
 
 
 inline Glyph Cmap::map_uni(uint32_t c) const {
-    return map_table(USE_BEST_UNICODE_TABLE, c, ErrorHandler::default_handler());
+    if (!_bmp_pages.size())
+        accelerate();
+    if (c < 65536)
+        return _page_glyphs[_bmp_pages[c >> 8] + (c & 255)];
+    else
+        return map_supplementary(c);
+}
+
+inline uint32_t Cmap::unmap(Glyph g) const {
+    if (!_bmp_pages.size())
+        accelerate();
+    return (g > 0 && g < _unicodes.size() ? _unicodes[g] : 0);
 }
 
 inline void Cmap::unmap_all(Vector<std::pair<uint32_t, Glyph> > &ugp) const {
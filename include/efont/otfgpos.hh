@@ -32,7 +32,10 @@ class GposLookup { public:
     GposLookup(const Data&);
     int type() const                    { return _type; }
     uint16_t flags() const              { return _d.u16(2); }
-    bool unparse_automatics(Vector<Positioning>&, ErrorHandler* = 0) const;
+    int nsubtables() const              { return _d.u16(4); }
+    uint16_t mark_filtering_set() const { return _d.u16(HEADERSIZE + nsubtables() * RECSIZE); }
+    Data subtable(int i) const;
+    bool unparse_automatics(Vector<Positioning>&, const Coverage& limit, ErrorHandler* = 0) const;
     enum {
         HEADERSIZE = 6, RECSIZE = 2,
         L_SINGLE = 1, L_PAIR = 2, L_CURSIVE = 3, L_MARKTOBASE = 4,
@@ -42,7 +45,6 @@ class GposLookup { public:
   private:
     Data _d;
     int _type;
-    Data subtable(int i) const;
 };
 
 class GposValue { public:
@@ -69,7 +71,7 @@ class GposSingle { public:
     GposSingle(const Data&);
     // default destructor
     Coverage coverage() const noexcept;
-    void unparse(Vector<Positioning>&) const;
+    void unparse(Vector<Positioning>&, const Coverage& limit) const;
     enum { F2_HEADERSIZE = 8 };
   private:
     Data _d;
@@ -79,7 +81,7 @@ class GposPair { public:
     GposPair(const Data&);
     // default destructor
     Coverage coverage() const noexcept;
-    void unparse(Vector<Positioning>&) const;
+    void unparse(Vector<Positioning>&, const Coverage& limit) const;
     enum { F1_HEADERSIZE = 10, F1_RECSIZE = 2,
            PAIRSET_HEADERSIZE = 2, PAIRVALUE_HEADERSIZE = 2,
            F2_HEADERSIZE = 16 };
@@ -34,6 +34,9 @@ class GsubLookup { public:
     GsubLookup(const Data &);
     int type() const                    { return _type; }
     uint16_t flags() const              { return _d.u16(2); }
+    int nsubtables() const              { return _d.u16(4); }
+    uint16_t mark_filtering_set() const { return _d.u16(HEADERSIZE + nsubtables() * RECSIZE); }
+    Data subtable(int i) const;
     void mark_out_glyphs(const Gsub &gsub, Vector<bool> &gmap) const;
     bool unparse_automatics(const Gsub &gsub, Vector<Substitution> &subs, const Coverage &limit) const;
     bool apply(const Glyph *, int pos, int n, Substitution &) const;
@@ -45,7 +48,6 @@ class GsubLookup { public:
   private:
     Data _d;
     int _type;
-    Data subtable(int i) const;
 };
 
 class GsubSingle { public:
@@ -208,50 +210,37 @@ class Substitution { public:
 
   private:
 
-    enum { T_NONE = 0, T_GLYPH, T_GLYPHS, T_COVERAGE };
-    typedef union {
-        Glyph gid;
-        Glyph *gids;    // first entry is a count
-        Coverage *coverage;
-    } Substitute;
-
-    Substitute _left;
-    Substitute _in;
-    Substitute _out;
-    Substitute _right;
-
-    uint8_t _left_is;
-    uint8_t _in_is;
-    uint8_t _out_is;
-    uint8_t _right_is;
-
-    bool _alternate : 1;
-
-    static void clear(Substitute &, uint8_t &);
-    static void assign_space(Substitute &, uint8_t &, int);
-    static void assign(Substitute &, uint8_t &, Glyph);
-    static void assign(Substitute &, uint8_t &, int, const Glyph *);
-    static void assign(Substitute &, uint8_t &, const Coverage &);
-    static void assign(Substitute &, uint8_t &, const Substitute &, uint8_t);
-    static void assign_append(Substitute &, uint8_t &, const Substitute &, uint8_t, const Substitute &, uint8_t);
-    static void assign_append(Substitute &, uint8_t &, const Substitute &, uint8_t, Glyph);
-    static bool substitute_in(const Substitute &, uint8_t, const Coverage &);
-    static bool substitute_in(const Substitute &, uint8_t, const GlyphSet &);
-
-    static Glyph extract_glyph(const Substitute &, uint8_t) noexcept;
-    static Glyph extract_glyph(const Substitute &, int which, uint8_t) noexcept;
-    static bool extract_glyphs(const Substitute &, uint8_t, Vector<Glyph> &, bool coverage_ok) noexcept;
-    static Glyph *extract_glyphptr(const Substitute &, uint8_t) noexcept;
-    static int extract_nglyphs(const Substitute &, uint8_t, bool coverage_ok) noexcept;
-    static bool matches(const Substitute &, uint8_t, int pos, Glyph) noexcept;
-
-    static void unparse_glyphids(StringAccum &, const Substitute &, uint8_t, const Vector<PermString> *) noexcept;
+    // Glyphs are stored in one run, left context first, then input,
+    // output, and right context. Short runs, which are most of them, live
+    // in _inline, so constructing or copying a Substitution rarely
+    // allocates.
+    enum { INLINE_CAPACITY = 7 };
+
+    Glyph *_g;
+    uint16_t _nleft;
+    uint16_t _nin;
+    uint16_t _nout;
+    uint16_t _nright;
+    bool _alternate;
+    Glyph _inline[INLINE_CAPACITY];
+
+    int nglyphs() const                 { return _nleft + _nin + _nout + _nright; }
+    void assign_space(int nleft, int nin, int nout, int nright);
+    Glyph *splice(int pos, int nremove, int ninsert);
+
+    static void unparse_glyphids(StringAccum &, const Glyph *, int, const Vector<PermString> *) noexcept;
 
 };
 
 inline Substitution::Substitution()
-    : _left_is(T_NONE), _in_is(T_NONE), _out_is(T_NONE), _right_is(T_NONE)
+    : _g(_inline), _nleft(0), _nin(0), _nout(0), _nright(0), _alternate(false)
+{
+}
+
+inline Substitution::~Substitution()
 {
+    if (_g != _inline)
+        delete[] _g;
 }
 
 /* Single 1: u16 format, offset coverage, u16 glyphdelta
@@ -267,142 +256,146 @@ inline Substitution::Substitution()
 
 inline Substitution::operator bool() const
 {
-    return !(_left_is == T_NONE && _in_is == T_NONE && _out_is == T_NONE && _right_is == T_NONE);
+    return _nleft || _nin || _nout || _nright;
 }
 
 inline bool Substitution::is_single() const
 {
-    return _left_is == T_NONE && _in_is == T_GLYPH && _out_is == T_GLYPH && _right_is == T_NONE;
+    return _nleft == 0 && _nin == 1 && _nout == 1 && _nright == 0;
 }
 
 inline bool Substitution::is_multiple() const
 {
-    return _left_is == T_NONE && _in_is == T_GLYPH && _out_is == T_GLYPHS && _right_is == T_NONE && !_alternate;
+    return _nleft == 0 && _nin == 1 && _nout > 1 && _nright == 0 && !_alternate;
 }
 
 inline bool Substitution::is_alternate() const
 {
-    return _left_is == T_NONE && _in_is == T_GLYPH && _out_is == T_GLYPHS && _right_is == T_NONE && _alternate;
+    return _nleft == 0 && _nin == 1 && _nout > 1 && _nright == 0 && _alternate;
 }
 
 inline bool Substitution::is_ligature() const
 {
-    return _left_is == T_NONE && _in_is == T_GLYPHS && _out_is == T_GLYPH && _right_is == T_NONE;
+    return _nleft == 0 && _nin > 1 && _nout == 1 && _nright == 0;
 }
 
 inline bool Substitution::is_simple_context() const
 {
-    return _left_is != T_COVERAGE && (_in_is == T_GLYPH || _in_is == T_GLYPHS) && (_out_is == T_GLYPH || _out_is == T_GLYPHS) && _right_is != T_COVERAGE;
+    return _nin > 0 && _nout > 0;
 }
 
 inline bool Substitution::is_single_lcontext() const
 {
-    return _left_is == T_GLYPH && _in_is == T_GLYPH && _out_is == T_GLYPH && _right_is == T_NONE;
+    return _nleft == 1 && _nin == 1 && _nout == 1 && _nright == 0;
 }
 
 inline bool Substitution::is_single_rcontext() const
 {
-    return _left_is == T_NONE && _in_is == T_GLYPH && _out_is == T_GLYPH && _right_is == T_GLYPH;
+    return _nleft == 0 && _nin == 1 && _nout == 1 && _nright == 1;
 }
 
 inline Glyph Substitution::left_glyph() const
 {
-    return extract_glyph(_left, _left_is);
+    return (_nleft == 1 ? _g[0] : 0);
 }
 
 inline int Substitution::left_nglyphs() const
 {
-    return extract_nglyphs(_left, _left_is, false);
+    return _nleft;
 }
 
 inline Glyph Substitution::in_glyph() const
 {
-    return extract_glyph(_in, _in_is);
+    return (_nin == 1 ? _g[_nleft] : 0);
 }
 
 inline Glyph Substitution::in_glyph(int which) const
 {
-    return extract_glyph(_in, which, _in_is);
+    return (which >= 0 && which < _nin ? _g[_nleft + which] : 0);
 }
 
 inline bool Substitution::in_glyphs(Vector<Glyph> &v) const
 {
-    return extract_glyphs(_in, _in_is, v, true);
+    for (int i = 0; i < _nin; i++)
+        v.push_back(_g[_nleft + i]);
+    return _nin > 0;
 }
 
 inline int Substitution::in_nglyphs() const
 {
-    return extract_nglyphs(_in, _in_is, true);
+    return _nin;
 }
 
 inline bool Substitution::in_matches(int pos, Glyph g) const
 {
-    return matches(_in, _in_is, pos, g);
+    return pos >= 0 && pos < _nin && _g[_nleft + pos] == g;
 }
 
 inline Glyph Substitution::out_glyph() const
 {
-    return extract_glyph(_out, _out_is);
+    return (_nout == 1 ? _g[_nleft + _nin] : 0);
 }
 
 inline Glyph Substitution::out_glyph(int which) const
 {
-    return extract_glyph(_out, which, _out_is);
+    return (which >= 0 && which < _nout ? _g[_nleft + _nin + which] : 0);
 }
 
 inline bool Substitution::out_glyphs(Vector<Glyph> &v) const
 {
-    return extract_glyphs(_out, _out_is, v, false);
+    for (int i = 0; i < _nout; i++)
+        v.push_back(_g[_nleft + _nin + i]);
+    return _nout > 0;
 }
 
 inline int Substitution::out_nglyphs() const
 {
-    return extract_nglyphs(_out, _out_is, false);
+    return _nout;
 }
 
 inline Glyph Substitution::right_glyph() const
 {
-    return extract_glyph(_right, _right_is);
+    return (_nright == 1 ? _g[_nleft + _nin + _nout] : 0);
 }
 
 inline const Glyph *Substitution::left_glyphptr() const
 {
-    return extract_glyphptr(_left, _left_is);
+    return (_nleft ? _g : 0);
 }
 
 inline Glyph *Substitution::left_glyphptr()
 {
-    return extract_glyphptr(_left, _left_is);
+    return (_nleft ? _g : 0);
 }
 
 inline const Glyph *Substitution::in_glyphptr() const
 {
-    return extract_glyphptr(_in, _in_is);
+    return (_nin ? _g + _nleft : 0);
 }
 
 inline Glyph *Substitution::in_glyphptr()
 {
-    return extract_glyphptr(_in, _in_is);
+    return (_nin ? _g + _nleft : 0);
 }
 
 inline const Glyph *Substitution::out_glyphptr() const
 {
-    return extract_glyphptr(_out, _out_is);
+    return (_nout ? _g + _nleft + _nin : 0);
 }
 
 inline Glyph *Substitution::out_glyphptr()
 {
-    return extract_glyphptr(_out, _out_is);
+    return (_nout ? _g + _nleft + _nin : 0);
 }
 
 inline const Glyph *Substitution::right_glyphptr() const
 {
-    return extract_glyphptr(_right, _right_is);
+    return (_nright ? _g + _nleft + _nin + _nout : 0);
 }
 
 inline Glyph *Substitution::right_glyphptr()
 {
-    return extract_glyphptr(_right, _right_is);
+    return (_nright ? _g + _nleft + _nin + _nout : 0);
 }
 
 inline StringAccum &operator<<(StringAccum &sa, const Substitution &sub)
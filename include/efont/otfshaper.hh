@@ -0,0 +1,100 @@
+// -*- related-file-name: "../../libefont/otfshaper.cc" -*-
+#ifndef EFONT_OTFSHAPER_HH
+#define EFONT_OTFSHAPER_HH
+#include <efont/otfgsub.hh>
+#include <efont/otfgpos.hh>
+namespace Efont { namespace OpenType {
+
+// Runs a string of glyphs, already mapped through the cmap, through a
+// font's GSUB and GPOS lookups for a set of features.  GSUB lookups apply
+// in lookup list order, including context, chaining context, and reverse
+// chaining lookups; GPOS single, pair, and context adjustments accumulate
+// into one Position per output glyph.  Glyphs a lookup's flags ignore, by
+// GDEF glyph class, mark attachment class, or mark glyph set, are skipped
+// while matching; cursive and mark attachment lookups are ignored.
+// Buffers are kept between calls, so shape text a line or a word at a
+// time.  The coverage and class tables of lookups in use become dense
+// arrays, up to ACCELERATE_BUDGET bytes per Shaper, so matching a glyph
+// does not search.
+
+class Shaper { public:
+
+    Shaper(const Font &, ErrorHandler * = 0);
+    ~Shaper();
+
+    int set_features(Tag script, Tag langsys, const Vector<Tag> &features, ErrorHandler * = 0);
+    int ngsub_lookups() const           { return _gsub_plan.size(); }
+    int ngpos_lookups() const           { return _gpos_plan.size(); }
+
+    void shape(const Glyph *glyphs, int nglyphs);
+    inline void shape(const Vector<Glyph> &glyphs);
+
+    int nglyphs() const                 { return _glyphs.size(); }
+    const Glyph *glyphs() const         { return _glyphs.begin(); }
+    const Position *positions() const   { return _positions.begin(); }
+
+    enum { MAX_NESTING = 16 };
+    enum { MAX_NESTED_OPS = 256 };      // per glyph, so that lookups that
+                                        // call themselves stay linear
+    enum { ACCELERATE_BUDGET = 1 << 20 };  // bytes of dense lookup arrays
+
+  private:
+
+    struct Subtable {
+        Data d;
+        Coverage coverage;
+        ClassDef classdefs[3];  // format 2 pair and context subtables
+    };
+
+    struct Lookup {
+        int type;               // 0: not yet loaded, -1: unusable
+        int first_subtable;
+        int last_subtable;
+        uint16_t flags;
+        Coverage mark_set;      // if flags use a mark filtering set
+        Lookup()                : type(0), first_subtable(0), last_subtable(0), flags(0) { }
+    };
+
+    Gsub *_gsub;
+    Gpos *_gpos;
+    bool _reverse_backtrack;
+    int _nested_ops;
+    int _accelerate_budget;
+
+    ClassDef _glyph_classes;    // from GDEF
+    ClassDef _mark_classes;
+    Vector<Coverage> _mark_sets;
+
+    Vector<Lookup> _gsub_lookups;
+    Vector<Lookup> _gpos_lookups;
+    Vector<Subtable> _subtables;
+    Vector<int> _gsub_plan;
+    Vector<int> _gpos_plan;
+
+    Vector<Glyph> _glyphs;
+    Vector<Position> _positions;
+    Vector<Glyph> _scratch;
+
+    Shaper(const Shaper &);
+    Shaper &operator=(const Shaper &);
+
+    const Lookup &gsub_lookup(int lookup_index);
+    const Lookup &gpos_lookup(int lookup_index);
+    void add_subtable(const Data &, int type, int context_type, int chain_type, int pair_type);
+    template <typename T> void accelerate(T &table);
+    int apply_gsub(int lookup_index, int pos, int depth);
+    int apply_gsub_subtable(const Lookup &lookup, int subtable, int ci, int pos, int depth);
+    int apply_gpos(int lookup_index, int pos, int depth);
+    int apply_gpos_subtable(const Lookup &lookup, int subtable, int ci, int pos, int depth);
+    void replace(int pos, int nin, const Glyph *out, int nout);
+    void adjust(int pos, uint16_t format, const Data &value);
+
+};
+
+inline void Shaper::shape(const Vector<Glyph> &glyphs)
+{
+    shape(glyphs.begin(), glyphs.size());
+}
+
+}}
+#endif
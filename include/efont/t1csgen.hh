@@ -80,6 +80,10 @@ class Type1CharstringGenInterp : public CharstringInterp { public:
     void intermediate_output(Type1Charstring &out);
     void run(const CharstringContext &g, Type1Charstring &out);
 
+  protected:
+
+    virtual bool gen_hint_replacement(const String &hints);
+
   private:
 
     // output
@@ -25,12 +25,21 @@ class Type1Reader { public:
 
   private:
 
-    enum { DATA_SIZE = 1024 };
+    enum { DATA_SIZE = 8192 };
 
     unsigned char *_data;
     int _len;
     int _pos;
 
+    // decrypted eexec data: for binary eexec, _plain[i] came from
+    // _data[_plain_start + i]; for ASCII, from just before _plain_end[i]
+    unsigned char *_plain;
+    int *_plain_end;
+    int _plain_len;
+    int _plain_pos;
+    int _plain_cap;
+    int _plain_start;
+
     PermString _charstring_definer;
     int _charstring_start;
     int _charstring_len;
@@ -46,9 +55,13 @@ class Type1Reader { public:
     Type1Reader &operator=(const Type1Reader &);
 
     int more_data();
+    bool fill_data(int keep);
 
     inline int eexec(int);
     int ascii_eexec_get();
+    void reserve_plain(int);
+    int more_plain();
+    inline void append_line(StringAccum &);
     inline int get_base();
     inline int get();
 
@@ -135,7 +148,7 @@ class Type1Writer { public:
 
   private:
 
-    enum { BufSize = 1024 };
+    enum { BufSize = 8192 };
 
     unsigned char *_buf;
     int _pos;
@@ -149,7 +162,6 @@ class Type1Writer { public:
     int _lenIV;
 
     void local_flush();
-    inline unsigned char eexec(int);
 
     Type1Writer(const Type1Writer &);
     Type1Writer &operator=(const Type1Writer &);
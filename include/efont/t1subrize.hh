@@ -0,0 +1,42 @@
+// -*- related-file-name: "../../libefont/t1subrize.cc" -*-
+#ifndef EFONT_T1SUBRIZE_HH
+#define EFONT_T1SUBRIZE_HH
+#include <efont/t1font.hh>
+namespace Efont {
+
+// Moves charstring code that repeats across a Type 1 font's glyphs into new
+// subroutines.  Code moves in whole commands, operands included; hsbw,
+// sbw, seac, endchar, flex, hint replacement, and calls to the font's
+// existing subroutines stay put.  Each pass may call the subroutines added
+// by earlier passes, so the new subroutines nest at most max_depth deep.
+
+class Type1Subroutinizer { public:
+
+    Type1Subroutinizer(Type1Font *, int max_depth = DEFAULT_MAX_DEPTH);
+
+    void set_max_subrs(int n)           { _max_subrs = (n < MAX_SUBRS ? n : MAX_SUBRS); }
+
+    int run();
+
+    int nsubrs_added() const            { return _nsubrs_added; }
+    int bytes_saved() const             { return _bytes_saved; }
+
+    enum { DEFAULT_MAX_DEPTH = 4, MAX_DEPTH = 8 };
+    enum { MAX_SUBRS = 32767 };
+    enum { SUBR_OVERHEAD = 20 };        // "dup N LEN RD ", lenIV, " NP"
+
+  private:
+
+    Type1Font *_font;
+    int _max_depth;
+    int _max_subrs;
+    int _first_subr;
+    int _nsubrs_added;
+    int _bytes_saved;
+
+    int run_pass();
+
+};
+
+}
+#endif
@@ -0,0 +1,11 @@
+// -*- related-file-name: "../../liblcdf/readfile.cc" -*-
+#ifndef LCDF_READFILE_HH
+#define LCDF_READFILE_HH
+#include <lcdf/string.hh>
+#include <stdio.h>
+class ErrorHandler;
+
+String read_file(FILE *f, int &error);
+String read_file(String filename, ErrorHandler *errh, bool warning = false);
+
+#endif
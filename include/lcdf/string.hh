@@ -148,6 +148,17 @@ class String { public:
     }
     static String make_fill(int c, int n); // n copies of c
 
+    /** @brief Return a String containing the first @a len bytes of the file
+     * open on @a fd.
+     *
+     * The String's data is a private memory mapping of the file, released
+     * when the last String sharing it goes away, so no bytes are copied.
+     * Returns a null String if the file can't be mapped (for instance, if
+     * @a fd refers to a pipe or mmap() is not available); the caller should
+     * then read the file normally.
+     *
+     * @warning The file should not shrink while the String is live. */
+    static String make_mapped(int fd, int len);
 
     /** @brief Return the string's length. */
     inline int length() const {
@@ -619,6 +630,7 @@ class String { public:
 	volatile uint32_t refcount;
 	uint32_t capacity;
 	volatile uint32_t dirty;
+	uint32_t mapped;	// nonzero: size of enclosing mmap() region
 #if HAVE_STRING_PROFILING > 1
 	memo_t **pprev;
 	memo_t *next;
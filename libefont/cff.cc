@@ -352,8 +352,6 @@ Cff::Cff(const String& s, unsigned units_per_em, ErrorHandler* errh)
 
 Cff::~Cff()
 {
-    for (int i = 0; i < _gsubrs_cs.size(); i++)
-        delete _gsubrs_cs[i];
     for (int i = 0; i < _fonts.size(); ++i)
         delete _fonts[i];
 }
@@ -416,7 +414,7 @@ Cff::parse_header(ErrorHandler *errh)
     _gsubrs_index = IndexIterator(_data, global_subr_index_pos, _len, errh, "Gsubrs INDEX");
     if (_gsubrs_index.error() < 0)
         return _gsubrs_index.error();
-    _gsubrs_cs.assign(ngsubrs(), 0);
+    _gsubrs_cs.assign(ngsubrs());
 
     return 0;
 }
@@ -560,16 +558,7 @@ Cff::gsubr(int i)
     i += subr_bias(2, ngsubrs());
     if (i < 0 || i >= ngsubrs())
         return 0;
-    if (!_gsubrs_cs[i]) {
-        const uint8_t *s1 = _gsubrs_index[i];
-        int slen = _gsubrs_index[i + 1] - s1;
-        String cs = data_string().substring(s1 - data(), slen);
-        if (slen == 0)
-            return 0;
-        else
-            _gsubrs_cs[i] = new Type2Charstring(cs);
-    }
-    return _gsubrs_cs[i];
+    return _gsubrs_cs.get(this, _gsubrs_index, i, 2);
 }
 
 
@@ -820,6 +809,55 @@ Cff::IndexIterator::nitems() const
 
 
 
+/*****
+ * Cff::CharstringCache
+ **/
+
+Cff::CharstringCache::~CharstringCache()
+{
+    clear();
+}
+
+void
+Cff::CharstringCache::clear()
+{
+    // Type 2 charstrings live in _t2; others were allocated one by one
+    for (int i = 0; i < _cs.size(); i++)
+        if (_cs[i] && !(_t2 && _cs[i] == &_t2[i]))
+            delete _cs[i];
+    delete[] _t2;
+    _t2 = 0;
+}
+
+void
+Cff::CharstringCache::assign(int n)
+{
+    clear();
+    _cs.assign(n, 0);
+}
+
+Charstring *
+Cff::CharstringCache::create(const Cff *cff, const IndexIterator &iiter,
+                             int i, int charstring_type)
+{
+    const uint8_t *s1 = iiter[i];
+    int slen = iiter[i + 1] - s1;
+    if (slen == 0)
+        return 0;
+    String cs = cff->data_string().substring(s1 - cff->data(), slen);
+    if (charstring_type == 1)
+        _cs[i] = new Type1Charstring(cs);
+    else {
+        if (!_t2)
+            _t2 = new Type2Charstring[_cs.size()];
+        _t2[i] = Type2Charstring(cs);
+        _cs[i] = &_t2[i];
+    }
+    return _cs[i];
+}
+
+
+
 /*****
  * Cff::Dict
  **/
@@ -1169,7 +1207,7 @@ Cff::Dict::unparse(ErrorHandler *errh, const char *dict_name) const
 static int
 handle_private(Cff *cff, const Cff::Dict &top_dict, Cff::Dict &private_dict,
                double &default_width_x, double &nominal_width_x,
-               Cff::IndexIterator &subrs_index, Vector<Charstring *> &subrs_cs,
+               Cff::IndexIterator &subrs_index, Cff::CharstringCache &subrs_cs,
                ErrorHandler *errh)
 {
     Vector<double> private_info;
@@ -1191,7 +1229,7 @@ handle_private(Cff *cff, const Cff::Dict &top_dict, Cff::Dict &private_dict,
         if (subrs_index.error() < 0)
             return subrs_index.error();
     }
-    subrs_cs.assign(subrs_index.nitems(), 0);
+    subrs_cs.assign(subrs_index.nitems());
     return 0;
 }
 
@@ -1201,20 +1239,6 @@ Cff::FontParent::FontParent(Cff* cff)
 {
 }
 
-Charstring *
-Cff::FontParent::charstring(const IndexIterator &iiter, int which) const
-{
-    const uint8_t *s1 = iiter[which];
-    int slen = iiter[which + 1] - s1;
-    String cs = _cff->data_string().substring(s1 - _cff->data(), slen);
-    if (slen == 0)
-        return 0;
-    else if (_charstring_type == 1)
-        return new Type1Charstring(cs);
-    else
-        return new Type2Charstring(cs);
-}
-
 Charstring *
 Cff::FontParent::gsubr(int i) const
 {
@@ -1249,7 +1273,7 @@ Cff::Font::Font(Cff *cff, PermString font_name, const Dict &top_dict, ErrorHandl
         _error = _charstrings_index.error();
         return;
     }
-    _charstrings_cs.assign(_charstrings_index.nitems(), 0);
+    _charstrings_cs.assign(_charstrings_index.nitems());
 
     int charset = 0;
     _top_dict.xvalue(oCharset, &charset);
@@ -1270,8 +1294,6 @@ Cff::Font::Font(Cff *cff, PermString font_name, const Dict &top_dict, ErrorHandl
 
 Cff::Font::~Font()
 {
-    for (int i = 0; i < _charstrings_cs.size(); i++)
-        delete _charstrings_cs[i];
     delete _t1encoding;
 }
 
@@ -1401,9 +1423,7 @@ Cff::Font::glyph(int gid) const
 {
     if (gid < 0 || gid >= nglyphs())
         return 0;
-    if (!_charstrings_cs[gid])
-        _charstrings_cs[gid] = charstring(_charstrings_index, gid);
-    return _charstrings_cs[gid];
+    return _charstrings_cs.get(_cff, _charstrings_index, gid, _charstring_type);
 }
 
 Charstring *
@@ -1412,9 +1432,7 @@ Cff::Font::glyph(PermString name) const
     int gid = _charset.sid_to_gid(_cff->sid(name));
     if (gid < 0)
         return 0;
-    if (!_charstrings_cs[gid])
-        _charstrings_cs[gid] = charstring(_charstrings_index, gid);
-    return _charstrings_cs[gid];
+    return _charstrings_cs.get(_cff, _charstrings_index, gid, _charstring_type);
 }
 
 int
@@ -1496,7 +1514,7 @@ Cff::CIDFont::CIDFont(Cff *cff, PermString font_name, const Dict &top_dict, Erro
         _error = _charstrings_index.error();
         return;
     }
-    _charstrings_cs.assign(_charstrings_index.nitems(), 0);
+    _charstrings_cs.assign(_charstrings_index.nitems());
 
     int charset = 0;
     _top_dict.value(oCharset, &charset);
@@ -1540,8 +1558,6 @@ Cff::CIDFont::CIDFont(Cff *cff, PermString font_name, const Dict &top_dict, Erro
 
 Cff::CIDFont::~CIDFont()
 {
-    for (int i = 0; i < _charstrings_cs.size(); i++)
-        delete _charstrings_cs[i];
     for (int i = 0; i < _child_fonts.size(); i++)
         delete _child_fonts[i];
 }
@@ -1586,9 +1602,7 @@ Cff::CIDFont::glyph(int gid) const
 {
     if (gid < 0 || gid >= nglyphs())
         return 0;
-    if (!_charstrings_cs[gid])
-        _charstrings_cs[gid] = charstring(_charstrings_index, gid);
-    return _charstrings_cs[gid];
+    return _charstrings_cs.get(_cff, _charstrings_index, gid, _charstring_type);
 }
 
 int
@@ -1645,22 +1659,6 @@ Cff::ChildFont::ChildFont(Cff *cff, Cff::CIDFont *parent, int charstring_type, c
 
 Cff::ChildFont::~ChildFont()
 {
-    for (int i = 0; i < _subrs_cs.size(); i++)
-        delete _subrs_cs[i];
-}
-
-Charstring *
-Cff::ChildFont::charstring(const IndexIterator &iiter, int which) const
-{
-    const uint8_t *s1 = iiter[which];
-    int slen = iiter[which + 1] - s1;
-    String cs = _cff->data_string().substring(s1 - _cff->data(), slen);
-    if (slen == 0)
-        return 0;
-    else if (_charstring_type == 1)
-        return new Type1Charstring(cs);
-    else
-        return new Type2Charstring(cs);
 }
 
 Charstring *
@@ -1669,9 +1667,7 @@ Cff::ChildFont::subr(int i) const
     i += Efont::subr_bias(_charstring_type, nsubrs_x());
     if (i < 0 || i >= nsubrs_x())
         return 0;
-    if (!_subrs_cs[i])
-        _subrs_cs[i] = charstring(_subrs_index, i);
-    return _subrs_cs[i];
+    return _subrs_cs.get(_cff, _subrs_index, i, _charstring_type);
 }
 
 int
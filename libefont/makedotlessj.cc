@@ -0,0 +1,210 @@
+// -*- related-file-name: "../include/efont/makedotlessj.hh" -*-
+
+/* makedotlessj.{cc,hh} -- derive a dotlessj font from a Type 1 font
+ *
+ * Copyright (c) 2003-2023 Eddie Kohler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <efont/makedotlessj.hh>
+#include <efont/t1font.hh>
+#include <efont/t1item.hh>
+#include <efont/t1csgen.hh>
+#include <efont/t1bounds.hh>
+#include <lcdf/straccum.hh>
+#include <math.h>
+
+namespace Efont {
+
+static const char * const private_use_dotlessj = "uniF6BE";
+
+namespace {
+
+class Sectioner : public Type1CharstringGenInterp { public:
+
+    Sectioner(int precision);
+
+    void act_line(int, const Point &, const Point &);
+    void act_curve(int, const Point &, const Point &, const Point &, const Point &);
+    void act_closepath(int);
+    void act_flex(int, const Point &, const Point &, const Point &, const Point &, const Point &, const Point &, const Point &, double);
+
+    void run(const CharstringContext &g);
+    bool undot();
+    Type1Charstring gen(Type1Font *);
+
+  private:
+
+    CharstringBounds _boundser;
+
+    Vector<String> _sections;
+    Vector<int> _bounds;
+
+    void append_bounds();
+
+};
+
+Sectioner::Sectioner(int precision)
+    : Type1CharstringGenInterp(precision)
+{
+    set_direct_hint_replacement(true);
+}
+
+void
+Sectioner::act_line(int cmd, const Point &p0, const Point &p1)
+{
+    Type1CharstringGenInterp::act_line(cmd, p0, p1);
+    _boundser.act_line(cmd, p0, p1);
+}
+
+void
+Sectioner::act_curve(int cmd, const Point &p0, const Point &p1, const Point &p2, const Point &p3)
+{
+    Type1CharstringGenInterp::act_curve(cmd, p0, p1, p2, p3);
+    _boundser.act_curve(cmd, p0, p1, p2, p3);
+}
+
+void
+Sectioner::act_flex(int cmd, const Point &p0, const Point &p1, const Point &p2, const Point &p3_4, const Point &p5, const Point &p6, const Point &p7, double flex_depth)
+{
+    Type1CharstringGenInterp::act_flex(cmd, p0, p1, p2, p3_4, p5, p6, p7, flex_depth);
+    _boundser.act_flex(cmd, p0, p1, p2, p3_4, p5, p6, p7, flex_depth);
+}
+
+void Sectioner::append_bounds() {
+    double bb[5];
+    _boundser.output(bb, bb[4]);
+    _bounds.push_back((int) floor(bb[0]));
+    _bounds.push_back((int) floor(bb[1]));
+    _bounds.push_back((int) ceil(bb[2]));
+    _bounds.push_back((int) ceil(bb[3]));
+}
+
+void
+Sectioner::act_closepath(int cmd)
+{
+    Type1CharstringGenInterp::act_closepath(cmd);
+    Type1Charstring result;
+    Type1CharstringGenInterp::intermediate_output(result);
+    _sections.push_back(result.data_string());
+    append_bounds();
+    _boundser.clear();
+}
+
+void
+Sectioner::run(const CharstringContext &g)
+{
+    _boundser.clear();
+    Type1Charstring last_section;
+    Type1CharstringGenInterp::run(g, last_section);
+    _sections.push_back(last_section.data_string());
+    append_bounds();
+}
+
+bool
+Sectioner::undot()
+{
+    if (_sections.size() < 3)
+        return false;
+
+    int topmost = -1;
+    for (int i = 0; i < _sections.size() - 1; i++)
+        if (topmost < 0 || _bounds[i*4 + 1] > _bounds[topmost*4 + 1])
+            topmost = i;
+
+    // check if any sections are below this
+    for (int i = 0; i < _sections.size() - 1; i++)
+        if (_bounds[i*4 + 1] < _bounds[topmost*4 + 1]) {
+            _sections[topmost] = String();
+            return true;
+        }
+    return false;
+}
+
+Type1Charstring
+Sectioner::gen(Type1Font *font)
+{
+    StringAccum sa;
+    for (String *s = _sections.begin(); s < _sections.end(); s++)
+        sa << *s;
+    Type1Charstring in(sa.take_string()), out;
+    Type1CharstringGenInterp gen(precision());
+    gen.set_hint_replacement_storage(font);
+    gen.run(CharstringContext(program(), &in), out);
+    return out;
+}
+
+}
+
+
+Type1Font *
+create_dotlessj_font(Type1Font *font, PermString font_name, int *status, PermString *glyph_name)
+{
+    // check for existing dotlessj
+    static const char * const dotlessj_names[] = {
+        "dotlessj", "uni0237", "u0237", private_use_dotlessj, 0
+    };
+    for (const char * const *n = dotlessj_names; *n; n++)
+        if (font->glyph(*n)) {
+            if (glyph_name)
+                *glyph_name = *n;
+            *status = DOTLESSJ_EXISTS;
+            return 0;
+        }
+
+    // check for j
+    Type1Charstring *j_cs = font->glyph("j");
+    if (!j_cs)
+        j_cs = font->glyph("uni006A");
+    if (!j_cs)
+        j_cs = font->glyph("u006A");
+    if (!j_cs) {
+        *status = DOTLESSJ_NO_J;
+        return 0;
+    }
+
+    // chop the dot before building anything
+    Sectioner sec(5);
+    sec.run(CharstringContext(font, j_cs));
+    if (!sec.undot()) {
+        *status = DOTLESSJ_J_NODOT;
+        return 0;
+    }
+
+    // make new font
+    Vector<double> xuid_extension;
+    xuid_extension.push_back(0x00237237);
+    Type1Font *dotless_font = Type1Font::skeleton_make_copy(font, font_name, &xuid_extension);
+    dotless_font->skeleton_common_subrs();
+
+    // copy space and .notdef
+    if (Type1Charstring *notdef = font->glyph(".notdef"))
+        dotless_font->add_glyph(Type1Subr::make_glyph(".notdef", *notdef, " |-"));
+    if (Type1Charstring *space = font->glyph("space")) {
+        dotless_font->add_glyph(Type1Subr::make_glyph("space", *space, " |-"));
+        dotless_font->type1_encoding()->put(' ', "space");
+    }
+
+    // create dotless j
+    Type1Subr *dotlessj = Type1Subr::make_glyph("uni0237", sec.gen(dotless_font), " |-");
+    dotless_font->add_glyph(dotlessj);
+
+    // encode dotless j
+    dotless_font->type1_encoding()->clear();
+    dotless_font->type1_encoding()->put('j', "uni0237");
+
+    *status = DOTLESSJ_OK;
+    return dotless_font;
+}
+
+}
@@ -0,0 +1,946 @@
+// -*- related-file-name: "../include/efont/maket1font.hh" -*-
+
+/* maket1font.{cc,hh} -- translate CFF fonts to Type 1 fonts
+ *
+ * Copyright (c) 2002-2023 Eddie Kohler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <efont/maket1font.hh>
+#include <efont/t1interp.hh>
+#include <efont/t1csgen.hh>
+#include <lcdf/point.hh>
+#include <lcdf/error.hh>
+#include <efont/t1font.hh>
+#include <efont/t1item.hh>
+#include <efont/t1unparser.hh>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <algorithm>
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+# include <sys/wait.h>
+#endif
+#ifdef HAVE_POLL_H
+# include <poll.h>
+#endif
+#if !defined(WIN32) && HAVE_FORK && HAVE_WAITPID && HAVE_POLL_H
+# define HAVE_CONVERSION_WORKERS 1
+#endif
+
+namespace Efont {
+
+typedef unsigned CsRef;
+enum { CSR_GLYPH = 0x00000000, CSR_SUBR = 0x80000000,
+       CSR_GSUBR = 0xC0000000,
+       CSR_TYPE = 0xC0000000, CSR_NUM = 0x3FFFFFFF };
+
+class MakeType1CharstringInterp : public Type1CharstringGenInterp { public:
+
+    MakeType1CharstringInterp(int precision = 5);
+    ~MakeType1CharstringInterp();
+
+    Type1Font *output() const                   { return _output; }
+
+    void run(const CharstringProgram *, const Vector<int> *subset, Type1Font *, PermString glyph_definer, int njobs, ErrorHandler *);
+
+    bool type2_command(int, const uint8_t *, int *);
+    void act_seac(int, double, double, double, int, int);
+
+    enum { MIN_GLYPHS_PER_JOB = 256 };
+
+    class Subr;
+    struct SubrCaller;
+
+  protected:
+
+    bool gen_hint_replacement(const String &hints);
+
+  private:
+
+    // output
+    Type1Font *_output;
+    int _flex_message;
+    bool _hr_ok;
+    HashMap<String, int> _hr_subrs;
+
+    // current glyph, see convert()
+    Vector<int> _hr_pos;
+    Vector<String> _hr_hints;
+    Vector<int> _calls;
+    Vector<int> _seac_codes;
+
+    // glyphs to convert
+    Vector<int> _wanted;
+    Vector<int> _pending;
+    HashMap<PermString, int> _glyph_map;
+
+    // subroutines
+    int _subr_bias;
+    int _gsubr_bias;
+    mutable Vector<Subr *> _glyphs;
+    mutable Vector<Subr *> _subrs;
+    mutable Vector<Subr *> _gsubrs;
+    Vector<SubrCaller> _callers;
+
+    Subr *csr_subr(CsRef, bool force) const;
+    Type1Charstring *csr_charstring(CsRef) const;
+
+    void convert(const CharstringProgram *, const int *first, const int *last, StringAccum &);
+    void convert_all(const CharstringProgram *, const Vector<int> &gids, int njobs, Vector<String> &);
+    void merge(const CharstringProgram *, const String &, PermString glyph_definer, ErrorHandler *);
+    void want_seac_component(const CharstringProgram *, int code);
+    int hint_replacement_subr(const String &hints);
+
+};
+
+// A place where a subroutine's code was interpolated into a caller's
+// charstring.  Each SubrCaller is listed both by its callee, in _callers,
+// and by its caller, in _calls, so that rewriting a caller touches only
+// that caller's own call sites.
+
+struct MakeType1CharstringInterp::SubrCaller {
+    Subr *callee;
+    Subr *subr;         // caller, or null if the call site was erased
+    int pos;
+    int len;
+    SubrCaller(Subr *c, Subr *s, int p, int l)
+        : callee(c), subr(s), pos(p), len(l) {
+    }
+    inline String charstring(const MakeType1CharstringInterp *mcsi) const;
+};
+
+class MakeType1CharstringInterp::Subr { public:
+
+    Subr(CsRef csr)                     : _csr(csr), _output_subrno(-1) { }
+
+    //String name(const MakeType1CharstringInterp *) const;
+    Type1Charstring *charstring(const MakeType1CharstringInterp *) const;
+
+    int ncallers() const                { return _callers.size(); }
+
+    inline void add_caller(MakeType1CharstringInterp *, Subr *s, int pos, int len);
+
+    int output_subrno() const           { return _output_subrno; }
+    void set_output_subrno(int n)       { _output_subrno = n; }
+
+    void transfer_nested_calls(MakeType1CharstringInterp *, int pos, int length, Subr *new_caller);
+    void change_calls(MakeType1CharstringInterp *, int pos, int length, int new_length);
+    bool unify(MakeType1CharstringInterp *);
+
+  private:
+
+    CsRef _csr;
+    Vector<int> _calls;         // indexes into mcsi->_callers
+    Vector<int> _callers;       // indexes into mcsi->_callers
+
+    int _output_subrno;
+
+    friend class MakeType1CharstringInterp;
+
+};
+
+inline String
+MakeType1CharstringInterp::SubrCaller::charstring(const MakeType1CharstringInterp *mcsi) const
+{
+    Type1Charstring *t1cs = subr->charstring(mcsi);
+    return t1cs->substring(pos, len);
+}
+
+inline void
+MakeType1CharstringInterp::Subr::add_caller(MakeType1CharstringInterp *mcsi, Subr *s, int pos, int len)
+{
+    _callers.push_back(mcsi->_callers.size());
+    s->_calls.push_back(mcsi->_callers.size());
+    mcsi->_callers.push_back(SubrCaller(this, s, pos, len));
+}
+
+
+/*****
+ * MakeType1CharstringInterp
+ **/
+
+MakeType1CharstringInterp::MakeType1CharstringInterp(int precision)
+    : Type1CharstringGenInterp(precision), _flex_message(0), _hr_subrs(-1),
+      _glyph_map(-1)
+{
+}
+
+MakeType1CharstringInterp::~MakeType1CharstringInterp()
+{
+    for (int i = 0; i < _glyphs.size(); i++)
+        delete _glyphs[i];
+    for (int i = 0; i < _subrs.size(); i++)
+        delete _subrs[i];
+    for (int i = 0; i < _gsubrs.size(); i++)
+        delete _gsubrs[i];
+}
+
+// subroutines
+
+MakeType1CharstringInterp::Subr *
+MakeType1CharstringInterp::csr_subr(CsRef csr, bool force) const
+{
+    Vector<Subr *> *vp;
+    if ((csr & CSR_TYPE) == CSR_SUBR)
+        vp = &_subrs;
+    else if ((csr & CSR_TYPE) == CSR_GSUBR)
+        vp = &_gsubrs;
+    else if ((csr & CSR_TYPE) == CSR_GLYPH)
+        vp = &_glyphs;
+    else
+        return 0;
+
+    int n = (csr & CSR_NUM);
+    if (n >= vp->size())
+        return 0;
+
+    Subr *&what = (*vp)[n];
+    if (!what && force)
+        what = new Subr(csr);
+    return what;
+}
+
+#if 0
+String
+MakeType1CharstringInterp::Subr::name(const MakeType1CharstringInterp *mcsi) const
+{
+    int n = (_csr & CSR_NUM);
+    switch (_csr & CSR_TYPE) {
+    case CSR_SUBR:
+        return "subr" + String(n);
+    case CSR_GSUBR:
+        return "gsubr" + String(n);
+    case CSR_GLYPH:
+        if (String name = mcsi->output()->glyph_name(n))
+            return name;
+        else
+            return "??glyph" + String(n) + "??";
+    default:
+        return "";
+    }
+}
+#endif
+
+Type1Charstring *
+MakeType1CharstringInterp::Subr::charstring(const MakeType1CharstringInterp *mcsi) const
+{
+    int n = (_csr & CSR_NUM);
+    switch (_csr & CSR_TYPE) {
+      case CSR_SUBR:
+      case CSR_GSUBR:
+        if (_output_subrno >= 0)
+            return static_cast<Type1Charstring *>(mcsi->output()->subr(_output_subrno));
+        return 0;
+      case CSR_GLYPH:
+        return static_cast<Type1Charstring *>(mcsi->output()->glyph(n));
+      default:
+        return 0;
+    }
+}
+
+void
+MakeType1CharstringInterp::Subr::transfer_nested_calls(MakeType1CharstringInterp *mcsi, int pos, int length, Subr *new_caller)
+{
+    int right = pos + length;
+    for (int i = 0; i < _calls.size(); i++) {
+        SubrCaller &c = mcsi->_callers[_calls[i]];
+        // 11.Jul.2006 - remember not to shift the new caller's records!  (Michael Zedler)
+        if (c.callee != new_caller && c.subr == this
+            && pos <= c.pos && c.pos + c.len <= right) {
+            // shift caller to point at the subroutine
+            c.subr = new_caller;
+            c.pos -= pos;
+            new_caller->_calls.push_back(_calls[i]);
+        }
+    }
+}
+
+void
+MakeType1CharstringInterp::Subr::change_calls(MakeType1CharstringInterp *mcsi, int pos, int length, int new_length)
+{
+    // Adjust this subr's call sites after its charstring's [pos, pos +
+    // length) was replaced by new_length bytes, dropping call sites that
+    // no longer belong to it.
+    int right = pos + length;
+    int delta = new_length - length;
+    int *w = _calls.begin();
+    for (int *r = _calls.begin(); r != _calls.end(); r++) {
+        SubrCaller &c = mcsi->_callers[*r];
+        if (c.subr != this)
+            continue;
+        else if (pos <= c.pos && c.pos + c.len <= right) {
+            // erase
+            //if (c.debug) fprintf(stderr, "  ERASE caller %08x:%d+%d [%d+%d]\n", c.subr->_csr, c.pos, c.len, pos, length);
+            c.subr = 0;
+        } else if (right <= c.pos) {
+            //if (c.debug) fprintf(stderr, "  ADJUST caller %08x:%d+%d -> %d+%d [%d+%d]\n", c.subr->_csr, c.pos, c.len, c.pos+delta, c.len, pos, length);
+            c.pos += delta;
+        } else if (c.pos <= pos && right <= c.pos + c.len) {
+            //if (c.debug) fprintf(stderr, "  ADJUST caller %08x:%d+%d -> %d+%d [%d+%d]\n", c.subr->_csr, c.pos, c.len, c.pos, c.len+delta, pos, length);
+            c.len += delta;
+        } else
+            c.subr = 0;
+        if (c.subr)
+            *w++ = *r;
+    }
+    _calls.erase(w, _calls.end());
+}
+
+bool
+MakeType1CharstringInterp::Subr::unify(MakeType1CharstringInterp *mcsi)
+{
+    // clean up caller list
+    const Vector<SubrCaller> &callers = mcsi->_callers;
+    for (int i = 0; i < _callers.size(); i++)
+        if (!callers[_callers[i]].subr) {
+            _callers[i] = _callers.back();
+            _callers.pop_back();
+            i--;
+        }
+
+    if (!_callers.size())
+        return false;
+    assert(!_calls.size());     // because this hasn't been unified yet
+
+    // Find the smallest shared complete charstring.
+    String substr = callers[_callers[0]].charstring(mcsi);
+    int suboff = 0;
+    for (int i = 1; i < _callers.size(); i++) {
+        String substr1 = callers[_callers[i]].charstring(mcsi);
+        const char *d = substr.data() + suboff, *d1 = substr1.data();
+        const char *dx = substr.data() + substr.length(), *d1x = d1 + substr1.length();
+        while (dx > d && d1x > d1 && dx[-1] == d1x[-1])
+            dx--, d1x--;
+        if (d1x != d1) {
+            // 8.13.2013 -- We might have stopped in the middle of a number
+            // or command in d1 -- even if we absorbed all of d! For
+            // example, maybe d's version is "15 rlineto" (encoded "154 5"),
+            // and our version is "518 rlineto" (encoded "248 154 5")! So
+            // whenever we stop before the end of d1, we must adjust our
+            // position to the next caret in d1, which, in the example,
+            // would be after "248 154" and before "5".
+            int suboff1 = Type1Charstring(substr1).first_caret_after(d1x - d1);
+            dx += suboff1 - (d1x - d1);
+        }
+        suboff = dx - substr.data();
+    }
+    substr = substr.substring(Type1Charstring(substr).first_caret_after(suboff));
+    if (!substr.length())
+        return false;
+    for (int i = 0; i < _callers.size(); i++) {
+        SubrCaller &c = mcsi->_callers[_callers[i]];
+        if (int delta = c.len - substr.length()) {
+            //if (c.debug) fprintf(stderr, "  PREFIX caller %08x:%d+%d -> %d+%d [%s]\n", c.subr->_csr, c.pos, c.len, c.pos+delta, c.len+delta, CharstringUnparser::unparse(Type1Charstring(substr)).c_str());
+            c.pos += delta;
+            c.len -= delta;
+        }
+    }
+
+    // otherwise, success
+    _output_subrno = mcsi->output()->nsubrs();
+    mcsi->output()->set_subr(_output_subrno, Type1Charstring(substr + "\013"));
+
+    // This subr has become real, so it is suitable for later unifications.
+    // Mark it as having called any subroutines contained completely within itself.
+    // How to do this?  Look at one caller, and go over all its calls.
+    const SubrCaller &c0 = callers[_callers[0]];
+    c0.subr->transfer_nested_calls(mcsi, c0.pos, c0.len, this);
+
+    // adapt callers
+    String callsubr_string = Type1CharstringGen::callsubr_string(_output_subrno);
+
+    for (int i = 0; i < _callers.size(); i++)
+        // 13.Jun.2003 - must check whether _callers[i].subr exists: if we
+        // called a subroutine more than once, change_callers() might have
+        // zeroed it out.
+        if (callers[_callers[i]].subr && callers[_callers[i]].subr != this) {
+            SubrCaller c = callers[_callers[i]];
+            c.subr->charstring(mcsi)->assign_substring(c.pos, c.len, callsubr_string);
+            c.subr->change_calls(mcsi, c.pos, c.len, callsubr_string.length());
+            assert(!callers[_callers[i]].subr);
+        }
+
+    // this subr is no longer "called"/interpolated from anywhere
+    _callers.clear();
+
+    //fprintf(stderr, "Succeeded %x\n", _csr);
+    return true;
+}
+
+
+// running
+
+bool
+MakeType1CharstringInterp::type2_command(int cmd, const uint8_t *data, int *left)
+{
+    switch (cmd) {
+
+      case Cs::cCallsubr:
+      case Cs::cCallgsubr:
+        if (subr_depth() < MAX_SUBR_DEPTH && size() == 1) {
+            //fprintf(stderr, "succeeded %d\n", (int) top());
+            bool g = (cmd == Cs::cCallgsubr);
+            CsRef csref = ((int)top() + program()->xsubr_bias(g)) | (g ? CSR_GSUBR : CSR_SUBR);
+
+            // merge() replays these calls against the Subr objects
+            int left = csgen().length();
+            bool more = callxsubr_command(g);
+
+            int right = csgen().length();
+            if (error() >= 0) {
+                _calls.push_back(csref);
+                _calls.push_back(left);
+                _calls.push_back(right - left);
+            }
+            return more;
+        } else {
+            //fprintf(stderr, "failed %d\n", (int) top());
+            goto normal;
+        }
+
+      normal:
+      default:
+        return CharstringInterp::type2_command(cmd, data, left);
+
+    }
+}
+
+void
+MakeType1CharstringInterp::act_seac(int cmd, double asb, double adx, double ady, int bchar, int achar)
+{
+    _seac_codes.push_back(bchar);
+    _seac_codes.push_back(achar);
+    Type1CharstringGenInterp::act_seac(cmd, asb, adx, ady, bchar, achar);
+}
+
+bool
+MakeType1CharstringInterp::gen_hint_replacement(const String &hints)
+{
+    // Subroutine numbers depend on the glyphs converted so far, so leave
+    // the number out and let merge() insert it.
+    if (_hr_ok) {
+        _hr_pos.push_back(csgen().length());
+        _hr_hints.push_back(hints);
+    }
+    return _hr_ok;
+}
+
+int
+MakeType1CharstringInterp::hint_replacement_subr(const String &hints)
+{
+    int &subrno = _hr_subrs.find_force(hints);
+    if (subrno < 0) {
+        int nsubrs = _output->nsubrs();
+        if (_output->set_subr(nsubrs, Type1Charstring(hints)))
+            subrno = nsubrs;
+    }
+    return subrno;
+}
+
+static inline void
+append_int(StringAccum &sa, int x)
+{
+    memcpy(sa.extend(sizeof(int)), &x, sizeof(int));
+}
+
+static inline int
+take_int(const char *&s)
+{
+    int x;
+    memcpy(&x, s, sizeof(int));
+    s += sizeof(int);
+    return x;
+}
+
+void
+MakeType1CharstringInterp::convert(const CharstringProgram *program, const int *first, const int *last, StringAccum &sa)
+{
+    // Convert glyphs [first, last) without touching the output font or the
+    // Subr objects.  Each glyph's record holds its glyph ID; its charstring,
+    // minus hint replacement subroutine numbers; the hint replacements; its
+    // subroutine calls; which warnings it triggered first; and the
+    // StandardEncoding codes of its seac components.
+    Type1Charstring receptacle;
+    for (const int *gp = first; gp != last; gp++) {
+        int had = (had_bad_flex() ? 1 : 0) | (had_flex() ? 2 : 0) | (had_hr() ? 4 : 0);
+        _hr_pos.clear();
+        _hr_hints.clear();
+        _calls.clear();
+        _seac_codes.clear();
+
+        Type1CharstringGenInterp::run(program->glyph_context(*gp), receptacle);
+
+        const String &cs = receptacle.data_string();
+        append_int(sa, *gp);
+        append_int(sa, cs.length());
+        sa << cs;
+        append_int(sa, _hr_pos.size());
+        for (int j = 0; j < _hr_pos.size(); j++) {
+            append_int(sa, _hr_pos[j]);
+            append_int(sa, _hr_hints[j].length());
+            sa << _hr_hints[j];
+        }
+        append_int(sa, _calls.size());
+        for (int j = 0; j < _calls.size(); j++)
+            append_int(sa, _calls[j]);
+        int now = (had_bad_flex() ? 1 : 0) | (had_flex() ? 2 : 0) | (had_hr() ? 4 : 0);
+        append_int(sa, now & ~had);
+        append_int(sa, _seac_codes.size());
+        for (int j = 0; j < _seac_codes.size(); j++)
+            append_int(sa, _seac_codes[j]);
+    }
+}
+
+void
+MakeType1CharstringInterp::want_seac_component(const CharstringProgram *program, int code)
+{
+    // A seac component must be in the font under its StandardEncoding name.
+    if (code < 0 || code > 255)
+        return;
+    PermString name = Type1Encoding::standard_encoding()->elt(code);
+    if (!_glyph_map.size()) {
+        Vector<PermString> names;
+        program->glyph_names(names);
+        for (int gid = names.size() - 1; gid >= 0; gid--)
+            _glyph_map.insert(names[gid], gid);
+    }
+    int gid = _glyph_map[name];
+    if (gid >= 0 && gid < _wanted.size() && !_wanted[gid]) {
+        _wanted[gid] = 1;
+        _pending.push_back(gid);
+    }
+}
+
+void
+MakeType1CharstringInterp::merge(const CharstringProgram *program, const String &records, PermString glyph_definer, ErrorHandler *errh)
+{
+    StringAccum sa;
+    Vector<int> hr_pos, hr_len;
+    const char *s = records.begin();
+    while (s != records.end()) {
+        int i = take_int(s);
+        // glyph Subrs are numbered by their position in the output
+        Subr *glyph_subr = _glyphs[i] = new Subr(CSR_GLYPH | _output->nglyphs());
+
+        // charstring, with hint replacement subroutine numbers
+        int cslen = take_int(s);
+        const char *cs = s;
+        s += cslen;
+        int nhr = take_int(s), cspos = 0;
+        hr_pos.clear();
+        hr_len.clear();
+        for (int j = 0; j < nhr; j++) {
+            int pos = take_int(s);
+            int hintslen = take_int(s);
+            int subrno = hint_replacement_subr(String(s, hintslen));
+            s += hintslen;
+            assert(subrno >= 0);
+            sa.append(cs + cspos, pos - cspos);
+            cspos = pos;
+            int salen = sa.length();
+            Type1CharstringGen csg;
+            csg.gen_number(subrno);
+            sa << csg.take_string();
+            hr_pos.push_back(pos);
+            hr_len.push_back(sa.length() - salen);
+        }
+        sa.append(cs + cspos, cslen - cspos);
+
+        // subroutine calls, shifted past any inserted subroutine numbers
+        int ncalls = take_int(s);
+        for (int j = 0; j < ncalls; j += 3) {
+            CsRef csref = take_int(s);
+            int pos = take_int(s);
+            int len = take_int(s);
+            Subr *callee = csr_subr(csref, true);
+            if (callee) {
+                int delta_pos = 0, delta_len = 0;
+                for (int k = 0; k < hr_pos.size(); k++)
+                    if (hr_pos[k] < pos)
+                        delta_pos += hr_len[k];
+                    else if (hr_pos[k] < pos + len)
+                        delta_len += hr_len[k];
+                callee->add_caller(this, glyph_subr, pos + delta_pos, len + delta_len);
+            }
+        }
+
+        int warnings = take_int(s) & ~_flex_message;
+        if (warnings) {
+            String landmark = errh->format("glyph %<%s%>", program->glyph_name(i).c_str());
+            if (warnings & 1) {
+                errh->lwarning(landmark, "complex flex hint replaced with curves");
+                errh->message("(This font contains flex hints prohibited by Type 1. They%,ve been\nreplaced by ordinary curves.)");
+            }
+#if !HAVE_ADOBE_CODE
+            if (warnings & 2) {
+                errh->lwarning(landmark, "flex hints required");
+                errh->message("(This program was compiled without Adobe code for flex hint support,\nso its output may not work on all devices.)");
+            }
+            if (warnings & 4) {
+                errh->lwarning(landmark, "hint replacement required");
+                errh->message("(This program was compiled without Adobe code for hint replacement,\nso its output may not work on all devices.)");
+            }
+#endif
+            _flex_message |= warnings;
+        }
+
+        int nseac = take_int(s);
+        for (int j = 0; j < nseac; j++)
+            want_seac_component(program, take_int(s));
+
+        PermString name = program->glyph_name(i);
+        if (_output->glyph(name)) {
+            errh->warning("glyph %<%s%> defined more than once", name.c_str());
+            int i = 1;
+            do {
+                name = program->glyph_name(i) + String(".") + String(i);
+                ++i;
+            } while (_output->glyph(name));
+        }
+        _output->add_glyph(Type1Subr::make_glyph(name, Type1Charstring(sa.take_string()), glyph_definer));
+    }
+}
+
+#if HAVE_CONVERSION_WORKERS
+static bool
+write_all(int fd, const char *data, int len)
+{
+    while (len > 0) {
+        ssize_t w = write(fd, data, len);
+        if (w < 0 && errno != EINTR && errno != EAGAIN)
+            return false;
+        else if (w > 0) {
+            data += w;
+            len -= w;
+        }
+    }
+    return true;
+}
+#endif
+
+void
+MakeType1CharstringInterp::convert_all(const CharstringProgram *program, const Vector<int> &gids, int njobs, Vector<String> &records)
+{
+    // Split the glyphs into contiguous ranges, one per job.  Worker
+    // processes convert all ranges but the ones that could not be handed
+    // off, which are converted here, in order.  (Processes, not threads:
+    // PermString, String, and the charstring programs are not thread-safe.)
+    int nglyphs = gids.size();
+    if (njobs > nglyphs / MIN_GLYPHS_PER_JOB)
+        njobs = nglyphs / MIN_GLYPHS_PER_JOB;
+    if (njobs < 1)
+        njobs = 1;
+    Vector<int> first;
+    for (int w = 0; w <= njobs; w++)
+        first.push_back((int) ((long long) nglyphs * w / njobs));
+    records.assign(njobs, String());
+    Vector<int> done(njobs, 0);
+
+#if HAVE_CONVERSION_WORKERS
+    if (njobs > 1) {
+        // don't let children repeat buffered output
+        fflush(stdout);
+        fflush(stderr);
+
+        Vector<pid_t> pids(njobs, -1);
+        Vector<int> fds(njobs, -1);
+        Vector<StringAccum> outputs(njobs, StringAccum());
+        for (int w = 0; w < njobs; w++) {
+            int p[2];
+            if (pipe(p) < 0)
+                break;
+            pid_t child = fork();
+            if (child < 0) {
+                close(p[0]);
+                close(p[1]);
+                break;
+            } else if (child == 0) {
+                close(p[0]);
+                StringAccum sa;
+                convert(program, gids.begin() + first[w], gids.begin() + first[w + 1], sa);
+                bool ok = write_all(p[1], sa.data(), sa.length());
+                close(p[1]);
+                _exit(ok ? 0 : 1);
+            }
+            close(p[1]);
+            pids[w] = child;
+            fds[w] = p[0];
+        }
+
+        // collect worker output
+        Vector<int> eof(njobs, 0);
+        while (1) {
+            Vector<struct pollfd> pfds;
+            Vector<int> pfd_worker;
+            for (int w = 0; w < njobs; w++)
+                if (fds[w] >= 0) {
+                    struct pollfd pfd;
+                    pfd.fd = fds[w];
+                    pfd.events = POLLIN;
+                    pfd.revents = 0;
+                    pfds.push_back(pfd);
+                    pfd_worker.push_back(w);
+                }
+            if (!pfds.size())
+                break;
+            if (poll(pfds.begin(), pfds.size(), -1) < 0) {
+                if (errno == EINTR)
+                    continue;
+                for (int i = 0; i < pfds.size(); i++) {
+                    close(pfds[i].fd);
+                    fds[pfd_worker[i]] = -1;
+                }
+                break;
+            }
+            for (int i = 0; i < pfds.size(); i++)
+                if (pfds[i].revents) {
+                    int w = pfd_worker[i];
+                    char *x = outputs[w].reserve(65536);
+                    ssize_t r = read(fds[w], x, 65536);
+                    if (r > 0)
+                        outputs[w].adjust_length(r);
+                    else if (r == 0 || (errno != EINTR && errno != EAGAIN)) {
+                        eof[w] = (r == 0);
+                        close(fds[w]);
+                        fds[w] = -1;
+                    }
+                }
+        }
+
+        for (int w = 0; w < njobs; w++)
+            if (pids[w] >= 0) {
+                int status;
+                pid_t answer;
+                while ((answer = waitpid(pids[w], &status, 0)) < 0 && errno == EINTR)
+                    /* try again */;
+                if (answer >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0
+                    && eof[w]) {
+                    records[w] = outputs[w].take_string();
+                    done[w] = 1;
+                }
+            }
+    }
+#endif
+
+    for (int w = 0; w < njobs; w++)
+        if (!done[w]) {
+            StringAccum sa;
+            convert(program, gids.begin() + first[w], gids.begin() + first[w + 1], sa);
+            records[w] = sa.take_string();
+        }
+}
+
+void
+MakeType1CharstringInterp::run(const CharstringProgram *program, const Vector<int> *subset, Type1Font *output, PermString glyph_definer, int njobs, ErrorHandler *errh)
+{
+    _output = output;
+
+    // hint replacements go in new Subrs, which need an existing Subr as a
+    // pattern (see Type1Font::set_subr)
+    _hr_ok = false;
+    for (int i = 0; i < output->nsubrs() && !_hr_ok; i++)
+        _hr_ok = (output->subr_x(i) != 0);
+    _hr_subrs.clear();
+
+    _glyphs.assign(program->nglyphs(), 0);
+    _subrs.assign(program->nsubrs(), 0);
+    _subr_bias = program->subr_bias();
+    _gsubrs.assign(program->ngsubrs(), 0);
+    _gsubr_bias = program->gsubr_bias();
+
+    // run over the glyphs, then add them to the output in order; repeat
+    // for seac components that were left out of a subset
+    Vector<int> gids;
+    if (subset)
+        gids = *subset;
+    else
+        for (int i = 0; i < program->nglyphs(); i++)
+            gids.push_back(i);
+    _wanted.assign(program->nglyphs(), 0);
+    for (int *gp = gids.begin(); gp != gids.end(); gp++)
+        _wanted[*gp] = 1;
+
+    while (gids.size()) {
+        Vector<String> records;
+        convert_all(program, gids, njobs, records);
+        _pending.clear();
+        for (int w = 0; w < records.size(); w++) {
+            merge(program, records[w], glyph_definer, errh);
+            records[w] = String();
+        }
+        gids.swap(_pending);
+        std::sort(gids.begin(), gids.end());
+    }
+
+    // unify Subrs
+    for (int i = 0; i < _subrs.size(); i++)
+        if (_subrs[i])
+            _subrs[i]->unify(this);
+
+    for (int i = 0; i < _gsubrs.size(); i++)
+        if (_gsubrs[i])
+            _gsubrs[i]->unify(this);
+}
+
+
+/*****
+ * main
+ **/
+
+static void
+add_number_def(Type1Font* output, int dict, PermString name, const Cff::Font* font, Cff::DictOperator op)
+{
+    double v;
+    if (font->dict_value(op, &v))
+        output->add_definition(dict, Type1Definition::make(name, v, "def"));
+}
+
+static void
+add_number_def(Type1Font* output, int dict, PermString name, const Cff::Font* font, Cff::DictOperator op, double default_value)
+{
+    double v;
+    if (font->dict_value(op, &v) && v != default_value)
+        output->add_definition(dict, Type1Definition::make(name, v, "def"));
+}
+
+static void
+add_delta_def(Type1Font* output, int dict, PermString name, const Cff::Font* font, Cff::DictOperator op)
+{
+    Vector<double> vec;
+    if (font->dict_value(op, vec)) {
+        for (int i = 1; i < vec.size(); i++)
+            vec[i] += vec[i - 1];
+        StringAccum sa;
+        for (int i = 0; i < vec.size(); i++)
+            sa << (i ? ' ' : '[') << vec[i];
+        sa << ']';
+        output->add_definition(dict, Type1Definition::make_literal(name, sa.take_string(), (dict == Type1Font::dP ? "|-" : "readonly def")));
+    }
+}
+
+Type1Font *
+create_type1_font(const Cff::Font *font, ErrorHandler *errh, int njobs,
+                  const Vector<PermString> *glyphs)
+{
+    String version = font->dict_string(Cff::oVersion);
+    Type1Font *output = Type1Font::skeleton_make(font->font_name(), version);
+    StringAccum sa;
+    double v;
+    Vector<double> vec;
+    const char* old_double_format = StringAccum::double_format;
+    StringAccum::double_format = "%.9g";
+
+    output->add_definition(Type1Font::dF, Type1Definition::make("FontType", 1.0, "def"));
+    output->add_definition(Type1Font::dF, Type1Definition::make_literal("FontName", "/" + font->font_name(), "def"));
+    font->dict_value(Cff::oPaintType, &v);
+    output->add_definition(Type1Font::dF, Type1Definition::make("PaintType", v, "def"));
+    if (font->dict_value(Cff::oFontMatrix, vec) && vec.size() == 6) {
+        sa << '[' << vec[0] << ' ' << vec[1] << ' ' << vec[2] << ' ' << vec[3] << ' ' << vec[4] << ' ' << vec[5] << ']';
+        output->add_definition(Type1Font::dF, Type1Definition::make_literal("FontMatrix", sa.take_string(), "readonly def"));
+    } else {
+        output->add_definition(Type1Font::dF, Type1Definition::make_literal("FontMatrix", "[0.001 0 0 0.001 0 0]", "readonly def"));
+    }
+
+    // FontInfo dictionary
+    if (version)
+        output->add_definition(Type1Font::dFI, Type1Definition::make_string("version", version, "readonly def"));
+    if (String s = font->dict_string(Cff::oNotice))
+        output->add_definition(Type1Font::dFI, Type1Definition::make_string("Notice", s, "readonly def"));
+    if (String s = font->dict_string(Cff::oCopyright))
+        output->add_definition(Type1Font::dFI, Type1Definition::make_string("Copyright", s, "readonly def"));
+    if (String s = font->dict_string(Cff::oFullName))
+        output->add_definition(Type1Font::dFI, Type1Definition::make_string("FullName", s, "readonly def"));
+    if (String s = font->dict_string(Cff::oFamilyName))
+        output->add_definition(Type1Font::dFI, Type1Definition::make_string("FamilyName", s, "readonly def"));
+    if (String s = font->dict_string(Cff::oWeight))
+        output->add_definition(Type1Font::dFI, Type1Definition::make_string("Weight", s, "readonly def"));
+    if (font->dict_value(Cff::oIsFixedPitch, &v))
+        output->add_definition(Type1Font::dFI, Type1Definition::make_literal("isFixedPitch", (v ? "true" : "false"), "def"));
+    add_number_def(output, Type1Font::dFI, "ItalicAngle", font, Cff::oItalicAngle);
+    add_number_def(output, Type1Font::dFI, "UnderlinePosition", font, Cff::oUnderlinePosition);
+    add_number_def(output, Type1Font::dFI, "UnderlineThickness", font, Cff::oUnderlineThickness);
+    output->skeleton_fontinfo_end();
+
+    // Encoding, other font dictionary entries
+    output->add_type1_encoding(font->type1_encoding_copy());
+    add_number_def(output, Type1Font::dF, "StrokeWidth", font, Cff::oStrokeWidth);
+    add_number_def(output, Type1Font::dF, "UniqueID", font, Cff::oUniqueID);
+    if (font->dict_value(Cff::oXUID, vec) && vec.size()) {
+        for (int i = 0; i < vec.size(); i++)
+            sa << (i ? ' ' : '[') << vec[i];
+        sa << ']';
+        output->add_definition(Type1Font::dF, Type1Definition::make_literal("XUID", sa.take_string(), "readonly def"));
+    }
+    if (font->dict_value(Cff::oFontBBox, vec) && vec.size() == 4) {
+        sa << '{' << vec[0] << ' ' << vec[1] << ' ' << vec[2] << ' ' << vec[3] << '}';
+        output->add_definition(Type1Font::dF, Type1Definition::make_literal("FontBBox", sa.take_string(), "readonly def"));
+    } else
+        output->add_definition(Type1Font::dF, Type1Definition::make_literal("FontBBox", "{0 0 0 0}", "readonly def"));
+    output->skeleton_fontdict_end();
+
+    // Private dictionary
+    if (font->dict_has(Cff::oBlueValues))
+        add_delta_def(output, Type1Font::dP, "BlueValues", font, Cff::oBlueValues);
+    else
+        output->add_definition(Type1Font::dP, Type1Definition::make_literal("BlueValues", "[]", "|-"));
+    add_delta_def(output, Type1Font::dP, "OtherBlues", font, Cff::oOtherBlues);
+    add_delta_def(output, Type1Font::dP, "FamilyBlues", font, Cff::oFamilyBlues);
+    add_delta_def(output, Type1Font::dP, "FamilyOtherBlues", font, Cff::oFamilyOtherBlues);
+    add_number_def(output, Type1Font::dP, "BlueScale", font, Cff::oBlueScale, 0.039625);
+    add_number_def(output, Type1Font::dP, "BlueShift", font, Cff::oBlueShift, 7);
+    add_number_def(output, Type1Font::dP, "BlueFuzz", font, Cff::oBlueFuzz, 1);
+    if (font->dict_value(Cff::oStdHW, &v))
+        output->add_definition(Type1Font::dP, Type1Definition::make_literal("StdHW", String("[") + String(v) + "]", "|-"));
+    if (font->dict_value(Cff::oStdVW, &v))
+        output->add_definition(Type1Font::dP, Type1Definition::make_literal("StdVW", String("[") + String(v) + "]", "|-"));
+    add_delta_def(output, Type1Font::dP, "StemSnapH", font, Cff::oStemSnapH);
+    add_delta_def(output, Type1Font::dP, "StemSnapV", font, Cff::oStemSnapV);
+    if (font->dict_value(Cff::oForceBold, &v))
+        output->add_definition(Type1Font::dP, Type1Definition::make_literal("ForceBold", (v ? "true" : "false"), "def"));
+    add_number_def(output, Type1Font::dP, "LanguageGroup", font, Cff::oLanguageGroup, 0);
+    add_number_def(output, Type1Font::dP, "ExpansionFactor", font, Cff::oExpansionFactor, 0.06);
+    add_number_def(output, Type1Font::dP, "UniqueID", font, Cff::oUniqueID);
+    output->add_definition(Type1Font::dP, Type1Definition::make_literal("MinFeature", "{16 16}", "|-"));
+    output->add_definition(Type1Font::dP, Type1Definition::make_literal("password", "5839", "def"));
+    output->add_definition(Type1Font::dP, Type1Definition::make_literal("lenIV", "0", "def"));
+    output->skeleton_private_end();
+    output->skeleton_common_subrs();
+
+    // add glyphs
+    Vector<int> subset;
+    if (glyphs) {
+        subset.push_back(0);    // .notdef
+        for (const PermString *gp = glyphs->begin(); gp != glyphs->end(); gp++) {
+            int gid = font->glyphid(*gp);
+            if (gid >= 0)
+                subset.push_back(gid);
+            else
+                errh->warning("glyph %<%s%> not in font", gp->c_str());
+        }
+        std::sort(subset.begin(), subset.end());
+        subset.erase(std::unique(subset.begin(), subset.end()), subset.end());
+    }
+    MakeType1CharstringInterp maker(5);
+    maker.run(font, glyphs ? &subset : 0, output, " |-", njobs, errh);
+
+    StringAccum::double_format = old_double_format;
+    return output;
+}
+
+} // namespace Efont
+
+#include <lcdf/vector.cc>
@@ -0,0 +1,277 @@
+// -*- related-file-name: "../include/efont/maket42font.hh" -*-
+
+/* maket42font.{cc,hh} -- translate TrueType fonts to Type 42 fonts
+ *
+ * Copyright (c) 2006-2019 Eddie Kohler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <efont/maket42font.hh>
+#include <efont/otfname.hh>
+#include <efont/otfpost.hh>
+#include <efont/otfcmap.hh>
+#include <efont/ttfcs.hh>
+#include <lcdf/error.hh>
+#include <lcdf/straccum.hh>
+#include <lcdf/md5.h>
+#include <string.h>
+
+namespace Efont {
+
+// This is the list of tables Adobe recommends be included from the source TTF,
+// plus the 'cmap' table, which helps to make PDF results searchable.
+static const char * const t42_tables[] = {
+    "cmap", "cvt ", "fpgm", "glyf", "head", "hhea", "hmtx",
+    "loca", "maxp", "prep", "vhea", "vmtx", 0
+};
+
+enum { TYPE42_WRITE_SIZE = 65536 };
+
+struct NameId {
+    const char *name;
+    int nameid;
+};
+
+static const NameId fontinfo_names[] = {
+    { "version", OpenType::Name::N_VERSION },
+    { "Notice", OpenType::Name::N_TRADEMARK },
+    { "Copyright", OpenType::Name::N_COPYRIGHT },
+    { "FullName", OpenType::Name::N_FULLNAME },
+    { "FamilyName", OpenType::Name::N_FAMILY },
+    { "Weight", OpenType::Name::N_SUBFAMILY },
+    { 0, 0 }
+};
+
+static void
+append_sfnts_string(StringAccum &sa, const String &data)
+{
+    // '<', 38 bytes of hex per line, and a padding byte, all written at once
+    static const char hexdigits[] = "0123456789ABCDEF";
+    int len = data.length();
+    int nchars = 1 + 2 * len + (len ? (len - 1) / 38 : 0) + (len % 38 == 0) + 4;
+    char *x = sa.extend(nchars);
+    if (!x)
+        return;
+    *x++ = '<';
+    const uint8_t *s = data.udata(), *end = s + len;
+    while (s != end) {
+        const uint8_t *line_end = (end - s > 38 ? s + 38 : end);
+        for (; s != line_end; ++s, x += 2) {
+            x[0] = hexdigits[*s >> 4];
+            x[1] = hexdigits[*s & 0xF];
+        }
+        if (s != end)
+            *x++ = '\n';
+    }
+    if (len % 38 == 0)
+        *x++ = '\n';
+    memcpy(x, "00>\n", 4);
+}
+
+static void
+flush_type42(StringAccum &sa, FILE *f)
+{
+    if (f && sa.length() >= TYPE42_WRITE_SIZE) {
+        fwrite(sa.data(), 1, sa.length(), f);
+        sa.clear();
+    }
+}
+
+static void
+append_sfnts(StringAccum &sa, FILE *f, const String &data, bool glyf, const OpenType::Font &font)
+{
+    OpenType::Data head = font.table("head");
+    if (glyf && data.length() >= 65535) {
+        OpenType::Data loca = font.table("loca");
+        bool loca_long = (head.length() >= 52 && head.u16(50) != 0);
+        int loca_size = (loca_long ? 4 : 2);
+        uint32_t first_offset = 0, cut_offset = 0;
+        for (int i = 1; i * loca_size < loca.length(); ++i) {
+            uint32_t offset = (loca_long ? loca.u32(4*i) : loca.u16(2*i) * 2);
+            if (offset - first_offset >= 65535) {
+                if (cut_offset == first_offset) {
+                    // either single glyph >= 65535 bytes, or offsets not even:
+                    // divide up to `offset`
+                    cut_offset = offset;
+                }
+                append_sfnts(sa, f, data.substring(first_offset, cut_offset - first_offset), false, font);
+                first_offset = cut_offset;
+            }
+            if ((offset - first_offset) % 2 == 0) {
+                cut_offset = offset;
+            }
+        }
+        append_sfnts(sa, f, data.substring(first_offset), false, font);
+    } else if (data.length() >= 65535) {
+        for (uint32_t offset = 0; offset < (uint32_t) data.length(); ) {
+            uint32_t cut_offset = offset + 65534;
+            if (cut_offset > (uint32_t) data.length()) {
+                cut_offset = data.length();
+            }
+            append_sfnts(sa, f, data.substring(offset, cut_offset - offset), false, font);
+            offset = cut_offset;
+        }
+    } else {
+        append_sfnts_string(sa, data);
+        flush_type42(sa, f);
+    }
+}
+
+bool
+check_type42_font(const OpenType::Font &otf, ErrorHandler *errh)
+{
+    if (!otf.check_checksums(errh))
+        return false;
+    if (otf.table("CFF")) {
+        errh->error("CFF-flavored OpenType font not suitable for Type 42");
+        return false;
+    }
+
+    OpenType::Name name(otf.table("name"), errh);
+    OpenType::Data head_data = otf.table("head");
+    if (!otf.table("glyf") || head_data.length() <= 52 || !name.ok()) {
+        errh->error("font appears to lack required tables");
+        return false;
+    }
+    return true;
+}
+
+// Writes the Type 42 font to sa, or, if f is nonnull, streams it to f
+// through sa.  Returns false, having written nothing, on error.
+static bool
+make_type42_font(const OpenType::Font &otf, StringAccum &sa, FILE *f, ErrorHandler *errh)
+{
+    if (!check_type42_font(otf, errh))
+        return false;
+    OpenType::Name name(otf.table("name"), errh);
+    OpenType::Data head_data = otf.table("head");
+
+    // create reduced font
+    Vector<OpenType::Tag> tags;
+    Vector<String> tables;
+    for (const char * const *table = t42_tables; *table; table++)
+        if (String s = otf.table(*table)) {
+            tags.push_back(*table);
+            tables.push_back(s);
+        }
+    OpenType::Font reduced_font = OpenType::Font::make(true, tags, tables);
+
+    // get glyph names
+    TrueTypeBoundsCharstringProgram ttbprog(&otf);
+    Vector<PermString> gn;
+    ttbprog.glyph_names(gn);
+    OpenType::Post post(otf.table("post"));
+    OpenType::Cmap cmap(otf.table("cmap"));
+    double emunits = head_data.u16(18);
+
+    // font opener
+    sa << "%!PS-TrueTypeFont-65536-" << head_data.u32(4) << "-1\n";
+    if (post.ok())
+        sa << "%%VMusage: " << post.mem_type42(false) << ' ' << post.mem_type42(true) << '\n';
+    sa << "11 dict begin\n";
+    sa << "/FontName /" << name.english_name(OpenType::Name::N_POSTSCRIPT) << " def\n";
+    sa << "/FontType 42 def\n";
+    sa << "/FontMatrix [1 0 0 1 0 0] def\n";
+    sa.snprintf(120, "/FontBBox [%g %g %g %g] readonly def\n",
+                head_data.s16(36) / emunits, head_data.s16(38) / emunits,
+                head_data.s16(40) / emunits, head_data.s16(42) / emunits);
+    sa << "/PaintType 0 def\n";
+
+    // XUID (MD5 sum of font data)
+    {
+        MD5_CONTEXT md5;
+        md5_init(&md5);
+        md5_update(&md5, (const unsigned char *) reduced_font.data(), reduced_font.length());
+        unsigned char result[MD5_DIGEST_SIZE + 3];
+        memset(result, 0, sizeof(result));
+        md5_final(result, &md5);
+        sa << "/XUID [42";
+        for (int i = 0; i < MD5_DIGEST_SIZE; i += 3)
+            sa.snprintf(20, " 16#%X", result[i] + result[i+1]*256 + result[i+2]*256*256);
+        sa << "] def\n";
+    }
+
+    // FontInfo dictionary
+    sa << "/FontInfo 10 dict dup begin\n";
+    for (const NameId *n = fontinfo_names; n->name; n++)
+        if (String s = name.english_name(n->nameid)) {
+            sa << '/' << n->name << " (";
+            for (const char *x = s.begin(); x < s.end(); x++)
+                if (*x == '(' || *x == '\\' || *x == ')')
+                    sa << '\\' << *x;
+                else if (*x == '\n' || (*x >= ' ' && *x <= '~'))
+                    sa << *x;
+                else
+                    sa.snprintf(5, "\\%03o", (unsigned char) *x);
+            sa << ") readonly def\n";
+        }
+    if (post.ok()) {
+        sa << "/isFixedPitch " << (post.is_fixed_pitch() ? "true" : "false") << " def\n";
+        sa.snprintf(40, "/ItalicAngle %g def\n", post.italic_angle());
+        sa.snprintf(60, "/UnderlinePosition %g def\n", (post.underline_position() - (post.underline_thickness() / 2)) / emunits);
+        sa.snprintf(60, "/UnderlineThickness %g def\n", post.underline_thickness() / emunits);
+    }
+    sa << "end readonly def\n";
+
+    // encoding
+    sa << "/Encoding 256 array\n0 1 255{1 index exch/.notdef put}for\n";
+    for (int i = 0; i < 256; i++)
+        if (OpenType::Glyph g = cmap.map_uni(i))
+            sa << "dup " << i << " /" << gn[g] << " put\n";
+    sa << "readonly def\n";
+
+    // print 'sfnts' array
+    OpenType::Data sfnts = reduced_font.data_string();
+    sa << "/sfnts[\n";
+    append_sfnts(sa, f, sfnts.substring(0, OpenType::Font::HEADER_SIZE + OpenType::Font::TABLE_DIR_ENTRY_SIZE * reduced_font.ntables()), false, reduced_font);
+    for (int i = 0; i < reduced_font.ntables(); i++) {
+        int off = OpenType::Font::HEADER_SIZE + OpenType::Font::TABLE_DIR_ENTRY_SIZE * i;
+        uint32_t offset = sfnts.u32(off + 8);
+        uint32_t length = (sfnts.u32(off + 12) + 3) & ~3;
+        append_sfnts(sa, f, sfnts.substring(offset, length), sfnts.u32(off) == 0x676C7966 /*glyf*/, reduced_font);
+    }
+    sa << "] def\n";
+
+    // print CharStrings data
+    sa << "/CharStrings " << ttbprog.nglyphs() << " dict dup begin\n";
+    for (int i = 0; i < gn.size(); i++)
+        sa << '/' << gn[i] << ' ' << i << " def\n";
+    sa << "end readonly def\n";
+
+    // complete font
+    sa << "FontName currentdict end definefont pop\n";
+
+    if (f) {
+        fwrite(sa.data(), 1, sa.length(), f);
+        sa.clear();
+    }
+    return true;
+}
+
+String
+create_type42_font(const OpenType::Font &otf, ErrorHandler *errh)
+{
+    StringAccum sa;
+    if (!make_type42_font(otf, sa, 0, errh))
+        return String();
+    return sa.take_string();
+}
+
+bool
+write_type42_font(const OpenType::Font &otf, FILE *f, ErrorHandler *errh)
+{
+    StringAccum sa;
+    return make_type42_font(otf, sa, f, errh);
+}
+
+}
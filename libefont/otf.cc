@@ -32,31 +32,64 @@ namespace Efont { namespace OpenType {
 Vector<PermString> debug_glyph_names;
 
 Font::Font(const String& s, ErrorHandler* errh)
-    : _str(s), _units_per_em(0) {
+    : _str(s), _units_per_em(0), _offset(0), _face(-1), _nfaces(0) {
     _str.align(4);
-    _error = parse_header(errh ? errh : ErrorHandler::silent_handler());
+    _error = parse_header(0, errh ? errh : ErrorHandler::silent_handler());
+}
+
+Font::Font(const String& s, int face, ErrorHandler* errh)
+    : _str(s), _units_per_em(0), _offset(0), _face(-1), _nfaces(0) {
+    _str.align(4);
+    _error = parse_header(face, errh ? errh : ErrorHandler::silent_handler());
 }
 
 int
-Font::parse_header(ErrorHandler *errh)
-{
+Font::parse_header(int face, ErrorHandler *errh)
+{
+    // COLLECTION HEADER FORMAT:
+    // Tag      'ttcf'
+    // USHORT   majorVersion
+    // USHORT   minorVersion
+    // ULONG    numFonts
+    // ULONG    offsetTable[numFonts]
+    // ...      (digital signature fields in version 2)
+    uint32_t len = length();
+    const uint8_t *data = this->data();
+    if (HEADER_SIZE > len)
+        return errh->error("OTF file corrupted (too small)"), -EFAULT;
+    if (data[0] == 't' && data[1] == 't' && data[2] == 'c' && data[3] == 'f') {
+        uint32_t nfaces = Data::u32_aligned(data + 8);
+        if (nfaces == 0)
+            return errh->error("font collection contains no fonts"), -EINVAL;
+        if (nfaces > (len - HEADER_SIZE) / 4 || nfaces > 0xFFFF)
+            return errh->error("font collection directory out of range"), -EFAULT;
+        _nfaces = nfaces;
+        if (face < 0 || face >= _nfaces)
+            return errh->error("no font %d in collection (it has %d)", face, _nfaces), -ENOENT;
+        _face = face;
+        _offset = Data::u32_aligned(data + HEADER_SIZE + 4 * face);
+        if (_offset > len - HEADER_SIZE || (_offset & 3))
+            return errh->error("font %d out of range", face), -EFAULT;
+    } else {
+        _nfaces = 1;
+        if (face != 0)
+            return errh->error("no font %d (not a font collection)", face), -ENOENT;
+    }
+
     // HEADER FORMAT:
     // Fixed    sfnt version
     // USHORT   numTables
     // USHORT   searchRange
     // USHORT   entrySelector
     // USHORT   rangeShift
-    int len = length();
-    const uint8_t *data = this->data();
-    if (HEADER_SIZE > len)
-        return errh->error("OTF file corrupted (too small)"), -EFAULT;
+    data = directory();
     if ((data[0] != 'O' || data[1] != 'T' || data[2] != 'T' || data[3] != 'O')
         && (data[0] != '\000' || data[1] != '\001'))
         return errh->error("not an OpenType font (bad magic number)"), -ERANGE;
     int ntables = Data::u16_aligned(data + 4);
     if (ntables == 0)
         return errh->error("OTF contains no tables"), -EINVAL;
-    if (HEADER_SIZE + TABLE_DIR_ENTRY_SIZE * ntables > len)
+    if (_offset + HEADER_SIZE + TABLE_DIR_ENTRY_SIZE * ntables > len)
         return errh->error("OTF table directory out of range"), -EFAULT;
 
     // TABLE DIRECTORY ENTRY FORMAT:
@@ -72,7 +105,7 @@ Font::parse_header(ErrorHandler *errh)
         uint32_t length = Data::u32_aligned(data + loc + 12);
         if (tag <= last_tag)
             return errh->error("tags out of order"), -EINVAL;
-        if (offset + length > (uint32_t) len)
+        if (offset > len || length > len - offset)
             return errh->error("OTF data for %<%s%> out of range", Tag(tag).text().c_str()), -EFAULT;
         if (Tag::head_tag() == tag) {
             Head head(_str.substring(offset, length));
@@ -92,7 +125,7 @@ Font::check_checksums(ErrorHandler *errh) const
     int nt = ntables();
     bool ok = true;
     for (int i = 0; i < nt; i++) {
-        const uint8_t *entry = data() + HEADER_SIZE + TABLE_DIR_ENTRY_SIZE * i;
+        const uint8_t *entry = directory() + HEADER_SIZE + TABLE_DIR_ENTRY_SIZE * i;
         String tbl = _str.substring(Data::u32_aligned(entry + 8),
                                     Data::u32_aligned(entry + 12));
         uint32_t sum = checksum(tbl);
@@ -114,7 +147,7 @@ Font::ntables() const
     if (error() < 0)
         return 0;
     else
-        return Data::u16_aligned(data() + 4);
+        return Data::u16_aligned(directory() + 4);
 }
 
 String
@@ -122,7 +155,7 @@ Font::table(Tag tag) const
 {
     if (error() < 0)
         return String();
-    const uint8_t *entry = tag.table_entry(data() + HEADER_SIZE, Data::u16_aligned(data() + 4), TABLE_DIR_ENTRY_SIZE);
+    const uint8_t *entry = tag.table_entry(directory() + HEADER_SIZE, Data::u16_aligned(directory() + 4), TABLE_DIR_ENTRY_SIZE);
     if (entry)
         return _str.substring(Data::u32_aligned(entry + 8), Data::u32_aligned(entry + 12));
     else
@@ -134,7 +167,7 @@ Font::has_table(Tag tag) const
 {
     const uint8_t *entry = 0;
     if (error() >= 0)
-        entry = tag.table_entry(data() + HEADER_SIZE, Data::u16_aligned(data() + 4), TABLE_DIR_ENTRY_SIZE);
+        entry = tag.table_entry(directory() + HEADER_SIZE, Data::u16_aligned(directory() + 4), TABLE_DIR_ENTRY_SIZE);
     return entry != 0;
 }
 
@@ -143,7 +176,7 @@ Font::table_checksum(Tag tag) const
 {
     if (error() < 0)
         return 0;
-    const uint8_t *entry = tag.table_entry(data() + HEADER_SIZE, Data::u16_aligned(data() + 4), TABLE_DIR_ENTRY_SIZE);
+    const uint8_t *entry = tag.table_entry(directory() + HEADER_SIZE, Data::u16_aligned(directory() + 4), TABLE_DIR_ENTRY_SIZE);
     if (entry)
         return Data::u32_aligned(entry + 4);
     else
@@ -156,7 +189,7 @@ Font::table_tag(int i) const
     if (error() < 0 || i < 0 || i >= ntables())
         return Tag();
     else
-        return Tag(Data::u32_aligned(data() + HEADER_SIZE + TABLE_DIR_ENTRY_SIZE * i));
+        return Tag(Data::u32_aligned(directory() + HEADER_SIZE + TABLE_DIR_ENTRY_SIZE * i));
 }
 
 uint32_t
@@ -748,10 +781,12 @@ FeatureList::lookups(const ScriptList &script_list, Tag script, Tag langsys, con
  **************************/
 
 Coverage::Coverage() noexcept
+    : _map_first(0)
 {
 }
 
 Coverage::Coverage(Glyph first, Glyph last) noexcept
+    : _map_first(0)
 {
     if (first <= last) {
         _str = String("\000\002\000\001\000\000\000\000\000\000", 10);
@@ -765,6 +800,7 @@ Coverage::Coverage(Glyph first, Glyph last) noexcept
 }
 
 Coverage::Coverage(const Vector<bool> &gmap) noexcept
+    : _map_first(0)
 {
     int end = gmap.size();
     while (end > 0 && !gmap[end - 1])
@@ -791,7 +827,7 @@ Coverage::Coverage(const Vector<bool> &gmap) noexcept
 }
 
 Coverage::Coverage(const String &str, ErrorHandler *errh, bool do_check) noexcept
-    : _str(str)
+    : _str(str), _map_first(0)
 {
     _str.align(2);
     if (do_check) {
@@ -863,6 +899,13 @@ Coverage::size() const noexcept
 int
 Coverage::coverage_index(Glyph g) const noexcept
 {
+    if (_map.length()) {
+        unsigned i = g - _map_first;
+        if (i < (unsigned) _map.length() / 2)
+            return reinterpret_cast<const uint16_t *>(_map.data())[i] - 1;
+        else
+            return -1;
+    }
     if (_str.length() == 0)
         return -1;
 
@@ -905,6 +948,55 @@ Coverage::coverage_index(Glyph g) const noexcept
         return -1;
 }
 
+// Build a native-endian array, indexed by glyph, of coverage indexes, so
+// later coverage_index() calls need not search the table. Returns the
+// number of bytes allocated, which is 0 if lookups are already fast, or
+// -1 if the array would need more than MAX_BYTES.
+int
+Coverage::accelerate(int max_bytes) noexcept
+{
+    if (_map.length() || _str.length() == 0 || _str.udata()[1] == T_X_BYTEMAP)
+        return 0;
+
+    const uint8_t *data = _str.udata();
+    int count = Data::u16_aligned(data + 2);
+    if (count == 0)
+        return 0;
+    int recsize = (data[1] == T_LIST ? LIST_RECSIZE : RANGES_RECSIZE);
+    Glyph first = 0xFFFF, last = 0;
+    for (int i = 0; i < count; i++) {
+        const uint8_t *rec = data + HEADERSIZE + i * recsize;
+        first = std::min(first, (Glyph) Data::u16_aligned(rec));
+        last = std::max(last, (Glyph) Data::u16_aligned(rec + (recsize == LIST_RECSIZE ? 0 : 2)));
+    }
+    if (first > last || (last - first + 1) * 2 > max_bytes)
+        return -1;
+
+    String map = String::make_uninitialized((last - first + 1) * 2);
+    map.align(2);
+    uint16_t *m = reinterpret_cast<uint16_t *>(map.mutable_data());
+    memset(m, 0, map.length());
+    // on duplicate entries, the first wins
+    for (int i = count - 1; i >= 0; i--) {
+        const uint8_t *rec = data + HEADERSIZE + i * recsize;
+        Glyph start = Data::u16_aligned(rec);
+        if (recsize == LIST_RECSIZE)
+            m[start - first] = i + 1;
+        else {
+            Glyph end = Data::u16_aligned(rec + 2);
+            int cindex = Data::u16_aligned(rec + 4);
+            if (cindex + end - start >= 0xFFFF)
+                return -1;
+            for (Glyph g = start; g <= end; g++)
+                m[g - first] = cindex + g - start + 1;
+        }
+    }
+
+    _map = map;
+    _map_first = first;
+    return _map.length();
+}
+
 Glyph
 Coverage::operator[](int cindex) const noexcept
 {
@@ -1238,7 +1330,7 @@ GlyphSet::operator=(const GlyphSet &o)
  **************************/
 
 ClassDef::ClassDef(const String &str, ErrorHandler *errh) noexcept
-    : _str(str)
+    : _str(str), _map_first(0)
 {
     _str.align(2);
     if (check(errh ? errh : ErrorHandler::silent_handler()) < 0)
@@ -1279,6 +1371,13 @@ ClassDef::check(ErrorHandler *errh)
 int
 ClassDef::lookup(Glyph g) const noexcept
 {
+    if (_map.length()) {
+        unsigned i = g - _map_first;
+        if (i < (unsigned) _map.length() / 2)
+            return reinterpret_cast<const uint16_t *>(_map.data())[i];
+        else
+            return 0;
+    }
     if (_str.length() == 0)
         return -1;
 
@@ -1310,6 +1409,60 @@ ClassDef::lookup(Glyph g) const noexcept
         return 0;
 }
 
+// Build a native-endian array, indexed by glyph, of classes, so later
+// lookup() calls need not search the table. Returns the number of bytes
+// allocated, which is 0 if there is nothing to do, or -1 if the array would
+// need more than MAX_BYTES.
+int
+ClassDef::accelerate(int max_bytes) noexcept
+{
+    if (_map.length() || _str.length() == 0)
+        return 0;
+
+    const uint8_t *data = _str.udata();
+    Glyph first, last;
+    int count;
+    if (data[1] == T_LIST) {
+        first = Data::u16_aligned(data + 2);
+        count = Data::u16_aligned(data + 4);
+        last = first + count - 1;
+    } else {
+        count = Data::u16_aligned(data + 2);
+        first = 0xFFFF, last = 0;
+        for (int i = 0; i < count; i++) {
+            const uint8_t *rec = data + RANGES_HEADERSIZE + i * RANGES_RECSIZE;
+            first = std::min(first, (Glyph) Data::u16_aligned(rec));
+            last = std::max(last, (Glyph) Data::u16_aligned(rec + 2));
+        }
+    }
+    if (count == 0 || first > last)
+        return 0;
+    if ((last - first + 1) * 2 > max_bytes)
+        return -1;
+
+    String map = String::make_uninitialized((last - first + 1) * 2);
+    map.align(2);
+    uint16_t *m = reinterpret_cast<uint16_t *>(map.mutable_data());
+    if (data[1] == T_LIST) {
+        for (int i = 0; i < count; i++)
+            m[i] = Data::u16_aligned(data + LIST_HEADERSIZE + i * LIST_RECSIZE);
+    } else {
+        memset(m, 0, map.length());
+        // on overlapping ranges, the first wins
+        for (int i = count - 1; i >= 0; i--) {
+            const uint8_t *rec = data + RANGES_HEADERSIZE + i * RANGES_RECSIZE;
+            Glyph end = Data::u16_aligned(rec + 2);
+            int c = Data::u16_aligned(rec + 4);
+            for (Glyph g = Data::u16_aligned(rec); g <= end; g++)
+                m[g - first] = c;
+        }
+    }
+
+    _map = map;
+    _map_first = first;
+    return _map.length();
+}
+
 void
 ClassDef::unparse(StringAccum &sa) const noexcept
 {
@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <efont/otfdata.hh>     // for ntohl()
 
 #define USHORT_AT(d)            (Data::u16_aligned(d))
@@ -28,6 +29,8 @@
 #define ULONG_AT(d)             (Data::u32_aligned(d))
 #define ULONG_AT2(d)            (Data::u32_aligned16(d))
 
+static const uint32_t MAX_UNICODE = 0x10FFFF;
+
 namespace Efont { namespace OpenType {
 
 Cmap::Cmap(const String &s, ErrorHandler *errh)
@@ -159,29 +162,31 @@ Cmap::check_table(int t, ErrorHandler *errh) const
       case F_BYTE:
         if (left < 4
             || (length = USHORT_AT(data + 2)) > left
-            || length != 259)
+            || length != 262)
             return errh->error("bad table %d length (format %d)", t, format);
         break;
 
       case F_HIBYTE:
         if (left < 4
             || (length = USHORT_AT(data + 2)) > left
-            || length < 524)
+            || length < HIBYTE_SUBHEADERS)
             return errh->error("bad table %d length (format %d)", t, format);
-        for (int hi_byte = 0; hi_byte < 256; hi_byte++)
-            if (uint32_t subh_key = USHORT_AT(data + 6 + 2 * hi_byte)) {
+        for (int hi_byte = 0; hi_byte < 256; hi_byte++) {
+            uint32_t subh_key = USHORT_AT(data + 6 + 2 * hi_byte);
+            if (subh_key || hi_byte == 0) {
                 if ((subh_key & 7) || HIBYTE_SUBHEADERS + subh_key + 8 > length)
                     return errh->error("bad table %d subheader %d offset (format 2)", t, hi_byte);
                 const uint8_t *subh = data + HIBYTE_SUBHEADERS + subh_key;
                 int firstCode = USHORT_AT(subh);
                 int entryCount = USHORT_AT(subh + 2);
                 int idRangeOffset = USHORT_AT(subh + 6);
-                if (firstCode + entryCount > 256 || entryCount == 0)
+                if (firstCode + entryCount > 256)
                     return errh->error("bad table %d subheader %d contents (format 2)", t, hi_byte);
                 if ((HIBYTE_SUBHEADERS + subh_key + 6) // pos[idRangeOffset]
                     + idRangeOffset + entryCount * 2 > length)
                     return errh->error("bad table %d subheader %d length (format 2)", t, hi_byte);
             }
+        }
         break;
 
       case F_SEGMENTED: {
@@ -245,7 +250,7 @@ Cmap::check_table(int t, ErrorHandler *errh) const
               || (length = ULONG_AT(data + 4)) > left
               || length < 16)
               return errh->error("bad table %d length (format %d)", t, format);
-          uint32_t nGroups = ULONG_AT(data + 16);
+          uint32_t nGroups = ULONG_AT(data + 12);
           if ((length - 16) / 12 < nGroups)
               return errh->error("bad table %d length (format %d)", t, format);
           uint32_t last_post_end = 0;
@@ -293,7 +298,7 @@ Cmap::map_table(int t, uint32_t uni, ErrorHandler *errh) const
         int subh = USHORT_AT(data + 6 + hi_byte * 2);
         if (subh == 0 && hi_byte) // XXX?
             return 0;
-        data += 524 + subh;
+        data += HIBYTE_SUBHEADERS + subh;
         int firstCode = USHORT_AT(data);
         int entryCount = USHORT_AT(data + 2);
         int idDelta = SHORT_AT(data + 4);
@@ -405,12 +410,11 @@ Cmap::dump_table(int t, Vector<std::pair<uint32_t, Glyph> > &ugp, ErrorHandler *
         break;
 
     case F_HIBYTE:
-        assert(USHORT_AT(data + 6) == 0);
         for (int hi_byte = 0; hi_byte < 256; hi_byte++) {
-            int subh = USHORT_AT(data + 6 + hi_byte * 4);
+            int subh = USHORT_AT(data + 6 + hi_byte * 2);
             if (subh == 0 && hi_byte > 0)
                 continue;
-            const uint8_t *tdata = data + 524 + subh;
+            const uint8_t *tdata = data + HIBYTE_SUBHEADERS + subh;
             int firstCode = USHORT_AT(tdata);
             int entryCount = USHORT_AT(tdata + 2);
             int idDelta = SHORT_AT(tdata + 4);
@@ -441,7 +445,7 @@ Cmap::dump_table(int t, Vector<std::pair<uint32_t, Glyph> > &ugp, ErrorHandler *
                     Glyph g = (u + idDelta) & 65535;
                     ugp.push_back(std::make_pair(u, g));
                 }
-            } else {
+            } else if (idRangeOffset != 65535) {
                 const uint8_t *gdata = idRangeOffsets + i + idRangeOffset;
                 for (uint32_t u = startCount; u <= endCount; ++u, gdata += 2)
                     if (Glyph g = USHORT_AT(gdata)) {
@@ -467,10 +471,10 @@ Cmap::dump_table(int t, Vector<std::pair<uint32_t, Glyph> > &ugp, ErrorHandler *
         const uint8_t *groups = data + 16;
         for (uint32_t i = 0; i < nGroups; i++, groups += 12) {
             uint32_t startCharCode = ULONG_AT2(groups);
-            uint32_t nCharCodes = ULONG_AT2(groups + 4) - startCharCode;
+            uint32_t endCharCode = std::min(ULONG_AT2(groups + 4), MAX_UNICODE);
             Glyph startGlyphID = ULONG_AT2(groups + 8);
-            for (uint32_t i = 0; i <= nCharCodes; i++)
-                ugp.push_back(std::make_pair(startCharCode + i, startGlyphID + i));
+            for (uint32_t u = startCharCode; u <= endCharCode; u++)
+                ugp.push_back(std::make_pair(u, startGlyphID + u - startCharCode));
         }
         break;
     }
@@ -480,10 +484,10 @@ Cmap::dump_table(int t, Vector<std::pair<uint32_t, Glyph> > &ugp, ErrorHandler *
         const uint8_t *groups = data + 16;
         for (uint32_t i = 0; i < nGroups; i++, groups += 12) {
             uint32_t startCharCode = ULONG_AT2(groups);
-            uint32_t nCharCodes = ULONG_AT2(groups + 4) - startCharCode;
+            uint32_t endCharCode = std::min(ULONG_AT2(groups + 4), MAX_UNICODE);
             Glyph glyphID = ULONG_AT2(groups + 8);
-            for (uint32_t i = 0; i <= nCharCodes; i++)
-                ugp.push_back(std::make_pair(startCharCode + i, glyphID));
+            for (uint32_t u = startCharCode; u <= endCharCode; u++)
+                ugp.push_back(std::make_pair(u, glyphID));
         }
         break;
     }
@@ -494,15 +498,64 @@ Cmap::dump_table(int t, Vector<std::pair<uint32_t, Glyph> > &ugp, ErrorHandler *
     }
 }
 
+void
+Cmap::accelerate() const
+{
+    Vector<std::pair<uint32_t, Glyph> > ugp;
+    dump_table(USE_BEST_UNICODE_TABLE, ugp, ErrorHandler::default_handler());
+
+    _bmp_pages.assign(256, 0);
+    _page_glyphs.assign(256, 0);
+    _supplementary.clear();
+    _unicodes.clear();
+    for (const std::pair<uint32_t, Glyph> *it = ugp.begin(); it != ugp.end(); ++it) {
+        uint32_t u = it->first;
+        Glyph g = it->second;
+        if (g <= 0)
+            continue;
+        if (u < 65536) {
+            int &page = _bmp_pages[u >> 8];
+            if (!page) {
+                page = _page_glyphs.size();
+                _page_glyphs.resize(page + 256, 0);
+            }
+            _page_glyphs[page + (u & 255)] = g;
+        } else
+            _supplementary.push_back(*it);
+        if (g > 65535)
+            continue;
+        if (g >= _unicodes.size())
+            _unicodes.resize(g + 1, 0);
+        if (!_unicodes[g] || u < _unicodes[g])
+            _unicodes[g] = u;
+    }
+    std::sort(_supplementary.begin(), _supplementary.end());
+}
+
+Glyph
+Cmap::map_supplementary(uint32_t uni) const
+{
+    int l = 0, r = _supplementary.size();
+    while (l < r) {
+        int m = l + (r - l) / 2;
+        if (uni < _supplementary[m].first)
+            r = m;
+        else if (uni == _supplementary[m].first)
+            return _supplementary[m].second;
+        else
+            l = m + 1;
+    }
+    return 0;
+}
+
 int
 Cmap::map_uni(const Vector<uint32_t> &vin, Vector<Glyph> &vout) const
 {
-    int t;
-    if ((t = check_table(USE_BEST_UNICODE_TABLE)) < 0)
+    if (check_table(USE_BEST_UNICODE_TABLE) < 0)
         return -1;
     vout.resize(vin.size(), 0);
     for (int i = 0; i < vin.size(); i++)
-        vout[i] = map_table(t, vin[i]);
+        vout[i] = map_uni(vin[i]);
     return 0;
 }
 
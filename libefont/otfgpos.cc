@@ -106,7 +106,7 @@ GposLookup::subtable(int i) const
 }
 
 bool
-GposLookup::unparse_automatics(Vector<Positioning> &v, ErrorHandler *errh) const
+GposLookup::unparse_automatics(Vector<Positioning> &v, const Coverage &limit, ErrorHandler *errh) const
 {
     int nlookup = _d.u16(4), success = 0;
     switch (_type) {
@@ -114,7 +114,7 @@ GposLookup::unparse_automatics(Vector<Positioning> &v, ErrorHandler *errh) const
         for (int i = 0; i < nlookup; i++)
             try {
                 GposSingle s(subtable(i));
-                s.unparse(v);
+                s.unparse(v, limit);
                 success++;
             } catch (Error e) {
                 if (errh)
@@ -125,7 +125,7 @@ GposLookup::unparse_automatics(Vector<Positioning> &v, ErrorHandler *errh) const
         for (int i = 0; i < nlookup; i++)
             try {
                 GposPair p(subtable(i));
-                p.unparse(v);
+                p.unparse(v, limit);
                 success++;
             } catch (Error e) {
                 if (errh)
@@ -162,18 +162,20 @@ GposSingle::coverage() const noexcept
 }
 
 void
-GposSingle::unparse(Vector<Positioning> &v) const
+GposSingle::unparse(Vector<Positioning> &v, const Coverage &limit) const
 {
     if (_d[1] == 1) {
         int format = _d.u16(4);
         Data value = _d.subtable(6);
         for (Coverage::iterator i = coverage().begin(); i; i++)
-            v.push_back(Positioning(Position(*i, format, value)));
+            if (limit.covers(*i))
+                v.push_back(Positioning(Position(*i, format, value)));
     } else {
         int format = _d.u16(4);
         int size = GposValue::size(format);
         for (Coverage::iterator i = coverage().begin(); i; i++)
-            v.push_back(Positioning(Position(*i, format, _d.subtable(F2_HEADERSIZE + size*i.coverage_index()))));
+            if (limit.covers(*i))
+                v.push_back(Positioning(Position(*i, format, _d.subtable(F2_HEADERSIZE + size*i.coverage_index()))));
     }
 }
 
@@ -201,8 +203,33 @@ GposPair::coverage() const noexcept
     return Coverage(_d.offset_subtable(2), 0, false);
 }
 
+// Sort the glyphs in GLYPHS by their CLASSDEF class. On return, class c's
+// glyphs are out[starts[c]] through out[starts[c+1] - 1], in glyph order.
+static void
+group_classes(const ClassDef &classdef, int nclass, const Coverage &glyphs,
+              Vector<int> &starts, Vector<Glyph> &out)
+{
+    Vector<Glyph> gs;
+    Vector<int> cs;
+    starts.assign(nclass + 1, 0);
+    for (Coverage::iterator i = glyphs.begin(); i; i++) {
+        int c = classdef.lookup(*i);
+        if (c >= 0 && c < nclass) {
+            gs.push_back(*i);
+            cs.push_back(c);
+            starts[c + 1]++;
+        }
+    }
+    for (int c = 0; c < nclass; c++)
+        starts[c + 1] += starts[c];
+    Vector<int> pos(starts);
+    out.assign(gs.size(), 0);
+    for (int i = 0; i < gs.size(); i++)
+        out[pos[cs[i]]++] = gs[i];
+}
+
 void
-GposPair::unparse(Vector<Positioning> &v) const
+GposPair::unparse(Vector<Positioning> &v, const Coverage &limit) const
 {
     if (_d[1] == 1) {
         int format1 = _d.u16(4);
@@ -210,12 +237,15 @@ GposPair::unparse(Vector<Positioning> &v) const
         int f2_pos = PAIRVALUE_HEADERSIZE + GposValue::size(format1);
         int pairvalue_size = f2_pos + GposValue::size(format2);
         for (Coverage::iterator i = coverage().begin(); i; i++) {
+            if (!limit.covers(*i))
+                continue;
             Data pairset = _d.offset_subtable(F1_HEADERSIZE + i.coverage_index()*F1_RECSIZE);
             int npair = pairset.u16(0);
             for (int j = 0; j < npair; j++) {
                 Data pair = pairset.subtable(PAIRSET_HEADERSIZE + j*pairvalue_size);
-                v.push_back(Positioning(Position(*i, format1, pair.subtable(PAIRVALUE_HEADERSIZE)),
-                                        Position(pair.u16(0), format2, pair.subtable(f2_pos))));
+                if (limit.covers(pair.u16(0)))
+                    v.push_back(Positioning(Position(*i, format1, pair.subtable(PAIRVALUE_HEADERSIZE)),
+                                            Position(pair.u16(0), format2, pair.subtable(f2_pos))));
             }
         }
     } else {                    // _d[1] == 2
@@ -225,18 +255,30 @@ GposPair::unparse(Vector<Positioning> &v) const
         int recsize = f2_pos + GposValue::size(format2);
         ClassDef class1(_d.offset_subtable(8));
         ClassDef class2(_d.offset_subtable(10));
-        Coverage coverage = this->coverage();
         int nclass1 = _d.u16(12);
         int nclass2 = _d.u16(14);
+
+        // Expand classes over LIMIT only, so a font with thousands of
+        // glyphs per class does not produce pairs nobody can use. This
+        // also lets us handle class 0 of class2, which is every glyph
+        // not assigned another class.
+        Vector<int> starts1, starts2;
+        Vector<Glyph> glyphs1, glyphs2;
+        group_classes(class1, nclass1, coverage() & limit, starts1, glyphs1);
+        group_classes(class2, nclass2, limit, starts2, glyphs2);
+
         int offset = F2_HEADERSIZE;
         for (int c1 = 0; c1 < nclass1; c1++)
             for (int c2 = 0; c2 < nclass2; c2++, offset += recsize) {
+                if (starts1[c1] == starts1[c1 + 1]
+                    || starts2[c2] == starts2[c2 + 1])
+                    continue;
                 Position p1(format1, _d.subtable(offset));
                 Position p2(format2, _d.subtable(offset + f2_pos));
                 if (p1 || p2) {
-                    for (ClassDef::class_iterator c1i = class1.begin(c1, coverage); c1i; c1i++)
-                        for (ClassDef::class_iterator c2i = class2.begin(c2); c2i; c2i++)
-                            v.push_back(Positioning(Position(*c1i, p1), Position(*c2i, p2)));
+                    for (int i1 = starts1[c1]; i1 < starts1[c1 + 1]; i1++)
+                        for (int i2 = starts2[c2]; i2 < starts2[c2 + 1]; i2++)
+                            v.push_back(Positioning(Position(glyphs1[i1], p1), Position(glyphs2[i2], p2)));
                 }
             }
     }
@@ -27,437 +27,204 @@
 
 namespace Efont { namespace OpenType {
 
+// Make room for NLEFT + NIN + NOUT + NRIGHT glyphs, discarding the old ones.
 void
-Substitution::clear(Substitute &s, uint8_t &t)
-{
-    switch (t) {
-      case T_GLYPHS:
-        delete[] s.gids;
-        break;
-      case T_COVERAGE:
-        delete s.coverage;
-        break;
-    }
-    t = T_NONE;
-}
-
-void
-Substitution::assign_space(Substitute &s, uint8_t &t, int n)
-{
-    clear(s, t);
-    if (n == 1)
-        t = T_GLYPH;
-    else if (n > 1) {
-        s.gids = new Glyph[n + 1];
-        s.gids[0] = n;
-        t = T_GLYPHS;
+Substitution::assign_space(int nleft, int nin, int nout, int nright)
+{
+    int n = nleft + nin + nout + nright;
+    if (_g != _inline && n <= INLINE_CAPACITY) {
+        delete[] _g;
+        _g = _inline;
+    } else if (n > INLINE_CAPACITY) {
+        if (_g != _inline)
+            delete[] _g;
+        _g = new Glyph[n];
     }
+    _nleft = nleft;
+    _nin = nin;
+    _nout = nout;
+    _nright = nright;
 }
 
-void
-Substitution::assign(Substitute &s, uint8_t &t, Glyph gid)
-{
-    clear(s, t);
-    s.gid = gid;
-    t = T_GLYPH;
-}
-
-void
-Substitution::assign(Substitute &s, uint8_t &t, int ngids, const Glyph *gids)
-{
-    clear(s, t);
-    assert(ngids > 0);
-    if (ngids == 1) {
-        s.gid = gids[0];
-        t = T_GLYPH;
-    } else {
-        s.gids = new Glyph[ngids + 1];
-        s.gids[0] = ngids;
-        memcpy(s.gids + 1, gids, ngids * sizeof(Glyph));
-        t = T_GLYPHS;
-    }
-}
-
-void
-Substitution::assign(Substitute &s, uint8_t &t, const Coverage &coverage)
-{
-    clear(s, t);
-    s.coverage = new Coverage(coverage);
-    t = T_COVERAGE;
-}
-
-void
-Substitution::assign(Substitute &s, uint8_t &t, const Substitute &os, uint8_t ot)
-{
-    if (&s == &os)
-        return;
-    switch (ot) {
-      case T_NONE:
-        clear(s, t);
-        break;
-      case T_GLYPH:
-        assign(s, t, os.gid);
-        break;
-      case T_GLYPHS:
-        assign(s, t, os.gids[0], os.gids + 1);
-        break;
-      case T_COVERAGE:
-        assign(s, t, *os.coverage);
-        break;
-      default:
-        assert(0);
-    }
+// Replace the NREMOVE glyphs at POS in the combined run with NINSERT
+// uninitialized glyphs, and return a pointer to them. The caller adjusts
+// the part counts.
+Glyph *
+Substitution::splice(int pos, int nremove, int ninsert)
+{
+    int n = nglyphs();
+    int new_n = n - nremove + ninsert;
+    if (new_n > INLINE_CAPACITY && (_g == _inline || ninsert > nremove)) {
+        Glyph *g = new Glyph[new_n];
+        memcpy(g, _g, pos * sizeof(Glyph));
+        memcpy(g + pos + ninsert, _g + pos + nremove, (n - pos - nremove) * sizeof(Glyph));
+        if (_g != _inline)
+            delete[] _g;
+        _g = g;
+    } else
+        memmove(_g + pos + ninsert, _g + pos + nremove, (n - pos - nremove) * sizeof(Glyph));
+    return _g + pos;
 }
 
 Substitution::Substitution(const Substitution &o)
-    : _left_is(T_NONE), _in_is(T_NONE), _out_is(T_NONE), _right_is(T_NONE),
-      _alternate(o._alternate)
+    : _g(_inline), _alternate(o._alternate)
 {
-    assign(_left, _left_is, o._left, o._left_is);
-    assign(_in, _in_is, o._in, o._in_is);
-    assign(_out, _out_is, o._out, o._out_is);
-    assign(_right, _right_is, o._right, o._right_is);
+    assign_space(o._nleft, o._nin, o._nout, o._nright);
+    memcpy(_g, o._g, nglyphs() * sizeof(Glyph));
 }
 
 Substitution::Substitution(Glyph in, Glyph out)
-    : _left_is(T_NONE), _in_is(T_GLYPH), _out_is(T_GLYPH), _right_is(T_NONE)
+    : _g(_inline), _nleft(0), _nin(1), _nout(1), _nright(0), _alternate(false)
 {
-    _in.gid = in;
-    _out.gid = out;
+    _g[0] = in;
+    _g[1] = out;
 }
 
 Substitution::Substitution(Glyph in, const Vector<Glyph> &out, bool is_alternate)
-    : _left_is(T_NONE), _in_is(T_GLYPH), _out_is(T_NONE), _right_is(T_NONE),
-      _alternate(is_alternate)
+    : _g(_inline), _alternate(is_alternate)
 {
     assert(out.size() > 0);
-    _in.gid = in;
-    assign(_out, _out_is, out.size(), &out[0]);
+    assign_space(0, 1, out.size(), 0);
+    _g[0] = in;
+    memcpy(_g + 1, out.begin(), out.size() * sizeof(Glyph));
 }
 
 Substitution::Substitution(Glyph in1, Glyph in2, Glyph out)
-    : _left_is(T_NONE), _in_is(T_GLYPHS), _out_is(T_GLYPH), _right_is(T_NONE)
+    : _g(_inline), _nleft(0), _nin(2), _nout(1), _nright(0), _alternate(false)
 {
-    _in.gids = new Glyph[3];
-    _in.gids[0] = 2;
-    _in.gids[1] = in1;
-    _in.gids[2] = in2;
-    _out.gid = out;
+    _g[0] = in1;
+    _g[1] = in2;
+    _g[2] = out;
 }
 
 Substitution::Substitution(const Vector<Glyph> &in, Glyph out)
-    : _left_is(T_NONE), _in_is(T_NONE), _out_is(T_GLYPH), _right_is(T_NONE)
+    : _g(_inline), _alternate(false)
 {
     assert(in.size() > 0);
-    assign(_in, _in_is, in.size(), &in[0]);
-    _out.gid = out;
+    assign_space(0, in.size(), 1, 0);
+    memcpy(_g, in.begin(), in.size() * sizeof(Glyph));
+    _g[in.size()] = out;
 }
 
 Substitution::Substitution(int nin, const Glyph *in, Glyph out)
-    : _left_is(T_NONE), _in_is(T_NONE), _out_is(T_GLYPH), _right_is(T_NONE)
+    : _g(_inline), _alternate(false)
 {
     assert(nin > 0);
-    assign(_in, _in_is, nin, in);
-    _out.gid = out;
+    assign_space(0, nin, 1, 0);
+    memcpy(_g, in, nin * sizeof(Glyph));
+    _g[nin] = out;
 }
 
 Substitution::Substitution(int nleft, int nin, int nout, int nright)
-    : _left_is(T_NONE), _in_is(T_NONE), _out_is(T_NONE), _right_is(T_NONE)
+    : _g(_inline), _alternate(false)
 {
-    if (nleft)
-        assign_space(_left, _left_is, nleft);
-    if (nin)
-        assign_space(_in, _in_is, nin);
-    if (nout)
-        assign_space(_out, _out_is, nout);
-    if (nright)
-        assign_space(_right, _right_is, nright);
-}
-
-Substitution::~Substitution()
-{
-    clear(_left, _left_is);
-    clear(_in, _in_is);
-    clear(_out, _out_is);
-    clear(_right, _right_is);
+    assign_space(nleft, nin, nout, nright);
 }
 
 Substitution &
 Substitution::operator=(const Substitution &o)
 {
-    assign(_left, _left_is, o._left, o._left_is);
-    assign(_in, _in_is, o._in, o._in_is);
-    assign(_out, _out_is, o._out, o._out_is);
-    assign(_right, _right_is, o._right, o._right_is);
-    _alternate = o._alternate;
-    return *this;
-}
-
-bool
-Substitution::substitute_in(const Substitute &s, uint8_t t, const Coverage &c)
-{
-    switch (t) {
-      case T_NONE:
-        return true;
-      case T_GLYPH:
-        return c.covers(s.gid);
-      case T_GLYPHS:
-        for (int i = 1; i <= s.gids[0]; i++)
-            if (!c.covers(s.gids[i]))
-                return false;
-        return true;
-      case T_COVERAGE:
-        return *s.coverage <= c;
-      default:
-        assert(0);
-        return false;
-    }
-}
-
-bool
-Substitution::substitute_in(const Substitute &s, uint8_t t, const GlyphSet &gs)
-{
-    switch (t) {
-      case T_NONE:
-        return true;
-      case T_GLYPH:
-        return gs.covers(s.gid);
-      case T_GLYPHS:
-        for (int i = 1; i <= s.gids[0]; i++)
-            if (!gs.covers(s.gids[i]))
-                return false;
-        return true;
-      case T_COVERAGE:
-        for (Coverage::iterator i = s.coverage->begin(); i; i++)
-            if (!gs.covers(*i))
-                return false;
-        return true;
-      default:
-        assert(0);
-        return false;
+    if (&o != this) {
+        assign_space(o._nleft, o._nin, o._nout, o._nright);
+        memcpy(_g, o._g, nglyphs() * sizeof(Glyph));
+        _alternate = o._alternate;
     }
+    return *this;
 }
 
 bool
 Substitution::context_in(const Coverage &c) const
 {
-    return substitute_in(_left, _left_is, c)
-        && substitute_in(_in, _in_is, c)
-        && substitute_in(_right, _right_is, c);
+    for (int i = 0; i < _nleft + _nin; i++)
+        if (!c.covers(_g[i]))
+            return false;
+    for (int i = _nleft + _nin + _nout; i < nglyphs(); i++)
+        if (!c.covers(_g[i]))
+            return false;
+    return true;
 }
 
 bool
 Substitution::context_in(const GlyphSet &gs) const
 {
-    return substitute_in(_left, _left_is, gs)
-        && substitute_in(_in, _in_is, gs)
-        && substitute_in(_right, _right_is, gs);
-}
-
-Glyph
-Substitution::extract_glyph(const Substitute &s, uint8_t t) noexcept
-{
-    return (t == T_GLYPH ? s.gid : 0);
-}
-
-Glyph
-Substitution::extract_glyph(const Substitute &s, int which, uint8_t t) noexcept
-{
-    switch (t) {
-      case T_GLYPH:
-        return (which == 0 ? s.gid : 0);
-      case T_GLYPHS:
-        return (s.gids[0] > which ? s.gids[which + 1] : 0);
-      case T_COVERAGE:
-        for (Coverage::iterator ci = s.coverage->begin(); ci; ci++, which--)
-            if (which == 0)
-                return *ci;
-        return 0;
-      default:
-        return 0;
-    }
-}
-
-bool
-Substitution::extract_glyphs(const Substitute &s, uint8_t t, Vector<Glyph> &v, bool coverage_ok) noexcept
-{
-    switch (t) {
-      case T_GLYPH:
-        v.push_back(s.gid);
-        return true;
-      case T_GLYPHS:
-        for (int i = 1; i <= s.gids[0]; i++)
-            v.push_back(s.gids[i]);
-        return true;
-      case T_COVERAGE:
-        if (coverage_ok) {
-            for (Coverage::iterator i = s.coverage->begin(); i; i++)
-                v.push_back(*i);
-            return true;
-        } else
+    for (int i = 0; i < _nleft + _nin; i++)
+        if (!gs.covers(_g[i]))
             return false;
-      default:
-        return false;
-    }
-}
-
-Glyph *
-Substitution::extract_glyphptr(const Substitute &s, uint8_t t) noexcept
-{
-    switch (t) {
-      case T_GLYPH:
-        return const_cast<Glyph *>(&s.gid);
-      case T_GLYPHS:
-        return &s.gids[1];
-      default:
-        return 0;
-    }
-}
-
-int
-Substitution::extract_nglyphs(const Substitute &s, uint8_t t, bool coverage_ok) noexcept
-{
-    switch (t) {
-      case T_GLYPH:
-        return 1;
-      case T_GLYPHS:
-        return s.gids[0];
-      case T_COVERAGE:
-        return (coverage_ok ? 1 : 0);
-      default:
-        return 0;
-    }
-}
-
-bool
-Substitution::matches(const Substitute &s, uint8_t t, int pos, Glyph g) noexcept
-{
-    switch (t) {
-      case T_GLYPH:
-        return (pos == 0 && s.gid == g);
-      case T_GLYPHS:
-        return (pos >= 0 && pos < s.gids[0] && s.gids[1 + pos] == g);
-      case T_COVERAGE:
-        return (pos == 0 && s.coverage->covers(g));
-      default:
-        return false;
-    }
+    for (int i = _nleft + _nin + _nout; i < nglyphs(); i++)
+        if (!gs.covers(_g[i]))
+            return false;
+    return true;
 }
 
 bool
 Substitution::is_noop() const
 {
-    return (_in_is == T_GLYPH && _out_is == T_GLYPH && _in.gid == _out.gid)
-        || (_in_is == T_GLYPHS && _out_is == T_GLYPHS
-            && _in.gids[0] == _out.gids[0]
-            && memcmp(_in.gids, _out.gids, (_in.gids[0] + 1) * sizeof(Glyph)) == 0);
+    return _nin > 0 && _nin == _nout
+        && memcmp(_g + _nleft, _g + _nleft + _nin, _nin * sizeof(Glyph)) == 0;
 }
 
 bool
 Substitution::all_in_glyphs(Vector<Glyph> &gs) const
 {
-    bool ok = true;
     gs.clear();
-    if (_left_is != T_NONE)
-        ok &= extract_glyphs(_left, _left_is, gs, false);
-    ok &= extract_glyphs(_in, _in_is, gs, false);
-    if (_right_is != T_NONE)
-        ok &= extract_glyphs(_right, _right_is, gs, false);
-    return ok;
+    for (int i = 0; i < _nleft + _nin; i++)
+        gs.push_back(_g[i]);
+    for (int i = _nleft + _nin + _nout; i < nglyphs(); i++)
+        gs.push_back(_g[i]);
+    return _nin > 0;
 }
 
 bool
 Substitution::all_out_glyphs(Vector<Glyph> &v) const
 {
-    bool ok = true;
-    if (_left_is != T_NONE)
-        ok &= extract_glyphs(_left, _left_is, v, false);
-    ok &= extract_glyphs(_out, _out_is, v, false);
-    if (_right_is != T_NONE)
-        ok &= extract_glyphs(_right, _right_is, v, false);
-    return ok;
-}
-
-void
-Substitution::assign_append(Substitute &s, uint8_t &t, const Substitute &ls, uint8_t lt, const Substitute &rs, uint8_t rt)
-{
-    if (lt == T_NONE)
-        assign(s, t, rs, rt);
-    else if (rt == T_NONE)
-        assign(s, t, ls, lt);
-    else if (lt != T_COVERAGE && rt != T_COVERAGE) {
-        int nl = extract_nglyphs(ls, lt, false);
-        int nr = extract_nglyphs(rs, rt, false);
-        Glyph *gids = new Glyph[nl + nr + 1];
-        gids[0] = nl + nr;
-        memcpy(&gids[1], extract_glyphptr(ls, lt), nl * sizeof(Glyph));
-        memcpy(&gids[1 + nl], extract_glyphptr(rs, rt), nr * sizeof(Glyph));
-        clear(s, t);
-        s.gids = gids;
-        t = T_GLYPHS;
-    } else
-        throw Error();
-}
-
-void
-Substitution::assign_append(Substitute &s, uint8_t &t, const Substitute &ls, uint8_t lt, Glyph rg)
-{
-    Substitute rs;
-    rs.gid = rg;
-    assign_append(s, t, ls, lt, rs, T_GLYPH);
+    for (int i = 0; i < _nleft; i++)
+        v.push_back(_g[i]);
+    for (int i = _nleft + _nin; i < nglyphs(); i++)
+        v.push_back(_g[i]);
+    return _nout > 0;
 }
 
 Substitution
 Substitution::in_out_append_glyph(Glyph g) const
 {
-    Substitution s;
-    assign(s._left, s._left_is, _left, _left_is);
-    assign(s._right, s._right_is, _right, _right_is);
-    assign_append(s._in, s._in_is, _in, _in_is, g);
-    assign_append(s._out, s._out_is, _out, _out_is, g);
+    Substitution s(_nleft, _nin + 1, _nout + 1, _nright);
+    int nli = _nleft + _nin;
+    memcpy(s._g, _g, nli * sizeof(Glyph));
+    s._g[nli] = g;
+    memcpy(s._g + nli + 1, _g + nli, _nout * sizeof(Glyph));
+    s._g[nli + 1 + _nout] = g;
+    memcpy(s._g + nli + 2 + _nout, _g + nli + _nout, _nright * sizeof(Glyph));
     return s;
 }
 
 void
 Substitution::add_outer_left(Glyph g)
 {
-    Substitute ls;
-    ls.gid = g;
-    assign_append(_left, _left_is, ls, T_GLYPH, _left, _left_is);
+    *splice(0, 0, 1) = g;
+    _nleft++;
 }
 
 void
 Substitution::remove_outer_left()
 {
-    if (_left_is == T_GLYPH)
-        _left_is = T_NONE;
-    else if (_left_is == T_GLYPHS) {
-        if (_left.gids[0] == 2)
-            assign(_left, _left_is, _left.gids[2]);
-        else {
-            _left.gids[0]--;
-            memmove(_left.gids + 1, _left.gids + 2, _left.gids[0] * sizeof(Glyph));
-        }
+    if (_nleft) {
+        splice(0, 1, 0);
+        _nleft--;
     }
 }
 
 void
 Substitution::add_outer_right(Glyph g)
 {
-    assign_append(_right, _right_is, _right, _right_is, g);
+    *splice(nglyphs(), 0, 1) = g;
+    _nright++;
 }
 
 void
 Substitution::remove_outer_right()
 {
-    if (_right_is == T_GLYPH)
-        _right_is = T_NONE;
-    else if (_right_is == T_GLYPHS) {
-        if (_right.gids[0] == 2)
-            assign(_right, _right_is, _right.gids[1]);
-        else
-            _right.gids[0]--;
-    }
+    if (_nright)
+        _nright--;
 }
 
 bool
@@ -468,7 +235,7 @@ Substitution::out_alter(const Substitution &o, int pos) noexcept
     const Glyph *out_g = o.out_glyphptr();
     int out_ng = o.out_nglyphs();
     int in_ng = o.in_nglyphs();
-    if (pos + in_ng > ng || out_ng == 0)
+    if (pos + in_ng > ng || out_ng == 0 || ng - in_ng + out_ng > 0xFFFF)
         return false;
 
     // check that input substitution actually matches us
@@ -477,15 +244,8 @@ Substitution::out_alter(const Substitution &o, int pos) noexcept
             return false;
 
     // actually change output
-    Vector<Glyph> new_g;
-    for (int i = 0; i < pos; i++)
-        new_g.push_back(g[i]);
-    for (int i = 0; i < out_ng; i++)
-        new_g.push_back(out_g[i]);
-    for (int i = pos + in_ng; i < ng; i++)
-        new_g.push_back(g[i]);
-    assign(_out, _out_is, new_g.size(), &new_g[0]);
-
+    memcpy(splice(_nleft + _nin + pos, in_ng, out_ng), out_g, out_ng * sizeof(Glyph));
+    _nout = ng - in_ng + out_ng;
     return true;
 }
 
@@ -499,19 +259,14 @@ unparse_glyphid(StringAccum &sa, Glyph gid, const Vector<PermString> *gns) noexc
 }
 
 void
-Substitution::unparse_glyphids(StringAccum &sa, const Substitute &s, uint8_t t, const Vector<PermString> *gns) noexcept
+Substitution::unparse_glyphids(StringAccum &sa, const Glyph *g, int n, const Vector<PermString> *gns) noexcept
 {
-    if (t == T_GLYPH)
-        unparse_glyphid(sa, s.gid, gns);
-    else if (t == T_GLYPHS) {
-        for (int i = 1; i <= s.gids[0]; i++) {
-            if (i != 1)
-                sa << ' ';
-            unparse_glyphid(sa, s.gids[i], gns);
-        }
-    } else if (t == T_COVERAGE)
-        sa << "<coverage>";
-    else
+    for (int i = 0; i < n; i++) {
+        if (i != 0)
+            sa << ' ';
+        unparse_glyphid(sa, g[i], gns);
+    }
+    if (n == 0)
         sa << "-";
 }
 
@@ -534,16 +289,16 @@ Substitution::unparse(StringAccum &sa, const Vector<PermString> *gns) const
         else
             sa << "UNKNOWN[";
 
-        if (_left_is != T_NONE) {
-            unparse_glyphids(sa, _left, _left_is, gns);
+        if (_nleft) {
+            unparse_glyphids(sa, _g, _nleft, gns);
             sa << " | ";
         }
-        unparse_glyphids(sa, _in, _in_is, gns);
+        unparse_glyphids(sa, _g + _nleft, _nin, gns);
         sa << " => ";
-        unparse_glyphids(sa, _out, _out_is, gns);
-        if (_right_is != T_NONE) {
+        unparse_glyphids(sa, _g + _nleft + _nin, _nout, gns);
+        if (_nright) {
             sa << " | ";
-            unparse_glyphids(sa, _right, _right_is, gns);
+            unparse_glyphids(sa, _g + _nleft + _nin + _nout, _nright, gns);
         }
 
         sa << ']';
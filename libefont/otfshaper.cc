@@ -0,0 +1,731 @@
+// -*- related-file-name: "../include/efont/otfshaper.hh" -*-
+
+/* otfshaper.{cc,hh} -- apply OpenType GSUB and GPOS features to glyphs
+ *
+ * Copyright (c) 2026 Eddie Kohler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <efont/otfshaper.hh>
+#include <lcdf/error.hh>
+#include <string.h>
+#include <algorithm>
+
+namespace Efont { namespace OpenType {
+
+namespace {
+
+enum { M_GLYPH, M_CLASS, M_COVERAGE };
+
+enum { F_IGNORE_BASE = 0x0002, F_IGNORE_LIGATURES = 0x0004,
+       F_IGNORE_MARKS = 0x0008, F_MARK_FILTERING_SET = 0x0010,
+       F_MARK_ATTACHMENT_TYPE = 0xFF00,
+       F_IGNORE = F_IGNORE_BASE | F_IGNORE_LIGATURES | F_IGNORE_MARKS
+                  | F_MARK_FILTERING_SET | F_MARK_ATTACHMENT_TYPE };
+
+enum { C_BASE = 1, C_LIGATURE = 2, C_MARK = 3 }; // GDEF glyph classes
+
+// The glyph buffer as one lookup sees it: glyphs the lookup's flags
+// exclude, according to their GDEF classes, are stepped over.
+struct GlyphRun {
+    const Vector<Glyph> &g;
+    uint16_t flags;
+    const ClassDef &classes;
+    const ClassDef &mark_classes;
+    const Coverage &mark_set;
+
+    GlyphRun(const Vector<Glyph> &g_, uint16_t flags_, const ClassDef &classes_,
+             const ClassDef &mark_classes_, const Coverage &mark_set_)
+        : g(g_), flags(flags_ & F_IGNORE), classes(classes_),
+          mark_classes(mark_classes_), mark_set(mark_set_) {
+    }
+
+    int size() const {
+        return g.size();
+    }
+    bool ignored(int pos) const {
+        if (!flags)
+            return false;
+        switch (classes.lookup(g[pos])) {
+        case C_BASE:
+            return flags & F_IGNORE_BASE;
+        case C_LIGATURE:
+            return flags & F_IGNORE_LIGATURES;
+        case C_MARK:
+            return (flags & F_IGNORE_MARKS)
+                || ((flags & F_MARK_ATTACHMENT_TYPE)
+                    && mark_classes.lookup(g[pos]) != (flags >> 8))
+                || ((flags & F_MARK_FILTERING_SET)
+                    && !mark_set.covers(g[pos]));
+        default:
+            return false;
+        }
+    }
+    // Return the first position after POS, in direction STEP, that isn't
+    // ignored; it may be out of range.
+    int next(int pos, int step) const {
+        do {
+            pos += step;
+        } while (pos >= 0 && pos < g.size() && ignored(pos));
+        return pos;
+    }
+};
+
+struct ContextMatch {
+    int end;                    // one past the last input glyph
+    int nrecords;
+    Data records;               // u16 sequence index, u16 lookup index
+};
+
+}
+
+// Return true if the COUNT values at D[OFFSET] match the glyphs at POS,
+// and onward in direction STEP, skipping ignored glyphs. The values are
+// glyphs, CLASSDEF classes, or offsets from D to coverage tables,
+// according to KIND. Sets *LAST to the last glyph matched.
+static bool
+match_sequence(const Data &d, int offset, int count, const GlyphRun &run,
+               int pos, int step, int kind, const ClassDef *classdef,
+               int *last = 0)
+{
+    for (int k = 0; k < count; k++, offset += 2) {
+        if (pos < 0 || pos >= run.size())
+            return false;
+        Glyph g = run.g[pos];
+        int v = d.u16(offset);
+        if (kind == M_GLYPH ? g != v
+            : kind == M_CLASS ? classdef->lookup(g) != v
+            : !Coverage(d.subtable(v)).covers(g))
+            return false;
+        if (last)
+            *last = pos;
+        if (k + 1 < count)
+            pos = run.next(pos, step);
+    }
+    return true;
+}
+
+/* Context rule: u16 ninput, u16 nrecords, input[], records[]
+   Chain context rule: u16 nbacktrack, backtrack[], u16 ninput, input[],
+     u16 nlookahead, lookahead[], u16 nrecords, records[]
+   Rules in rule sets omit the first input value, which the subtable's
+   coverage or class has already matched. Format 3 subtables are laid out
+   as rules with every input value present. */
+
+static bool
+match_context_rule(const Data &d, int offset, bool full_input, int kind,
+                   const ClassDef *classdef, const GlyphRun &run, int pos,
+                   ContextMatch &m)
+{
+    int ninput = d.u16(offset);
+    if (ninput < 1 || pos + ninput > run.size())
+        return false;
+    int input = offset + 4 + (full_input ? 2 : 0), last = pos;
+    if (!match_sequence(d, input, ninput - 1, run, run.next(pos, 1), 1, kind, classdef, &last))
+        return false;
+    m.end = last + 1;
+    m.nrecords = d.u16(offset + 2);
+    m.records = d.subtable(input + (ninput - 1) * 2);
+    return true;
+}
+
+static bool
+match_chain_rule(const Data &d, int offset, bool full_input, int kind,
+                 const ClassDef *classdefs, const GlyphRun &run, int pos,
+                 bool reverse_backtrack, ContextMatch &m)
+{
+    int nbacktrack = d.u16(offset);
+    int input = offset + 2 + nbacktrack * 2;
+    int ninput = d.u16(input);
+    if (ninput < 1)
+        return false;
+    int lookahead = input + 2 + (full_input ? ninput : ninput - 1) * 2;
+    int nlookahead = d.u16(lookahead);
+    if (pos < nbacktrack || pos + ninput + nlookahead > run.size())
+        return false;
+
+    // see Gsub::chaincontext_reverse_backtrack
+    const ClassDef *cd = classdefs;
+    if (reverse_backtrack) {
+        int first = pos;
+        for (int k = 0; k < nbacktrack; k++)
+            first = run.next(first, -1);
+        if (!match_sequence(d, offset + 2, nbacktrack, run, first, 1, kind, cd))
+            return false;
+    } else if (!match_sequence(d, offset + 2, nbacktrack, run, run.next(pos, -1), -1, kind, cd))
+        return false;
+    cd = (classdefs ? classdefs + 1 : 0);
+    int last = pos;
+    if (!match_sequence(d, input + (full_input ? 4 : 2), ninput - 1, run, run.next(pos, 1), 1, kind, cd, &last))
+        return false;
+    cd = (classdefs ? classdefs + 2 : 0);
+    if (!match_sequence(d, lookahead + 2, nlookahead, run, run.next(last, 1), 1, kind, cd))
+        return false;
+
+    int records = lookahead + 2 + nlookahead * 2;
+    m.end = last + 1;
+    m.nrecords = d.u16(records);
+    m.records = d.subtable(records + 2);
+    return true;
+}
+
+static bool
+context_rule_set(const Data &d, int offset, int i, Data &set)
+{
+    if (i < 0 || i >= d.u16(offset) || d.u16(offset + 2 + i*2) == 0)
+        return false;
+    set = d.offset_subtable(offset + 2 + i*2);
+    return true;
+}
+
+static bool
+match_rule_set(const Data &set, bool chain, int kind, const ClassDef *classdefs,
+               const GlyphRun &run, int pos, bool reverse_backtrack,
+               ContextMatch &m)
+{
+    int nrules = set.u16(0);
+    for (int r = 0; r < nrules; r++) {
+        Data rule = set.offset_subtable(2 + r*2);
+        if (chain
+            ? match_chain_rule(rule, 0, false, kind, classdefs, run, pos, reverse_backtrack, m)
+            : match_context_rule(rule, 0, false, kind, classdefs, run, pos, m))
+            return true;
+    }
+    return false;
+}
+
+// Match a GSUB or GPOS (chaining) context subtable at G[POS], whose
+// coverage index is CI. GSUB and GPOS share these formats. CLASSDEFS are
+// the subtable's class definitions, as loaded by Shaper::add_subtable.
+static bool
+match_context_subtable(const Data &d, int ci, bool chain, const ClassDef *classdefs,
+                       const GlyphRun &run, int pos, bool reverse_backtrack,
+                       ContextMatch &m)
+{
+    Data set;
+    switch (d.u16(0)) {
+    case 1:
+        return context_rule_set(d, 4, ci, set)
+            && match_rule_set(set, chain, M_GLYPH, 0, run, pos, reverse_backtrack, m);
+    case 2:
+        if (!chain)
+            return context_rule_set(d, 6, classdefs[0].lookup(run.g[pos]), set)
+                && match_rule_set(set, false, M_CLASS, classdefs, run, pos, reverse_backtrack, m);
+        else
+            return context_rule_set(d, 10, classdefs[1].lookup(run.g[pos]), set)
+                && match_rule_set(set, true, M_CLASS, classdefs, run, pos, reverse_backtrack, m);
+    case 3:
+        if (chain)
+            return match_chain_rule(d, 2, true, M_COVERAGE, 0, run, pos, reverse_backtrack, m);
+        else
+            return match_context_rule(d, 2, true, M_COVERAGE, 0, run, pos, m);
+    default:
+        return false;
+    }
+}
+
+
+/**************************
+ * Shaper                 *
+ *                        *
+ **************************/
+
+Shaper::Shaper(const Font &otf, ErrorHandler *errh)
+    : _gsub(0), _gpos(0), _reverse_backtrack(false), _nested_ops(0),
+      _accelerate_budget(ACCELERATE_BUDGET)
+{
+    if (String gsub_table = otf.table("GSUB"))
+        try {
+            _gsub = new Gsub(gsub_table, &otf, errh);
+            _gsub_lookups.resize(_gsub->nlookups());
+            _reverse_backtrack = _gsub->chaincontext_reverse_backtrack();
+        } catch (Error e) {
+            delete _gsub;
+            _gsub = 0;
+            _gsub_lookups.clear();
+            if (errh)
+                errh->error("%s", e.description.c_str());
+        }
+    if (String gpos_table = otf.table("GPOS"))
+        try {
+            _gpos = new Gpos(gpos_table, errh);
+            _gpos_lookups.resize(_gpos->nlookups());
+        } catch (Error e) {
+            delete _gpos;
+            _gpos = 0;
+            _gpos_lookups.clear();
+            if (errh)
+                errh->error("%s", e.description.c_str());
+        }
+    if (String gdef_table = otf.table("GDEF"))
+        try {
+            // u32 version, offset glyph classes, attachment list, ligature
+            // caret list, mark attachment classes, [1.2] mark glyph sets
+            Data gdef(gdef_table);
+            if (gdef.u16(4))
+                _glyph_classes = ClassDef(gdef.offset_subtable(4), errh);
+            if (gdef.u16(10))
+                _mark_classes = ClassDef(gdef.offset_subtable(10), errh);
+            if (gdef.u32(0) >= 0x00010002 && gdef.u16(12)) {
+                // u16 format, u16 count, u32 coverage offsets[]
+                Data sets = gdef.offset_subtable(12);
+                for (int i = 0; i < sets.u16(2); i++)
+                    _mark_sets.push_back(Coverage(sets.subtable(sets.u32(4 + i*4)), errh));
+            }
+            accelerate(_glyph_classes);
+        } catch (Error e) {
+            if (errh)
+                errh->error("GDEF: %s", e.description.c_str());
+        }
+}
+
+Shaper::~Shaper()
+{
+    delete _gsub;
+    delete _gpos;
+}
+
+int
+Shaper::set_features(Tag script, Tag langsys, const Vector<Tag> &features, ErrorHandler *errh)
+{
+    Vector<Tag> sorted_features(features);
+    std::sort(sorted_features.begin(), sorted_features.end());
+    int result = 0;
+
+    _gsub_plan.clear();
+    if (_gsub && _gsub->feature_list().lookups(_gsub->script_list(), script, langsys, sorted_features, _gsub_plan, errh) < 0) {
+        _gsub_plan.clear();
+        result = -1;
+    }
+    while (_gsub_plan.size() && _gsub_plan.back() >= _gsub_lookups.size())
+        _gsub_plan.pop_back();
+
+    _gpos_plan.clear();
+    if (_gpos && _gpos->feature_list().lookups(_gpos->script_list(), script, langsys, sorted_features, _gpos_plan, errh) < 0) {
+        _gpos_plan.clear();
+        result = -1;
+    }
+    while (_gpos_plan.size() && _gpos_plan.back() >= _gpos_lookups.size())
+        _gpos_plan.pop_back();
+
+    return result;
+}
+
+void
+Shaper::add_subtable(const Data &d, int type, int context_type, int chain_type, int pair_type)
+{
+    if (!d.length())
+        return;
+    // the coverage table that decides whether a glyph starts a match
+    int offset = 2;
+    if (type == context_type && d.u16(0) == 3)
+        offset = GsubContext::F3_HSIZE;
+    else if (type == chain_type && d.u16(0) == 3)
+        offset = GsubChainContext::F3_HSIZE + d.u16(2) * 2 + GsubChainContext::F3_INPUT_HSIZE;
+    Subtable s;
+    s.d = d;
+    s.coverage = Coverage(d.offset_subtable(offset));
+    if (!s.coverage.ok())
+        return;
+    accelerate(s.coverage);
+
+    // class definitions that matching consults for every glyph
+    int nclassdefs = 0, classdef_offset = 0;
+    if (d.u16(0) == 2 && (type == context_type || type == chain_type))
+        nclassdefs = (type == chain_type ? 3 : 1), classdef_offset = 4;
+    else if (d.u16(0) == 2 && type == pair_type)
+        nclassdefs = 2, classdef_offset = 8;
+    for (int i = 0; i < nclassdefs; i++) {
+        s.classdefs[i] = ClassDef(d.offset_subtable(classdef_offset + i*2));
+        accelerate(s.classdefs[i]);
+    }
+
+    _subtables.push_back(s);
+}
+
+// Convert a hot coverage or class table to a dense array while the
+// Shaper's memory budget lasts.
+template <typename T> void
+Shaper::accelerate(T &table)
+{
+    int n = table.accelerate(_accelerate_budget);
+    if (n > 0)
+        _accelerate_budget -= n;
+}
+
+const Shaper::Lookup &
+Shaper::gsub_lookup(int lookup_index)
+{
+    Lookup &l = _gsub_lookups[lookup_index];
+    if (l.type == 0) {
+        l.type = -1;
+        l.first_subtable = _subtables.size();
+        try {
+            GsubLookup lookup = _gsub->lookup(lookup_index);
+            for (int i = 0; i < lookup.nsubtables(); i++)
+                try {
+                    add_subtable(lookup.subtable(i), lookup.type(), GsubLookup::L_CONTEXT, GsubLookup::L_CHAIN, -1);
+                } catch (Error) {
+                }
+            if (lookup.type() > 0)
+                l.type = lookup.type();
+            l.flags = lookup.flags();
+            if ((l.flags & F_MARK_FILTERING_SET)
+                && lookup.mark_filtering_set() < _mark_sets.size())
+                l.mark_set = _mark_sets[lookup.mark_filtering_set()];
+        } catch (Error) {
+            _subtables.resize(l.first_subtable);
+        }
+        l.last_subtable = _subtables.size();
+    }
+    return l;
+}
+
+const Shaper::Lookup &
+Shaper::gpos_lookup(int lookup_index)
+{
+    Lookup &l = _gpos_lookups[lookup_index];
+    if (l.type == 0) {
+        l.type = -1;
+        l.first_subtable = _subtables.size();
+        try {
+            GposLookup lookup = _gpos->lookup(lookup_index);
+            for (int i = 0; i < lookup.nsubtables(); i++)
+                try {
+                    add_subtable(lookup.subtable(i), lookup.type(), GposLookup::L_CONTEXT, GposLookup::L_CHAIN, GposLookup::L_PAIR);
+                } catch (Error) {
+                }
+            if (lookup.type() > 0)
+                l.type = lookup.type();
+            l.flags = lookup.flags();
+            if ((l.flags & F_MARK_FILTERING_SET)
+                && lookup.mark_filtering_set() < _mark_sets.size())
+                l.mark_set = _mark_sets[lookup.mark_filtering_set()];
+        } catch (Error) {
+            _subtables.resize(l.first_subtable);
+        }
+        l.last_subtable = _subtables.size();
+    }
+    return l;
+}
+
+void
+Shaper::replace(int pos, int nin, const Glyph *out, int nout)
+{
+    int n = _glyphs.size();
+    if (nout > nin)
+        _glyphs.resize(n + nout - nin);
+    Glyph *g = _glyphs.begin();
+    memmove(g + pos + nout, g + pos + nin, (n - pos - nin) * sizeof(Glyph));
+    memcpy(g + pos, out, nout * sizeof(Glyph));
+    if (nout < nin)
+        _glyphs.resize(n + nout - nin);
+}
+
+// Apply GSUB lookup LOOKUP_INDEX at _glyphs[POS]. Returns -1 if the lookup
+// does not apply, or else the number of glyphs it left in place of the
+// ones it consumed.
+int
+Shaper::apply_gsub(int lookup_index, int pos, int depth)
+{
+    const Lookup &l = gsub_lookup(lookup_index);
+    Glyph g = _glyphs[pos];
+    if (depth == 0)
+        _nested_ops = MAX_NESTED_OPS;
+    if (l.flags & F_IGNORE) {
+        GlyphRun run(_glyphs, l.flags, _glyph_classes, _mark_classes, l.mark_set);
+        if (run.ignored(pos))
+            return -1;
+    }
+    for (int k = l.first_subtable; k < l.last_subtable; k++) {
+        int ci = _subtables[k].coverage.coverage_index(g);
+        if (ci >= 0) {
+            int nout = apply_gsub_subtable(l, k, ci, pos, depth);
+            if (nout >= 0)
+                return nout;
+        }
+    }
+    return -1;
+}
+
+int
+Shaper::apply_gsub_subtable(const Lookup &lookup, int subtable, int ci, int pos, int depth)
+{
+    // nested lookups can grow _subtables, so copy the data
+    Data d = _subtables[subtable].d;
+    GlyphRun run(_glyphs, lookup.flags, _glyph_classes, _mark_classes, lookup.mark_set);
+    int type = lookup.type;
+
+    switch (type) {
+
+    case GsubLookup::L_SINGLE:
+        if (d.u16(0) == 1)
+            _glyphs[pos] = (_glyphs[pos] + d.s16(4)) & 0xFFFF;
+        else
+            _glyphs[pos] = d.u16(GsubSingle::HEADERSIZE + ci*GsubSingle::FORMAT2_RECSIZE);
+        return 1;
+
+    case GsubLookup::L_MULTIPLE: {
+        Data seq = d.offset_subtable(GsubMultiple::HEADERSIZE + ci*GsubMultiple::RECSIZE);
+        int nout = seq.u16(0);
+        _scratch.resize(nout);
+        for (int i = 0; i < nout; i++)
+            _scratch[i] = seq.u16(GsubMultiple::SEQ_HEADERSIZE + i*GsubMultiple::SEQ_RECSIZE);
+        replace(pos, 1, _scratch.begin(), nout);
+        return nout;
+    }
+
+    case GsubLookup::L_ALTERNATE: {
+        // use the first alternate
+        Data alts = d.offset_subtable(GsubMultiple::HEADERSIZE + ci*GsubMultiple::RECSIZE);
+        if (alts.u16(0) == 0)
+            return -1;
+        _glyphs[pos] = alts.u16(GsubMultiple::SEQ_HEADERSIZE);
+        return 1;
+    }
+
+    case GsubLookup::L_LIGATURE: {
+        Data ligset = d.offset_subtable(GsubLigature::HEADERSIZE + ci*GsubLigature::RECSIZE);
+        int nligset = ligset.u16(0), n = _glyphs.size();
+        for (int j = 0; j < nligset; j++) {
+            Data lig = ligset.offset_subtable(GsubLigature::SET_HEADERSIZE + j*GsubLigature::SET_RECSIZE);
+            int ncomp = lig.u16(2);
+            if (ncomp < 1 || pos + ncomp > n)
+                continue;
+            int c = 1, last = pos;
+            for (; c < ncomp; c++) {
+                int next = run.next(last, 1);
+                if (next >= n
+                    || lig.u16(GsubLigature::LIG_HEADERSIZE + (c - 1)*GsubLigature::LIG_RECSIZE) != _glyphs[next])
+                    break;
+                last = next;
+            }
+            if (c == ncomp) {
+                // ignored glyphs between components follow the ligature
+                _scratch.resize(1);
+                _scratch[0] = lig.u16(0);
+                for (int i = pos + 1; i < last; i++)
+                    if (run.ignored(i))
+                        _scratch.push_back(_glyphs[i]);
+                int nout = _scratch.size();
+                replace(pos, last + 1 - pos, _scratch.begin(), nout);
+                return nout;
+            }
+        }
+        return -1;
+    }
+
+    case GsubLookup::L_CONTEXT:
+    case GsubLookup::L_CHAIN: {
+        ContextMatch m;
+        if (!match_context_subtable(d, ci, type == GsubLookup::L_CHAIN, _subtables[subtable].classdefs, run, pos, _reverse_backtrack, m))
+            return -1;
+        // sequence indexes refer to the input as changed by earlier records
+        int end = m.end;
+        for (int r = 0; r < m.nrecords; r++) {
+            int seq_index = m.records.u16(r*4);
+            int lookup_index = m.records.u16(r*4 + 2);
+            int seq_pos = pos;
+            for (int i = 0; i < seq_index && seq_pos < end; i++)
+                seq_pos = run.next(seq_pos, 1);
+            if (seq_pos < end && depth < MAX_NESTING
+                && lookup_index < _gsub_lookups.size() && --_nested_ops >= 0) {
+                int n = _glyphs.size();
+                apply_gsub(lookup_index, seq_pos, depth + 1);
+                end += _glyphs.size() - n;
+            }
+        }
+        return end - pos;
+    }
+
+    case GsubLookup::L_REVCHAIN: {
+        // u16 format, offset coverage, u16 nbacktrack, offset backtrack[],
+        // u16 nlookahead, offset lookahead[], u16 nsubst, glyph subst[]
+        if (d.u16(0) != 1)
+            return -1;
+        int nbacktrack = d.u16(4);
+        int lookahead = 6 + nbacktrack*2;
+        int nlookahead = d.u16(lookahead);
+        if (pos < nbacktrack || pos + 1 + nlookahead > _glyphs.size()
+            || !match_sequence(d, 6, nbacktrack, run, run.next(pos, -1), -1, M_COVERAGE, 0)
+            || !match_sequence(d, lookahead + 2, nlookahead, run, run.next(pos, 1), 1, M_COVERAGE, 0))
+            return -1;
+        _glyphs[pos] = d.u16(lookahead + 2 + nlookahead*2 + 2 + ci*2);
+        return 1;
+    }
+
+    default:
+        return -1;
+
+    }
+}
+
+void
+Shaper::adjust(int pos, uint16_t format, const Data &value)
+{
+    Position p(format, value);
+    Position &q = _positions[pos];
+    q.pdx += p.pdx;
+    q.pdy += p.pdy;
+    q.adx += p.adx;
+    q.ady += p.ady;
+}
+
+// Apply GPOS lookup LOOKUP_INDEX at _glyphs[POS]. Returns -1 if the lookup
+// does not apply, or else the number of glyphs it positioned.
+int
+Shaper::apply_gpos(int lookup_index, int pos, int depth)
+{
+    const Lookup &l = gpos_lookup(lookup_index);
+    Glyph g = _glyphs[pos];
+    if (depth == 0)
+        _nested_ops = MAX_NESTED_OPS;
+    if (l.flags & F_IGNORE) {
+        GlyphRun run(_glyphs, l.flags, _glyph_classes, _mark_classes, l.mark_set);
+        if (run.ignored(pos))
+            return -1;
+    }
+    for (int k = l.first_subtable; k < l.last_subtable; k++) {
+        int ci = _subtables[k].coverage.coverage_index(g);
+        if (ci >= 0) {
+            int n = apply_gpos_subtable(l, k, ci, pos, depth);
+            if (n >= 0)
+                return n;
+        }
+    }
+    return -1;
+}
+
+int
+Shaper::apply_gpos_subtable(const Lookup &lookup, int subtable, int ci, int pos, int depth)
+{
+    Data d = _subtables[subtable].d;
+    GlyphRun run(_glyphs, lookup.flags, _glyph_classes, _mark_classes, lookup.mark_set);
+    int type = lookup.type;
+
+    switch (type) {
+
+    case GposLookup::L_SINGLE: {
+        uint16_t format = d.u16(4);
+        if (d.u16(0) == 1)
+            adjust(pos, format, d.subtable(6));
+        else
+            adjust(pos, format, d.subtable(GposSingle::F2_HEADERSIZE + ci*GposValue::size(format)));
+        return 1;
+    }
+
+    case GposLookup::L_PAIR: {
+        int pos2 = run.next(pos, 1);
+        if (pos2 >= _glyphs.size())
+            return -1;
+        uint16_t format1 = d.u16(4), format2 = d.u16(6);
+        int size1 = GposValue::size(format1);
+        Glyph g2 = _glyphs[pos2];
+        // skip the second glyph only if it was adjusted
+        int nused = (format2 ? pos2 + 1 : pos2) - pos;
+        if (d.u16(0) == 1) {
+            // pair sets are sorted by second glyph
+            Data pairset = d.offset_subtable(GposPair::F1_HEADERSIZE + ci*GposPair::F1_RECSIZE);
+            int recsize = GposPair::PAIRVALUE_HEADERSIZE + size1 + GposValue::size(format2);
+            int l = 0, r = pairset.u16(0);
+            while (l < r) {
+                int m = l + (r - l) / 2;
+                int offset = GposPair::PAIRSET_HEADERSIZE + m*recsize;
+                Glyph g = pairset.u16(offset);
+                if (g2 < g)
+                    r = m;
+                else if (g2 > g)
+                    l = m + 1;
+                else {
+                    offset += GposPair::PAIRVALUE_HEADERSIZE;
+                    adjust(pos, format1, pairset.subtable(offset));
+                    adjust(pos2, format2, pairset.subtable(offset + size1));
+                    return nused;
+                }
+            }
+            return -1;
+        } else {
+            const ClassDef *classdefs = _subtables[subtable].classdefs;
+            int nclass1 = d.u16(12), nclass2 = d.u16(14);
+            int c1 = classdefs[0].lookup(_glyphs[pos]), c2 = classdefs[1].lookup(g2);
+            if (c1 < 0 || c1 >= nclass1 || c2 < 0 || c2 >= nclass2)
+                return -1;
+            int offset = GposPair::F2_HEADERSIZE + (c1*nclass2 + c2) * (size1 + GposValue::size(format2));
+            adjust(pos, format1, d.subtable(offset));
+            adjust(pos2, format2, d.subtable(offset + size1));
+            return nused;
+        }
+    }
+
+    case GposLookup::L_CONTEXT:
+    case GposLookup::L_CHAIN: {
+        ContextMatch m;
+        if (!match_context_subtable(d, ci, type == GposLookup::L_CHAIN, _subtables[subtable].classdefs, run, pos, _reverse_backtrack, m))
+            return -1;
+        for (int r = 0; r < m.nrecords; r++) {
+            int seq_index = m.records.u16(r*4);
+            int lookup_index = m.records.u16(r*4 + 2);
+            int seq_pos = pos;
+            for (int i = 0; i < seq_index && seq_pos < m.end; i++)
+                seq_pos = run.next(seq_pos, 1);
+            if (seq_pos < m.end && depth < MAX_NESTING
+                && lookup_index < _gpos_lookups.size() && --_nested_ops >= 0)
+                apply_gpos(lookup_index, seq_pos, depth + 1);
+        }
+        return m.end - pos;
+    }
+
+    default:
+        return -1;
+
+    }
+}
+
+void
+Shaper::shape(const Glyph *glyphs, int nglyphs)
+{
+    _glyphs.resize(nglyphs);
+    memcpy(_glyphs.begin(), glyphs, nglyphs * sizeof(Glyph));
+
+    // A malformed lookup stops where it is; the buffer stays consistent.
+    for (const int *lp = _gsub_plan.begin(); lp != _gsub_plan.end(); ++lp)
+        try {
+            if (gsub_lookup(*lp).type == GsubLookup::L_REVCHAIN) {
+                for (int pos = _glyphs.size() - 1; pos >= 0; pos--)
+                    apply_gsub(*lp, pos, 0);
+            } else {
+                for (int pos = 0; pos < _glyphs.size(); ) {
+                    int nout = apply_gsub(*lp, pos, 0);
+                    pos += (nout < 0 ? 1 : nout);
+                }
+            }
+        } catch (Error) {
+        }
+
+    _positions.resize(_glyphs.size());
+    for (int i = 0; i < _glyphs.size(); i++)
+        _positions[i] = Position(_glyphs[i], 0, 0, 0, 0);
+
+    for (const int *lp = _gpos_plan.begin(); lp != _gpos_plan.end(); ++lp)
+        try {
+            for (int pos = 0; pos < _glyphs.size(); ) {
+                int n = apply_gpos(*lp, pos, 0);
+                pos += (n <= 0 ? 1 : n);
+            }
+        } catch (Error) {
+        }
+}
+
+}}
+
+#include <lcdf/vector.cc>
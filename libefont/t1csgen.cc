@@ -426,30 +426,41 @@ Type1CharstringGenInterp::act_hintmask(int cmd, const unsigned char *data, int n
         if (_state == S_INITIAL)
             gen_sbw(true);
         _csgen.append_charstring(hints);
-    } else if (_hr_storage && hints != _last_hints) {
+    } else if (hints != _last_hints) {
         _last_hints = hints;
         hints += (char)(Cs::cReturn);
-
-        int subrno = -1, nsubrs = _hr_storage->nsubrs();
-        for (int i = _hr_firstsubr; i < nsubrs; i++)
-            if (Type1Subr *s = _hr_storage->subr_x(i))
-                if (s->t1cs() == hints) {
-                    subrno = i;
-                    break;
-                }
-
-        if (subrno < 0 && _hr_storage->set_subr(nsubrs, Type1Charstring(hints)))
-            subrno = nsubrs;
-
-        if (subrno >= 0) {
+        if (gen_hint_replacement(hints)) {
             _had_hr = true;
-            _csgen.gen_number(subrno);
             _csgen.gen_number(4);
             _csgen.gen_command(Cs::cCallsubr);
         }
     }
 }
 
+bool
+Type1CharstringGenInterp::gen_hint_replacement(const String &hints)
+{
+    // Generate the number of a subroutine containing "hints", or return
+    // false if there is nowhere to store one.
+    if (!_hr_storage)
+        return false;
+
+    int subrno = -1, nsubrs = _hr_storage->nsubrs();
+    for (int i = _hr_firstsubr; i < nsubrs; i++)
+        if (Type1Subr *s = _hr_storage->subr_x(i))
+            if (s->t1cs() == hints) {
+                subrno = i;
+                break;
+            }
+
+    if (subrno < 0 && _hr_storage->set_subr(nsubrs, Type1Charstring(hints)))
+        subrno = nsubrs;
+
+    if (subrno >= 0)
+        _csgen.gen_number(subrno);
+    return subrno >= 0;
+}
+
 void
 Type1CharstringGenInterp::act_line(int cmd, const Point &a, const Point &b)
 {
@@ -617,6 +628,7 @@ Type1CharstringGenInterp::run(const CharstringContext &g, Type1Charstring &out)
 {
     _width = Point(0, 0);
     _csgen.clear();
+    _last_hints = String();
     swap_stem_hints();
     _state = S_INITIAL;
     _in_hr = false;
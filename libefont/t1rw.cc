@@ -24,14 +24,23 @@
 #include <string.h>
 namespace Efont {
 
+// xvalue[C] is C's value as a hex digit (0 for non-digits), or XSPACE if C
+// is whitespace.  xvalue[-1] (EOF) is 0.
 unsigned char Type1Reader::xvalue_store[257];
 unsigned char *Type1Reader::xvalue = &Type1Reader::xvalue_store[1];
+#define XSPACE 16
 
 void
 Type1Reader::static_initialize()
 {
     // rely on static data being initialized to 0
     if (!xvalue[(unsigned char) 'A']) {
+        xvalue[(unsigned char) ' '] = XSPACE;
+        xvalue[(unsigned char) '\t'] = XSPACE;
+        xvalue[(unsigned char) '\n'] = XSPACE;
+        xvalue[(unsigned char) '\v'] = XSPACE;
+        xvalue[(unsigned char) '\f'] = XSPACE;
+        xvalue[(unsigned char) '\r'] = XSPACE;
         xvalue[(unsigned char) '0'] = 0;
         xvalue[(unsigned char) '1'] = 1;
         xvalue[(unsigned char) '2'] = 2;
@@ -60,6 +69,8 @@ Type1Reader::static_initialize()
 
 Type1Reader::Type1Reader()
     : _data(new unsigned char[DATA_SIZE]), _len(0), _pos(0),
+      _plain(0), _plain_end(0), _plain_len(0), _plain_pos(0), _plain_cap(0),
+      _plain_start(0),
       _ungot(-1), _eexec(false)
 {
     static_initialize();
@@ -68,6 +79,8 @@ Type1Reader::Type1Reader()
 Type1Reader::~Type1Reader()
 {
     delete[] _data;
+    delete[] _plain;
+    delete[] _plain_end;
 }
 
 
@@ -101,7 +114,14 @@ Type1Reader::switch_eexec(bool on, unsigned char *data, int len)
         memcpy(_data + _pos - len, data, len);
         _pos -= len;
         start_eexec(original_pos - _pos);
+    } else if (_eexec) {
+        // give back the raw data behind any unread decrypted bytes
+        if (_plain_pos < _plain_len && _binary_eexec)
+            _pos = _plain_start + _plain_pos;
+        else if (_plain_pos < _plain_len)
+            _pos = _plain_end[_plain_pos - 1];
     }
+    _plain_len = _plain_pos = 0;
     _eexec = on;
 }
 
@@ -118,6 +138,21 @@ Type1Reader::more_data()
 }
 
 
+// Read more raw data, keeping the last KEEP bytes of the current buffer.
+bool
+Type1Reader::fill_data(int keep)
+{
+    if (_len < 0)
+        return false;
+    assert(keep >= 0 && keep < DATA_SIZE && keep <= _len);
+    memmove(_data, _data + _len - keep, keep);
+    _pos = 0;
+    int len = more_data(_data + keep, DATA_SIZE - keep);
+    _len = (len < 0 ? -1 : keep + len);
+    return len >= 0;
+}
+
+
 inline int
 Type1Reader::get_base()
 {
@@ -141,11 +176,11 @@ int
 Type1Reader::ascii_eexec_get()
 {
     int d1 = get_base();
-    while (isspace(d1))
+    while (xvalue[d1] == XSPACE)
         d1 = get_base();
 
     int d2 = get_base();
-    while (isspace(d2))
+    while (xvalue[d2] == XSPACE)
         d2 = get_base();
     if (d2 < 0)
         return -1;
@@ -154,18 +189,109 @@ Type1Reader::ascii_eexec_get()
 }
 
 
+void
+Type1Reader::reserve_plain(int n)
+{
+    if (n > _plain_cap) {
+        delete[] _plain;
+        delete[] _plain_end;
+        _plain_cap = (n > DATA_SIZE ? n : DATA_SIZE);
+        _plain = new unsigned char[_plain_cap];
+        _plain_end = new int[_plain_cap];
+    }
+}
+
+/* Eexec data is decrypted a block at a time, rather than a byte at a time
+   in get(), so that next_line() and get_data() can copy whole runs of
+   decrypted bytes.  switch_eexec(false) backs up to the raw data behind the
+   first unread decrypted byte. */
+
+int
+Type1Reader::more_plain()
+{
+    _plain_len = _plain_pos = 0;
+    int r = _r;
+
+    if (_binary_eexec) {
+        if (_pos >= _len && !fill_data(0))
+            return -1;
+        reserve_plain(_len - _pos);
+        const unsigned char *d = _data + _pos;
+        unsigned char *x = _plain;
+        for (int p = _pos; p < _len; p++, d++, x++) {
+            *x = *d ^ (r >> 8);
+            r = ((*d + r) * (uint32_t) t1C1 + t1C2) & 0xFFFF;
+        }
+        _plain_len = _len - _pos;
+        _plain_start = _pos;
+        _pos = _len;
+
+    } else {
+        while (1) {
+            reserve_plain((_len - _pos) / 2 + 1);
+            int p = _pos;
+            while (1) {
+                while (p < _len && xvalue[_data[p]] == XSPACE)
+                    p++;
+                int p1 = p++;
+                while (p < _len && xvalue[_data[p]] == XSPACE)
+                    p++;
+                if (p >= _len) {
+                    // leave an unpaired digit for the next block
+                    p = p1;
+                    break;
+                }
+                unsigned char c = (xvalue[_data[p1]] << 4) | xvalue[_data[p]];
+                p++;
+                _plain[_plain_len] = c ^ (r >> 8);
+                _plain_end[_plain_len] = p;
+                _plain_len++;
+                r = ((c + r) * (uint32_t) t1C1 + t1C2) & 0xFFFF;
+            }
+            if (_plain_len) {
+                _pos = _plain_end[_plain_len - 1];
+                break;
+            }
+            // keep only the unpaired digit, not any whitespace after it
+            int keep = 0;
+            if (p < _len) {
+                _data[_len - 1] = _data[p];
+                keep = 1;
+            }
+            if (!fill_data(keep))
+                return -1;
+        }
+    }
+
+    _r = r;
+    return _plain[_plain_pos++];
+}
+
+
 inline int
 Type1Reader::get()
 {
     if (!_eexec)
         return get_base();
+    else if (_plain_pos < _plain_len)
+        return _plain[_plain_pos++];
+    else
+        return more_plain();
+}
 
-    else if (_binary_eexec) {
-        int c = get_base();
-        return c < 0 ? c : eexec(c);
 
-    } else
-        return ascii_eexec_get();
+// Append buffered characters up to the next line ending.
+inline void
+Type1Reader::append_line(StringAccum &s)
+{
+    const unsigned char *buf = (_eexec ? _plain : _data);
+    int &pos = (_eexec ? _plain_pos : _pos);
+    int len = (_eexec ? _plain_len : _len);
+    int p = pos;
+    while (p < len && buf[p] != '\n' && buf[p] != '\r')
+        p++;
+    s.append(reinterpret_cast<const char *>(buf + pos), p - pos);
+    pos = p;
 }
 
 
@@ -263,11 +389,6 @@ Type1Reader::test_charstring(StringAccum &str)
 }
 
 
-/* PERFORMANCE NOTE: All kinds of speedup tricks tried with eexec -- buffering
-   (doing eexec processing at more_data time), etc., and all this stuff -- and
-   found to have essentially zero effect for PFB fonts. Now, it might be
-   effective for PFAs; but who cares? I hate PFAs. */
-
 bool
 Type1Reader::next_line(StringAccum &s)
 {
@@ -306,6 +427,7 @@ Type1Reader::next_line(StringAccum &s)
           normal:
           default:
             s.append((char)c);
+            append_line(s);
             break;
 
         }
@@ -330,11 +452,25 @@ Type1Reader::get_data(unsigned char *data, int len)
         _ungot = -1;
     }
 
-    for (; pos < len; pos++) {
-        int c = get();
-        if (c < 0)
-            break;
-        *data++ = c;
+    while (pos < len) {
+        // copy buffered data in bulk
+        const unsigned char *buf = (_eexec ? _plain : _data);
+        int &bufpos = (_eexec ? _plain_pos : _pos);
+        int n = (_eexec ? _plain_len : _len) - bufpos;
+        if (n > 0) {
+            if (n > len - pos)
+                n = len - pos;
+            memcpy(data, buf + bufpos, n);
+            data += n;
+            pos += n;
+            bufpos += n;
+        } else {
+            int c = get();
+            if (c < 0)
+                break;
+            *data++ = c;
+            pos++;
+        }
     }
 
     return pos;
@@ -450,15 +586,6 @@ Type1Writer::~Type1Writer()
 }
 
 
-inline unsigned char
-Type1Writer::eexec(int p)
-{
-    unsigned char c = ((unsigned char)p ^ (_r >> 8)) & 0xFF;
-    _r = ((c + _r) * (uint32_t) t1C1 + t1C2) & 0xFFFF;
-    return c;
-}
-
-
 void
 Type1Writer::flush()
 {
@@ -468,15 +595,25 @@ Type1Writer::flush()
 
 /* PERFORMANCE NOTE: Doing eexec processing during flush -- which streamlines
    code for the print() methods -- seems to save some time (4-5%). It also
-   makes write performance more consistent. But I have mixed feelings. */
+   makes write performance more consistent. But I have mixed feelings.
+   Each ciphertext byte feeds the next key, so the loop can't be vectorized;
+   keeping the key in a local at least keeps it in a register. */
 
 void
 Type1Writer::local_flush()
 {
     if (_eexec_start >= 0 && _eexec_end < 0)
         _eexec_end = _pos;
-    for (int p = _eexec_start; p < _eexec_end; p++)
-        _buf[p] = eexec(_buf[p]);
+    if (_eexec_start >= 0) {
+        uint32_t r = _r;
+        unsigned char *x = _buf + _eexec_start, *end = _buf + _eexec_end;
+        for (; x < end; x++) {
+            unsigned char c = *x ^ (r >> 8);
+            r = ((c + r) * (uint32_t) t1C1 + t1C2) & 0xFFFF;
+            *x = c;
+        }
+        _r = r;
+    }
     print0(_buf, _pos);
     _pos = 0;
     _eexec_start = _eexec ? 0 : -1;
@@ -560,14 +697,27 @@ void
 Type1PFAWriter::print0(const unsigned char *c, int l)
 {
     if (eexecing()) {
-        const char *hex = "0123456789ABCDEF";
-        for (; l; c++, l--) {
-            putc(hex[*c / 16], _f);
-            putc(hex[*c % 16], _f);
-            if (++_hex_line == 39) {
-                putc('\n', _f);
-                _hex_line = 0;
+        // hex-encode into a local buffer, 39 bytes (78 digits) per line
+        static const char hex[] = "0123456789ABCDEF";
+        char buf[4096];
+        while (l > 0) {
+            char *x = buf;
+            while (l > 0 && x + 80 <= buf + sizeof(buf)) {
+                int n = 39 - _hex_line;
+                if (n > l)
+                    n = l;
+                for (const unsigned char *end = c + n; c < end; c++, x += 2) {
+                    x[0] = hex[*c >> 4];
+                    x[1] = hex[*c & 15];
+                }
+                l -= n;
+                if ((_hex_line += n) == 39) {
+                    *x++ = '\n';
+                    _hex_line = 0;
+                }
             }
+            ssize_t result = fwrite(buf, 1, x - buf, _f);
+            (void) result;
         }
     } else {
         ssize_t result = fwrite(c, 1, l, _f);
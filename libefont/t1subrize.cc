@@ -0,0 +1,442 @@
+// -*- related-file-name: "../include/efont/t1subrize.hh" -*-
+
+/* t1subrize.{cc,hh} -- add subroutines to Type 1 fonts
+ *
+ * Copyright (c) 2026 Eddie Kohler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <efont/t1subrize.hh>
+#include <efont/t1csgen.hh>
+#include <lcdf/hashmap.hh>
+#include <lcdf/straccum.hh>
+#include <algorithm>
+
+namespace Efont {
+
+namespace {
+
+// A command group is a command with all its operands.  Groups that must
+// not move to a subroutine get IDs that occur only once.
+
+enum { G_MOVABLE, G_BARRIER, G_FLEX_BEGIN, G_FLEX_END };
+
+int
+number_length(int n)
+{
+    if (n >= -107 && n <= 107)
+        return 1;
+    else if (n >= -1131 && n <= 1131)
+        return 2;
+    else
+        return 5;
+}
+
+int
+scan_group(const uint8_t *data, int pos, int len, int first_subr, int &end)
+{
+    int nnum = 0, last = -1, cmd = -1;
+    while (pos < len) {
+        int v = data[pos];
+        if (v >= 32) {
+            if (v <= 246) {
+                last = v - 139;
+                pos++;
+            } else if (v <= 250 && pos + 1 < len) {
+                last = ((v - 247) << 8) + data[pos + 1] + 108;
+                pos += 2;
+            } else if (v <= 254 && pos + 1 < len) {
+                last = -((v - 251) << 8) - data[pos + 1] - 108;
+                pos += 2;
+            } else if (v == 255 && pos + 4 < len) {
+                last = (int) (((uint32_t) data[pos + 1] << 24) | (data[pos + 2] << 16) | (data[pos + 3] << 8) | data[pos + 4]);
+                pos += 5;
+            } else
+                break;
+            nnum++;
+        } else if (v == Charstring::cEscape) {
+            if (pos + 1 >= len)
+                break;
+            cmd = Charstring::cEscapeDelta + data[pos + 1];
+            pos += 2;
+            if (cmd != Charstring::cDiv)
+                goto found;
+        } else {
+            cmd = v;
+            pos++;
+            goto found;
+        }
+    }
+    end = len;
+    return G_BARRIER;
+
+  found:
+    end = pos;
+    switch (cmd) {
+      case Charstring::cCallsubr:
+        // A callsubr without a literal operand takes its subroutine number
+        // from the stack, as in hint replacement's "callothersubr pop
+        // callsubr"; it is neither movable nor part of a flex.
+        if (nnum == 0)
+            return G_BARRIER;
+        else if (nnum == 1 && last >= first_subr)
+            return G_MOVABLE;
+        else if (last == 1)
+            return G_FLEX_BEGIN;
+        else if (last == 0)
+            return G_FLEX_END;
+        else
+            return G_BARRIER;
+      case Charstring::cHstem:
+      case Charstring::cVstem:
+      case Charstring::cVmoveto:
+      case Charstring::cRlineto:
+      case Charstring::cHlineto:
+      case Charstring::cVlineto:
+      case Charstring::cRrcurveto:
+      case Charstring::cClosepath:
+      case Charstring::cRmoveto:
+      case Charstring::cHmoveto:
+      case Charstring::cVhcurveto:
+      case Charstring::cHvcurveto:
+      case Charstring::cDotsection:
+      case Charstring::cVstem3:
+      case Charstring::cHstem3:
+        return G_MOVABLE;
+      default:
+        return G_BARRIER;
+    }
+}
+
+// Suffix array by prefix doubling with counting sorts.
+void
+build_suffix_array(const Vector<int> &text, int nids, Vector<int> &sa)
+{
+    int n = text.size();
+    Vector<int> rank(text), next_rank(n, 0), by_second(n, 0), count;
+    sa.assign(n, 0);
+
+    count.assign(nids, 0);
+    for (int i = 0; i < n; i++)
+        count[text[i]]++;
+    for (int r = 1; r < nids; r++)
+        count[r] += count[r - 1];
+    for (int i = n - 1; i >= 0; i--)
+        sa[--count[text[i]]] = i;
+
+    int nranks = nids;
+    for (int k = 1; n > 1; k <<= 1) {
+        int j = 0;
+        for (int i = n - k; i < n; i++)
+            by_second[j++] = i;
+        for (int i = 0; i < n; i++)
+            if (sa[i] >= k)
+                by_second[j++] = sa[i] - k;
+
+        count.assign(nranks, 0);
+        for (int i = 0; i < n; i++)
+            count[rank[i]]++;
+        for (int r = 1; r < nranks; r++)
+            count[r] += count[r - 1];
+        for (int i = n - 1; i >= 0; i--)
+            sa[--count[rank[by_second[i]]]] = by_second[i];
+
+        int r = 0;
+        next_rank[sa[0]] = 0;
+        for (int i = 1; i < n; i++) {
+            int a = sa[i - 1], b = sa[i];
+            if (rank[a] != rank[b]
+                || (a + k < n ? rank[a + k] : -1) != (b + k < n ? rank[b + k] : -1))
+                r++;
+            next_rank[b] = r;
+        }
+        rank.swap(next_rank);
+        nranks = r + 1;
+        if (nranks == n)
+            break;
+    }
+}
+
+// lcp[i] is the length of the common prefix of suffixes sa[i-1] and sa[i].
+void
+build_lcp(const Vector<int> &text, const Vector<int> &sa, Vector<int> &lcp)
+{
+    int n = text.size();
+    Vector<int> inverse(n, 0);
+    for (int i = 0; i < n; i++)
+        inverse[sa[i]] = i;
+    lcp.assign(n, 0);
+    for (int i = 0, h = 0; i < n; i++)
+        if (inverse[i] > 0) {
+            int j = sa[inverse[i] - 1];
+            while (i + h < n && j + h < n && text[i + h] == text[j + h])
+                h++;
+            lcp[inverse[i]] = h;
+            if (h > 0)
+                h--;
+        } else
+            h = 0;
+}
+
+struct Candidate {
+    int lb;                     // suffix array interval
+    int rb;
+    int ngroups;
+    int savings;
+    Candidate(int lb_, int rb_, int ngroups_, int savings_)
+        : lb(lb_), rb(rb_), ngroups(ngroups_), savings(savings_) {
+    }
+};
+
+class CandidateCompar { public:
+    CandidateCompar(const Vector<Candidate> &c) : _c(c) { }
+    bool operator()(int a, int b) const {
+        return _c[a].savings < _c[b].savings
+            || (_c[a].savings == _c[b].savings && a > b);
+    }
+    const Vector<Candidate> &_c;
+};
+
+struct NewSubr {
+    String body;
+    int ngroups;
+    int ncalls;
+    NewSubr(const String &body_, int ngroups_, int ncalls_)
+        : body(body_), ngroups(ngroups_), ncalls(ncalls_) {
+    }
+};
+
+class NewSubrCompar { public:
+    NewSubrCompar(const Vector<NewSubr> &s) : _s(s) { }
+    bool operator()(int a, int b) const {
+        return _s[a].ncalls > _s[b].ncalls
+            || (_s[a].ncalls == _s[b].ncalls && a < b);
+    }
+    const Vector<NewSubr> &_s;
+};
+
+inline int
+savings(int nbytes, int ncalls, int call_cost)
+{
+    return ncalls * (nbytes - call_cost)
+        - (nbytes + 1 + Type1Subroutinizer::SUBR_OVERHEAD);
+}
+
+}
+
+
+Type1Subroutinizer::Type1Subroutinizer(Type1Font *font, int max_depth)
+    : _font(font), _max_depth(max_depth), _max_subrs(MAX_SUBRS), _first_subr(0),
+      _nsubrs_added(0), _bytes_saved(0)
+{
+    if (_max_depth > MAX_DEPTH)
+        _max_depth = MAX_DEPTH;
+}
+
+int
+Type1Subroutinizer::run_pass()
+{
+    // Concatenate every glyph's command groups, as group IDs, into one
+    // text; each glyph ends with a unique ID so no match crosses glyphs.
+    int nglyphs = _font->nglyphs();
+    Vector<int> text, offset, starts;
+    Vector<String> glyph_data;
+    HashMap<String, int> ids(-1);
+    int nids = 0;
+    for (int g = 0; g < nglyphs; g++) {
+        starts.push_back(text.size());
+        Type1Charstring *t1cs = _font->glyph(g);
+        glyph_data.push_back(t1cs ? t1cs->data_string() : String());
+        const String &cs = glyph_data.back();
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(cs.data());
+        bool in_flex = false;
+        for (int pos = 0, end; pos < cs.length(); pos = end) {
+            int type = scan_group(data, pos, cs.length(), _first_subr, end);
+            if (type == G_MOVABLE && !in_flex) {
+                int &id = ids.find_force(cs.substring(pos, end - pos));
+                if (id < 0)
+                    id = nids++;
+                text.push_back(id);
+            } else
+                text.push_back(-1);
+            offset.push_back(pos);
+            if (type == G_FLEX_BEGIN)
+                in_flex = true;
+            else if (type == G_FLEX_END)
+                in_flex = false;
+        }
+        text.push_back(-1);
+        offset.push_back(cs.length());
+    }
+    starts.push_back(text.size());
+    for (int *tp = text.begin(); tp != text.end(); tp++)
+        if (*tp < 0)
+            *tp = nids++;
+
+    int n = text.size();
+    Vector<int> sa, lcp;
+    build_suffix_array(text, nids, sa);
+    build_lcp(text, sa, lcp);
+
+    // Every repeated group sequence that is as long as possible for its
+    // occurrences, and whose occurrences are not all preceded by the same
+    // group, is a candidate.
+    int call_cost = number_length(_font->nsubrs()) + 1;
+    Vector<Candidate> candidates;
+    Vector<int> stack_lcp, stack_lb;
+    stack_lcp.push_back(0);
+    stack_lb.push_back(0);
+    for (int i = 1; i <= n; i++) {
+        int h = (i < n ? lcp[i] : 0), lb = i - 1;
+        while (h < stack_lcp.back()) {
+            int ngroups = stack_lcp.back();
+            lb = stack_lb.back();
+            stack_lcp.pop_back();
+            stack_lb.pop_back();
+            int p = sa[lb];
+            int nbytes = offset[p + ngroups] - offset[p];
+            if (savings(nbytes, i - lb, call_cost) > 0) {
+                int left = (p > 0 ? text[p - 1] : -1), j = lb + 1;
+                while (j < i && left >= 0 && (sa[j] > 0 ? text[sa[j] - 1] : -1) == left)
+                    j++;
+                if (j < i || left < 0)
+                    candidates.push_back(Candidate(lb, i - 1, ngroups, savings(nbytes, i - lb, call_cost)));
+            }
+        }
+        if (h > stack_lcp.back()) {
+            stack_lcp.push_back(h);
+            stack_lb.push_back(lb);
+        }
+    }
+    lcp.clear();
+
+    // Greedily choose the candidates that save the most, recounting each
+    // candidate's free occurrences when it reaches the top.  "covered"
+    // marks groups already moved; "cover_starts" is a Fenwick tree that
+    // counts the starts of moved sequences.
+    Vector<int> heap;
+    for (int c = 0; c < candidates.size(); c++)
+        heap.push_back(c);
+    CandidateCompar compar(candidates);
+    std::make_heap(heap.begin(), heap.end(), compar);
+
+    Vector<char> covered(n, 0);
+    Vector<int> cover_starts(n + 1, 0), call_at(n, -1);
+    Vector<NewSubr> new_subrs;
+    Vector<int> occurrences;
+    while (heap.size() && _font->nsubrs() + new_subrs.size() < _max_subrs) {
+        std::pop_heap(heap.begin(), heap.end(), compar);
+        Candidate &c = candidates[heap.back()];
+
+        occurrences.clear();
+        for (int j = c.lb; j <= c.rb; j++)
+            occurrences.push_back(sa[j]);
+        std::sort(occurrences.begin(), occurrences.end());
+        int *w = occurrences.begin();
+        for (int *pp = occurrences.begin(); pp != occurrences.end(); pp++) {
+            int p = *pp;
+            if (covered[p] || (w != occurrences.begin() && p < w[-1] + c.ngroups))
+                continue;
+            int nstarts = 0;
+            for (int x = p + c.ngroups; x > 0; x -= x & -x)
+                nstarts += cover_starts[x];
+            for (int x = p + 1; x > 0; x -= x & -x)
+                nstarts -= cover_starts[x];
+            if (nstarts == 0)
+                *w++ = p;
+        }
+        occurrences.erase(w, occurrences.end());
+
+        int p0 = sa[c.lb];
+        int nbytes = offset[p0 + c.ngroups] - offset[p0];
+        call_cost = number_length(_font->nsubrs() + new_subrs.size()) + 1;
+        int s = (occurrences.size() > 1 ? savings(nbytes, occurrences.size(), call_cost) : 0);
+        if (s <= 0) {
+            heap.pop_back();
+            continue;
+        } else if (s < c.savings && heap.size() > 1) {
+            c.savings = s;
+            std::push_heap(heap.begin(), heap.end(), compar);
+            continue;
+        }
+        heap.pop_back();
+
+        for (int *pp = occurrences.begin(); pp != occurrences.end(); pp++) {
+            for (int x = *pp; x < *pp + c.ngroups; x++)
+                covered[x] = 1;
+            for (int x = *pp + 1; x <= n; x += x & -x)
+                cover_starts[x]++;
+            call_at[*pp] = new_subrs.size();
+        }
+        int g = std::upper_bound(starts.begin(), starts.end(), p0) - starts.begin() - 1;
+        new_subrs.push_back(NewSubr(glyph_data[g].substring(offset[p0], nbytes), c.ngroups, occurrences.size()));
+    }
+
+    if (!new_subrs.size())
+        return 0;
+
+    // Number the new subroutines, most called first, so more calls get
+    // short subroutine numbers.
+    Vector<int> order, subrno(new_subrs.size(), 0);
+    for (int i = 0; i < new_subrs.size(); i++)
+        order.push_back(i);
+    std::sort(order.begin(), order.end(), NewSubrCompar(new_subrs));
+    for (int i = 0; i < order.size(); i++)
+        subrno[order[i]] = _font->nsubrs() + i;
+
+    for (int i = 0; i < new_subrs.size(); i++) {
+        _font->set_subr(subrno[i], Type1Charstring(new_subrs[i].body + String::make_stable("\013", 1)));
+        _bytes_saved += savings(new_subrs[i].body.length(), new_subrs[i].ncalls, number_length(subrno[i]) + 1) + SUBR_OVERHEAD;
+    }
+
+    // Rewrite the glyphs.
+    StringAccum sa_cs;
+    for (int g = 0; g < nglyphs; g++) {
+        const String &cs = glyph_data[g];
+        bool changed = false;
+        sa_cs.clear();
+        for (int p = starts[g]; p < starts[g + 1] - 1; ) {
+            if (call_at[p] >= 0) {
+                int sn = call_at[p];
+                sa_cs << Type1CharstringGen::callsubr_string(subrno[sn]);
+                p += new_subrs[sn].ngroups;
+                changed = true;
+            } else {
+                sa_cs.append(cs.data() + offset[p], offset[p + 1] - offset[p]);
+                p++;
+            }
+        }
+        if (changed)
+            _font->glyph(g)->assign(sa_cs.take_string());
+    }
+
+    _nsubrs_added += new_subrs.size();
+    return new_subrs.size();
+}
+
+int
+Type1Subroutinizer::run()
+{
+    // New subroutines go after the existing ones, and set_subr() copies
+    // the definer of an existing subroutine.
+    _font->fill_in_subrs();
+    if (_font->nsubrs() == 0)
+        return 0;
+    _first_subr = _font->nsubrs();
+    for (int pass = 0; pass < _max_depth; pass++)
+        if (!run_pass())
+            break;
+    return _nsubrs_added;
+}
+
+}
@@ -22,7 +22,6 @@
 #include <efont/otfpost.hh>
 #include <efont/otfcmap.hh>
 #include <lcdf/hashmap.hh>
-#include <algorithm>
 namespace Efont {
 typedef OpenType::Glyph Glyph;
 
@@ -120,25 +119,9 @@ TrueTypeBoundsCharstringProgram::glyph_name(int gi) const
     // try 'uniXXXX' names
     if (!_got_unicodes) {
         OpenType::Cmap cmap(_otf->table("cmap"));
-        if (cmap.ok()) {
-            Vector<std::pair<uint32_t, Glyph> > ugp;
-            cmap.unmap_all(ugp);
-            std::sort(ugp.begin(), ugp.end());
-            for (Vector<std::pair<uint32_t, Glyph> >::iterator it = ugp.begin();
-                 it != ugp.end(); ) {
-                Vector<std::pair<uint32_t, Glyph> >::iterator nit = it + 1;
-                // ignore code points with multiple glyph mappings
-                if (nit == ugp.end() || nit->first != it->first) {
-                    if (it->second >= _unicodes.size())
-                        _unicodes.resize(it->second + 1, 0);
-                    if (!_unicodes[it->second])
-                        _unicodes[it->second] = it->first;
-                } else
-                    while (nit != ugp.end() && nit->first == it->first)
-                        ++nit;
-                it = nit;
-            }
-        }
+        if (cmap.ok())
+            for (int g = 0; g < _nglyphs; ++g)
+                _unicodes.push_back(cmap.unmap(g));
         _got_unicodes = true;
     }
 
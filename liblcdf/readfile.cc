@@ -0,0 +1,108 @@
+// -*- related-file-name: "../include/lcdf/readfile.hh" -*-
+
+/* readfile.{cc,hh} -- read whole input files into Strings
+ *
+ * Copyright (c) 2003-2023 Eddie Kohler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include <lcdf/readfile.hh>
+#include <lcdf/error.hh>
+#include <lcdf/straccum.hh>
+#include <errno.h>
+#include <string.h>
+#ifdef HAVE_SYS_TYPES_H
+# include <sys/types.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#if defined(_MSDOS) || defined(_WIN32)
+# include <fcntl.h>
+# include <io.h>
+#endif
+
+// Smaller files are cheaper to read than to map.
+#define MAP_THRESHOLD 65536
+
+String
+read_file(FILE *f, int &error)
+{
+    // Returns the rest of f's contents.  A regular file that hasn't been
+    // read yet is memory-mapped (see String::make_mapped()); anything else,
+    // including pipes and terminals, is read in chunks.
+    error = 0;
+    int size_hint = 0;
+#if defined(HAVE_SYS_STAT_H) && defined(HAVE_UNISTD_H) && !defined(_WIN32)
+    struct stat st;
+    int fd = fileno(f);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+        && st.st_size > 0 && st.st_size < 0x40000000
+        && ftell(f) == 0 && lseek(fd, 0, SEEK_CUR) == 0) {
+        size_hint = (int) st.st_size;
+        if (size_hint >= MAP_THRESHOLD)
+            if (String s = String::make_mapped(fd, size_hint)) {
+                fseek(f, 0, SEEK_END);
+                return s;
+            }
+    }
+#endif
+
+    StringAccum sa(size_hint + 1);
+    int amt;
+    do {
+        int want = (size_hint > sa.length() ? size_hint - sa.length() : 8192);
+        if (char *x = sa.reserve(want)) {
+            amt = fread(x, 1, want, f);
+            sa.adjust_length(amt);
+        } else
+            amt = 0;
+    } while (amt != 0);
+    if (!feof(f) || ferror(f))
+        error = (errno ? errno : EIO);
+    return sa.take_string();
+}
+
+String
+read_file(String filename, ErrorHandler *errh, bool warning)
+{
+    FILE *f;
+    int f_errno = 0;
+    if (!filename || filename == "-") {
+        filename = "<stdin>";
+        f = stdin;
+#if defined(_MSDOS) || defined(_WIN32)
+        // Set the file mode to binary
+        _setmode(_fileno(f), _O_BINARY);
+#endif
+    } else {
+        f = fopen(filename.c_str(), "rb");
+        f_errno = errno;
+    }
+
+    String error_anno = (warning ? errh->e_warning : errh->e_error) + ErrorHandler::make_landmark_anno(filename);
+    if (!f) {
+        errh->xmessage(error_anno, strerror(f_errno));
+        return String();
+    }
+
+    String s = read_file(f, f_errno);
+    if (f_errno)
+        errh->xmessage(error_anno, strerror(f_errno));
+    if (f != stdin)
+        fclose(f);
+    return s;
+}
@@ -27,6 +27,18 @@
 #include <string.h>
 #include <ctype.h>
 #include <lcdf/inttypes.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+# define MAP_ANONYMOUS MAP_ANON
+#endif
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+# define USE_MMAP 1
+#endif
 
 #ifndef likely
 #define likely(x) (x)
@@ -110,6 +122,7 @@ String::create_memo(char *space, int dirty, int capacity)
         memo->capacity = capacity;
         memo->dirty = dirty;
         memo->refcount = (space ? 0 : 1);
+        memo->mapped = 0;
 #if HAVE_STRING_PROFILING
         int bucket = profile_memo_size_bucket(dirty, capacity);
         ++memo_sizes[bucket];
@@ -141,6 +154,14 @@ String::delete_memo(memo_t *memo)
     if ((*memo->pprev = memo->next))
         memo->next->pprev = memo->pprev;
 # endif
+#endif
+#if USE_MMAP
+    if (memo->mapped) {
+        // see make_mapped(): the mapping starts one page before real_data
+        char *base = memo->real_data - (memo->mapped - memo->capacity);
+        munmap(base, memo->mapped);
+        return;
+    }
 #endif
     delete[] reinterpret_cast<char *>(memo);
 }
@@ -259,6 +280,41 @@ String::make_claim(char *str, int len, int capacity)
     return String(str, len, new_memo);
 }
 
+String
+String::make_mapped(int fd, int len)
+{
+#if USE_MMAP
+    // Layout: one anonymous page, whose tail holds the memo_t header, then
+    // the file's pages, then zero fill through the end of the next page
+    // boundary.  So real_data is the file data, real_data[len] is a
+    // writable '\0', and c_str() and short appends work in place.  The
+    // mapping is private, so mutable_data() never changes the file.
+    long pagesize = sysconf(_SC_PAGESIZE);
+    if (len <= 0 || pagesize < (long) MEMO_SPACE
+        || (pagesize & (pagesize - 1)) != 0
+        || len > 0x7FFFFFFF - 2 * pagesize)
+        return String();
+    uint32_t capacity = ((uint32_t) len + pagesize) & ~(uint32_t) (pagesize - 1);
+    uint32_t mapsize = capacity + pagesize;
+    void *base = mmap(0, mapsize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return String();
+    char *data = reinterpret_cast<char *>(base) + pagesize;
+    if (mmap(data, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+             fd, 0) == MAP_FAILED) {
+        munmap(base, mapsize);
+        return String();
+    }
+    memo_t *memo = create_memo(data - MEMO_SPACE, len, capacity);
+    memo->mapped = mapsize;
+    return String(data, len, memo);
+#else
+    (void) fd, (void) len;
+    return String();
+#endif
+}
+
 String
 String::make_stable(const char *s, int len)
 {
@@ -17,6 +17,7 @@
 #include <efont/psres.hh>
 #include <efont/t1rw.hh>
 #include <efont/t1mm.hh>
+#include <efont/t1subrize.hh>
 #include "myfont.hh"
 #include "t1rewrit.hh"
 #include "t1minimize.hh"
@@ -54,6 +55,7 @@
 #define PRECISION_OPT   315
 #define SUBRS_OPT       316
 #define MINIMIZE_OPT    317
+#define SUBROUTINIZE_OPT 318
 
 const Clp_Option options[] = {
   { "1", '1', N1_OPT, Clp_ValDouble, 0 },
@@ -70,6 +72,7 @@ const Clp_Option options[] = {
   { "precision", 'p', PRECISION_OPT, Clp_ValUnsigned, 0 },
   { "quiet", 'q', QUIET_OPT, 0, Clp_Negate },
   { "style", 0, STYLE_OPT, Clp_ValDouble, 0 },
+  { "subroutinize", 0, SUBROUTINIZE_OPT, 0, Clp_Negate },
   { "subrs", 0, SUBRS_OPT, Clp_ValInt, Clp_Negate },
   { "version", 'v', VERSION_OPT, 0, 0 },
   { "wd", 0, WIDTH_OPT, Clp_ValDouble, 0 },
@@ -126,6 +129,7 @@ General options:\n\
   -o, --output=FILE            Write output to FILE.\n\
   -p, --precision=N            Set precision to N (larger means more precise).\n\
       --subrs=N                Limit output font to at most N subroutines.\n\
+      --subroutinize           Move repeated outline code into subroutines.\n\
       --no-minimize            Do not replace original font%,s PostScript code.\n\
   -h, --help                   Print this message and exit.\n\
   -q, --quiet                  Do not generate any error messages.\n\
@@ -269,6 +273,7 @@ main(int argc, char *argv[])
   bool minimize = true;
   int precision = 5;
   int subr_count = -1;
+  bool subroutinize = false;
   FILE *outfile = 0;
   ::errh =
       ErrorHandler::static_initialize(new FileErrorHandler(stderr, String(program_name) + ": "));
@@ -336,6 +341,10 @@ main(int argc, char *argv[])
         minimize = !clp->negated;
         break;
 
+      case SUBROUTINIZE_OPT:
+        subroutinize = !clp->negated;
+        break;
+
      case QUIET_OPT:
        if (clp->negated)
            errh = ErrorHandler::default_handler();
@@ -424,6 +433,13 @@ particular purpose.\n");
 
   font->fill_in_subrs();
 
+  if (subroutinize) {
+      Type1Subroutinizer subrizer(font);
+      if (subr_count >= 0)
+          subrizer.set_max_subrs(subr_count);
+      subrizer.run();
+  }
+
   Type1Font *t1font;
   if (minimize) {
       t1font = ::minimize(font);
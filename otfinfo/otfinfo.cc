@@ -22,10 +22,12 @@
 #include <efont/otfname.hh>
 #include <efont/otfos2.hh>
 #include <efont/otfpost.hh>
+#include <efont/otfshaper.hh>
 #include <efont/ttfhead.hh>
 #include <efont/cff.hh>
 #include <lcdf/clp.h>
 #include <lcdf/error.hh>
+#include <lcdf/readfile.hh>
 #include <lcdf/straccum.hh>
 #include <stdlib.h>
 #include <string.h>
@@ -33,6 +35,7 @@
 #include <stdarg.h>
 #include <ctype.h>
 #include <errno.h>
+#include <time.h>
 #include <algorithm>
 #include <utility>
 #ifdef HAVE_UNISTD_H
@@ -50,6 +53,7 @@ using namespace Efont;
 #define QUIET_OPT               303
 #define VERBOSE_OPT             304
 #define SCRIPT_OPT              305
+#define FEATURE_OPT             306
 
 #define QUERY_SCRIPTS_OPT       320
 #define QUERY_FEATURES_OPT      321
@@ -63,9 +67,13 @@ using namespace Efont;
 #define DUMP_TABLE_OPT          329
 #define QUERY_UNICODE_OPT       330
 #define QUERY_VARIABLE_OPT      331
+#define SHAPE_OPT               332
+#define SHAPE_FILE_OPT          333
+#define FACE_OPT                334
 
 const Clp_Option options[] = {
     { "script", 0, SCRIPT_OPT, Clp_ValString, 0 },
+    { "feature", 0, FEATURE_OPT, Clp_ValString, 0 },
     { "quiet", 'q', QUIET_OPT, 0, Clp_Negate },
     { "verbose", 'V', VERBOSE_OPT, 0, Clp_Negate },
     { "features", 'f', QUERY_FEATURES_OPT, 0, 0 },
@@ -82,6 +90,9 @@ const Clp_Option options[] = {
     { "unicode", 'u', QUERY_UNICODE_OPT, 0, 0 },
     { "variable", 0, QUERY_VARIABLE_OPT, 0, 0 },
     { "variations", 0, QUERY_VARIABLE_OPT, 0, 0 },
+    { "shape", 0, SHAPE_OPT, Clp_ValString, 0 },
+    { "shape-file", 0, SHAPE_FILE_OPT, Clp_ValString, 0 },
+    { "face", 0, FACE_OPT, Clp_ValUnsigned, 0 },
     { "help", 'h', HELP_OPT, 0, 0 },
     { "version", 0, VERSION_OPT, 0, 0 },
 };
@@ -90,6 +101,9 @@ const Clp_Option options[] = {
 static const char *program_name;
 
 static Efont::OpenType::Tag script, langsys;
+static Vector<Efont::OpenType::Tag> shape_features;
+static Vector<String> shape_lines;
+static int face = -1;
 
 bool verbose = false;
 bool quiet = false;
@@ -133,9 +147,13 @@ Query options:\n\
   -u, --unicode                Report font%,s supported Unicode code points.\n\
       --variable               Report variable font information.\n\
   -T, --dump-table NAME        Output font%,s %<NAME%> table.\n\
+      --shape=TEXT             Report glyphs and positions for UTF-8 TEXT.\n\
+      --shape-file=FILE        Report glyphs and positions for each line of FILE.\n\
 \n\
 Other options:\n\
-      --script=SCRIPT[.LANG]   Set script used for --features [latn].\n\
+      --script=SCRIPT[.LANG]   Set script used for --features and --shape [latn].\n\
+      --feature=FEAT           Apply feature FEAT for --shape.\n\
+      --face=N                 Use font N of a font collection [all].\n\
   -V, --verbose                Print progress information to standard error.\n\
   -h, --help                   Print this message and exit.\n\
   -q, --quiet                  Do not generate any error messages.\n\
@@ -144,45 +162,6 @@ Other options:\n\
 Report bugs to <ekohler@gmail.com>.\n");
 }
 
-String
-read_file(String filename, ErrorHandler *errh, bool warning = false)
-{
-    FILE *f;
-    int f_errno = 0;
-    if (!filename || filename == "-") {
-        filename = "<stdin>";
-        f = stdin;
-#if defined(_MSDOS) || defined(_WIN32)
-        // Set the file mode to binary
-        _setmode(_fileno(f), _O_BINARY);
-#endif
-    } else {
-        f = fopen(filename.c_str(), "rb");
-        f_errno = errno;
-    }
-
-    String error_anno = (warning ? errh->e_warning : errh->e_error) + ErrorHandler::make_landmark_anno(filename);
-    if (!f) {
-        errh->xmessage(error_anno, strerror(f_errno));
-        return String();
-    }
-
-    StringAccum sa;
-    int amt;
-    do {
-        if (char *x = sa.reserve(8192)) {
-            amt = fread(x, 1, 8192, f);
-            sa.adjust_length(amt);
-        } else
-            amt = 0;
-    } while (amt != 0);
-    if (!feof(f) || ferror(f))
-        errh->xmessage(error_anno, strerror(errno));
-    if (f != stdin)
-        fclose(f);
-    return sa.take_string();
-}
-
 String
 printable_filename(const String &s)
 {
@@ -629,6 +608,79 @@ do_query_variable(const OpenType::Font& otf, ErrorHandler* errh, ErrorHandler* r
     }
 }
 
+static void
+decode_utf8(const String &str, Vector<uint32_t> &out)
+{
+    out.clear();
+    const unsigned char *s = str.udata(), *end = s + str.length();
+    while (s < end) {
+        uint32_t c = *s++;
+        int more = (c >= 0xF0 && c <= 0xF4 ? 3 : c >= 0xE0 ? 2 : c >= 0xC2 ? 1 : 0);
+        if (c >= 0x80 && (more == 0 || c >= 0xF5))
+            c = 0xFFFD;
+        else if (more) {
+            c &= 0x3F >> more;
+            for (; more && s < end && (*s & 0xC0) == 0x80; --more)
+                c = (c << 6) | (*s++ & 0x3F);
+            if (more)
+                c = 0xFFFD;
+        }
+        out.push_back(c);
+    }
+}
+
+static void
+do_shape(const OpenType::Font &otf, ErrorHandler *errh, ErrorHandler *result_errh)
+{
+    int before_nerrors = errh->nerrors();
+    try {
+        OpenType::Cmap cmap(otf.table("cmap"), errh);
+        if (!cmap.ok())
+            throw OpenType::Error();
+
+        Vector<PermString> glyph_names;
+        if (otf.table("CFF"))
+            do_query_glyphs_cff(otf, errh, glyph_names);
+        else if (otf.table("post"))
+            do_query_glyphs_post(otf, errh, glyph_names);
+
+        OpenType::Shaper shaper(otf, errh);
+        shaper.set_features(script, langsys, shape_features, errh);
+
+        Vector<uint32_t> code_points;
+        Vector<OpenType::Glyph> glyphs;
+        StringAccum sa;
+        clock_t shape_clock = 0;
+        int nglyphs = 0;
+        for (const String *lp = shape_lines.begin(); lp != shape_lines.end(); ++lp) {
+            decode_utf8(*lp, code_points);
+            cmap.map_uni(code_points, glyphs);
+            clock_t start = clock();
+            shaper.shape(glyphs);
+            shape_clock += clock() - start;
+            nglyphs += shaper.nglyphs();
+
+            sa.clear();
+            for (int i = 0; i < shaper.nglyphs(); ++i) {
+                if (i)
+                    sa << ' ';
+                shaper.positions()[i].unparse(sa, &glyph_names);
+            }
+            result_errh->message("%s", sa.c_str());
+        }
+
+        if (verbose) {
+            double sec = (double) shape_clock / CLOCKS_PER_SEC;
+            errh->message("shaped %d glyphs with %d GSUB and %d GPOS lookups in %.3f s (%.0f glyphs/s)",
+                          nglyphs, shaper.ngsub_lookups(), shaper.ngpos_lookups(),
+                          sec, sec > 0 ? nglyphs / sec : 0.);
+        }
+    } catch (OpenType::Error) {
+        if (errh->nerrors() == before_nerrors)
+            errh->message("corrupted tables");
+    }
+}
+
 static void
 do_tables(const OpenType::Font &otf, ErrorHandler *errh, ErrorHandler *result_errh)
 {
@@ -701,6 +753,14 @@ main(int argc, char *argv[])
               break;
           }
 
+          case FEATURE_OPT: {
+              OpenType::Tag t(clp->vstr);
+              if (!t.valid())
+                  usage_error(errh, "bad feature tag");
+              shape_features.push_back(t);
+              break;
+          }
+
           case QUERY_SCRIPTS_OPT:
           case QUERY_FEATURES_OPT:
           case QUERY_OPTICAL_SIZE_OPT:
@@ -717,6 +777,26 @@ main(int argc, char *argv[])
             query = opt;
             break;
 
+        case SHAPE_OPT:
+        case SHAPE_FILE_OPT:
+            if (query && query != SHAPE_OPT)
+                usage_error(errh, "supply exactly one query type option");
+            if (opt == SHAPE_OPT)
+                shape_lines.push_back(clp->vstr);
+            else {
+                String text = read_file(clp->vstr, errh);
+                for (const char *s = text.begin(); s != text.end(); ) {
+                    const char *eol = std::find(s, text.end(), '\n');
+                    const char *next = eol + (eol != text.end());
+                    if (eol != s && eol[-1] == '\r')
+                        --eol;
+                    shape_lines.push_back(text.substring(s, eol));
+                    s = next;
+                }
+            }
+            query = SHAPE_OPT;
+            break;
+
         case DUMP_TABLE_OPT:
             if (query)
                 usage_error(errh, "supply exactly one query type option");
@@ -725,6 +805,10 @@ main(int argc, char *argv[])
             query = opt;
             break;
 
+        case FACE_OPT:
+            face = clp->val.u;
+            break;
+
           case QUIET_OPT:
             if (clp->negated)
                 errh = ErrorHandler::default_handler();
@@ -784,36 +868,49 @@ particular purpose.\n");
 
         String input_file = printable_filename(*input_filep);
         LandmarkErrorHandler cerrh(errh, input_file);
-        OpenType::Font otf(font_data, &cerrh);
+        OpenType::Font otf(font_data, face < 0 ? 0 : face, &cerrh);
         if (!otf.ok())
             continue;
 
-        PrefixErrorHandler stdout_cerrh(&stdout_errh, input_file + ":");
-        ErrorHandler *result_errh = (input_files.size() > 1 ? static_cast<ErrorHandler *>(&stdout_cerrh) : static_cast<ErrorHandler *>(&stdout_errh));
-        if (query == QUERY_SCRIPTS_OPT)
-            do_query_scripts(otf, &cerrh, result_errh);
-        else if (query == QUERY_FEATURES_OPT)
-            do_query_features(otf, &cerrh, result_errh);
-        else if (query == QUERY_OPTICAL_SIZE_OPT)
-            do_query_optical_size(otf, &cerrh, result_errh);
-        else if (query == QUERY_POSTSCRIPT_NAME_OPT)
-            do_query_postscript_name(otf, &cerrh, result_errh);
-        else if (query == QUERY_GLYPHS_OPT)
-            do_query_glyphs(otf, &cerrh, result_errh);
-        else if (query == QUERY_UNICODE_OPT)
-            do_query_unicode(otf, &cerrh, result_errh);
-        else if (query == QUERY_FAMILY_OPT)
-            do_query_family_name(otf, &cerrh, result_errh);
-        else if (query == QUERY_FVERSION_OPT)
-            do_query_font_version(otf, &cerrh, result_errh);
-        else if (query == QUERY_VARIABLE_OPT)
-            do_query_variable(otf, &cerrh, result_errh);
-        else if (query == TABLES_OPT)
-            do_tables(otf, &cerrh, result_errh);
-        else if (query == DUMP_TABLE_OPT)
-            do_dump_table(otf, dump_table, &cerrh);
-        else if (query == INFO_OPT)
-            do_info(otf, &cerrh, result_errh);
+        // without --face, report on every font in a collection
+        int nfaces = (face < 0 ? otf.nfaces() : 1);
+        for (int f = 0; f < nfaces; f++) {
+            String face_file = input_file;
+            if (nfaces > 1)
+                face_file += "[" + String(f) + "]";
+            LandmarkErrorHandler face_errh(errh, face_file);
+            if (f > 0 && !(otf = OpenType::Font(font_data, f, &face_errh)).ok())
+                continue;
+
+            PrefixErrorHandler stdout_cerrh(&stdout_errh, face_file + ":");
+            ErrorHandler *result_errh = (input_files.size() > 1 || nfaces > 1 ? static_cast<ErrorHandler *>(&stdout_cerrh) : static_cast<ErrorHandler *>(&stdout_errh));
+            if (query == QUERY_SCRIPTS_OPT)
+                do_query_scripts(otf, &face_errh, result_errh);
+            else if (query == QUERY_FEATURES_OPT)
+                do_query_features(otf, &face_errh, result_errh);
+            else if (query == QUERY_OPTICAL_SIZE_OPT)
+                do_query_optical_size(otf, &face_errh, result_errh);
+            else if (query == QUERY_POSTSCRIPT_NAME_OPT)
+                do_query_postscript_name(otf, &face_errh, result_errh);
+            else if (query == QUERY_GLYPHS_OPT)
+                do_query_glyphs(otf, &face_errh, result_errh);
+            else if (query == QUERY_UNICODE_OPT)
+                do_query_unicode(otf, &face_errh, result_errh);
+            else if (query == QUERY_FAMILY_OPT)
+                do_query_family_name(otf, &face_errh, result_errh);
+            else if (query == QUERY_FVERSION_OPT)
+                do_query_font_version(otf, &face_errh, result_errh);
+            else if (query == QUERY_VARIABLE_OPT)
+                do_query_variable(otf, &face_errh, result_errh);
+            else if (query == TABLES_OPT)
+                do_tables(otf, &face_errh, result_errh);
+            else if (query == DUMP_TABLE_OPT)
+                do_dump_table(otf, dump_table, &face_errh);
+            else if (query == INFO_OPT)
+                do_info(otf, &face_errh, result_errh);
+            else if (query == SHAPE_OPT)
+                do_shape(otf, &face_errh, result_errh);
+        }
     }
 
     Clp_DeleteParser(clp);
@@ -14,7 +14,13 @@
 #include <config.h>
 #include "automatic.hh"
 #include "kpseinterface.h"
+#include "secondary.hh"
 #include "util.hh"
+#include <efont/maket1font.hh>
+#include <efont/makedotlessj.hh>
+#include <efont/maket42font.hh>
+#include <efont/t1font.hh>
+#include <efont/t1rw.hh>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -32,6 +38,7 @@
 # include <sys/wait.h>
 #endif
 #include <lcdf/error.hh>
+#include <lcdf/hashmap.hh>
 #include <lcdf/straccum.hh>
 #if HAVE_FCNTL_H
 # include <fcntl.h>
@@ -58,12 +65,9 @@
 # endif
 #endif
 
-#if HAVE_AUTO_T1DOTLESSJ
-enum { T1DOTLESSJ_EXIT_J_NODOT = 2 };
-#endif
-
 static String odir[NUMODIR];
 static String typeface;
+static bool typeface_override;
 static String vendor;
 static String map_file;
 #define DEFAULT_VENDOR "lcdftools"
@@ -162,6 +166,244 @@ get_typeface()
 }
 #endif
 
+// The kpathsea lookup cache.  With --kpathsea-cache=FILE, the results of
+// kpathsea searches are saved in FILE and reused by later runs, until the
+// list of TEXMF trees changes or any tree's ls-R file is modified.  The
+// cache maps "FORMAT NAME" to "+PATH"; a format's entries are dropped when
+// its expanded search path (which reflects variables like T1FONTS)
+// changes.  Failed searches are not cached, since the stamp can't see
+// files added to trees that lack ls-R.  A cached entry is not used if the
+// format searches the current directory and the file exists there.
+// update_odir() forgets the names of files as otftotfm installs them.
+
+static String kpathsea_cache_file;
+static HashMap<String, String> kpathsea_cache;
+static Vector<String> kpathsea_cache_changes; // pairs of key and new value
+static bool kpathsea_cache_dirty = false;
+
+void
+set_kpathsea_cache(const String &filename)
+{
+    kpathsea_cache_file = filename;
+}
+
+static void
+change_kpathsea_cache(const String &key, const String &value)
+{
+    kpathsea_cache.insert(key, value);
+    kpathsea_cache_changes.push_back(key);
+    kpathsea_cache_changes.push_back(value);
+    kpathsea_cache_dirty = true;
+}
+
+#if HAVE_KPATHSEA
+static bool kpathsea_cache_loaded = false;
+
+static String
+kpathsea_cache_stamp()
+{
+    StringAccum sa;
+    String path = kpsei_string(kpsei_path_expand("$TEXMF"));
+    while (path) {
+        const char* colon = std::find(path.begin(), path.end(), kpsei_env_sep_char);
+        String texdir = path.substring(path.begin(), colon);
+        path = path.substring(colon + 1, path.end());
+        while (texdir && texdir[0] == '!')
+            texdir = texdir.substring(1);
+        if (!texdir)
+            continue;
+        String ls_r = texdir + (texdir.back() == '/' ? "ls-R" : "/ls-R");
+        struct stat st;
+        if (stat(ls_r.c_str(), &st) < 0 && stat(texdir.c_str(), &st) < 0)
+            memset(&st, 0, sizeof(st));
+        sa << "T\t" << (long) st.st_mtime << '\t' << (long) st.st_size
+           << '\t' << (unsigned long) st.st_ino << '\t' << texdir << '\n';
+    }
+    return sa.take_string();
+}
+
+static const String &
+kpathsea_format_path(int format)
+{
+    static Vector<String> paths;
+    if (!paths.size())
+        for (int f = KPSEI_FMT_WEB2C; f <= KPSEI_FMT_TYPE42; f++)
+            paths.push_back(kpsei_string(kpsei_format_path(f)));
+    return paths[format];
+}
+
+static void
+load_kpathsea_cache()
+{
+    kpathsea_cache_loaded = true;
+    if (access(kpathsea_cache_file.c_str(), R_OK) < 0)
+        return;
+    String text = read_file(kpathsea_cache_file, ErrorHandler::silent_handler());
+    String stamp = kpathsea_cache_stamp();
+
+    // the stamp lines come first; ignore the cache if they're out of date
+    int pos = text.find_left('\n') + 1;
+    if (pos <= 0 || text.substring(0, pos) != "% otftotfm kpathsea cache\n"
+        || text.length() < pos + stamp.length()
+        || text.substring(pos, stamp.length()) != stamp) {
+        if (verbose)
+            ErrorHandler::default_handler()->message("ignoring out-of-date kpathsea cache %s", kpathsea_cache_file.c_str());
+        kpathsea_cache_dirty = true;
+        return;
+    }
+
+    // the rest are "P\tFORMAT\tPATH" lines, giving each format's search
+    // path when the cache was written, and "F\tKEY\tVALUE" lines; keep
+    // only entries whose format's path is unchanged
+    Vector<int> path_ok(KPSEI_FMT_TYPE42 + 1, 0);
+    pos += stamp.length();
+    while (pos < text.length()) {
+        int nl = text.find_left('\n', pos);
+        if (nl < 0)
+            nl = text.length();
+        String line = text.substring(pos, nl - pos);
+        int tab = line.find_left('\t', 2);
+        int format = (tab > 2 ? atoi(line.c_str() + 2) : -1);
+        if (line.length() > 2 && line[1] == '\t'
+            && format >= 0 && format <= KPSEI_FMT_TYPE42) {
+            String value = line.substring(tab + 1);
+            if (line[0] == 'P')
+                path_ok[format] = (value == kpathsea_format_path(format));
+            else if (line[0] == 'F' && path_ok[format])
+                kpathsea_cache.insert(line.substring(2, tab - 2), value);
+            else if (line[0] == 'F')
+                kpathsea_cache_dirty = true;
+        }
+        pos = nl + 1;
+    }
+}
+
+static String
+kpsei_find_file_cached(const String &name, int format)
+{
+    if (!kpathsea_cache_file)
+        return kpsei_string(kpsei_find_file(name.c_str(), format));
+
+    if (!kpathsea_cache_loaded)
+        load_kpathsea_cache();
+    // a file in the current directory may shadow the cached result; paths
+    // with other relative directories are not worth checking
+    int searches_cwd = kpsei_format_searches_cwd(format);
+    if (searches_cwd > 1
+        || (searches_cwd && access(name.c_str(), F_OK) >= 0))
+        return kpsei_string(kpsei_find_file(name.c_str(), format));
+    String key = String(format) + " " + name;
+    String value = kpathsea_cache[key];
+    // ignore failures recorded by earlier versions, and removed files
+    if (value && (value[0] != '+' || access(value.c_str() + 1, F_OK) < 0))
+        value = String();
+    if (!value) {
+        String path = kpsei_string(kpsei_find_file(name.c_str(), format));
+        if (!path)
+            return path;
+        value = "+" + path;
+        // relative results depend on the current directory
+        bool absolute = path[0] == '/'
+            || (path.length() > 2 && path[1] == ':' && path[2] == '/');
+        if (absolute && name.find_left('\t') < 0 && name.find_left('\n') < 0
+            && value.find_left('\n') < 0)
+            change_kpathsea_cache(key, value);
+    }
+    return value.substring(1);
+}
+
+static void
+forget_kpathsea_cache(const String &file)
+{
+    if (!kpathsea_cache_file)
+        return;
+    if (!kpathsea_cache_loaded)
+        load_kpathsea_cache();
+    String name = pathname_filename(file);
+    for (int format = KPSEI_FMT_WEB2C; format <= KPSEI_FMT_TYPE42; format++) {
+        String key = String(format) + " " + name;
+        if (kpathsea_cache[key])
+            change_kpathsea_cache(key, String());
+    }
+}
+#endif
+
+void
+take_kpathsea_cache_changes(Vector<String> &changes)
+{
+    changes.clear();
+    changes.swap(kpathsea_cache_changes);
+}
+
+void
+apply_kpathsea_cache_changes(const Vector<String> &changes)
+{
+#if HAVE_KPATHSEA
+    // batch workers report changes relative to the saved cache
+    if (changes.size() && kpathsea_cache_file && !kpathsea_cache_loaded)
+        load_kpathsea_cache();
+#endif
+    for (int i = 0; i + 1 < changes.size(); i += 2)
+        change_kpathsea_cache(changes[i], changes[i + 1]);
+}
+
+String
+find_kpathsea_file(const String &name, int format)
+{
+#if HAVE_KPATHSEA
+    return kpsei_find_file_cached(name, format);
+#else
+    (void) name, (void) format;
+    return String();
+#endif
+}
+
+int
+save_kpathsea_cache(ErrorHandler *errh)
+{
+#if HAVE_KPATHSEA
+    if (!kpathsea_cache_file || !kpathsea_cache_dirty || no_create)
+        return 0;
+
+    Vector<String> keys;
+    for (HashMap<String, String>::const_iterator it = kpathsea_cache.begin(); it; ++it)
+        if (it.value())
+            keys.push_back(it.key());
+    std::sort(keys.begin(), keys.end());
+
+    // the stamp describes the trees as they are now, including any ls-R
+    // changes made by update_odir()
+    StringAccum sa;
+    sa << "% otftotfm kpathsea cache\n" << kpathsea_cache_stamp();
+    for (int format = KPSEI_FMT_WEB2C; format <= KPSEI_FMT_TYPE42; format++)
+        sa << "P\t" << format << '\t' << kpathsea_format_path(format) << '\n';
+    for (String *k = keys.begin(); k != keys.end(); k++)
+        sa << "F\t" << *k << '\t' << kpathsea_cache[*k] << '\n';
+
+    // write a new file and rename it into place, so concurrent runs see
+    // either the old cache or the new one
+    String tmp_filename = kpathsea_cache_file + "." + String((int) getpid()) + ".tmp";
+    FILE *f = fopen(tmp_filename.c_str(), "wb");
+    if (!f) {
+        errh->warning("%s: %s", tmp_filename.c_str(), strerror(errno));
+        return -1;
+    }
+    ignore_result(fwrite(sa.data(), 1, sa.length(), f));
+    if (fclose(f) != 0 || rename(tmp_filename.c_str(), kpathsea_cache_file.c_str()) != 0) {
+        errh->warning("%s: %s", kpathsea_cache_file.c_str(), strerror(errno));
+        unlink(tmp_filename.c_str());
+        return -1;
+    }
+    if (verbose)
+        errh->message("wrote kpathsea cache %s", kpathsea_cache_file.c_str());
+    kpathsea_cache_dirty = false;
+    return 1;
+#else
+    (void) errh;
+    return 0;
+#endif
+}
+
 bool
 set_vendor(const String &s)
 {
@@ -176,9 +418,27 @@ set_typeface(const String &s, bool override)
     bool had = (bool) typeface;
     if (!had || override)
         typeface = s;
+    if (override)
+        typeface_override = true;
     return !had;
 }
 
+void
+reset_typeface()
+{
+    if (typeface_override)
+        return;
+    typeface = String();
+#if HAVE_KPATHSEA
+    // forget directories that depend on the typeface
+    for (int o = 0; o < NUMODIR; o++)
+        if (odir_kpathsea[o] && String(odir_info[o].texdir).back() == '%') {
+            odir[o] = String();
+            odir_kpathsea[o] = String();
+        }
+#endif
+}
+
 String
 getodir(int o, ErrorHandler *errh)
 {
@@ -274,6 +534,32 @@ odirname(int o)
     }
 }
 
+const char *
+odirenvvar(int o)
+{
+    assert(o >= 0 && o < NUMODIR);
+    return odir_info[o].envvar;
+}
+
+
+// Output records collect the files and map lines a job produces, so that a
+// later run can tell whether they are still in place.
+
+static OutputRecord *output_record;
+
+void
+set_output_record(OutputRecord *record)
+{
+    output_record = record;
+}
+
+void
+record_output_file(const String &file)
+{
+    if (output_record && file)
+        output_record->files.push_back(file);
+}
+
 #if HAVE_KPATHSEA
 static bool
 file_in_kpathsea_odir(int o, const String &file)
@@ -289,7 +575,10 @@ void
 update_odir(int o, String file, ErrorHandler *errh)
 {
     assert(o >= 0 && o < NUMODIR);
+    record_output_file(file.find_left('/') < 0 ? odir[o] + "/" + file : file);
 #if HAVE_KPATHSEA
+    forget_kpathsea_cache(file);
+
     if (file.find_left('/') < 0)
         file = odir[o] + "/" + file;
 
@@ -337,7 +626,7 @@ update_odir(int o, String file, ErrorHandler *errh)
 #ifdef _WIN32
             mktexupd = "mktexupd.exe";
 #else
-            mktexupd = kpsei_string(kpsei_find_file("mktexupd", KPSEI_FMT_WEB2C));
+            mktexupd = kpsei_find_file_cached("mktexupd", KPSEI_FMT_WEB2C);
 #endif
             mktexupd_tried = true;
         }
@@ -367,22 +656,86 @@ set_map_file(const String &s)
     return !had;
 }
 
+#if HAVE_AUTO_CFFTOT1 || HAVE_AUTO_T1DOTLESSJ
+// the Type 1 font most recently generated from the CFF, so a dotless-j
+// font can be derived from it without reading it back in
+static String generated_type1_filename;
+static Efont::Type1Font *generated_type1_font;
+
+static bool
+write_type1_file(Efont::Type1Font *font, const String &filename, ErrorHandler *errh)
+{
+    if (no_create) {
+        errh->message("would create %s", filename.c_str());
+        return true;
+    }
+    if (verbose)
+        errh->message("creating %s", filename.c_str());
+    // write a new file and rename it into place, so batch workers that
+    // generate the same font never read it half written
+    String tmp_filename = filename + "." + String((int) getpid()) + ".tmp";
+    FILE *f = fopen(tmp_filename.c_str(), "wb");
+    if (!f) {
+        errh->error("%s: %s", tmp_filename.c_str(), strerror(errno));
+        return false;
+    }
+    {
+        Efont::Type1PFBWriter w(f);
+        font->write(w);
+    }
+    if (fclose(f) != 0 || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        errh->error("%s: %s", filename.c_str(), strerror(errno));
+        unlink(tmp_filename.c_str());
+        return false;
+    }
+    return true;
+}
+#endif
+
+#if HAVE_AUTO_T1DOTLESSJ
+static Efont::Type1Font *
+read_type1_file(const String &filename, ErrorHandler *errh)
+{
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) {
+        errh->error("%s: %s", filename.c_str(), strerror(errno));
+        return 0;
+    }
+    Efont::Type1Reader *reader;
+    int c = getc(f);
+    ungetc(c, f);
+    if (c == 128)
+        reader = new Efont::Type1PFBReader(f);
+    else
+        reader = new Efont::Type1PFAReader(f);
+    Efont::Type1Font *font = new Efont::Type1Font(*reader);
+    delete reader;
+    fclose(f);
+    if (!font->ok()) {
+        errh->error("%s: no glyphs in font", filename.c_str());
+        delete font;
+        return 0;
+    }
+    return font;
+}
+#endif
+
 String
-installed_type1(const String &otf_filename, const String &ps_fontname, bool allow_generate, ErrorHandler *errh)
+installed_type1(const FontInfo &finfo, const String &ps_fontname, bool allow_generate, ErrorHandler *errh)
 {
-    (void) otf_filename, (void) allow_generate, (void) errh;
+    (void) finfo, (void) allow_generate, (void) errh;
 
     if (!ps_fontname)
         return String();
 
 #if HAVE_KPATHSEA
 # if HAVE_AUTO_CFFTOT1
-    if (!(force && allow_generate && otf_filename && otf_filename != "-" && getodir(O_TYPE1, errh))) {
+    if (!(force && allow_generate && finfo.cff && getodir(O_TYPE1, errh))) {
 # endif
         // look for .pfb and .pfa
         String file, path;
-        if ((file = ps_fontname + ".pfb", path = kpsei_string(kpsei_find_file(file.c_str(), KPSEI_FMT_TYPE1)))
-            || (file = ps_fontname + ".pfa", path = kpsei_string(kpsei_find_file(file.c_str(), KPSEI_FMT_TYPE1)))) {
+        if ((file = ps_fontname + ".pfb", path = kpsei_find_file_cached(file, KPSEI_FMT_TYPE1))
+            || (file = ps_fontname + ".pfa", path = kpsei_find_file_cached(file, KPSEI_FMT_TYPE1))) {
             if (path == "./" + file || path == file) {
                 if (verbose)
                     errh->message("ignoring Type 1 file %s found with kpathsea in %<.%>", path.c_str());
@@ -398,23 +751,22 @@ installed_type1(const String &otf_filename, const String &ps_fontname, bool allo
 #endif
 
 #if HAVE_AUTO_CFFTOT1
-    // if not found, and can generate on the fly, run cfftot1
-    if (allow_generate && otf_filename && otf_filename != "-" && getodir(O_TYPE1, errh)) {
+    // if not found, and can generate on the fly, translate the CFF font
+    if (allow_generate && finfo.cff && getodir(O_TYPE1, errh)) {
         String pfb_filename = odir[O_TYPE1] + "/" + ps_fontname + ".pfb";
-        if (pfb_filename.find_left('\'') >= 0 || otf_filename.find_left('\'') >= 0)
-            return String();
-        String command = "cfftot1 " + shell_quote(otf_filename) + " -n " + shell_quote(ps_fontname) + " " + shell_quote(pfb_filename);
-        int retval = mysystem(command.c_str(), errh);
-        if (retval == 127)
-            errh->error("could not run %<%s%>", command.c_str());
-        else if (retval < 0)
-            errh->error("could not run %<%s%>: %s", command.c_str(), strerror(errno));
-        else if (retval != 0)
-            errh->error("%<%s%> failed", command.c_str());
-        if (retval == 0) {
+        if (pfb_filename == generated_type1_filename)
+            return pfb_filename;
+        if (verbose)
+            errh->message("translating %s to Type 1", finfo.cff->font_name().c_str());
+        Efont::Type1Font *font = Efont::create_type1_font(finfo.cff, errh);
+        if (font && write_type1_file(font, pfb_filename, errh)) {
+            delete generated_type1_font;
+            generated_type1_filename = pfb_filename;
+            generated_type1_font = font;
             update_odir(O_TYPE1, pfb_filename, errh);
             return pfb_filename;
         }
+        delete font;
     }
 #endif
 
@@ -422,9 +774,9 @@ installed_type1(const String &otf_filename, const String &ps_fontname, bool allo
 }
 
 String
-installed_type1_dotlessj(const String &otf_filename, const String &ps_fontname, bool allow_generate, ErrorHandler *errh)
+installed_type1_dotlessj(const FontInfo &finfo, const String &ps_fontname, bool allow_generate, ErrorHandler *errh)
 {
-    (void) otf_filename, (void) allow_generate, (void) errh;
+    (void) finfo, (void) allow_generate, (void) errh;
 
     if (!ps_fontname)
         return String();
@@ -439,8 +791,8 @@ installed_type1_dotlessj(const String &otf_filename, const String &ps_fontname,
 # endif
         // look for existing .pfb or .pfa
         String file, path;
-        if ((file = j_ps_fontname + ".pfb", path = kpsei_string(kpsei_find_file(file.c_str(), KPSEI_FMT_TYPE1)))
-            || (file = j_ps_fontname + ".pfa", path = kpsei_string(kpsei_find_file(file.c_str(), KPSEI_FMT_TYPE1)))) {
+        if ((file = j_ps_fontname + ".pfb", path = kpsei_find_file_cached(file, KPSEI_FMT_TYPE1))
+            || (file = j_ps_fontname + ".pfa", path = kpsei_find_file_cached(file, KPSEI_FMT_TYPE1))) {
             // ignore versions in the current directory
             if (path == "./" + file || path == file) {
                 if (verbose)
@@ -457,23 +809,33 @@ installed_type1_dotlessj(const String &otf_filename, const String &ps_fontname,
 #endif
 
 #if HAVE_AUTO_T1DOTLESSJ
-    // if not found, and can generate on the fly, try running t1dotlessj
+    // if not found, and can generate on the fly, derive it from the
+    // Type 1 font
     if (allow_generate && getodir(O_TYPE1, errh)) {
-        if (String base_filename = installed_type1(otf_filename, ps_fontname, allow_generate, errh)) {
+        if (String base_filename = installed_type1(finfo, ps_fontname, allow_generate, errh)) {
             String pfb_filename = odir[O_TYPE1] + "/" + j_ps_fontname + ".pfb";
-            if (pfb_filename.find_left('\'') >= 0 || base_filename.find_left('\'') >= 0)
-                return String();
-            String command = "t1dotlessj " + shell_quote(base_filename) + " -n " + shell_quote(j_ps_fontname) + " " + shell_quote(pfb_filename);
-            int retval = mysystem(command.c_str(), errh);
-            if (retval == 127)
-                errh->warning("could not run %<%s%>", command.c_str());
-            else if (retval < 0)
-                errh->warning("could not run %<%s%>: %s", command.c_str(), strerror(errno));
-            else if (WEXITSTATUS(retval) == T1DOTLESSJ_EXIT_J_NODOT)
+            Efont::Type1Font *base_font = 0;
+            if (base_filename == generated_type1_filename)
+                base_font = generated_type1_font;
+            else
+                base_font = read_type1_file(base_filename, errh);
+
+            int status = -1;
+            Efont::Type1Font *font = 0;
+            if (base_font)
+                font = Efont::create_dotlessj_font(base_font, j_ps_fontname, &status);
+            if (base_font && base_font != generated_type1_font)
+                delete base_font;
+
+            if (status == Efont::DOTLESSJ_J_NODOT)
                 return String("\0", 1);
-            else if (retval != 0)
-                errh->warning("%<%s%> failed (%d)", command.c_str(), retval);
-            if (retval == 0) {
+            else if (status == Efont::DOTLESSJ_EXISTS)
+                errh->warning("%s: already has a dotless-j glyph", base_filename.c_str());
+            else if (status == Efont::DOTLESSJ_NO_J)
+                errh->warning("%s: has no %<j%> glyph to make dotless", base_filename.c_str());
+            bool ok = font && write_type1_file(font, pfb_filename, errh);
+            delete font;
+            if (ok) {
                 update_odir(O_TYPE1, pfb_filename, errh);
                 return pfb_filename;
             } else
@@ -492,7 +854,7 @@ installed_truetype(const String &ttf_filename, bool allow_generate, ErrorHandler
 
 #if HAVE_KPATHSEA
     if (!(force && allow_generate && ttf_filename && ttf_filename != "-" && getodir(O_TRUETYPE, errh))) {
-        if (String path = kpsei_string(kpsei_find_file(file.c_str(), KPSEI_FMT_TRUETYPE))) {
+        if (String path = kpsei_find_file_cached(file, KPSEI_FMT_TRUETYPE)) {
             if (path == "./" + file || path == file) {
                 if (verbose)
                     errh->message("ignoring TrueType file %s found with kpathsea in %<.%>", path.c_str());
@@ -537,20 +899,20 @@ installed_truetype(const String &ttf_filename, bool allow_generate, ErrorHandler
 }
 
 String
-installed_type42(const String &ttf_filename, const String &ps_fontname, bool allow_generate, ErrorHandler *errh)
+installed_type42(const FontInfo &finfo, const String &ps_fontname, bool allow_generate, ErrorHandler *errh)
 {
-    (void) allow_generate, (void) ttf_filename, (void) errh;
+    (void) allow_generate, (void) finfo, (void) errh;
 
     if (!ps_fontname)
         return String();
 
 #if HAVE_KPATHSEA
 # if HAVE_AUTO_TTFTOTYPE42
-    if (!(force && allow_generate && ttf_filename && ttf_filename != "-" && getodir(O_TYPE42, errh))) {
+    if (!(force && allow_generate && !finfo.cff && getodir(O_TYPE42, errh))) {
 # endif
         // look for .pfb and .pfa
         String file, path;
-        if ((file = ps_fontname + ".t42", path = kpsei_string(kpsei_find_file(file.c_str(), KPSEI_FMT_TYPE42)))) {
+        if ((file = ps_fontname + ".t42", path = kpsei_find_file_cached(file, KPSEI_FMT_TYPE42))) {
             if (path == "./" + file || path == file) {
                 if (verbose)
                     errh->message("ignoring Type 42 file %s found with kpathsea in %<.%>", path.c_str());
@@ -566,20 +928,18 @@ installed_type42(const String &ttf_filename, const String &ps_fontname, bool all
 #endif
 
 #if HAVE_AUTO_TTFTOTYPE42
-    // if not found, and can generate on the fly, run ttftotype42
-    if (allow_generate && ttf_filename && ttf_filename != "-" && getodir(O_TYPE42, errh)) {
+    // if not found, and can generate on the fly, translate the TrueType font
+    if (allow_generate && !finfo.cff && getodir(O_TYPE42, errh)) {
         String t42_filename = odir[O_TYPE42] + "/" + ps_fontname + ".t42";
-        if (t42_filename.find_left('\'') >= 0 || ttf_filename.find_left('\'') >= 0)
-            return String();
-        String command = "ttftotype42 " + shell_quote(ttf_filename) + " " + shell_quote(t42_filename);
-        int retval = mysystem(command.c_str(), errh);
-        if (retval == 127)
-            errh->error("could not run %<%s%>", command.c_str());
-        else if (retval < 0)
-            errh->error("could not run %<%s%>: %s", command.c_str(), strerror(errno));
-        else if (retval != 0)
-            errh->error("%<%s%> failed", command.c_str());
-        if (retval == 0) {
+        bool ok;
+        if (no_create) {
+            errh->message("would create %s", t42_filename.c_str());
+            ok = true;
+        } else {
+            String t42 = Efont::create_type42_font(*finfo.otf, errh);
+            ok = t42 && write_file(t42_filename, t42, errh);
+        }
+        if (ok) {
             update_odir(O_TYPE42, t42_filename, errh);
             return t42_filename;
         }
@@ -589,201 +949,291 @@ installed_type42(const String &ttf_filename, const String &ps_fontname, bool all
     return String();
 }
 
-int
-update_autofont_map(const String &fontname, String mapline, ErrorHandler *errh)
+// Replace FONTNAME's line in the map file TEXT with MAPLINE.  Returns 1 if
+// TEXT changed, 0 if not, and -1 if TEXT already contained MAPLINE.
+static int
+edit_autofont_map(String &text, const String &fontname, const String &mapline)
 {
-#if HAVE_KPATHSEA
-    if (automatic && !map_file && getodir(O_MAP, errh))
-        map_file = odir[O_MAP] + "/" + get_vendor() + ".map";
-#endif
+    String old_text = text;
+    int fl = 0;
+    int nl = text.find_left('\n') + 1;
+    bool changed = false;
+    while (fl < text.length()) {
+        if (fl + fontname.length() + 1 < nl
+            && memcmp(text.data() + fl, fontname.data(), fontname.length()) == 0
+            && text[fl + fontname.length()] == ' ') {
+            // found the old name
+            if (text.substring(fl, nl - fl) == mapline) {
+                // duplicate of old name, don't change it
+                text = old_text;
+                return -1;
+            } else {
+                text = text.substring(0, fl) + text.substring(nl);
+                nl = fl;
+                changed = true;
+            }
+        }
+        fl = nl;
+        nl = text.find_left('\n', fl) + 1;
+    }
 
-    if (map_file == "" || map_file == "-")
-        fputs(mapline.c_str(), stdout);
-    else {
-        // report no_create/verbose
-        if (no_create) {
-            errh->message("would update %s for %s", map_file.c_str(), String(fontname).c_str());
-            return 0;
-        } else if (verbose)
-            errh->message("updating %s for %s", map_file.c_str(), String(fontname).c_str());
+    // add our text
+    if (mapline) {
+        text += mapline;
+        changed = true;
+    }
+    return changed;
+}
 
-        int fd = open(map_file.c_str(), O_RDWR | O_CREAT, 0666);
-        if (fd < 0)
-            return errh->lerror(map_file, "%s", strerror(errno));
-        FILE *f = fdopen(fd, "r+");
-        // NB: also change encoding logic if you change this code
+static bool defer_map = false;
+static Vector<String> deferred_map_fontnames;
+static Vector<String> deferred_map_lines;
+
+static int
+write_autofont_map(const Vector<String> &fontnames, const Vector<String> &maplines, ErrorHandler *errh)
+{
+    // report no_create/verbose
+    for (int i = 0; i < fontnames.size(); i++)
+        if (no_create)
+            errh->message("would update %s for %s", map_file.c_str(), fontnames[i].c_str());
+        else if (verbose)
+            errh->message("updating %s for %s", map_file.c_str(), fontnames[i].c_str());
+    if (no_create)
+        return 0;
+
+    int fd = open(map_file.c_str(), O_RDWR | O_CREAT, 0666);
+    if (fd < 0)
+        return errh->lerror(map_file, "%s", strerror(errno));
+    FILE *f = fdopen(fd, "r+");
+    // NB: also change encoding logic if you change this code
 
 #if defined(F_SETLKW) && defined(HAVE_FTRUNCATE)
-        {
-            struct flock lock;
-            lock.l_type = F_WRLCK;
-            lock.l_whence = SEEK_SET;
-            lock.l_start = 0;
-            lock.l_len = 0;
-            int result;
-            while ((result = fcntl(fd, F_SETLKW, &lock)) < 0 && errno == EINTR)
-                /* try again */;
-            if (result < 0) {
-                result = errno;
-                fclose(f);
-                return errh->error("locking %s: %s", map_file.c_str(), strerror(result));
-            }
+    {
+        struct flock lock;
+        lock.l_type = F_WRLCK;
+        lock.l_whence = SEEK_SET;
+        lock.l_start = 0;
+        lock.l_len = 0;
+        int result;
+        while ((result = fcntl(fd, F_SETLKW, &lock)) < 0 && errno == EINTR)
+            /* try again */;
+        if (result < 0) {
+            result = errno;
+            fclose(f);
+            return errh->error("locking %s: %s", map_file.c_str(), strerror(result));
         }
+    }
 #endif
 
-        // read old data from map file
-        StringAccum sa;
-        int amt;
-        do {
-            if (char *x = sa.reserve(8192)) {
-                amt = fread(x, 1, 8192, f);
-                sa.adjust_length(amt);
-            } else
-                amt = 0;
-        } while (amt != 0);
-        if (!feof(f))
-            return errh->error("%s: %s", map_file.c_str(), strerror(errno));
-        String text = sa.take_string();
-
-        // add comment if necessary
-        bool created = (!text);
-        if (created)
-            text = "% Automatically maintained by otftotfm or other programs. Do not edit.\n\n";
-        if (text.back() != '\n')
-            text += "\n";
-
-        // append old encodings
-        int fl = 0;
-        int nl = text.find_left('\n') + 1;
-        bool changed = created;
-        while (fl < text.length()) {
-            if (fl + fontname.length() + 1 < nl
-                && memcmp(text.data() + fl, fontname.data(), fontname.length()) == 0
-                && text[fl + fontname.length()] == ' ') {
-                // found the old name
-                if (text.substring(fl, nl - fl) == mapline) {
-                    // duplicate of old name, don't change it
-                    fclose(f);
-                    if (verbose)
-                        errh->message("%s unchanged", map_file.c_str());
-                    return 0;
-                } else {
-                    text = text.substring(0, fl) + text.substring(nl);
-                    nl = fl;
-                    changed = true;
-                }
-            }
-            fl = nl;
-            nl = text.find_left('\n', fl) + 1;
-        }
-
-        if (!mapline && !changed) {
-            // special case: empty mapline, unchanged file
-            if (verbose)
-                errh->message("%s unchanged", map_file.c_str());
-        } else {
-            // add our text
-            text += mapline;
+    // read old data from map file
+    StringAccum sa;
+    int amt;
+    do {
+        if (char *x = sa.reserve(8192)) {
+            amt = fread(x, 1, 8192, f);
+            sa.adjust_length(amt);
+        } else
+            amt = 0;
+    } while (amt != 0);
+    if (!feof(f))
+        return errh->error("%s: %s", map_file.c_str(), strerror(errno));
+    String text = sa.take_string();
+
+    // add comment if necessary
+    bool created = (!text);
+    if (created)
+        text = "% Automatically maintained by otftotfm or other programs. Do not edit.\n\n";
+    if (text.back() != '\n')
+        text += "\n";
+
+    // replace old lines
+    bool changed = created, all_duplicates = true;
+    for (int i = 0; i < fontnames.size(); i++) {
+        int r = edit_autofont_map(text, fontnames[i], maplines[i]);
+        if (r > 0)
+            changed = true;
+        if (r >= 0)
+            all_duplicates = false;
+    }
 
-            // rewind file
+    if (all_duplicates && !created) {
+        // duplicates of old lines, don't change the file
+        fclose(f);
+        if (verbose)
+            errh->message("%s unchanged", map_file.c_str());
+        return 0;
+    } else if (!changed) {
+        // special case: empty maplines, unchanged file
+        if (verbose)
+            errh->message("%s unchanged", map_file.c_str());
+    } else {
+        // rewind file
 #if HAVE_FTRUNCATE
-            rewind(f);
-            if (ftruncate(fd, 0) < 0)
+        rewind(f);
+        if (ftruncate(fd, 0) < 0)
 #endif
-            {
-                fclose(f);
-                f = fopen(map_file.c_str(), "wb");
-                fd = fileno(f);
-            }
-
-            // write data
-            ignore_result(fwrite(text.data(), 1, text.length(), f));
+        {
+            fclose(f);
+            f = fopen(map_file.c_str(), "wb");
+            fd = fileno(f);
         }
 
-        fclose(f);
+        // write data
+        ignore_result(fwrite(text.data(), 1, text.length(), f));
+    }
+
+    fclose(f);
 
-        // inform about the new file if necessary
-        if (created)
-            update_odir(O_MAP, map_file, errh);
+    // inform about the new file if necessary
+    if (created)
+        update_odir(O_MAP, map_file, errh);
 
 #if HAVE_KPATHSEA && !WIN32
-        // run 'updmap' if present
-        String updmap_prog = output_flags & G_UPDMAP_USER ? "updmap-user" : "updmap-sys";
-        String updmap_dir, updmap_file;
-        if (automatic && (output_flags & G_UPDMAP))
-            updmap_dir = getodir(O_MAP_PARENT, errh);
-        if (updmap_dir
-            && (updmap_file = updmap_dir + "/" + updmap_prog)
-            && access(updmap_file.c_str(), X_OK) >= 0) {
-            // want to run `updmap` from its directory, can't use system()
-            if (verbose)
-                errh->message("running %s", updmap_file.c_str());
-
-            pid_t child = fork();
-            if (child < 0)
-                errh->fatal("%s during fork", strerror(errno));
-            else if (child == 0) {
-                // change to updmap directory, run it
-                if (chdir(updmap_dir.c_str()) < 0)
-                    errh->fatal("%s: %s during chdir", updmap_dir.c_str(), strerror(errno));
-                if (execl(output_flags & G_UPDMAP_USER ? "./updmap-user" : "./updmap-sys",
-                          updmap_file.c_str(),
-                          (const char*) 0) < 0)
-                    errh->fatal("%s: %s during exec", updmap_file.c_str(), strerror(errno));
-                exit(1);        // should never get here
-            }
+    // run 'updmap' if present
+    String updmap_prog = output_flags & G_UPDMAP_USER ? "updmap-user" : "updmap-sys";
+    String updmap_dir, updmap_file;
+    if (automatic && (output_flags & G_UPDMAP))
+        updmap_dir = getodir(O_MAP_PARENT, errh);
+    if (updmap_dir
+        && (updmap_file = updmap_dir + "/" + updmap_prog)
+        && access(updmap_file.c_str(), X_OK) >= 0) {
+        // want to run `updmap` from its directory, can't use system()
+        if (verbose)
+            errh->message("running %s", updmap_file.c_str());
+
+        pid_t child = fork();
+        if (child < 0)
+            errh->fatal("%s during fork", strerror(errno));
+        else if (child == 0) {
+            // change to updmap directory, run it
+            if (chdir(updmap_dir.c_str()) < 0)
+                errh->fatal("%s: %s during chdir", updmap_dir.c_str(), strerror(errno));
+            if (execl(output_flags & G_UPDMAP_USER ? "./updmap-user" : "./updmap-sys",
+                      updmap_file.c_str(),
+                      (const char*) 0) < 0)
+                errh->fatal("%s: %s during exec", updmap_file.c_str(), strerror(errno));
+            exit(1);        // should never get here
+        }
 
 # if HAVE_WAITPID
-            // wait for updmap to finish
-            int status;
-            while (1) {
-                pid_t answer = waitpid(child, &status, 0);
-                if (answer >= 0)
-                    break;
-                else if (errno != EINTR)
-                    errh->fatal("%s during wait", strerror(errno));
-            }
-            if (!WIFEXITED(status))
-                errh->warning("%s exited abnormally", updmap_file.c_str());
-            else if (WEXITSTATUS(status) != 0)
-                errh->warning("%s exited with status %d", updmap_file.c_str(), WEXITSTATUS(status));
+        // wait for updmap to finish
+        int status;
+        while (1) {
+            pid_t answer = waitpid(child, &status, 0);
+            if (answer >= 0)
+                break;
+            else if (errno != EINTR)
+                errh->fatal("%s during wait", strerror(errno));
+        }
+        if (!WIFEXITED(status))
+            errh->warning("%s exited abnormally", updmap_file.c_str());
+        else if (WEXITSTATUS(status) != 0)
+            errh->warning("%s exited with status %d", updmap_file.c_str(), WEXITSTATUS(status));
 # else
 #  error "need waitpid() support: report this bug to the maintainer"
 # endif
-            goto ran_updmap;
-        }
+        goto ran_updmap;
+    }
 
 # if HAVE_AUTO_UPDMAP
-        // run system updmap
-        if (output_flags & G_UPDMAP) {
-            String filename = map_file;
-            int slash = filename.find_right('/');
-            if (slash >= 0)
-                filename = filename.substring(slash + 1);
-            String redirect = verbose ? " 1>&2" : " >" DEV_NULL " 2>&1";
-            String command = updmap_prog + " --nomkmap --enable Map " + shell_quote(filename) + redirect
-                + CMD_SEP " " + updmap_prog + redirect;
-            int retval = mysystem(command.c_str(), errh);
-            if (retval == 127)
-                errh->warning("could not run %<%s%>", command.c_str());
-            else if (retval < 0)
-                errh->warning("could not run %<%s%>: %s", command.c_str(), strerror(errno));
-            else if (retval != 0)
-                errh->warning("%<%s%> exited with status %d;\nrun it manually to check for errors", command.c_str(), WEXITSTATUS(retval));
-            goto ran_updmap;
-        }
+    // run system updmap
+    if (output_flags & G_UPDMAP) {
+        String filename = map_file;
+        int slash = filename.find_right('/');
+        if (slash >= 0)
+            filename = filename.substring(slash + 1);
+        String redirect = verbose ? " 1>&2" : " >" DEV_NULL " 2>&1";
+        String command = updmap_prog + " --nomkmap --enable Map " + shell_quote(filename) + redirect
+            + CMD_SEP " " + updmap_prog + redirect;
+        int retval = mysystem(command.c_str(), errh);
+        if (retval == 127)
+            errh->warning("could not run %<%s%>", command.c_str());
+        else if (retval < 0)
+            errh->warning("could not run %<%s%>: %s", command.c_str(), strerror(errno));
+        else if (retval != 0)
+            errh->warning("%<%s%> exited with status %d;\nrun it manually to check for errors", command.c_str(), WEXITSTATUS(retval));
+        goto ran_updmap;
+    }
 # endif
 
-        if (verbose)
-            errh->message("not running updmap");
+    if (verbose)
+        errh->message("not running updmap");
 
-      ran_updmap: ;
+  ran_updmap: ;
 #endif
-    }
 
     return 0;
 }
 
+static void
+find_map_file(ErrorHandler *errh)
+{
+#if HAVE_KPATHSEA
+    if (automatic && !map_file && getodir(O_MAP, errh))
+        map_file = odir[O_MAP] + "/" + get_vendor() + ".map";
+#else
+    (void) errh;
+#endif
+}
+
+int
+update_autofont_map(const String &fontname, String mapline, ErrorHandler *errh)
+{
+    if (output_record) {
+        output_record->map_fontnames.push_back(fontname);
+        output_record->map_lines.push_back(mapline);
+    }
+
+    if (defer_map) {
+        deferred_map_fontnames.push_back(fontname);
+        deferred_map_lines.push_back(mapline);
+        return 0;
+    }
+
+    find_map_file(errh);
+    if (map_file == "" || map_file == "-") {
+        fputs(mapline.c_str(), stdout);
+        return 0;
+    }
+
+    Vector<String> fontnames, maplines;
+    fontnames.push_back(fontname);
+    maplines.push_back(mapline);
+    return write_autofont_map(fontnames, maplines, errh);
+}
+
+void
+defer_autofont_map(bool defer)
+{
+    defer_map = defer;
+}
+
+void
+take_deferred_autofont_map(Vector<String> &fontnames, Vector<String> &maplines)
+{
+    fontnames.swap(deferred_map_fontnames);
+    maplines.swap(deferred_map_lines);
+    deferred_map_fontnames.clear();
+    deferred_map_lines.clear();
+}
+
+int
+flush_autofont_map(ErrorHandler *errh)
+{
+    Vector<String> fontnames, maplines;
+    take_deferred_autofont_map(fontnames, maplines);
+    if (!fontnames.size())
+        return 0;
+
+    find_map_file(errh);
+    if (map_file == "" || map_file == "-") {
+        for (String *m = maplines.begin(); m != maplines.end(); m++)
+            fputs(m->c_str(), stdout);
+        return 0;
+    } else
+        return write_autofont_map(fontnames, maplines, errh);
+}
+
 String
 locate_encoding(String encfile, ErrorHandler *errh, bool literal)
 {
@@ -799,7 +1249,7 @@ locate_encoding(String encfile, ErrorHandler *errh, bool literal)
     }
 
 #if HAVE_KPATHSEA
-    if (String file = kpsei_string(kpsei_find_file(encfile.c_str(), KPSEI_FMT_ENCODING))) {
+    if (String file = kpsei_find_file_cached(encfile, KPSEI_FMT_ENCODING)) {
         if (verbose)
             errh->message("encoding file %s found with kpathsea at %s", encfile.c_str(), file.c_str());
         return file;
@@ -1,7 +1,9 @@
 #ifndef OTFTOTFM_AUTOMATIC_HH
 #define OTFTOTFM_AUTOMATIC_HH
 #include <lcdf/string.hh>
+#include <lcdf/vector.hh>
 class ErrorHandler;
+struct FontInfo;
 
 enum {
     O_ENCODING = 0, O_TFM, O_PL, O_VF, O_VPL, O_TYPE1, O_MAP, O_MAP_PARENT,
@@ -14,14 +16,32 @@ String getodir(int o, ErrorHandler *);
 void setodir(int o, const String &);
 bool set_vendor(const String &);
 bool set_typeface(const String &, bool override);
+void reset_typeface();
 bool set_map_file(const String &);
 const char *odirname(int o);
+const char *odirenvvar(int o);
 void update_odir(int o, String file, ErrorHandler *);
-String installed_type1(const String &otf_filename, const String &ps_fontname, bool allow_generate, ErrorHandler *);
-String installed_type1_dotlessj(const String &otf_filename, const String &ps_fontname, bool allow_generate, ErrorHandler *);
+String installed_type1(const FontInfo &, const String &ps_fontname, bool allow_generate, ErrorHandler *);
+String installed_type1_dotlessj(const FontInfo &, const String &ps_fontname, bool allow_generate, ErrorHandler *);
 String installed_truetype(const String &ttf_filename, bool allow_generate, ErrorHandler *errh);
-String installed_type42(const String &ttf_filename, const String &ps_fontname, bool allow_generate, ErrorHandler *errh);
+String installed_type42(const FontInfo &, const String &ps_fontname, bool allow_generate, ErrorHandler *errh);
 int update_autofont_map(const String &fontname, String mapline, ErrorHandler *);
+void defer_autofont_map(bool defer);
+void take_deferred_autofont_map(Vector<String> &fontnames, Vector<String> &maplines);
+int flush_autofont_map(ErrorHandler *);
+struct OutputRecord {
+    Vector<String> files;
+    Vector<String> map_fontnames;
+    Vector<String> map_lines;
+};
+void set_output_record(OutputRecord *);
+void record_output_file(const String &);
+
 String locate_encoding(String encfile, ErrorHandler *, bool literal = false);
+String find_kpathsea_file(const String &name, int format);
+void set_kpathsea_cache(const String &filename);
+void take_kpathsea_cache_changes(Vector<String> &changes);
+void apply_kpathsea_cache_changes(const Vector<String> &changes);
+int save_kpathsea_cache(ErrorHandler *);
 
 #endif
@@ -17,7 +17,9 @@
 #endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <kpathsea/progname.h>
+#include <kpathsea/absolute.h>
 #include <kpathsea/expand.h>
 #include <kpathsea/c-pathch.h>
 #include <kpathsea/tex-file.h>
@@ -88,6 +90,89 @@ kpsei_find_file(const char* name, int format)
     }
 }
 
+static char*
+format_path(kpse_file_format_type format)
+{
+    return kpse_brace_expand(kpse_init_format(format));
+}
+
+char*
+kpsei_format_path(int format)
+{
+    switch (format) {
+      case KPSEI_FMT_WEB2C:
+        return format_path(kpse_web2c_format);
+      case KPSEI_FMT_ENCODING: {
+#if HAVE_DECL_KPSE_ENC_FORMAT
+          char* enc = format_path(kpse_enc_format);
+          char* ps = format_path(kpse_tex_ps_header_format);
+          char* path = (char*) malloc(strlen(enc) + strlen(ps) + 2);
+          sprintf(path, "%s%c%s", enc, ENV_SEP, ps);
+          free(enc);
+          free(ps);
+          return path;
+#else
+          return format_path(kpse_tex_ps_header_format);
+#endif
+      }
+      case KPSEI_FMT_TYPE1:
+        return format_path(kpse_type1_format);
+      case KPSEI_FMT_TYPE42:
+        return format_path(kpse_type42_format);
+      case KPSEI_FMT_TRUETYPE:
+        return format_path(kpse_truetype_format);
+#if HAVE_DECL_KPSE_OPENTYPE_FORMAT
+      case KPSEI_FMT_OPENTYPE:
+        return format_path(kpse_opentype_format);
+#endif
+      case KPSEI_FMT_OTHER_TEXT:
+        return format_path(kpse_program_text_format);
+      case KPSEI_FMT_MAP:
+        return format_path(kpse_fontmap_format);
+      default:
+        return 0;
+    }
+}
+
+static int
+path_searches_cwd(char* path)
+{
+    char *s = path, *e;
+    int r = 0;
+    while (r < 2 && *s) {
+        for (e = s; *e && !IS_ENV_SEP(*e); e++)
+            /* nada */;
+        if (e - s >= 2 && s[0] == '!' && s[1] == '!')
+            s += 2;
+        if (e > s) {
+            char c = *e;
+            *e = 0;
+            if (strcmp(s, ".") == 0 || strcmp(s, "./") == 0)
+                r = 1;
+            else if (!kpse_absolute_p(s, false))
+                r = 2;
+            *e = c;
+        }
+        s = (*e ? e + 1 : e);
+    }
+    return r;
+}
+
+int
+kpsei_format_searches_cwd(int format)
+{
+    static int searches_cwd[KPSEI_FMT_TYPE42 + 1];
+    char* path;
+    if (format < 0 || format > KPSEI_FMT_TYPE42)
+        return 2;
+    if (!searches_cwd[format]) {
+        path = kpsei_format_path(format);
+        searches_cwd[format] = (path ? path_searches_cwd(path) : 2) + 1;
+        free(path);
+    }
+    return searches_cwd[format] - 1;
+}
+
 void
 kpsei_set_debug_flags(unsigned flags)
 {
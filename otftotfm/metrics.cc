@@ -24,7 +24,8 @@
 #include <lcdf/straccum.hh>
 
 Metrics::Metrics(const Efont::CharstringProgram *font, int nglyphs)
-    : _boundary_glyph(nglyphs), _emptyslot_glyph(nglyphs + 1),
+    : _lig_index(-1), _kern_index(-1), _pair_index_valid(false),
+      _boundary_glyph(nglyphs), _emptyslot_glyph(nglyphs + 1),
       _design_units(1000), _units_per_em(font->units_per_em()),
       _liveness_marked(false)
 {
@@ -276,6 +277,49 @@ Metrics::Char::swap(Char &c)
 }
 
 
+/*****************************************************************************/
+/* indexing ligature and kern lists                                          */
+
+void
+Metrics::make_pair_index() const
+{
+    _lig_index.clear();
+    _kern_index.clear();
+    for (Code c = 0; c < _encoding.size(); c++) {
+        const Char &ch = _encoding[c];
+        // the first of any duplicate pairs wins, as in a linear search
+        for (int i = 0; i < ch.ligatures.size(); i++) {
+            int &x = _lig_index.find_force(CodePair(c, ch.ligatures[i].in2));
+            if (x < 0)
+                x = i;
+        }
+        for (int i = 0; i < ch.kerns.size(); i++) {
+            int &x = _kern_index.find_force(CodePair(c, ch.kerns[i].in2));
+            if (x < 0)
+                x = i;
+        }
+    }
+    _pair_index_valid = true;
+}
+
+template <typename T> static int
+first_pair(const Vector<T> &v, Metrics::Code in2)
+{
+    for (int i = 0; i < v.size(); i++)
+        if (v[i].in2 == in2)
+            return i;
+    return -1;
+}
+
+inline void
+Metrics::set_pair_index(HashMap<CodePair, int> &index, Code in1, Code in2, int i)
+{
+    // An invalid index will be rebuilt from scratch, so leave it alone.
+    if (_pair_index_valid)
+        index.find_force(CodePair(in1, in2)) = i;
+}
+
+
 /*****************************************************************************/
 /* manipulating ligature lists                                               */
 
@@ -283,18 +327,23 @@ Metrics::Ligature *
 Metrics::ligature_obj(Code code1, Code code2)
 {
     assert(valid_code(code1) && valid_code(code2));
-    Char &ch = _encoding[code1];
-    for (Ligature *l = ch.ligatures.begin(); l != ch.ligatures.end(); l++)
-        if (l->in2 == code2)
-            return l;
-    return 0;
+    if (!_pair_index_valid)
+        make_pair_index();
+    int i = _lig_index[CodePair(code1, code2)];
+    if (i < 0)
+        return 0;
+    Ligature *l = &_encoding[code1].ligatures[i];
+    assert(l->in2 == code2);
+    return l;
 }
 
 inline void
 Metrics::new_ligature(Code in1, Code in2, Code out)
 {
     assert(valid_code(in1) && valid_code(in2) && valid_code(out));
-    _encoding[in1].ligatures.push_back(Ligature(in2, out));
+    Vector<Ligature> &ligs = _encoding[in1].ligatures;
+    set_pair_index(_lig_index, in1, in2, ligs.size());
+    ligs.push_back(Ligature(in2, out));
 }
 
 inline void
@@ -303,6 +352,19 @@ Metrics::repoint_ligature(Code, Ligature *l, Code out)
     l->out = out;
 }
 
+void
+Metrics::remove_ligature(Code in1, Ligature *l)
+{
+    Vector<Ligature> &ligs = _encoding[in1].ligatures;
+    Code in2 = l->in2, moved_in2 = ligs.back().in2;
+    *l = ligs.back();
+    ligs.pop_back();
+    if (_pair_index_valid) {
+        _lig_index.find_force(CodePair(in1, in2)) = first_pair(ligs, in2);
+        _lig_index.find_force(CodePair(in1, moved_in2)) = first_pair(ligs, moved_in2);
+    }
+}
+
 void
 Metrics::add_ligature(Code in1, Code in2, Code out)
 {
@@ -351,12 +413,12 @@ Metrics::remove_ligatures(Code in1, Code in2)
             remove_ligatures(in1, in2);
     } else {
         Char &ch = _encoding[in1];
-        if (in2 == CODE_ALL)
+        if (in2 == CODE_ALL) {
+            for (Ligature *l = ch.ligatures.begin(); l != ch.ligatures.end(); l++)
+                set_pair_index(_lig_index, in1, l->in2, -1);
             ch.ligatures.clear();
-        else if (Ligature *l = ligature_obj(in1, in2)) {
-            *l = ch.ligatures.back();
-            ch.ligatures.pop_back();
-        }
+        } else if (Ligature *l = ligature_obj(in1, in2))
+            remove_ligature(in1, l);
     }
 }
 
@@ -368,22 +430,37 @@ Metrics::Kern *
 Metrics::kern_obj(Code in1, Code in2)
 {
     assert(valid_code(in1) && valid_code(in2));
-    Char &ch = _encoding[in1];
-    for (Kern *k = ch.kerns.begin(); k != ch.kerns.end(); k++)
-        if (k->in2 == in2)
-            return k;
-    return 0;
+    if (!_pair_index_valid)
+        make_pair_index();
+    int i = _kern_index[CodePair(in1, in2)];
+    if (i < 0)
+        return 0;
+    Kern *k = &_encoding[in1].kerns[i];
+    assert(k->in2 == in2);
+    return k;
 }
 
 int
 Metrics::kern(Code in1, Code in2) const
 {
     assert(valid_code(in1) && valid_code(in2));
-    const Char &ch = _encoding[in1];
-    for (const Kern *k = ch.kerns.begin(); k != ch.kerns.end(); k++)
-        if (k->in2 == in2)
-            return k->kern;
-    return 0;
+    if (!_pair_index_valid)
+        make_pair_index();
+    int i = _kern_index[CodePair(in1, in2)];
+    return i < 0 ? 0 : _encoding[in1].kerns[i].kern;
+}
+
+void
+Metrics::remove_kern(Code in1, Kern *k)
+{
+    Vector<Kern> &kerns = _encoding[in1].kerns;
+    Code in2 = k->in2, moved_in2 = kerns.back().in2;
+    *k = kerns.back();
+    kerns.pop_back();
+    if (_pair_index_valid) {
+        _kern_index.find_force(CodePair(in1, in2)) = first_pair(kerns, in2);
+        _kern_index.find_force(CodePair(in1, moved_in2)) = first_pair(kerns, moved_in2);
+    }
 }
 
 void
@@ -391,8 +468,11 @@ Metrics::add_kern(Code in1, Code in2, int kern)
 {
     if (Kern *k = kern_obj(in1, in2))
         k->kern += kern;
-    else
-        _encoding[in1].kerns.push_back(Kern(in2, kern));
+    else {
+        Vector<Kern> &kerns = _encoding[in1].kerns;
+        set_pair_index(_kern_index, in1, in2, kerns.size());
+        kerns.push_back(Kern(in2, kern));
+    }
 }
 
 void
@@ -405,21 +485,25 @@ Metrics::set_kern(Code in1, Code in2, int kern)
         Char &ch = _encoding[in1];
         if (in2 == CODE_ALL) {
             assert(kern == 0);
+            for (Kern *k = ch.kerns.begin(); k != ch.kerns.end(); k++)
+                set_pair_index(_kern_index, in1, k->in2, -1);
             ch.kerns.clear();
         } else if (Kern *k = kern_obj(in1, in2)) {
-            if (kern == 0) {
-                *k = ch.kerns.back();
-                ch.kerns.pop_back();
-            } else
+            if (kern == 0)
+                remove_kern(in1, k);
+            else
                 k->kern = kern;
-        } else if (kern != 0)
+        } else if (kern != 0) {
+            set_pair_index(_kern_index, in1, in2, ch.kerns.size());
             ch.kerns.push_back(Kern(in2, kern));
+        }
     }
 }
 
 int
 Metrics::reencode_right_ligkern(Code old_in2, Code new_in2)
 {
+    invalidate_pair_index();
     int nchanges = 0;
     for (Char *ch = _encoding.begin(); ch != _encoding.end(); ch++) {
         for (Ligature *l = ch->ligatures.begin(); l != ch->ligatures.end(); l++)
@@ -470,52 +554,32 @@ Metrics::add_single_positioning(Code c, int pdx, int pdy, int adx)
 /* changed_context structure                                                 */
 
 class Metrics::ChangedContext { public:
-    ChangedContext(int ncodes);
-    ~ChangedContext();
+    ChangedContext(int ncodes, Vector<int> &rows, Vector<uint32_t> &bits);
     typedef Metrics::Code Code;
 
-    enum Context { CH_NONE = 0, CH_SOME = 1, CH_ALL = 2 };
+    enum Context { CH_NONE = -1, CH_ALL = -2 };
     bool allowed(Code, bool left_context) const;
     bool pair_allowed(Code, Code) const;
     bool virgin(Code) const;
     void disallow(Code);
     void disallow_pair(Code, Code);
   private:
-    Vector<Vector<uint32_t> *> _v;
-    int _initial_ncodes;
-    mutable Vector<uint32_t> _all_sentinel;
+    // _rows[c] is CH_NONE, CH_ALL, or the offset in _bits of c's row, which
+    // has a bit set for each disallowed pair. Both vectors belong to the
+    // Metrics, so their memory is reused from one lookup to the next.
+    Vector<int> &_rows;
+    Vector<uint32_t> &_bits;
+    int _stride;
     ChangedContext(const ChangedContext &);
     ChangedContext &operator=(const ChangedContext &);
-    static inline bool bit(const Vector<uint32_t> &, Code);
-    inline void ensure_all(Code) const;
+    void restride(int);
 };
 
-Metrics::ChangedContext::ChangedContext(int ncodes)
-    : _v(ncodes, 0), _initial_ncodes(ncodes), _all_sentinel(((ncodes - 1) >> 5) + 1, 0xFFFFFFFFU)
+Metrics::ChangedContext::ChangedContext(int ncodes, Vector<int> &rows, Vector<uint32_t> &bits)
+    : _rows(rows), _bits(bits), _stride((ncodes >> 5) + 1)
 {
-}
-
-Metrics::ChangedContext::~ChangedContext()
-{
-    for (Vector<uint32_t> **v = _v.begin(); v != _v.end(); v++)
-        if (*v != &_all_sentinel)
-            delete *v;
-}
-
-inline void
-Metrics::ChangedContext::ensure_all(Code c) const
-{
-    if (c >= 0 && (c >> 5) >= _all_sentinel.size())
-        _all_sentinel.resize((c >> 5) + 1, 0xFFFFFFFFU);
-}
-
-inline bool
-Metrics::ChangedContext::bit(const Vector<uint32_t> &v, Code c)
-{
-    if (c < 0 || (c >> 5) >= v.size())
-        return false;
-    else
-        return (v[c >> 5] & (1 << (c & 0x1F))) != 0;
+    _rows.assign(ncodes, CH_NONE);
+    _bits.clear();
 }
 
 bool
@@ -523,55 +587,72 @@ Metrics::ChangedContext::allowed(Code c, bool left_context) const
 {
     if (c < 0)
         return false;
-    else if (c >= _v.size())
+    else if (c >= _rows.size())
         return left_context;
     else
-        return (_v[c] != &_all_sentinel);
+        return _rows[c] != CH_ALL;
 }
 
 bool
 Metrics::ChangedContext::pair_allowed(Code c1, Code c2) const
 {
-    ensure_all(c2);
     if (c1 < 0 || c2 < 0)
         return false;
-    else if (c1 >= _v.size() || c2 >= _v.size() || !_v[c1])
+    else if (c1 >= _rows.size() || c2 >= _rows.size() || _rows[c1] == CH_NONE)
         return true;
+    else if (_rows[c1] == CH_ALL)
+        return false;
     else
-        return !bit(*_v[c1], c2);
+        return (c2 >> 5) >= _stride
+            || !(_bits[_rows[c1] + (c2 >> 5)] & (1U << (c2 & 0x1F)));
 }
 
 bool
 Metrics::ChangedContext::virgin(Code c) const
 {
-    return (c >= 0 && (c >= _v.size() || _v[c] == 0));
+    return (c >= 0 && (c >= _rows.size() || _rows[c] == CH_NONE));
 }
 
 void
 Metrics::ChangedContext::disallow(Code c)
 {
     assert(c >= 0);
-    if (c >= _v.size())
-        _v.resize(c + 1, 0);
-    if (_v[c] != &_all_sentinel) {
-        delete _v[c];
-        _v[c] = &_all_sentinel;
-    }
+    if (c >= _rows.size())
+        _rows.resize(c + 1, CH_NONE);
+    _rows[c] = CH_ALL;
+}
+
+void
+Metrics::ChangedContext::restride(int stride)
+{
+    Vector<uint32_t> bits;
+    bits.reserve(_bits.size() / _stride * stride);
+    for (int *r = _rows.begin(); r != _rows.end(); r++)
+        if (*r >= 0) {
+            int pos = bits.size();
+            for (int i = 0; i < stride; i++)
+                bits.push_back(i < _stride ? _bits[*r + i] : 0);
+            *r = pos;
+        }
+    _bits.swap(bits);
+    _stride = stride;
 }
 
 void
 Metrics::ChangedContext::disallow_pair(Code c1, Code c2)
 {
     assert(c1 >= 0 && c2 >= 0);
-    if (c1 >= _v.size())
-        _v.resize(c1 + 1, 0);
-    if (!_v[c1])
-        _v[c1] = new Vector<uint32_t>;
-    if (_v[c1] != &_all_sentinel) {
-        if ((c2 >> 5) >= _v[c1]->size())
-            _v[c1]->resize((c2 >> 5) + 1, 0);
-        (*_v[c1])[c2 >> 5] |= 1 << (c2 & 0x1F);
+    if (c1 >= _rows.size())
+        _rows.resize(c1 + 1, CH_NONE);
+    if (_rows[c1] == CH_ALL)
+        return;
+    if ((c2 >> 5) >= _stride)
+        restride((c2 >> 5) + 1);
+    if (_rows[c1] == CH_NONE) {
+        _rows[c1] = _bits.size();
+        _bits.resize(_bits.size() + _stride, 0);
     }
+    _bits[_rows[c1] + (c2 >> 5)] |= 1U << (c2 & 0x1F);
 }
 
 
@@ -723,7 +804,7 @@ Metrics::apply(const Vector<Substitution>& sv, bool allow_single, int lookup, co
     Vector<Code> codes;
 
     // keep track of what substitutions we have performed
-    ChangedContext ctx(_encoding.size());
+    ChangedContext ctx(_encoding.size(), _changed_rows, _changed_bits);
 
     // loop over substitutions
     int failures = 0;
@@ -811,27 +892,36 @@ Metrics::apply_alternates(const Vector<Substitution>& sv, int lookup, const Glyp
 /*****************************************************************************/
 /* applying GPOS positionings                                                */
 
-static bool                     // returns old value
-assign_bitvec(int*& bitvec, int e, int n)
+static inline bool              // returns old value
+assign_bit(uint32_t *bits, int e)
 {
-    if (e >= 0 && e < n) {
-        if (!bitvec) {
-            bitvec = new int[((n - 1) >> 5) + 1];
-            memset(bitvec, 0, sizeof(int) * (((n - 1) >> 5) + 1));
-        }
-        bool result = (bitvec[e >> 5] & (1 << (e & 0x1F))) != 0;
-        bitvec[e >> 5] |= (1 << (e & 0x1F));
-        return result;
-    } else
-        return false;
+    uint32_t mask = 1U << (e & 0x1F);
+    bool result = (bits[e >> 5] & mask) != 0;
+    bits[e >> 5] |= mask;
+    return result;
+}
+
+inline uint32_t *
+Metrics::changed_row(Code c, int stride)
+{
+    int &pos = _changed_rows[c];
+    if (pos < 0) {
+        pos = _changed_bits.size();
+        _changed_bits.resize(pos + stride, 0);
+    }
+    return _changed_bits.begin() + pos;
 }
 
 int
 Metrics::apply(const Vector<Positioning>& pv)
 {
-    // keep track of what substitutions we have performed
-    int *single_changed = 0;
-    Vector<int *> pair_changed(_encoding.size(), 0);
+    // keep track of what positionings we have performed: _changed_rows[c]
+    // is the offset in _changed_bits of the bit row for pairs starting with
+    // 'c', or -1; _changed_rows[n] tracks single positionings. Positioning
+    // never adds codes, so 'n' is fixed.
+    int n = _encoding.size(), stride = (n >> 5) + 1;
+    _changed_rows.assign(n + 1, -1);
+    _changed_bits.clear();
     Vector<Glyph> glyphs;
     Vector<Code> codes;
 
@@ -843,22 +933,19 @@ Metrics::apply(const Vector<Positioning>& pv)
             p->all_in_glyphs(glyphs);
             for (codes.clear(); next_encoding(codes, glyphs); )
                 if (is_single) {
-                    if (!assign_bitvec(single_changed, codes[0], _encoding.size())) {
+                    if (!assign_bit(changed_row(n, stride), codes[0])) {
                         _encoding[codes[0]].pdx += p->left().pdx;
                         _encoding[codes[0]].pdy += p->left().pdy;
                         _encoding[codes[0]].adx += p->left().adx;
                     }
                 } else {
-                    if (!assign_bitvec(pair_changed[codes[0]], codes[1], _encoding.size()))
+                    if (!assign_bit(changed_row(codes[0], stride), codes[1]))
                         add_kern(codes[0], codes[1], p->left().adx);
                 }
             success++;
         }
     }
 
-    delete[] single_changed;
-    for (int i = 0; i < pair_changed.size(); i++)
-        delete[] pair_changed[i];
     return success;
 }
 
@@ -980,6 +1067,7 @@ Metrics::reencode(const Vector<Code> &reencoding)
             ch->base_code = reencoding[ch->base_code];
     }
     _emap.clear();
+    invalidate_pair_index();
 }
 
 
@@ -1021,6 +1109,7 @@ Metrics::cut_encoding(int size)
     /* Need liveness markings. */
     if (!_liveness_marked)
         mark_liveness(size);
+    invalidate_pair_index();
 
     /* Characters below 'size' are 'good'.
        Characters above 'size' are not 'good'. */
@@ -1242,6 +1331,7 @@ Metrics::shrink_encoding(int size, const DvipsEncoding &dvipsenc, ErrorHandler *
     std::sort(slots.begin(), slots.end());
 
     /* Prefer their old slots, if available. */
+    invalidate_pair_index();
     for (Slot *slot = slots.begin(); slot < slots.end(); slot++)
         if (PermString g = code_name(slot->old_code)) {
             int c = dvipsenc.encoding_of(g);
@@ -1333,6 +1423,7 @@ To select specific glyphs, add them to the input encoding.)", sa.c_str());
 void
 Metrics::make_base(int size)
 {
+    invalidate_pair_index();
     Vector<Code> reencoding;
     for (Code c = 0; c < size && c < _encoding.size(); c++) {
         Char &ch = _encoding[c];
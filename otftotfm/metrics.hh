@@ -2,6 +2,7 @@
 #define OTFTOTFM_METRICS_HH
 #include <efont/otfgsub.hh>
 #include <efont/otfgpos.hh>
+#include <lcdf/hashmap.hh>
 #include "setting.hh"
 namespace Efont { class CharstringProgram; }
 class DvipsEncoding;
@@ -105,6 +106,14 @@ class Metrics { public:
         Vector<Setting> setting;
     };
 
+    struct CodePair {
+        Code in1;
+        Code in2;
+        CodePair()                      : in1(-1), in2(-1) { }
+        CodePair(Code in1_, Code in2_)  : in1(in1_), in2(in2_) { }
+        operator bool() const           { return in1 >= 0; }
+    };
+
     struct Ligature3 {
         Code in1;
         Code in2;
@@ -145,6 +154,16 @@ class Metrics { public:
     Vector<Char> _encoding;
     mutable Vector<int> _emap;
 
+    // (in1, in2) -> index into _encoding[in1].ligatures/kerns, or -1.
+    // Rebuilt on demand after bulk changes to the lists.
+    mutable HashMap<CodePair, int> _lig_index;
+    mutable HashMap<CodePair, int> _kern_index;
+    mutable bool _pair_index_valid;
+
+    // scratch space for apply()
+    Vector<int> _changed_rows;
+    Vector<uint32_t> _changed_bits;
+
     Glyph _boundary_glyph;
     Glyph _emptyslot_glyph;
 
@@ -166,8 +185,13 @@ class Metrics { public:
     Code hard_encoding(Glyph, Code) const;
     bool next_encoding(Vector<Code> &codes, const Vector<Glyph> &glyphs) const;
 
+    void make_pair_index() const;
+    void invalidate_pair_index()        { _pair_index_valid = false; }
+    inline void set_pair_index(HashMap<CodePair, int> &, Code, Code, int);
     Ligature *ligature_obj(Code, Code);
     Kern *kern_obj(Code, Code);
+    void remove_ligature(Code in1, Ligature *);
+    void remove_kern(Code in1, Kern *);
     inline void new_ligature(Code, Code, Code);
     inline void repoint_ligature(Code, Ligature *, Code);
 
@@ -177,6 +201,7 @@ class Metrics { public:
     void reencode(const Vector<Code> &);
 
     class ChangedContext;
+    inline uint32_t *changed_row(Code, int stride);
     void apply_ligature(const Vector<Code> &, const Substitution *, int lookup);
     void apply_single(Code cin, const Substitution *s, int lookup,
                 ChangedContext &ctx, const GlyphFilter &glyph_filter,
@@ -198,6 +223,18 @@ class Metrics { public:
 };
 
 
+inline bool
+operator==(const Metrics::CodePair &a, const Metrics::CodePair &b)
+{
+    return a.in1 == b.in1 && a.in2 == b.in2;
+}
+
+inline hashcode_t
+hashcode(const Metrics::CodePair &p)
+{
+    return (hashcode_t) p.in1 * 0x9E3779B1U + p.in2;
+}
+
 inline bool
 Metrics::valid_code(Code code) const
 {
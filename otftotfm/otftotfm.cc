@@ -35,6 +35,7 @@
 #include "kpseinterface.h"
 #include "util.hh"
 #include "otftotfm.hh"
+#include "tfmwriter.hh"
 #include <lcdf/md5.h>
 #include <lcdf/clp.h>
 #include <lcdf/error.hh>
@@ -64,6 +65,15 @@
 #ifdef HAVE_FCNTL_H
 # include <fcntl.h>
 #endif
+#ifdef HAVE_SYS_WAIT_H
+# include <sys/wait.h>
+#endif
+#ifdef HAVE_POLL_H
+# include <poll.h>
+#endif
+#if !defined(WIN32) && HAVE_FORK && HAVE_WAITPID && HAVE_POLL_H
+# define HAVE_BATCH_WORKERS 1
+#endif
 
 using namespace Efont;
 
@@ -72,6 +82,7 @@ using namespace Efont;
 #define QUERY_SCRIPTS_OPT       303
 #define QUERY_FEATURES_OPT      304
 #define KPATHSEA_DEBUG_OPT      305
+#define KPATHSEA_CACHE_OPT      306
 
 #define SCRIPT_OPT              311
 #define FEATURE_OPT             312
@@ -108,6 +119,7 @@ using namespace Efont;
 #define ITALIC_ANGLE_OPT        343
 #define PROPORTIONAL_WIDTH_OPT  344
 #define X_HEIGHT_OPT            345
+#define FACE_OPT                346
 
 #define AUTOMATIC_OPT           350
 #define FONT_NAME_OPT           351
@@ -124,6 +136,10 @@ using namespace Efont;
 #define TFM_OPT                 362
 #define MAP_FILE_OPT            363
 #define OUTPUT_ENCODING_OPT     364
+#define NATIVE_TFM_OPT          365
+#define CHECK_TFM_OPT           366
+#define BATCH_OPT               367
+#define JOBS_OPT                368
 
 #define DIR_OPTS                380
 #define ENCODING_DIR_OPT        (DIR_OPTS + O_ENCODING)
@@ -194,6 +210,7 @@ static Clp_Option options[] = {
     { "proportional-width", 0, PROPORTIONAL_WIDTH_OPT, 0, Clp_Negate },
     { "italic-angle", 0, ITALIC_ANGLE_OPT, Clp_ValDouble, 0 },
     { "x-height", 0, X_HEIGHT_OPT, Clp_ValString, 0 },
+    { "face", 0, FACE_OPT, Clp_ValUnsigned, 0 },
 
     { "pl", 'p', PL_OPT, 0, Clp_Negate },
     { "tfm", 't', TFM_OPT, 0, Clp_Negate }, // not in documentation
@@ -208,6 +225,10 @@ static Clp_Option options[] = {
     { "type42", 0, TYPE42_OPT, 0, Clp_Negate },
     { "map-file", 0, MAP_FILE_OPT, Clp_ValString, Clp_Negate },
     { "output-encoding", 0, OUTPUT_ENCODING_OPT, Clp_ValString, Clp_Optional },
+    { "native-tfm", 0, NATIVE_TFM_OPT, 0, Clp_Negate },
+    { "check-tfm", 0, CHECK_TFM_OPT, 0, Clp_Negate },
+    { "batch", 0, BATCH_OPT, Clp_ValString, 0 },
+    { "jobs", 'j', JOBS_OPT, Clp_ValInt, 0 },
 
     { "automatic", 'a', AUTOMATIC_OPT, 0, Clp_Negate },
     { "name", 'n', FONT_NAME_OPT, Clp_ValString, 0 },
@@ -230,6 +251,7 @@ static Clp_Option options[] = {
     { "force", 0, FORCE_OPT, 0, Clp_Negate },
     { "verbose", 'V', VERBOSE_OPT, 0, Clp_Negate },
     { "kpathsea-debug", 0, KPATHSEA_DEBUG_OPT, Clp_ValInt, 0 },
+    { "kpathsea-cache", 0, KPATHSEA_CACHE_OPT, Clp_ValString, 0 },
 
     { "help", 'h', HELP_OPT, 0, 0 },
     { "version", 0, VERSION_OPT, 0, 0 },
@@ -290,6 +312,9 @@ static double x_height;
 static String out_encoding_file;
 static String out_encoding_name;
 
+static bool native_tfm = true;
+static bool check_tfm = false;
+
 unsigned output_flags = G_ENCODING | G_METRICS | G_VMETRICS | G_PSFONTSMAP | G_TYPE1 | G_DOTLESSJ | G_UPDMAP | G_TRUETYPE;
 
 bool automatic = false;
@@ -298,8 +323,6 @@ bool no_create = false;
 bool quiet = false;
 bool force = false;
 
-static String otf_data;
-
 
 void
 usage_error(ErrorHandler *errh, const char *error_message, ...)
@@ -327,8 +350,9 @@ turn on optional OpenType features, and a %<-e ENC%> option to specify a base\n\
 encoding. Output files are written to the current directory (but see\n\
 %<--automatic%> and the %<directory%> options).\n\
 \n\
-Usage: %s [-a] [OPTIONS] OTFFILE FONTNAME\n\n",
-           program_name);
+Usage: %s [-a] [OPTIONS] OTFFILE FONTNAME\n\
+       %s [-a] [OPTIONS] --batch=FILE\n\n",
+           program_name, program_name);
     uerrh.message("\
 Font feature and transformation options:\n\
   -s, --script=SCRIPT[.LANG]   Use features for script SCRIPT[.LANG] [latn].\n\
@@ -348,6 +372,7 @@ Font feature and transformation options:\n\
       --fixed-width            Set fixed width (no space stretch).\n\
       --italic-angle=ANGLE     Set font italic angle (for positioning accents).\n\
       --x-height=AMT           Set x-height to AMT units.\n\
+      --face=N                 Use font N of a font collection [0].\n\
 \n");
     uerrh.message("\
 Encoding options:\n\
@@ -387,6 +412,8 @@ Output options:\n\
       --no-encoding            Do not generate an encoding file.\n\
       --no-map                 Do not generate a psfonts.map line.\n\
       --output-encoding[=FILE] Only generate an encoding file.\n\
+      --no-native-tfm          Run pltotf/vptovf to generate TFM/VFs.\n\
+      --check-tfm              Compare TFM/VFs with pltotf/vptovf output.\n\
 \n");
     uerrh.message("\
 File location options:\n\
@@ -401,12 +428,16 @@ File location options:\n\
       --map-file=FILE          Update FILE with psfonts.map information [-].\n\
 \n\
 Other options:\n\
+      --batch=FILE             Run the jobs listed in FILE, one per line.\n\
+  -j, --jobs=N                 Run up to N batch jobs in parallel [1].\n\
       --glyphlist=FILE         Use FILE to map Adobe glyph names to Unicode.\n\
   -V, --verbose                Print progress information to standard error.\n\
       --no-create              Print messages, don't modify any files.\n\
-      --force                  Generate files even if versions already exist.\n"
+      --force                  Generate files even if versions already exist,\n\
+                               or if an automatic-mode job is unchanged.\n"
 #if HAVE_KPATHSEA
-"      --kpathsea-debug=MASK    Set path searching debug flags to MASK.\n"
+"      --kpathsea-debug=MASK    Set path searching debug flags to MASK.\n\
+      --kpathsea-cache=FILE    Remember path searches between runs in FILE.\n"
 #endif
 "  -h, --help                   Print this message and exit.\n\
   -q, --quiet                  Do not generate any error messages.\n\
@@ -526,17 +557,28 @@ lig_context_str(int ctx)
 
 static double max_printed_real;
 
+// TFM fix_word for a real number as printed in a PL file
+static int
+real_fix(const char* s)
+{
+    int x = 0;
+    TfmWriter::parse_real(s, x);
+    return x;
+}
+
 namespace {
 struct Printer {
-    Printer(FILE* f, unsigned design_units, unsigned units_per_em)
-        : f_(f), du_((double) design_units / units_per_em),
+    Printer(FILE* f, TfmWriter* tfm, unsigned design_units, unsigned units_per_em)
+        : f_(f), tfm_(tfm), du_((double) design_units / units_per_em),
           round_(design_units == 1000) {
     }
     inline double transform(double value) const;
-    void print_transformed(const char* prefix, double value) const;
-    void print(const char* prefix, double value) const;
+    int print_transformed(const char* prefix, double value) const;
+    int print(const char* prefix, double value) const;
+    void print_param(const char* prefix, int param, double value) const;
     String render(double value) const;
     FILE* f_;
+    TfmWriter* tfm_;
     double du_;
     bool round_;
 };
@@ -548,16 +590,26 @@ inline double Printer::transform(double value) const {
     return value;
 }
 
-void Printer::print_transformed(const char* prefix, double value) const {
+int Printer::print_transformed(const char* prefix, double value) const {
+    char buf[128];
     if (round_ || value == 0 || (value > 0.01 && value - floor(value) < 0.01))
-        fprintf(f_, "%s R %g)\n", prefix, value);
+        snprintf(buf, sizeof(buf), "%g", value);
     else
-        fprintf(f_, "%s R %.4f)\n", prefix, value);
+        snprintf(buf, sizeof(buf), "%.4f", value);
+    if (f_)
+        fprintf(f_, "%s R %s)\n", prefix, buf);
     max_printed_real = std::max(max_printed_real, fabs(value));
+    return real_fix(buf);
+}
+
+int Printer::print(const char* prefix, double value) const {
+    return print_transformed(prefix, transform(value));
 }
 
-void Printer::print(const char* prefix, double value) const {
-    print_transformed(prefix, transform(value));
+void Printer::print_param(const char* prefix, int param, double value) const {
+    int x = print(prefix, value);
+    if (tfm_)
+        tfm_->set_param(param, x);
 }
 
 String Printer::render(double value) const {
@@ -580,47 +632,48 @@ font_slant(const FontInfo &finfo)
 }
 
 static void
-output_pl(Metrics &metrics, const String &ps_name, int boundary_char,
-          const FontInfo &finfo, bool vpl,
-          const String &filename, ErrorHandler *errh)
+write_metrics(Metrics &metrics, const String &ps_name, int boundary_char,
+              const FontInfo &finfo, bool vpl, FILE *f, TfmWriter *tfm)
 {
-    // create file
-    if (no_create) {
-        errh->message("would create %s", filename.c_str());
-        return;
-    }
-
-    if (verbose)
-        errh->message("creating %s", filename.c_str());
-    FILE *f = fopen(filename.c_str(), "wb");
-    if (!f) {
-        errh->error("%s: %s", filename.c_str(), strerror(errno));
-        return;
-    }
-
     // XXX check DESIGNSIZE and DESIGNUNITS for correctness
 
-    fprintf(f, "(COMMENT Created by '%s'%s)\n", invocation.c_str(), current_time.c_str());
+    if (f)
+        fprintf(f, "(COMMENT Created by '%s'%s)\n", invocation.c_str(), current_time.c_str());
 
     // calculate a TeX FAMILY name using afm2tfm's algorithm
     String family_name = String("TeX-") + ps_name;
     if (family_name.length() > 19)
         family_name = family_name.substring(0, 9) + family_name.substring(-10);
-    fprintf(f, "(FAMILY %s)\n", family_name.c_str());
-
-    if (metrics.coding_scheme())
-        fprintf(f, "(CODINGSCHEME %.39s)\n", String(metrics.coding_scheme()).c_str());
+    if (f)
+        fprintf(f, "(FAMILY %s)\n", family_name.c_str());
+    if (tfm)
+        tfm->set_family(family_name);
+
+    if (metrics.coding_scheme()) {
+        String coding_scheme = String(metrics.coding_scheme()).substring(0, 39);
+        if (f)
+            fprintf(f, "(CODINGSCHEME %s)\n", coding_scheme.c_str());
+        if (tfm)
+            tfm->set_coding_scheme(coding_scheme);
+    }
     int design_units = metrics.design_units();
 
     if (design_size <= 0)
         design_size = get_design_size(finfo);
     max_printed_real = 0;
 
-    fprintf(f, "(DESIGNSIZE R %.1f)\n"
-            "(DESIGNUNITS R %d.0)\n"
-            "(COMMENT DESIGNSIZE (1 em) IS IN POINTS)\n"
-            "(COMMENT OTHER DIMENSIONS ARE MULTIPLES OF DESIGNSIZE/%d)\n"
-            "(FONTDIMEN\n", design_size, design_units, design_units);
+    char design_size_str[128];
+    snprintf(design_size_str, sizeof(design_size_str), "%.1f", design_size);
+    if (f)
+        fprintf(f, "(DESIGNSIZE R %s)\n"
+                "(DESIGNUNITS R %d.0)\n"
+                "(COMMENT DESIGNSIZE (1 em) IS IN POINTS)\n"
+                "(COMMENT OTHER DIMENSIONS ARE MULTIPLES OF DESIGNSIZE/%d)\n"
+                "(FONTDIMEN\n", design_size_str, design_units, design_units);
+    if (tfm) {
+        tfm->set_design_size(real_fix(design_size_str));
+        tfm->set_design_units(real_fix(String(design_units).c_str()));
+    }
 
     // figure out font dimensions
     Transform font_xform;
@@ -629,37 +682,48 @@ output_pl(Metrics &metrics, const String &ps_name, int boundary_char,
     if (slant)
         font_xform.shear(slant);
     double bounds[4], width;
-    Printer pr(f, design_units, metrics.units_per_em());
+    Printer pr(f, tfm, design_units, metrics.units_per_em());
 
     double actual_slant = font_slant(finfo);
-    if (actual_slant)
-        fprintf(f, "   (SLANT R %g)\n", actual_slant);
+    if (actual_slant) {
+        char slant_str[128];
+        snprintf(slant_str, sizeof(slant_str), "%g", actual_slant);
+        if (f)
+            fprintf(f, "   (SLANT R %s)\n", slant_str);
+        if (tfm)
+            tfm->set_param(1, real_fix(slant_str));
+    }
 
     if (char_bounds(bounds, width, finfo, font_xform, ' ')) {
         // advance space width by letterspacing, scale by space_factor
         double space_width = (width + (vpl ? letterspace : 0)) * space_factor;
-        pr.print("   (SPACE", space_width);
+        pr.print_param("   (SPACE", 2, space_width);
         if (finfo.is_fixed_pitch()) {
             // fixed-pitch: no space stretch or shrink
-            pr.print("   (STRETCH", 0);
-            pr.print("   (SHRINK", 0);
-            pr.print("   (EXTRASPACE", space_width);
+            pr.print_param("   (STRETCH", 3, 0);
+            pr.print_param("   (SHRINK", 4, 0);
+            pr.print_param("   (EXTRASPACE", 7, space_width);
         } else {
-            pr.print("   (STRETCH", space_width / 2.);
-            pr.print("   (SHRINK", space_width / 3.);
-            pr.print("   (EXTRASPACE", space_width / 6.);
+            pr.print_param("   (STRETCH", 3, space_width / 2.);
+            pr.print_param("   (SHRINK", 4, space_width / 3.);
+            pr.print_param("   (EXTRASPACE", 7, space_width / 6.);
         }
     }
 
     double x_height = finfo.x_height(font_xform);
     if (x_height < finfo.units_per_em())
-        pr.print("   (XHEIGHT", x_height);
+        pr.print_param("   (XHEIGHT", 5, x_height);
 
-    pr.print("   (QUAD", finfo.units_per_em());
-    fprintf(f, "   )\n");
+    pr.print_param("   (QUAD", 6, finfo.units_per_em());
+    if (f)
+        fprintf(f, "   )\n");
 
-    if (boundary_char >= 0)
-        fprintf(f, "(BOUNDARYCHAR D %d)\n", boundary_char);
+    if (boundary_char >= 0) {
+        if (f)
+            fprintf(f, "(BOUNDARYCHAR D %d)\n", boundary_char);
+        if (tfm)
+            tfm->set_boundary_char(boundary_char);
+    }
 
     // figure out font mapping
     int mapped_font0 = 0;
@@ -695,7 +759,10 @@ output_pl(Metrics &metrics, const String &ps_name, int boundary_char,
             String name = metrics.mapped_font_name(j);
             if (!name)
                 name = make_base_font_name(font_name);
-            fprintf(f, "(MAPFONT D %d\n   (FONTNAME %s)\n   (FONTDSIZE R %.1f)\n   )\n", i, name.c_str(), design_size);
+            if (f)
+                fprintf(f, "(MAPFONT D %d\n   (FONTNAME %s)\n   (FONTDSIZE R %s)\n   )\n", i, name.c_str(), design_size_str);
+            if (tfm)
+                tfm->add_mapped_font(i, name, real_fix(design_size_str));
         }
     } else
         for (int i = 0; i < metrics.n_mapped_fonts(); i++)
@@ -743,7 +810,8 @@ output_pl(Metrics &metrics, const String &ps_name, int boundary_char,
     glyph_ids.push_back("BOUNDARYCHAR");
 
     // LIGTABLE
-    fprintf(f, "(LIGTABLE\n");
+    if (f)
+        fprintf(f, "(LIGTABLE\n");
     Vector<int> lig_code2, lig_outcode, lig_context, kern_code2, kern_amt;
     // don't print KRN x after printing LIG x
     uint32_t used[8];
@@ -755,6 +823,7 @@ output_pl(Metrics &metrics, const String &ps_name, int boundary_char,
             int any_kern = metrics.kerns(i, kern_code2, kern_amt);
             if (any_lig || any_kern) {
                 StringAccum kern_sa;
+                bool tfm_label = false;
                 memset(used, 0, sizeof(used));
                 for (int j = 0; j < lig_code2.size(); j++) {
                     if (lig_outcode[j] < 257) {
@@ -764,7 +833,14 @@ output_pl(Metrics &metrics, const String &ps_name, int boundary_char,
                                 << ')' << glyph_comments[lig_code2[j]]
                                 << glyph_comments[lig_outcode[j]] << '\n';
                         used[lig_code2[j] >> 5] |= (1 << (lig_code2[j] & 0x1F));
-                    } else {
+                        if (tfm) {
+                            if (!tfm_label)
+                                tfm->add_label(i);
+                            tfm_label = true;
+                            int op = (lig_context[j] == 0 ? TfmWriter::LIG : (lig_context[j] < 0 ? TfmWriter::LIG_KEEP_LEFT : TfmWriter::LIG_KEEP_RIGHT));
+                            tfm->add_lig(op, lig_code2[j], lig_outcode[j]);
+                        }
+                    } else if (f) {
                         omitted_clig_sa << "(COMMENT omitted "
                                 << lig_context_str(lig_context[j])
                                 << ' ' << metrics.code_name(i)
@@ -776,22 +852,34 @@ output_pl(Metrics &metrics, const String &ps_name, int boundary_char,
                 for (Vector<int>::const_iterator k2 = kern_code2.begin(); k2 < kern_code2.end(); k2++)
                     if (!(used[*k2 >> 5] & (1 << (*k2 & 0x1F)))) {
                         double this_kern = kern_amt[k2 - kern_code2.begin()];
-                        if (fabs(this_kern) >= minimum_kern)
+                        if (fabs(this_kern) >= minimum_kern) {
+                            String amt = pr.render(this_kern);
                             kern_sa << "   (KRN " << glyph_ids[*k2]
-                                    << " R " << pr.render(this_kern)
+                                    << " R " << amt
                                     << ')' << glyph_comments[*k2] << '\n';
+                            if (tfm) {
+                                if (!tfm_label)
+                                    tfm->add_label(i);
+                                tfm_label = true;
+                                tfm->add_kern(*k2, real_fix(amt.c_str()));
+                            }
+                        }
                     }
-                if (kern_sa) {
+                if (kern_sa && f) {
                     if (any_ligs)
                         fprintf(f, "\n");
                     fprintf(f, "   (LABEL %s)%s\n%s   (STOP)\n", glyph_ids[i].c_str(), glyph_comments[i].c_str(), kern_sa.c_str());
                     any_ligs = true;
                 }
+                if (tfm_label)
+                    tfm->add_stop();
             }
         }
-    fprintf(f, "   )\n");
-    if (omitted_clig_sa)
-        fprintf(f, "%s\n", omitted_clig_sa.c_str());
+    if (f) {
+        fprintf(f, "   )\n");
+        if (omitted_clig_sa)
+            fprintf(f, "%s\n", omitted_clig_sa.c_str());
+    }
 
     // CHARACTERs
     Vector<Setting> settings;
@@ -800,19 +888,27 @@ output_pl(Metrics &metrics, const String &ps_name, int boundary_char,
 
     for (int i = 0; i < 256; i++)
         if (metrics.setting(i, settings)) {
-            fprintf(f, "(CHARACTER %s%s\n", glyph_ids[i].c_str(), glyph_comments[i].c_str());
+            if (f)
+                fprintf(f, "(CHARACTER %s%s\n", glyph_ids[i].c_str(), glyph_comments[i].c_str());
 
             // unparse settings into DVI commands
+            bool need_map = vpl && (settings.size() > 1 || settings[0].op != Setting::SHOW);
+            TfmWriter *map_tfm = (need_map ? tfm : 0);
             sa.clear();
             push_stack.clear();
             CharstringBounds boundser(font_xform);
             int program_number = mapped_font0;
             const CharstringProgram *program = finfo.program();
+            bool cached_bounds = false;
             for (const Setting *s = settings.begin(); s < settings.end(); s++)
                 switch (s->op) {
 
                   case Setting::SHOW:
-                    if (vpl || program == finfo.program())
+                    // a lone glyph from the base font has its bounds cached
+                    if (settings.size() == 1 && program == finfo.program()) {
+                        finfo.glyph_bounds(s->y, font_xform, bounds, width);
+                        cached_bounds = true;
+                    } else if (vpl || program == finfo.program())
                         boundser.char_bounds(program->glyph_context(s->y));
                     // 3.Aug.2004 -- reported by Marco Kuhlmann: Don't use
                     // glyph_ids[] array when looking at a different font.
@@ -820,6 +916,8 @@ output_pl(Metrics &metrics, const String &ps_name, int boundary_char,
                         sa << "      (SETCHAR " << glyph_ids[s->x] << ')' << glyph_base_comments[s->x] << "\n";
                     else
                         sa << "      (SETCHAR D " << s->x << ")\n";
+                    if (map_tfm)
+                        map_tfm->add_setchar(s->x);
                     break;
 
                   case Setting::MOVE: {
@@ -828,33 +926,49 @@ output_pl(Metrics &metrics, const String &ps_name, int boundary_char,
                           x += s->x, y += s->y, s++;
                       if (vpl)
                           boundser.translate(s->x + x, s->y + y);
-                      if (s->x + x)
-                          sa << "      (MOVERIGHT R " << pr.render(s->x + x) << ")\n";
-                      if (s->y + y)
-                          sa << "      (MOVEUP R " << pr.render(s->y + y) << ")\n";
+                      if (s->x + x) {
+                          String amt = pr.render(s->x + x);
+                          sa << "      (MOVERIGHT R " << amt << ")\n";
+                          if (map_tfm)
+                              map_tfm->add_moveright(real_fix(amt.c_str()));
+                      }
+                      if (s->y + y) {
+                          String amt = pr.render(s->y + y);
+                          sa << "      (MOVEUP R " << amt << ")\n";
+                          if (map_tfm)
+                              map_tfm->add_moveup(real_fix(amt.c_str()));
+                      }
                       break;
                   }
 
-                  case Setting::RULE:
-                    if (vpl) {
-                        boundser.mark(Point(0, 0));
-                        boundser.mark(Point(s->x, s->y));
-                        boundser.translate(s->x, 0);
-                    }
-                    sa << "      (SETRULE R " << pr.render(s->y) << " R " << pr.render(s->x) << ")\n";
-                    break;
+                  case Setting::RULE: {
+                      if (vpl) {
+                          boundser.mark(Point(0, 0));
+                          boundser.mark(Point(s->x, s->y));
+                          boundser.translate(s->x, 0);
+                      }
+                      String ht = pr.render(s->y), wd = pr.render(s->x);
+                      sa << "      (SETRULE R " << ht << " R " << wd << ")\n";
+                      if (map_tfm)
+                          map_tfm->add_setrule(real_fix(ht.c_str()), real_fix(wd.c_str()));
+                      break;
+                  }
 
                   case Setting::FONT:
                     if ((int) s->x != program_number) {
                         program = metrics.mapped_font((int) s->x);
                         program_number = (int) s->x;
                         sa << "      (SELECTFONT D " << font_mapping[program_number] << ")\n";
+                        if (map_tfm)
+                            map_tfm->add_selectfont(font_mapping[program_number]);
                     }
                     break;
 
                   case Setting::PUSH:
                     push_stack.push_back(boundser.transform(Point(0, 0)));
                     sa << "      (PUSH)\n";
+                    if (map_tfm)
+                        map_tfm->add_push();
                     break;
 
                   case Setting::POP: {
@@ -864,6 +978,8 @@ output_pl(Metrics &metrics, const String &ps_name, int boundary_char,
                           boundser.translate(p.x, p.y);
                       push_stack.pop_back();
                       sa << "      (POP)\n";
+                      if (map_tfm)
+                          map_tfm->add_pop();
                       break;
                   }
 
@@ -882,6 +998,8 @@ output_pl(Metrics &metrics, const String &ps_name, int boundary_char,
                           sa << ")\n";
                       } else
                           sa << "      (SPECIAL " << s->s << ")\n";
+                      if (map_tfm)
+                          map_tfm->add_special(s->s);
                       break;
                   }
 
@@ -890,31 +1008,66 @@ output_pl(Metrics &metrics, const String &ps_name, int boundary_char,
             assert(push_stack.size() == 0);
 
             // output information
-            boundser.output(bounds, width);
-            pr.print("   (CHARWD", width);
+            if (!cached_bounds)
+                boundser.output(bounds, width);
+            int wd = pr.print("   (CHARWD", width), ht = 0, dp = 0, ic = 0;
             if (bounds[3] > 0)
-                pr.print("   (CHARHT", bounds[3]);
+                ht = pr.print("   (CHARHT", bounds[3]);
             if (bounds[1] < 0)
-                pr.print("   (CHARDP", -bounds[1]);
+                dp = pr.print("   (CHARDP", -bounds[1]);
             if (bounds[2] > width)
-                pr.print_transformed("   (CHARIC", pr.transform(bounds[2]) - pr.transform(width));
-            if (vpl && (settings.size() > 1 || settings[0].op != Setting::SHOW))
-                fprintf(f, "   (MAP\n%s      )\n", sa.c_str());
-            fprintf(f, "   )\n");
+                ic = pr.print_transformed("   (CHARIC", pr.transform(bounds[2]) - pr.transform(width));
+            if (f) {
+                if (need_map)
+                    fprintf(f, "   (MAP\n%s      )\n", sa.c_str());
+                fprintf(f, "   )\n");
+            }
+            if (tfm)
+                tfm->add_char(i, wd, ht, dp, ic);
         }
+}
+
+// Did we print a number too big for TeX to handle?  If so, the caller
+// should try again.
+static bool
+reduce_design_units(Metrics &metrics, ErrorHandler *errh)
+{
+    if (max_printed_real < 2047)
+        return false;
+    if (metrics.design_units() <= 1)
+        errh->fatal("This font appears to be broken.  It has characters so big that the PL format\ncannot represent them.");
+    metrics.set_design_units(metrics.design_units() > 200 ? metrics.design_units() - 250 : 1);
+    if (verbose)
+        errh->message("the font%,s metrics overflow the limits of PL files\n(reducing DESIGNUNITS to %d and trying again)", metrics.design_units());
+    return true;
+}
+
+static void
+output_pl(Metrics &metrics, const String &ps_name, int boundary_char,
+          const FontInfo &finfo, bool vpl,
+          const String &filename, ErrorHandler *errh)
+{
+    // create file
+    if (no_create) {
+        errh->message("would create %s", filename.c_str());
+        return;
+    }
+
+    if (verbose)
+        errh->message("creating %s", filename.c_str());
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) {
+        errh->error("%s: %s", filename.c_str(), strerror(errno));
+        return;
+    }
+
+    write_metrics(metrics, ps_name, boundary_char, finfo, vpl, f, 0);
 
     // at last, close the file
     fclose(f);
 
-    // Did we print a number too big for TeX to handle?  If so, try again.
-    if (max_printed_real >= 2047) {
-        if (metrics.design_units() <= 1)
-            errh->fatal("This font appears to be broken.  It has characters so big that the PL format\ncannot represent them.");
-        metrics.set_design_units(metrics.design_units() > 200 ? metrics.design_units() - 250 : 1);
-        if (verbose)
-            errh->message("the font%,s metrics overflow the limits of PL files\n(reducing DESIGNUNITS to %d and trying again)", metrics.design_units());
+    if (reduce_design_units(metrics, errh))
         output_pl(metrics, ps_name, boundary_char, finfo, vpl, filename, errh);
-    }
 }
 
 struct Lookup {
@@ -925,10 +1078,87 @@ struct Lookup {
     Lookup()                    : used(false), required(false), filter(0) { }
 };
 
+// The language systems and features of one GSUB or GPOS table, as far as
+// jobs have needed them.  Decoded once and shared by every job on the font,
+// or on any font of a collection that shares the table; each job then
+// filters the features it wants.  Loaded fonts are never freed, so the
+// table's data pointer identifies the table.
+struct FeaturePlan {
+    struct LangSys {
+        OpenType::Tag script;
+        OpenType::Tag langsys;
+        int required;
+        Vector<int> fids;
+    };
+    const char *data;
+    OpenType::Tag table;
+    Vector<LangSys> langsys;
+    Vector<int> lookups_start;  // per feature: index into lookups, or -1
+    Vector<int> lookups_end;
+    Vector<int> lookups;
+};
+
+static Vector<FeaturePlan *> feature_plans;
+
+static FeaturePlan &
+feature_plan(const OpenType::Font &otf, OpenType::Tag table)
+{
+    const char *data = otf.table(table).data();
+    for (FeaturePlan **fp = feature_plans.begin(); fp != feature_plans.end(); ++fp)
+        if ((*fp)->data == data && (*fp)->table == table)
+            return **fp;
+    FeaturePlan *fp = new FeaturePlan;
+    fp->data = data;
+    fp->table = table;
+    feature_plans.push_back(fp);
+    return *fp;
+}
+
+static const FeaturePlan::LangSys *
+plan_langsys(FeaturePlan &plan, const OpenType::ScriptList &scripts,
+             OpenType::Tag script, OpenType::Tag langsys, ErrorHandler *errh)
+{
+    for (const FeaturePlan::LangSys *ls = plan.langsys.begin(); ls != plan.langsys.end(); ++ls)
+        if (ls->script == script && ls->langsys == langsys)
+            return ls;
+    FeaturePlan::LangSys ls;
+    ls.script = script;
+    ls.langsys = langsys;
+    // errors are not remembered, so every job reports them
+    if (scripts.features(script, langsys, ls.required, ls.fids, errh) < 0)
+        return 0;
+    plan.langsys.push_back(ls);
+    return &plan.langsys.back();
+}
+
+static bool
+plan_lookups(FeaturePlan &plan, const OpenType::FeatureList &features,
+             int fid, const int *&begin, const int *&end, ErrorHandler *errh)
+{
+    if (fid < 0)
+        return false;
+    if (fid >= plan.lookups_start.size()) {
+        plan.lookups_start.resize(fid + 1, -1);
+        plan.lookups_end.resize(fid + 1, -1);
+    }
+    if (plan.lookups_start[fid] < 0) {
+        Vector<int> lookupids;
+        if (features.lookups(fid, lookupids, errh) < 0)
+            return false;
+        plan.lookups_start[fid] = plan.lookups.size();
+        for (int *l = lookupids.begin(); l != lookupids.end(); ++l)
+            plan.lookups.push_back(*l);
+        plan.lookups_end[fid] = plan.lookups.size();
+    }
+    begin = plan.lookups.begin() + plan.lookups_start[fid];
+    end = plan.lookups.begin() + plan.lookups_end[fid];
+    return true;
+}
+
 static void
-find_lookups(const OpenType::ScriptList& scripts, const OpenType::FeatureList& features, Vector<Lookup>& lookups, ErrorHandler* errh)
+find_lookups(FeaturePlan& plan, const OpenType::ScriptList& scripts, const OpenType::FeatureList& features, Vector<Lookup>& lookups, ErrorHandler* errh)
 {
-    Vector<int> fids, lookupids;
+    Vector<int> fids;
     int required;
 
     // go over all scripts
@@ -937,7 +1167,13 @@ find_lookups(const OpenType::ScriptList& scripts, const OpenType::FeatureList& f
         OpenType::Tag langsys = interesting_scripts[i+1];
 
         // collect features applying to this script
-        scripts.features(script, langsys, required, fids, errh);
+        if (const FeaturePlan::LangSys *ls = plan_langsys(plan, scripts, script, langsys, errh)) {
+            required = ls->required;
+            fids = ls->fids;
+        } else {
+            required = -1;
+            fids.clear();
+        }
 
         // only use the selected features
         features.filter(fids, interesting_features);
@@ -946,10 +1182,11 @@ find_lookups(const OpenType::ScriptList& scripts, const OpenType::FeatureList& f
         for (int j = (required < 0 ? 0 : -1); j < fids.size(); j++) {
             int fid = (j < 0 ? required : fids[j]);
             OpenType::Tag ftag = features.tag(fid);
-            if (features.lookups(fid, lookupids, errh) < 0)
-                lookupids.clear();
-            for (int k = 0; k < lookupids.size(); k++) {
-                int l = lookupids[k];
+            const int *lbegin, *lend;
+            if (!plan_lookups(plan, features, fid, lbegin, lend, errh))
+                lbegin = lend = 0;
+            for (const int *lp = lbegin; lp != lend; lp++) {
+                int l = *lp;
                 if (l < 0 || l >= lookups.size())
                     errh->error("lookup for %<%s%> feature out of range", OpenType::Tag::langsys_text(script, langsys).c_str());
                 else {
@@ -974,6 +1211,17 @@ find_lookups(const OpenType::ScriptList& scripts, const OpenType::FeatureList& f
         }
 }
 
+// Encoding files written by a batch worker are passed to the parent, which
+// writes them in job order.
+struct DeferredEncoding {
+    String filename;
+    String name;
+    String contents;
+};
+
+static bool defer_encodings = false;
+static Vector<DeferredEncoding> deferred_encodings;
+
 static int
 write_encoding_file(String &filename, const String &encoding_name,
                     StringAccum &contents, ErrorHandler *errh)
@@ -1148,15 +1396,23 @@ output_encoding(const Metrics &metrics,
     }
 
     // open encoding file
+    if (out_encoding_file != "-")
+        record_output_file(out_encoding_file);
     if (out_encoding_file == "-")
         ignore_result(fwrite(contents.data(), 1, contents.length(), stdout));
-    else if (write_encoding_file(out_encoding_file, out_encoding_name, contents, errh) == 1)
+    else if (defer_encodings) {
+        DeferredEncoding de;
+        de.filename = out_encoding_file;
+        de.name = out_encoding_name;
+        de.contents = contents.take_string();
+        deferred_encodings.push_back(de);
+    } else if (write_encoding_file(out_encoding_file, out_encoding_name, contents, errh) == 1)
         update_odir(O_ENCODING, out_encoding_file, errh);
     return true;
 }
 
-static void
-output_tfm(Metrics &metrics, const String &ps_name, int boundary_char,
+static bool
+run_pltotf(Metrics &metrics, const String &ps_name, int boundary_char,
            const FontInfo &finfo, String tfm_filename, String vf_filename,
            String pl_filename, ErrorHandler *errh)
 {
@@ -1170,7 +1426,7 @@ output_tfm(Metrics &metrics, const String &ps_name, int boundary_char,
         } else {
             int pl_fd = temporary_file(pl_filename, errh);
             if (pl_fd < 0)
-                return;
+                return false;
             output_pl(metrics, ps_name, boundary_char, finfo, vpl, pl_filename, errh);
             close(pl_fd);
         }
@@ -1224,13 +1480,91 @@ output_tfm(Metrics &metrics, const String &ps_name, int boundary_char,
     if (!no_create && !had_pl_filename)
         unlink(pl_filename.c_str());
 
-    if (status != 0)
-        errh->fatal("%s execution failed", (vpl ? "vptovf" : "pltotf"));
+    return status == 0;
+}
+
+static void
+make_tfm(Metrics &metrics, const String &ps_name, int boundary_char,
+         const FontInfo &finfo, bool vf, String &tfm_data, String &vf_data,
+         ErrorHandler *errh)
+{
+    TfmWriter tfm;
+    write_metrics(metrics, ps_name, boundary_char, finfo, vf, 0, &tfm);
+    if (reduce_design_units(metrics, errh))
+        make_tfm(metrics, ps_name, boundary_char, finfo, vf, tfm_data, vf_data, errh);
     else {
-        update_odir(O_TFM, tfm_filename, errh);
+        tfm.finish(vf, errh);
+        tfm_data = tfm.tfm_data();
+        vf_data = tfm.vf_data();
+    }
+}
+
+static void
+check_tfm_data(const String &filename, const String &data,
+               const String &check_filename, const char *program,
+               ErrorHandler *errh)
+{
+    String check_data = read_file(check_filename, errh);
+    int pos = 0;
+    while (pos < data.length() && pos < check_data.length()
+           && data[pos] == check_data[pos])
+        ++pos;
+    if (pos < data.length() || pos < check_data.length())
+        errh->warning("%s: differs from %s output at byte %d", filename.c_str(), program, pos);
+    else if (verbose)
+        errh->message("%s: matches %s output", filename.c_str(), program);
+}
+
+static void
+output_tfm(Metrics &metrics, const String &ps_name, int boundary_char,
+           const FontInfo &finfo, String tfm_filename, String vf_filename,
+           String pl_filename, ErrorHandler *errh)
+{
+    bool vpl = vf_filename;
+
+    if (!native_tfm) {
+        if (!run_pltotf(metrics, ps_name, boundary_char, finfo, tfm_filename, vf_filename, pl_filename, errh))
+            errh->fatal("%s execution failed", (vpl ? "vptovf" : "pltotf"));
+    } else if (no_create) {
+        errh->message("would create %s", tfm_filename.c_str());
         if (vpl)
-            update_odir(O_VF, vf_filename, errh);
+            errh->message("would create %s", vf_filename.c_str());
+    } else {
+        String tfm_data, vf_data;
+        make_tfm(metrics, ps_name, boundary_char, finfo, vpl, tfm_data, vf_data, errh);
+        if (!write_file(tfm_filename, tfm_data, errh)
+            || (vpl && !write_file(vf_filename, vf_data, errh)))
+            return;
+
+        // compare against pltotf/vptovf
+        if (check_tfm) {
+            const char *program = (vpl ? "vptovf" : "pltotf");
+            String check_tfm_filename, check_vf_filename;
+            int tfm_fd = temporary_file(check_tfm_filename, errh);
+            int vf_fd = (vpl ? temporary_file(check_vf_filename, errh) : 0);
+            if (tfm_fd >= 0 && vf_fd >= 0) {
+                if (!run_pltotf(metrics, ps_name, boundary_char, finfo, check_tfm_filename, check_vf_filename, pl_filename, errh))
+                    errh->warning("%s execution failed, can%,t check output", program);
+                else {
+                    check_tfm_data(tfm_filename, tfm_data, check_tfm_filename, program, errh);
+                    if (vpl)
+                        check_tfm_data(vf_filename, vf_data, check_vf_filename, program, errh);
+                }
+            }
+            if (tfm_fd >= 0) {
+                close(tfm_fd);
+                unlink(check_tfm_filename.c_str());
+            }
+            if (vpl && vf_fd >= 0) {
+                close(vf_fd);
+                unlink(check_vf_filename.c_str());
+            }
+        }
     }
+
+    update_odir(O_TFM, tfm_filename, errh);
+    if (vpl)
+        update_odir(O_VF, vf_filename, errh);
 }
 
 void
@@ -1392,18 +1726,26 @@ static String otf_filename;
 static String
 main_dvips_map(const String &ps_name, const FontInfo &finfo, ErrorHandler *errh)
 {
-    if (String fn = installed_type1(otf_filename, ps_name, (output_flags & G_TYPE1) != 0, errh))
-        return "<" + pathname_filename(fn);
-    if (!finfo.cff) {
+    String fn = installed_type1(finfo, ps_name, (output_flags & G_TYPE1) != 0, errh);
+    if (!fn && !finfo.cff && finfo.otf->face() >= 0) {
+        // a map line can't name one font of a collection, so install
+        // a Type 42 font instead of the TrueType file
+        unsigned flags = output_flags & (G_TRUETYPE | G_TYPE42);
+        fn = installed_type42(finfo, ps_name, flags != 0, errh);
+    } else if (!fn && !finfo.cff) {
         String ttf_fn, t42_fn;
         ttf_fn = installed_truetype(otf_filename, (output_flags & G_TRUETYPE) != 0, errh);
-        t42_fn = installed_type42(otf_filename, ps_name, (output_flags & G_TYPE42) != 0, errh);
+        t42_fn = installed_type42(finfo, ps_name, (output_flags & G_TYPE42) != 0, errh);
         if (t42_fn && (!ttf_fn || (output_flags & G_TYPE42) != 0))
-            return "<" + pathname_filename(t42_fn);
+            fn = t42_fn;
         else if (ttf_fn)
-            return "<" + pathname_filename(ttf_fn);
+            fn = ttf_fn;
     }
-    return "<" + pathname_filename(otf_filename);
+    if (!fn)
+        return "<" + pathname_filename(otf_filename);
+    // the map line depends on this font file staying put
+    record_output_file(fn);
+    return "<" + pathname_filename(fn);
 }
 
 static void
@@ -1414,8 +1756,9 @@ do_gsub(Metrics& metrics, const OpenType::Font& otf,
 {
     // find activated GSUB features
     OpenType::Gsub gsub(otf.table("GSUB"), &otf, errh);
+    FeaturePlan &plan = feature_plan(otf, OpenType::Tag("GSUB"));
     Vector<Lookup> lookups(gsub.nlookups(), Lookup());
-    find_lookups(gsub.script_list(), gsub.feature_list(), lookups, errh);
+    find_lookups(plan, gsub.script_list(), gsub.feature_list(), lookups, errh);
 
     // find all characters that might result
     Vector<bool> used(glyph_names.size(), false);
@@ -1473,7 +1816,7 @@ do_gsub(Metrics& metrics, const OpenType::Font& otf,
         altselector_features.swap(interesting_features);
         altselector_feature_filters.swap(feature_filters);
         Vector<Lookup> alt_lookups(gsub.nlookups(), Lookup());
-        find_lookups(gsub.script_list(), gsub.feature_list(), alt_lookups, ErrorHandler::silent_handler());
+        find_lookups(plan, gsub.script_list(), gsub.feature_list(), alt_lookups, ErrorHandler::silent_handler());
         Vector<OpenType::Substitution> alt_subs;
         for (int i = 0; i < alt_lookups.size(); i++)
             if (alt_lookups[i].used) {
@@ -1517,11 +1860,13 @@ do_try_ttf_kern(Metrics& metrics, const OpenType::Font& otf, HashMap<uint32_t, i
 }
 
 static void
-do_gpos(Metrics& metrics, const OpenType::Font& otf, HashMap<uint32_t, int>& feature_usage, ErrorHandler* errh)
+do_gpos(Metrics& metrics, const OpenType::Font& otf,
+        HashMap<uint32_t, int>& feature_usage,
+        const Vector<PermString>& glyph_names, ErrorHandler* errh)
 {
     OpenType::Gpos gpos(otf.table("GPOS"), errh);
     Vector<Lookup> lookups(gpos.nlookups(), Lookup());
-    find_lookups(gpos.script_list(), gpos.feature_list(), lookups, errh);
+    find_lookups(feature_plan(otf, OpenType::Tag("GPOS")), gpos.script_list(), gpos.feature_list(), lookups, errh);
 
     // OpenType recommends that if GPOS exists, but the "kern" feature loads
     // no lookups, we use the TrueType "kern" table, if any.
@@ -1534,12 +1879,21 @@ do_gpos(Metrics& metrics, const OpenType::Font& otf, HashMap<uint32_t, int>& fea
     skip_ttf_kern: ;
     }
 
+    // only encoded characters can be positioned
+    Vector<bool> used(glyph_names.size(), false);
+    for (Metrics::Code c = 0; c < metrics.encoding_size(); ++c) {
+        Metrics::Glyph g = metrics.glyph(c);
+        if (g >= 0 && g < used.size())
+            used[g] = true;
+    }
+    OpenType::Coverage used_coverage(used);
+
     Vector<OpenType::Positioning> poss;
     for (int i = 0; i < lookups.size(); i++)
         if (lookups[i].used) {
             OpenType::GposLookup l = gpos.lookup(i);
             poss.clear();
-            bool understood = l.unparse_automatics(poss, errh);
+            bool understood = l.unparse_automatics(poss, used_coverage, errh);
             int nunderstood = metrics.apply(poss);
 
             // mark as used
@@ -1585,15 +1939,29 @@ do_math_spacing(Metrics &metrics, const FontInfo &finfo,
 }
 
 static void
-do_file(const String &otf_filename, const OpenType::Font &otf,
+set_family_typeface(const FontInfo &finfo)
+{
+    // set typeface name from font family name
+    String typeface = finfo.family_name();
+
+    // make it reasonable for the shell
+    StringAccum sa;
+    for (int i = 0; i < typeface.length(); i++)
+        if (isalnum((unsigned char) typeface[i]) || typeface[i] == '_' || typeface[i] == '-' || typeface[i] == '.' || typeface[i] == ',' || typeface[i] == '+')
+            sa << typeface[i];
+
+    set_typeface(sa.length() ? sa.take_string() : font_name, false);
+}
+
+static void
+do_file(const String &otf_filename, FontInfo &finfo,
         const DvipsEncoding &dvipsenc_in, bool dvipsenc_literal,
         ErrorHandler *errh)
 {
-    FontInfo finfo(&otf, errh);
-    if (!finfo.ok())
-        return;
+    const OpenType::Font &otf = *finfo.otf;
     if (!finfo.cff)
         errh->warning("TrueType-flavored font support is experimental");
+    finfo.clear_overrides();
     if (override_is_fixed_pitch)
         finfo.set_is_fixed_pitch(is_fixed_pitch);
     if (override_italic_angle)
@@ -1606,19 +1974,6 @@ do_file(const String &otf_filename, const OpenType::Font &otf,
     finfo.glyph_names(glyph_names);
     OpenType::debug_glyph_names = glyph_names;
 
-    // set typeface name from font family name
-    {
-        String typeface = finfo.family_name();
-
-        // make it reasonable for the shell
-        StringAccum sa;
-        for (int i = 0; i < typeface.length(); i++)
-            if (isalnum((unsigned char) typeface[i]) || typeface[i] == '_' || typeface[i] == '-' || typeface[i] == '.' || typeface[i] == ',' || typeface[i] == '+')
-                sa << typeface[i];
-
-        set_typeface(sa.length() ? sa.take_string() : font_name, false);
-    }
-
     // initialize encoding
     DvipsEncoding dvipsenc(dvipsenc_in); // make copy
     Metrics metrics(finfo.program(), finfo.nglyphs());
@@ -1627,7 +1982,7 @@ do_file(const String &otf_filename, const OpenType::Font &otf,
     if (dvipsenc_literal)
         dvipsenc.make_metrics(metrics, finfo, 0, true, errh);
     else {
-        T1Secondary secondary(finfo, font_name, otf_filename);
+        T1Secondary secondary(finfo, font_name);
         dvipsenc.make_metrics(metrics, finfo, &secondary, false, errh);
     }
 
@@ -1655,7 +2010,7 @@ do_file(const String &otf_filename, const OpenType::Font &otf,
 
     // apply activated GPOS features
     try {
-        do_gpos(metrics, otf, feature_usage, errh);
+        do_gpos(metrics, otf, feature_usage, glyph_names, errh);
     } catch (OpenType::BlankTable) {
         do_try_ttf_kern(metrics, otf, feature_usage, errh);
     } catch (OpenType::Error e) {
@@ -1840,515 +2195,934 @@ parse_base_encodings(const String &filename, ErrorHandler *errh)
     }
 }
 
-int
-main(int argc, char *argv[])
-{
-#ifndef WIN32
-    handle_sigchld();
-#endif
-    Clp_Parser *clp =
-        Clp_NewParser(argc, (const char * const *)argv, sizeof(options) / sizeof(options[0]), options);
-    Clp_AddType(clp, CHAR_OPTTYPE, 0, clp_parse_char, 0);
-    program_name = Clp_ProgramName(clp);
-#if HAVE_KPATHSEA
-    kpsei_init(argv[0], "lcdftools");
-#endif
-#ifdef HAVE_CTIME
-    {
-        time_t t = time(0);
-        char *c = ctime(&t);
-        current_time = " on " + String(c).substring(0, -1); // get rid of \n
-    }
-#endif
-    for (int i = 0; i < argc; i++)
-        invocation << (i ? " " : "") << argv[i];
-
-    ErrorHandler *errh = ErrorHandler::static_initialize(new FileErrorHandler(stderr, String(program_name) + ": "));
-    const char *input_file = 0;
-    Vector<String> glyphlist_files;
-    bool literal_encoding = false;
-    bool have_encoding_file = false;
+struct JobOptions {
+    String input_file;
+    int face;
+    bool literal_encoding;
+    bool have_encoding_file;
     Vector<String> ligkern;
     Vector<String> pos;
     Vector<String> unicoding;
     Vector<String> base_encoding_files;
-    bool no_ecommand = false, default_ligkern = true;
-    int warn_missing = -1;
-    unsigned specified_output_flags = 0;
+    bool no_ecommand;
+    bool default_ligkern;
+    int warn_missing;
+    unsigned specified_output_flags;
     String codingscheme;
-    const char* odirs[NUMODIR + 1];
-    for (int i = 0; i <= NUMODIR; ++i) {
-        odirs[i] = 0;
-    }
-
     GlyphFilter current_substitution_filter;
     GlyphFilter current_alternate_filter;
-    GlyphFilter* current_filter_ptr = &null_filter;
-    Vector<GlyphFilter*> allocated_filters;
+    GlyphFilter *current_filter_ptr;
+    String output_options;
 
-    while (1) {
-        int opt = Clp_Next(clp);
-        switch (opt) {
-
-          case SCRIPT_OPT: {
-              String arg = clp->vstr;
-              int period = arg.find_left('.');
-              OpenType::Tag scr(period <= 0 ? arg : arg.substring(0, period));
-              if (scr.valid() && period > 0) {
-                  OpenType::Tag lang(arg.substring(period + 1));
-                  if (lang.valid()) {
-                      interesting_scripts.push_back(scr);
-                      interesting_scripts.push_back(lang);
-                  } else
-                      usage_error(errh, "bad language tag");
-              } else if (scr.valid()) {
+    JobOptions()
+        : face(0), literal_encoding(false), have_encoding_file(false),
+          no_ecommand(false), default_ligkern(true), warn_missing(-1),
+          specified_output_flags(0), current_filter_ptr(&null_filter) {
+    }
+};
+
+// Options that set globals.  A batch job starts from the settings given
+// on the command line, so each job's settings are saved after parsing and
+// restored before running.
+struct JobSettings {
+    String font_name;
+    String encoding_file;
+    Vector<OpenType::Tag> interesting_scripts;
+    Vector<OpenType::Tag> interesting_features;
+    Vector<OpenType::Tag> altselector_features;
+    HashMap<OpenType::Tag, GlyphFilter*> feature_filters;
+    HashMap<OpenType::Tag, GlyphFilter*> altselector_feature_filters;
+    Vector<BaseEncoding *> base_encodings;
+    double extend;
+    double slant;
+    int letterspace;
+    double design_size;
+    double minimum_kern;
+    double space_factor;
+    bool math_spacing;
+    int skew_char;
+    bool override_is_fixed_pitch;
+    bool is_fixed_pitch;
+    bool override_italic_angle;
+    double italic_angle;
+    int override_x_height;
+    double x_height;
+    String out_encoding_file;
+    String out_encoding_name;
+    bool native_tfm;
+    bool check_tfm;
+    unsigned output_flags;
+
+    void save();
+    void restore() const;
+};
+
+void
+JobSettings::save()
+{
+    font_name = ::font_name;
+    encoding_file = ::encoding_file;
+    interesting_scripts = ::interesting_scripts;
+    interesting_features = ::interesting_features;
+    altselector_features = ::altselector_features;
+    feature_filters = ::feature_filters;
+    altselector_feature_filters = ::altselector_feature_filters;
+    base_encodings = ::base_encodings;
+    extend = ::extend;
+    slant = ::slant;
+    letterspace = ::letterspace;
+    design_size = ::design_size;
+    minimum_kern = ::minimum_kern;
+    space_factor = ::space_factor;
+    math_spacing = ::math_spacing;
+    skew_char = ::skew_char;
+    override_is_fixed_pitch = ::override_is_fixed_pitch;
+    is_fixed_pitch = ::is_fixed_pitch;
+    override_italic_angle = ::override_italic_angle;
+    italic_angle = ::italic_angle;
+    override_x_height = ::override_x_height;
+    x_height = ::x_height;
+    out_encoding_file = ::out_encoding_file;
+    out_encoding_name = ::out_encoding_name;
+    native_tfm = ::native_tfm;
+    check_tfm = ::check_tfm;
+    output_flags = ::output_flags;
+}
+
+void
+JobSettings::restore() const
+{
+    ::font_name = font_name;
+    ::encoding_file = encoding_file;
+    ::interesting_scripts = interesting_scripts;
+    ::interesting_features = interesting_features;
+    ::altselector_features = altselector_features;
+    ::feature_filters = feature_filters;
+    ::altselector_feature_filters = altselector_feature_filters;
+    ::base_encodings = base_encodings;
+    ::extend = extend;
+    ::slant = slant;
+    ::letterspace = letterspace;
+    ::design_size = design_size;
+    ::minimum_kern = minimum_kern;
+    ::space_factor = space_factor;
+    ::math_spacing = math_spacing;
+    ::skew_char = skew_char;
+    ::override_is_fixed_pitch = override_is_fixed_pitch;
+    ::is_fixed_pitch = is_fixed_pitch;
+    ::override_italic_angle = override_italic_angle;
+    ::italic_angle = italic_angle;
+    ::override_x_height = override_x_height;
+    ::x_height = x_height;
+    ::out_encoding_file = out_encoding_file;
+    ::out_encoding_name = out_encoding_name;
+    ::native_tfm = native_tfm;
+    ::check_tfm = check_tfm;
+    ::output_flags = output_flags;
+}
+
+static Vector<String> glyphlist_files;
+static const char *odirs[NUMODIR + 1];
+static String batch_file;
+static int nworkers = 1;
+static Vector<GlyphFilter*> allocated_filters;
+
+static bool
+batch_option_allowed(Clp_Parser *clp, int opt)
+{
+    switch (opt) {
+      case AUTOMATIC_OPT:
+      case VENDOR_OPT:
+      case TYPEFACE_OPT:
+      case NO_UPDMAP_OPT:
+      case UPDMAP_SYS_OPT:
+      case UPDMAP_USER_OPT:
+      case GLYPHLIST_OPT:
+      case QUIET_OPT:
+      case VERBOSE_OPT:
+      case NOCREATE_OPT:
+      case FORCE_OPT:
+      case KPATHSEA_DEBUG_OPT:
+      case KPATHSEA_CACHE_OPT:
+      case BATCH_OPT:
+      case JOBS_OPT:
+      case VERSION_OPT:
+      case HELP_OPT:
+        return false;
+      case MAP_FILE_OPT:
+        return clp->negated;
+      default:
+        return opt < DIR_OPTS || opt > DIR_OPT;
+    }
+}
+
+// Returns true if option OPT can change otftotfm's output.
+static bool
+output_option(int opt)
+{
+    switch (opt) {
+      case NO_UPDMAP_OPT:
+      case UPDMAP_SYS_OPT:
+      case UPDMAP_USER_OPT:
+      case QUIET_OPT:
+      case VERBOSE_OPT:
+      case NOCREATE_OPT:
+      case FORCE_OPT:
+      case KPATHSEA_DEBUG_OPT:
+      case KPATHSEA_CACHE_OPT:
+      case BATCH_OPT:
+      case JOBS_OPT:
+      case VERSION_OPT:
+      case HELP_OPT:
+      case Clp_Done:
+      case Clp_BadOption:
+        return false;
+      default:
+        return true;
+    }
+}
+
+// Parse option OPT into JO and the globals.  Returns false at the end of
+// the options.  If IN_BATCH, OPT comes from a batch file line, where
+// options that affect the whole run are not allowed.
+static bool
+parse_option(Clp_Parser *clp, int opt, JobOptions &jo, bool in_batch,
+             ErrorHandler *&errh)
+{
+    if (in_batch && opt >= 0 && !batch_option_allowed(clp, opt))
+        usage_error(errh, "%<%s%> not allowed in batch file", Clp_CurOptionName(clp));
+
+    // remember the options that matter for automatic mode's stamps
+    if (output_option(opt)) {
+        StringAccum sa;
+        sa << opt << (clp->negated ? "!" : "") << '=';
+        if (opt == Clp_NotOption || clp->have_val)
+            sa << clp->vstr;
+        jo.output_options += String(sa.length()) + ":" + sa.take_string();
+    }
+
+    switch (opt) {
+
+      case SCRIPT_OPT: {
+          String arg = clp->vstr;
+          int period = arg.find_left('.');
+          OpenType::Tag scr(period <= 0 ? arg : arg.substring(0, period));
+          if (scr.valid() && period > 0) {
+              OpenType::Tag lang(arg.substring(period + 1));
+              if (lang.valid()) {
                   interesting_scripts.push_back(scr);
-                  interesting_scripts.push_back(OpenType::Tag());
+                  interesting_scripts.push_back(lang);
               } else
-                  usage_error(errh, "bad script tag");
-              break;
-          }
-
-          case FEATURE_OPT: {
-              OpenType::Tag t(clp->vstr);
-              if (!t.valid())
-                  usage_error(errh, "bad feature tag");
-              else if (feature_filters[t])
-                  usage_error(errh, "feature %<%s%> included twice", t.text().c_str());
-              else {
-                  if (!current_filter_ptr) {
-                      current_filter_ptr = new GlyphFilter(current_substitution_filter + current_alternate_filter);
-                      allocated_filters.push_back(current_filter_ptr);
-                  }
-                  interesting_features.push_back(t);
-                  feature_filters.insert(t, current_filter_ptr);
+                  usage_error(errh, "bad language tag");
+          } else if (scr.valid()) {
+              interesting_scripts.push_back(scr);
+              interesting_scripts.push_back(OpenType::Tag());
+          } else
+              usage_error(errh, "bad script tag");
+          break;
+      }
+
+      case FEATURE_OPT: {
+          OpenType::Tag t(clp->vstr);
+          if (!t.valid())
+              usage_error(errh, "bad feature tag");
+          else if (feature_filters[t])
+              usage_error(errh, "feature %<%s%> included twice", t.text().c_str());
+          else {
+              if (!jo.current_filter_ptr) {
+                  jo.current_filter_ptr = new GlyphFilter(jo.current_substitution_filter + jo.current_alternate_filter);
+                  allocated_filters.push_back(jo.current_filter_ptr);
               }
-              break;
+              interesting_features.push_back(t);
+              feature_filters.insert(t, jo.current_filter_ptr);
           }
+          break;
+      }
+
+      case LETTER_FEATURE_OPT: {
+          OpenType::Tag t(clp->vstr);
+          if (!t.valid())
+              usage_error(errh, "bad feature tag");
+          else if (feature_filters[t])
+              usage_error(errh, "feature %<%s%> included twice", t.text().c_str());
+          else {
+              interesting_features.push_back(t);
+              GlyphFilter* gf = new GlyphFilter;
+              gf->add_substitution_filter("<Letter>", false, errh);
+              *gf += jo.current_alternate_filter;
+              feature_filters.insert(t, gf);
+          }
+          break;
+      }
+
+      case SUBS_FILTER_OPT:
+        jo.current_substitution_filter = null_filter;
+        /* fallthru */
+      case EXCLUDE_SUBS_OPT:
+      case INCLUDE_SUBS_OPT:
+        jo.current_substitution_filter.add_substitution_filter(clp->vstr, opt == EXCLUDE_SUBS_OPT, errh);
+        jo.current_filter_ptr = 0;
+        break;
+
+      case CLEAR_SUBS_OPT:
+        jo.current_substitution_filter = null_filter;
+        jo.current_filter_ptr = 0;
+        break;
+
+      case ENCODING_OPT:
+        if (encoding_file)
+            usage_error(errh, "encoding specified twice");
+        encoding_file = clp->vstr;
+        jo.have_encoding_file = true;
+        break;
+
+      case LITERAL_ENCODING_OPT:
+        if (encoding_file)
+            usage_error(errh, "encoding specified twice");
+        encoding_file = clp->vstr;
+        jo.have_encoding_file = true;
+        jo.literal_encoding = true;
+        break;
+
+      case BASE_ENCODINGS_OPT:
+        jo.base_encoding_files.push_back(clp->vstr);
+        break;
+
+      case EXTEND_OPT:
+        if (extend)
+            usage_error(errh, "extend value specified twice");
+        extend = clp->val.d;
+        break;
 
-          case LETTER_FEATURE_OPT: {
-              OpenType::Tag t(clp->vstr);
-              if (!t.valid())
-                  usage_error(errh, "bad feature tag");
-              else if (feature_filters[t])
-                  usage_error(errh, "feature %<%s%> included twice", t.text().c_str());
-              else {
-                  interesting_features.push_back(t);
-                  GlyphFilter* gf = new GlyphFilter;
-                  gf->add_substitution_filter("<Letter>", false, errh);
-                  *gf += current_alternate_filter;
-                  feature_filters.insert(t, gf);
+      case SLANT_OPT:
+        if (slant)
+            usage_error(errh, "slant value specified twice");
+        slant = clp->val.d;
+        break;
+
+      case LETTERSPACE_OPT:
+        if (letterspace)
+            usage_error(errh, "letterspacing value specified twice");
+        letterspace = clp->val.i;
+        break;
+
+      case SPACE_FACTOR_OPT:
+        if (space_factor != 1)
+            usage_error(errh, "space factor specified twice");
+        space_factor = clp->val.d;
+        break;
+
+      case MATH_SPACING_OPT:
+        math_spacing = !clp->negated;
+        if (math_spacing && clp->have_val) {
+            if (clp->val.i < 0 || clp->val.i > 255)
+                usage_error(errh, "--math-spacing skew character must be between 0 and 255");
+            skew_char = clp->val.i;
+        }
+        break;
+
+      case DESIGN_SIZE_OPT:
+        if (design_size > 0)
+            usage_error(errh, "design size value specified twice");
+        else if (clp->val.d <= 0)
+            usage_error(errh, "design size must be > 0");
+        design_size = clp->val.d;
+        break;
+
+      case LIGKERN_OPT:
+        jo.ligkern.push_back(clp->vstr);
+        break;
+
+      case POSITION_OPT:
+        jo.pos.push_back(clp->vstr);
+        break;
+
+      case WARN_MISSING_OPT:
+        jo.warn_missing = !clp->negated;
+        break;
+
+      case NO_ECOMMAND_OPT:
+        jo.no_ecommand = true;
+        break;
+
+      case DEFAULT_LIGKERN_OPT:
+        jo.default_ligkern = !clp->negated;
+        break;
+
+      case BOUNDARY_CHAR_OPT:
+        jo.ligkern.push_back(String("|| = ") + String(clp->val.i));
+        break;
+
+      case ALTSELECTOR_CHAR_OPT:
+        jo.ligkern.push_back(String("^^ = ") + String(clp->val.i));
+        break;
+
+      case ALTSELECTOR_FEATURE_OPT: {
+          OpenType::Tag t(clp->vstr);
+          if (!t.valid())
+              usage_error(errh, "bad feature tag");
+          else if (altselector_feature_filters[t])
+              usage_error(errh, "altselector feature %<%s%> included twice", t.text().c_str());
+          else {
+              if (!jo.current_filter_ptr) {
+                  jo.current_filter_ptr = new GlyphFilter(jo.current_substitution_filter + jo.current_alternate_filter);
+                  allocated_filters.push_back(jo.current_filter_ptr);
               }
-              break;
+              altselector_features.push_back(t);
+              altselector_feature_filters.insert(t, jo.current_filter_ptr);
           }
+          break;
+      }
+
+      case ALTERNATES_FILTER_OPT:
+        jo.current_alternate_filter = null_filter;
+        /* fallthru */
+      case EXCLUDE_ALTERNATES_OPT:
+      case INCLUDE_ALTERNATES_OPT:
+        jo.current_alternate_filter.add_alternate_filter(clp->vstr, opt == EXCLUDE_ALTERNATES_OPT, errh);
+        jo.current_filter_ptr = 0;
+        break;
+
+      case CLEAR_ALTERNATES_OPT:
+        jo.current_alternate_filter = null_filter;
+        jo.current_filter_ptr = 0;
+        break;
+
+      case UNICODING_OPT:
+        jo.unicoding.push_back(clp->vstr);
+        break;
+
+      case CODINGSCHEME_OPT:
+        if (jo.codingscheme)
+            usage_error(errh, "coding scheme specified twice");
+        jo.codingscheme = clp->vstr;
+        if (jo.codingscheme.length() > 39)
+            errh->warning("only first 39 characters of coding scheme are significant");
+        if (jo.codingscheme.find_left('(') >= 0 || jo.codingscheme.find_left(')') >= 0)
+            usage_error(errh, "coding scheme cannot contain parentheses");
+        break;
+
+      case AUTOMATIC_OPT:
+        automatic = !clp->negated;
+        break;
+
+      case VENDOR_OPT:
+        if (!set_vendor(clp->vstr))
+            usage_error(errh, "vendor name specified twice");
+        break;
+
+      case TYPEFACE_OPT:
+        if (!set_typeface(clp->vstr, true))
+            usage_error(errh, "typeface name specified twice");
+        break;
+
+      case VIRTUAL_OPT:
+        if (clp->negated)
+            output_flags &= ~G_VMETRICS;
+        else
+            output_flags |= G_VMETRICS;
+        jo.specified_output_flags |= G_VMETRICS;
+        break;
+
+    case NO_ENCODING_OPT:
+    case NO_TYPE1_OPT:
+    case NO_DOTLESSJ_OPT:
+    case NO_UPDMAP_OPT:
+    case UPDMAP_SYS_OPT:
+        output_flags &= ~(opt - NO_OUTPUT_OPTS);
+        jo.specified_output_flags |= opt - NO_OUTPUT_OPTS;
+        break;
+
+    case TRUETYPE_OPT:
+    case TYPE42_OPT:
+    case UPDMAP_USER_OPT:
+        if (!clp->negated)
+            output_flags |= (opt - YES_OUTPUT_OPTS);
+        else
+            output_flags &= ~(opt - YES_OUTPUT_OPTS);
+        jo.specified_output_flags |= opt - YES_OUTPUT_OPTS;
+        break;
+
+      case OUTPUT_ENCODING_OPT:
+        if (out_encoding_file)
+            usage_error(errh, "encoding output file specified twice");
+        out_encoding_file = (clp->have_val ? clp->vstr : "-");
+        output_flags = G_ENCODING;
+        jo.specified_output_flags = -1;
+        break;
+
+      case NATIVE_TFM_OPT:
+        native_tfm = !clp->negated;
+        break;
+
+      case CHECK_TFM_OPT:
+        check_tfm = !clp->negated;
+        break;
+
+      case MINIMUM_KERN_OPT:
+        minimum_kern = clp->val.d;
+        break;
+
+      case MAP_FILE_OPT:
+        if (clp->negated)
+            output_flags &= ~G_PSFONTSMAP;
+        else {
+            output_flags |= G_PSFONTSMAP;
+            if (!set_map_file(clp->vstr))
+                usage_error(errh, "map file specified twice");
+        }
+        jo.specified_output_flags |= G_PSFONTSMAP;
+        break;
 
-          case SUBS_FILTER_OPT:
-            current_substitution_filter = null_filter;
-            /* fallthru */
-          case EXCLUDE_SUBS_OPT:
-          case INCLUDE_SUBS_OPT:
-            current_substitution_filter.add_substitution_filter(clp->vstr, opt == EXCLUDE_SUBS_OPT, errh);
-            current_filter_ptr = 0;
-            break;
+    case PL_OPT:
+        if (clp->negated)
+            output_flags &= ~G_ASCII;
+        else
+            output_flags |= G_ASCII;
+        jo.specified_output_flags |= G_ASCII;
+        break;
 
-          case CLEAR_SUBS_OPT:
-            current_substitution_filter = null_filter;
-            current_filter_ptr = 0;
-            break;
+    case TFM_OPT:
+        if (clp->negated)
+            output_flags &= ~G_BINARY;
+        else
+            output_flags |= G_BINARY;
+        jo.specified_output_flags |= G_BINARY;
+        break;
+
+    case ENCODING_DIR_OPT:
+    case TFM_DIR_OPT:
+    case PL_DIR_OPT:
+    case VF_DIR_OPT:
+    case VPL_DIR_OPT:
+    case TYPE1_DIR_OPT:
+    case TRUETYPE_DIR_OPT:
+    case TYPE42_DIR_OPT:
+    case DIR_OPT:
+        if (!odirs[opt - DIR_OPTS])
+            odirs[opt - DIR_OPTS] = clp->vstr;
+        else
+            usage_error(errh, "%s directory specified twice", odirname(opt - DIR_OPTS));
+        break;
+
+      case FONT_NAME_OPT:
+      font_name:
+        if (font_name)
+            usage_error(errh, "font name specified twice");
+        font_name = clp->vstr;
+        break;
+
+    case FIXED_PITCH_OPT:
+        override_is_fixed_pitch = true;
+        is_fixed_pitch = !clp->negated;
+        break;
+
+    case PROPORTIONAL_WIDTH_OPT:
+        override_is_fixed_pitch = true;
+        is_fixed_pitch = !!clp->negated;
+        break;
+
+    case ITALIC_ANGLE_OPT:
+        override_italic_angle = true;
+        italic_angle = clp->val.d;
+        break;
+
+      case GLYPHLIST_OPT:
+        glyphlist_files.push_back(clp->vstr);
+        break;
+
+      case QUERY_FEATURES_OPT:
+        usage_error(errh, "run %<otfinfo --query-features%> instead");
+        break;
+
+      case QUERY_SCRIPTS_OPT:
+        usage_error(errh, "run %<otfinfo --query-scripts%> instead");
+        break;
+
+      case QUIET_OPT:
+        if (clp->negated)
+            errh = ErrorHandler::default_handler();
+        else
+            // 9.Nov.05 -- need a new SilentErrorHandler, because we use
+            // the base SilentErrorHandler elsewhere to ignore errors
+            errh = new SilentErrorHandler;
+        break;
 
-          case ENCODING_OPT:
-            if (encoding_file)
-                usage_error(errh, "encoding specified twice");
-            encoding_file = clp->vstr;
-            have_encoding_file = true;
-            break;
+      case VERBOSE_OPT:
+        verbose = !clp->negated;
+        break;
 
-          case LITERAL_ENCODING_OPT:
-            if (encoding_file)
-                usage_error(errh, "encoding specified twice");
-            encoding_file = clp->vstr;
-            have_encoding_file = true;
-            literal_encoding = true;
-            break;
+      case NOCREATE_OPT:
+        no_create = clp->negated;
+        break;
 
-          case BASE_ENCODINGS_OPT:
-            base_encoding_files.push_back(clp->vstr);
-            break;
+      case FORCE_OPT:
+        force = !clp->negated;
+        break;
 
-          case EXTEND_OPT:
-            if (extend)
-                usage_error(errh, "extend value specified twice");
-            extend = clp->val.d;
-            break;
+      case KPATHSEA_DEBUG_OPT:
+#if HAVE_KPATHSEA
+        kpsei_set_debug_flags(clp->val.u);
+#else
+        errh->warning("Not compiled with kpathsea!");
+#endif
+        break;
 
-          case SLANT_OPT:
-            if (slant)
-                usage_error(errh, "slant value specified twice");
-            slant = clp->val.d;
-            break;
+      case KPATHSEA_CACHE_OPT:
+#if HAVE_KPATHSEA
+        set_kpathsea_cache(clp->vstr);
+#else
+        errh->warning("Not compiled with kpathsea!");
+#endif
+        break;
+
+    case X_HEIGHT_OPT: {
+        char* ends;
+        if (strcmp(clp->vstr, "auto") == 0)
+            override_x_height = FontInfo::x_height_auto;
+        else if (strcmp(clp->vstr, "x") == 0)
+            override_x_height = FontInfo::x_height_x;
+        else if (strcmp(clp->vstr, "font") == 0
+                 || strcmp(clp->vstr, "os/2") == 0)
+            override_x_height = FontInfo::x_height_os2;
+        else if ((x_height = strtod(clp->vstr, &ends)) >= 0
+                 && *ends == 0 && *clp->vstr != 0)
+            override_x_height = FontInfo::x_height_explicit;
+        else
+            usage_error(errh, "bad --x-height option");
+        break;
+    }
 
-          case LETTERSPACE_OPT:
-            if (letterspace)
-                usage_error(errh, "letterspacing value specified twice");
-            letterspace = clp->val.i;
-            break;
+    case FACE_OPT:
+        jo.face = clp->val.u;
+        break;
+
+      case BATCH_OPT:
+        if (batch_file)
+            usage_error(errh, "batch file specified twice");
+        batch_file = clp->vstr;
+        break;
+
+      case JOBS_OPT:
+        if (clp->val.i <= 0)
+            usage_error(errh, "%<--jobs%> must be at least 1");
+        nworkers = clp->val.i;
+        break;
+
+      case VERSION_OPT:
+        printf("otftotfm (LCDF typetools) %s\n", VERSION);
+        printf("Copyright (C) 2002-2023 Eddie Kohler\n\
+This is free software; see the source for copying conditions.\n\
+There is NO warranty, not even for merchantability or fitness for a\n\
+particular purpose.\n");
+        exit(0);
+        break;
+
+      case HELP_OPT:
+        usage();
+        exit(0);
+        break;
+
+      case Clp_NotOption:
+        if (jo.input_file && font_name)
+            usage_error(errh, "too many arguments");
+        else if (jo.input_file)
+            goto font_name;
+        else
+            jo.input_file = clp->vstr;
+        break;
 
-          case SPACE_FACTOR_OPT:
-            if (space_factor != 1)
-                usage_error(errh, "space factor specified twice");
-            space_factor = clp->val.d;
-            break;
+      case Clp_Done:
+        return false;
 
-          case MATH_SPACING_OPT:
-            math_spacing = !clp->negated;
-            if (math_spacing && clp->have_val) {
-                if (clp->val.i < 0 || clp->val.i > 255)
-                    usage_error(errh, "--math-spacing skew character must be between 0 and 255");
-                skew_char = clp->val.i;
-            }
-            break;
+      case Clp_BadOption:
+        usage_error(errh, 0);
+        break;
 
-          case DESIGN_SIZE_OPT:
-            if (design_size > 0)
-                usage_error(errh, "design size value specified twice");
-            else if (clp->val.d <= 0)
-                usage_error(errh, "design size must be > 0");
-            design_size = clp->val.d;
-            break;
+      default:
+        break;
 
-          case LIGKERN_OPT:
-            ligkern.push_back(clp->vstr);
-            break;
+    }
 
-          case POSITION_OPT:
-            pos.push_back(clp->vstr);
-            break;
-
-          case WARN_MISSING_OPT:
-            warn_missing = !clp->negated;
-            break;
-
-          case NO_ECOMMAND_OPT:
-            no_ecommand = true;
-            break;
-
-          case DEFAULT_LIGKERN_OPT:
-            default_ligkern = !clp->negated;
-            break;
-
-          case BOUNDARY_CHAR_OPT:
-            ligkern.push_back(String("|| = ") + String(clp->val.i));
-            break;
-
-          case ALTSELECTOR_CHAR_OPT:
-            ligkern.push_back(String("^^ = ") + String(clp->val.i));
-            break;
+    return true;
+}
 
-          case ALTSELECTOR_FEATURE_OPT: {
-              OpenType::Tag t(clp->vstr);
-              if (!t.valid())
-                  usage_error(errh, "bad feature tag");
-              else if (altselector_feature_filters[t])
-                  usage_error(errh, "altselector feature %<%s%> included twice", t.text().c_str());
-              else {
-                  if (!current_filter_ptr) {
-                      current_filter_ptr = new GlyphFilter(current_substitution_filter + current_alternate_filter);
-                      allocated_filters.push_back(current_filter_ptr);
-                  }
-                  altselector_features.push_back(t);
-                  altselector_feature_filters.insert(t, current_filter_ptr);
-              }
-              break;
-          }
+struct LoadedFont {
+    OpenType::Font *otf;
+    FontInfo *finfo;
+    int face;
+    LoadedFont *next_face;      // another font from the same file
+};
 
-          case ALTERNATES_FILTER_OPT:
-            current_alternate_filter = null_filter;
-            /* fallthru */
-          case EXCLUDE_ALTERNATES_OPT:
-          case INCLUDE_ALTERNATES_OPT:
-            current_alternate_filter.add_alternate_filter(clp->vstr, opt == EXCLUDE_ALTERNATES_OPT, errh);
-            current_filter_ptr = 0;
-            break;
+static HashMap<String, LoadedFont *> loaded_fonts(0);
+static HashMap<String, DvipsEncoding *> loaded_encodings(0);
 
-          case CLEAR_ALTERNATES_OPT:
-            current_alternate_filter = null_filter;
-            current_filter_ptr = 0;
-            break;
+static LoadedFont *
+load_font(const String &filename, int face, ErrorHandler *errh)
+{
+    // Fonts from one collection file share its data, and fonts with the
+    // same 'CFF ' table share its parse.
+    LoadedFont *siblings = loaded_fonts[filename];
+    for (LoadedFont *lf = siblings; lf; lf = lf->next_face)
+        if (lf->face == face)
+            return lf;
+
+    String data;
+    if (siblings)
+        data = siblings->otf->data_string();
+    else {
+        int before = errh->nerrors();
+        data = read_file(filename, errh);
+        if (errh->nerrors() != before)
+            return 0;
+    }
 
-          case UNICODING_OPT:
-            unicoding.push_back(clp->vstr);
-            break;
+    LandmarkErrorHandler cerrh(errh, printable_filename(filename));
+    OpenType::Font *otf = new OpenType::Font(data, face, &cerrh);
+    if (!otf->ok()) {
+        delete otf;
+        return 0;
+    }
+    Efont::Cff *cff_file = 0;
+    if (String cff_string = otf->table("CFF"))
+        for (LoadedFont *lf = siblings; lf && !cff_file; lf = lf->next_face)
+            if (lf->finfo->cff_file
+                && lf->otf->units_per_em() == otf->units_per_em()
+                && lf->otf->table("CFF") == cff_string)
+                cff_file = lf->finfo->cff_file;
+    FontInfo *finfo = new FontInfo(otf, &cerrh, cff_file);
+    if (!finfo->ok()) {
+        delete finfo;
+        delete otf;
+        return 0;
+    }
 
-          case CODINGSCHEME_OPT:
-            if (codingscheme)
-                usage_error(errh, "coding scheme specified twice");
-            codingscheme = clp->vstr;
-            if (codingscheme.length() > 39)
-                errh->warning("only first 39 characters of coding scheme are significant");
-            if (codingscheme.find_left('(') >= 0 || codingscheme.find_left(')') >= 0)
-                usage_error(errh, "coding scheme cannot contain parentheses");
-            break;
+    LoadedFont *lf = new LoadedFont;
+    lf->otf = otf;
+    lf->finfo = finfo;
+    lf->face = face;
+    lf->next_face = siblings;
+    loaded_fonts.insert(filename, lf);
+    return lf;
+}
 
-          case AUTOMATIC_OPT:
-            automatic = !clp->negated;
-            break;
+static const DvipsEncoding *
+load_encoding(const String &filename, bool no_ecommand, ErrorHandler *errh)
+{
+    String key = String(no_ecommand ? "N" : "E") + filename;
+    if (DvipsEncoding *dvipsenc = loaded_encodings[key])
+        return dvipsenc;
+
+    String path = locate_encoding(filename, errh);
+    if (!path) {
+        errh->error("encoding %<%s%> not found", filename.c_str());
+        return 0;
+    }
+    DvipsEncoding *dvipsenc = new DvipsEncoding;
+    dvipsenc->parse(path, no_ecommand, no_ecommand, errh);
+    loaded_encodings.insert(key, dvipsenc);
+    return dvipsenc;
+}
 
-          case VENDOR_OPT:
-            if (!set_vendor(clp->vstr))
-                usage_error(errh, "vendor name specified twice");
-            break;
+// In automatic mode, and only there, each job leaves a stamp file next to
+// its TFMs.  The stamp records a digest of the job's inputs, the files it
+// installed, and its map lines.  If a later run finds the same digest, and
+// the installed files are unchanged, it just reinstalls the map lines.
+// Runs without -a always regenerate.
 
-          case TYPEFACE_OPT:
-            if (!set_typeface(clp->vstr, true))
-                usage_error(errh, "typeface name specified twice");
-            break;
+static void
+digest_string(MD5_CONTEXT *md5, const String &str)
+{
+    char buf[24];
+    int n = sprintf(buf, "%d:", str.length());
+    md5_update(md5, (const unsigned char *) buf, n);
+    md5_update(md5, (const unsigned char *) str.data(), str.length());
+}
 
-          case VIRTUAL_OPT:
-            if (clp->negated)
-                output_flags &= ~G_VMETRICS;
-            else
-                output_flags |= G_VMETRICS;
-            specified_output_flags |= G_VMETRICS;
-            break;
+static void
+digest_file(MD5_CONTEXT *md5, const String &filename)
+{
+    digest_string(md5, filename);
+    if (filename && filename != "-")
+        digest_string(md5, read_file(filename, ErrorHandler::silent_handler()));
+}
 
-        case NO_ENCODING_OPT:
-        case NO_TYPE1_OPT:
-        case NO_DOTLESSJ_OPT:
-        case NO_UPDMAP_OPT:
-        case UPDMAP_SYS_OPT:
-            output_flags &= ~(opt - NO_OUTPUT_OPTS);
-            specified_output_flags |= opt - NO_OUTPUT_OPTS;
-            break;
+static String
+job_stamp_filename(const JobOptions &jo, const FontInfo &finfo,
+                   ErrorHandler *errh)
+{
+    // Name the stamp after the TeX font name.  Without one, use the
+    // PostScript name plus the options, which determine the TeX name.
+    String name = font_name;
+    if (!name) {
+        MD5_CONTEXT md5;
+        md5_init(&md5);
+        digest_string(&md5, jo.output_options);
+        char text_digest[MD5_TEXT_DIGEST_SIZE + 1];
+        md5_final_text(text_digest, &md5);
+        name = finfo.postscript_name() + "--" + String(text_digest).substring(0, 8);
+    }
+    if (name.find_left('/') >= 0)
+        return String();
+    return getodir(O_TFM, errh) + "/" + name + ".stamp";
+}
 
-        case TRUETYPE_OPT:
-        case TYPE42_OPT:
-        case UPDMAP_USER_OPT:
-            if (!clp->negated)
-                output_flags |= (opt - YES_OUTPUT_OPTS);
-            else
-                output_flags &= ~(opt - YES_OUTPUT_OPTS);
-            specified_output_flags |= opt - YES_OUTPUT_OPTS;
-            break;
+// Returns a digest of FILE's contents, or "-" if FILE doesn't exist yet.
+// (Batch workers leave encoding files to the parent process.  Encoding
+// files are named after their contents, so existence suffices.)
+static String
+output_file_stamp(const String &file)
+{
+    if (access(file.c_str(), F_OK) < 0)
+        return String::make_stable("-");
+    MD5_CONTEXT md5;
+    md5_init(&md5);
+    digest_string(&md5, read_file(file, ErrorHandler::silent_handler()));
+    char text_digest[MD5_TEXT_DIGEST_SIZE + 1];
+    md5_final_text(text_digest, &md5);
+    return String(text_digest);
+}
 
-          case OUTPUT_ENCODING_OPT:
-            if (out_encoding_file)
-                usage_error(errh, "encoding output file specified twice");
-            out_encoding_file = (clp->have_val ? clp->vstr : "-");
-            output_flags = G_ENCODING;
-            specified_output_flags = -1;
-            break;
+static String
+job_digest(const JobOptions &jo, const OpenType::Font &otf,
+           const DvipsEncoding &dvipsenc)
+{
+    MD5_CONTEXT md5;
+    md5_init(&md5);
+    digest_string(&md5, "otftotfm " VERSION);
+    digest_string(&md5, jo.output_options);
+    digest_string(&md5, otf.data_string());
+    digest_file(&md5, encoding_file ? dvipsenc.filename() : String());
+    for (const String *s = jo.base_encoding_files.begin(); s != jo.base_encoding_files.end(); s++)
+        digest_file(&md5, *s);
+    for (const String *g = glyphlist_files.begin(); g != glyphlist_files.end(); g++)
+        digest_file(&md5, *g);
+    for (int o = 0; o < NUMODIR; o++) {
+        const char *envvar = odirenvvar(o);
+        const char *value = (envvar ? getenv(envvar) : 0);
+        digest_string(&md5, value ? value : "");
+    }
+    char text_digest[MD5_TEXT_DIGEST_SIZE + 1];
+    md5_final_text(text_digest, &md5);
+    return String(text_digest);
+}
 
-          case MINIMUM_KERN_OPT:
-            minimum_kern = clp->val.d;
-            break;
+static bool
+check_job_stamp(const String &stamp_filename, const String &digest,
+                ErrorHandler *errh)
+{
+    if (access(stamp_filename.c_str(), R_OK) < 0)
+        return false;
+    String str = read_file(stamp_filename, ErrorHandler::silent_handler());
+    if (!str.starts_with("% otftotfm stamp\n"))
+        return false;
 
-          case MAP_FILE_OPT:
-            if (clp->negated)
-                output_flags &= ~G_PSFONTSMAP;
-            else {
-                output_flags |= G_PSFONTSMAP;
-                if (!set_map_file(clp->vstr))
-                    usage_error(errh, "map file specified twice");
+    bool digest_ok = false;
+    Vector<String> fontnames, maplines;
+    str.c_str();
+    const char *s_end = str.end();
+    for (const char *s = str.begin(); s != s_end; ) {
+        const char *line = s;
+        while (s != s_end && *s != '\n')
+            s++;
+        String l(line, s);
+        if (s != s_end)
+            s++;
+        if (l.length() < 2 || l[1] != '\t')
+            continue;
+        String value = l.substring(2);
+        if (l[0] == 'D') {
+            if (value != digest)
+                return false;
+            digest_ok = true;
+        } else if (l[0] == 'F' && digest_ok) {
+            int tab = value.find_left('\t');
+            String file = value.substring(tab + 1);
+            String stamp = (tab < 0 ? String() : value.substring(0, tab));
+            if (access(file.c_str(), F_OK) < 0
+                || (stamp != "-" && stamp != output_file_stamp(file))) {
+                if (verbose)
+                    errh->message("%s changed, regenerating", file.c_str());
+                return false;
             }
-            specified_output_flags |= G_PSFONTSMAP;
-            break;
-
-        case PL_OPT:
-            if (clp->negated)
-                output_flags &= ~G_ASCII;
-            else
-                output_flags |= G_ASCII;
-            specified_output_flags |= G_ASCII;
-            break;
-
-        case TFM_OPT:
-            if (clp->negated)
-                output_flags &= ~G_BINARY;
-            else
-                output_flags |= G_BINARY;
-            specified_output_flags |= G_BINARY;
-            break;
-
-        case ENCODING_DIR_OPT:
-        case TFM_DIR_OPT:
-        case PL_DIR_OPT:
-        case VF_DIR_OPT:
-        case VPL_DIR_OPT:
-        case TYPE1_DIR_OPT:
-        case TRUETYPE_DIR_OPT:
-        case TYPE42_DIR_OPT:
-        case DIR_OPT:
-            if (!odirs[opt - DIR_OPTS])
-                odirs[opt - DIR_OPTS] = clp->vstr;
-            else
-                usage_error(errh, "%s directory specified twice", odirname(opt - DIR_OPTS));
-            break;
-
-          case FONT_NAME_OPT:
-          font_name:
-            if (font_name)
-                usage_error(errh, "font name specified twice");
-            font_name = clp->vstr;
-            break;
-
-        case FIXED_PITCH_OPT:
-            override_is_fixed_pitch = true;
-            is_fixed_pitch = !clp->negated;
-            break;
-
-        case PROPORTIONAL_WIDTH_OPT:
-            override_is_fixed_pitch = true;
-            is_fixed_pitch = !!clp->negated;
-            break;
-
-        case ITALIC_ANGLE_OPT:
-            override_italic_angle = true;
-            italic_angle = clp->val.d;
-            break;
-
-          case GLYPHLIST_OPT:
-            glyphlist_files.push_back(clp->vstr);
-            break;
-
-          case QUERY_FEATURES_OPT:
-            usage_error(errh, "run %<otfinfo --query-features%> instead");
-            break;
-
-          case QUERY_SCRIPTS_OPT:
-            usage_error(errh, "run %<otfinfo --query-scripts%> instead");
-            break;
-
-          case QUIET_OPT:
-            if (clp->negated)
-                errh = ErrorHandler::default_handler();
-            else
-                // 9.Nov.05 -- need a new SilentErrorHandler, because we use
-                // the base SilentErrorHandler elsewhere to ignore errors
-                errh = new SilentErrorHandler;
-            break;
-
-          case VERBOSE_OPT:
-            verbose = !clp->negated;
-            break;
-
-          case NOCREATE_OPT:
-            no_create = clp->negated;
-            break;
-
-          case FORCE_OPT:
-            force = !clp->negated;
-            break;
-
-          case KPATHSEA_DEBUG_OPT:
-#if HAVE_KPATHSEA
-            kpsei_set_debug_flags(clp->val.u);
-#else
-            errh->warning("Not compiled with kpathsea!");
-#endif
-            break;
-
-        case X_HEIGHT_OPT: {
-            char* ends;
-            if (strcmp(clp->vstr, "auto") == 0)
-                override_x_height = FontInfo::x_height_auto;
-            else if (strcmp(clp->vstr, "x") == 0)
-                override_x_height = FontInfo::x_height_x;
-            else if (strcmp(clp->vstr, "font") == 0
-                     || strcmp(clp->vstr, "os/2") == 0)
-                override_x_height = FontInfo::x_height_os2;
-            else if ((x_height = strtod(clp->vstr, &ends)) >= 0
-                     && *ends == 0 && *clp->vstr != 0)
-                override_x_height = FontInfo::x_height_explicit;
-            else
-                usage_error(errh, "bad --x-height option");
-            break;
+        } else if (l[0] == 'M' || l[0] == 'R') {
+            int tab = value.find_left('\t');
+            fontnames.push_back(value.substring(0, tab < 0 ? value.length() : tab));
+            maplines.push_back(tab < 0 ? String() : value.substring(tab + 1) + "\n");
         }
+    }
+    if (!digest_ok)
+        return false;
 
-          case VERSION_OPT:
-            printf("otftotfm (LCDF typetools) %s\n", VERSION);
-            printf("Copyright (C) 2002-2023 Eddie Kohler\n\
-This is free software; see the source for copying conditions.\n\
-There is NO warranty, not even for merchantability or fitness for a\n\
-particular purpose.\n");
-            exit(0);
-            break;
-
-          case HELP_OPT:
-            usage();
-            exit(0);
-            break;
-
-          case Clp_NotOption:
-            if (input_file && font_name)
-                usage_error(errh, "too many arguments");
-            else if (input_file)
-                goto font_name;
-            else
-                input_file = clp->vstr;
-            break;
-
-          case Clp_Done:
-            goto done;
-
-          case Clp_BadOption:
-            usage_error(errh, 0);
-            break;
-
-          default:
-            break;
+    if (verbose)
+        errh->message("%s: inputs unchanged, skipping", stamp_filename.c_str());
+    for (int i = 0; i < fontnames.size(); i++)
+        update_autofont_map(fontnames[i], maplines[i], errh);
+    return true;
+}
 
-        }
+static void
+write_job_stamp(const String &stamp_filename, const String &digest,
+                OutputRecord &record, ErrorHandler *errh)
+{
+    StringAccum sa;
+    sa << "% otftotfm stamp\n" << "D\t" << digest << '\n';
+    std::sort(record.files.begin(), record.files.end());
+    String *files_end = std::unique(record.files.begin(), record.files.end());
+    for (String *f = record.files.begin(); f != files_end; f++) {
+        if (f->find_left('\n') >= 0)
+            return;
+        sa << "F\t" << output_file_stamp(*f) << '\t' << *f << '\n';
     }
+    for (int i = 0; i < record.map_fontnames.size(); i++) {
+        String fontname = record.map_fontnames[i], mapline = record.map_lines[i];
+        if (mapline && mapline.back() == '\n')
+            mapline = mapline.substring(0, -1);
+        if (fontname.find_left('\n') >= 0 || fontname.find_left('\t') >= 0
+            || mapline.find_left('\n') >= 0)
+            return;
+        if (mapline)
+            sa << "M\t" << fontname << '\t' << mapline << '\n';
+        else
+            sa << "R\t" << fontname << '\n';
+    }
+    write_file(stamp_filename, sa.take_string(), errh);
+}
 
-  done:
+static void
+run_job(JobOptions &jo, ErrorHandler *errh)
+{
     // check for odd option combinations
-    if (warn_missing > 0 && !(output_flags & G_VMETRICS))
+    if (jo.warn_missing > 0 && !(output_flags & G_VMETRICS))
         errh->warning("%<--warn-missing%> has no effect with %<--no-virtual%>");
-    if (!(specified_output_flags & (G_BINARY | G_ASCII)))
+    if (!(jo.specified_output_flags & (G_BINARY | G_ASCII)))
         output_flags |= G_BINARY;
 
-    // set up file names
-    if (!input_file)
-        usage_error(errh, "no font filename provided");
     if (encoding_file == "-")
         encoding_file = "";
 
-    // set up output directories
-    if (odirs[NUMODIR]) {
-        for (int i = 0; i < NUMODIR; ++i)
-            if (!odirs[i])
-                odirs[i] = odirs[NUMODIR];
-    }
-    for (int i = 0; i < NUMODIR; ++i)
-        if (odirs[i])
-            setodir(i, odirs[i]);
-
     // set up feature filters
     if (!altselector_features.size()) {
-        if (!current_filter_ptr) {
-            current_filter_ptr = new GlyphFilter(current_substitution_filter + current_alternate_filter);
-            allocated_filters.push_back(current_filter_ptr);
+        if (!jo.current_filter_ptr) {
+            jo.current_filter_ptr = new GlyphFilter(jo.current_substitution_filter + jo.current_alternate_filter);
+            allocated_filters.push_back(jo.current_filter_ptr);
         }
         altselector_features.push_back(OpenType::Tag("dlig"));
-        altselector_feature_filters.insert(OpenType::Tag("dlig"), current_filter_ptr);
+        altselector_feature_filters.insert(OpenType::Tag("dlig"), jo.current_filter_ptr);
         altselector_features.push_back(OpenType::Tag("salt"));
-        altselector_feature_filters.insert(OpenType::Tag("salt"), current_filter_ptr);
-    } else if (!current_filter_ptr) {
+        altselector_feature_filters.insert(OpenType::Tag("salt"), jo.current_filter_ptr);
+    } else if (!jo.current_filter_ptr) {
         errh->warning("some filtering options ignored");
         errh->message("(--include-*, --exclude-*, and --*-filter options must occur\nbefore the feature options to which they should apply.)");
     }
 
     try {
         // read font
-        otf_data = read_file(input_file, errh);
-        if (errh->nerrors())
-            exit(1);
-
-        LandmarkErrorHandler cerrh(errh, printable_filename(input_file));
-        BailErrorHandler bail_errh(&cerrh);
-
-        OpenType::Font otf(otf_data, &bail_errh);
-        assert(otf.ok());
+        LoadedFont *lf = load_font(jo.input_file, jo.face, errh);
+        if (!lf)
+            return;
+        const OpenType::Font &otf = *lf->otf;
+        LandmarkErrorHandler cerrh(errh, printable_filename(jo.input_file));
 
         // figure out scripts we care about
         if (!interesting_scripts.size()) {
@@ -2358,91 +3132,642 @@ particular purpose.\n");
         std::sort(interesting_features.begin(), interesting_features.end());
         std::sort(altselector_features.begin(), altselector_features.end());
 
-        // find glyphlist
-        if (!glyphlist_files.size()) {
-#if HAVE_KPATHSEA
-            if (String g = kpsei_find_file("glyphlist.txt", KPSEI_FMT_MAP)) {
-                glyphlist_files.push_back(g);
-                if (verbose)
-                    errh->message("glyphlist.txt found with kpathsea at %s", g.c_str());
-            } else
-#endif
-                glyphlist_files.push_back(GLYPHLISTDIR "/glyphlist.txt");
-#if HAVE_KPATHSEA
-            if (String g = kpsei_find_file("texglyphlist.txt", KPSEI_FMT_MAP)) {
-                glyphlist_files.push_back(g);
-                if (verbose)
-                    errh->message("texglyphlist.txt found with kpathsea at %s", g.c_str());
-            } else
-#endif
-                glyphlist_files.push_back(GLYPHLISTDIR "/texglyphlist.txt");
-        }
-
-        // read glyphlist
-        for (String *g = glyphlist_files.begin(); g < glyphlist_files.end(); g++)
-            if (String s = read_file(*g, errh, true))
-                DvipsEncoding::add_glyphlist(s);
-
         // read base encodings
-        for (String *s = base_encoding_files.begin(); s < base_encoding_files.end(); s++)
+        int nbase_encodings = base_encodings.size();
+        for (String *s = jo.base_encoding_files.begin(); s < jo.base_encoding_files.end(); s++)
             parse_base_encodings(*s, errh);
 
         // read encoding
         DvipsEncoding dvipsenc;
         if (encoding_file) {
-            if (String path = locate_encoding(encoding_file, errh))
-                dvipsenc.parse(path, no_ecommand, no_ecommand, errh);
+            if (const DvipsEncoding *e = load_encoding(encoding_file, jo.no_ecommand, errh))
+                dvipsenc = *e;
             else
-                errh->fatal("encoding %<%s%> not found", encoding_file.c_str());
+                return;
         } else {
             String cff_data(otf.table("CFF"));
             if (!cff_data) {
                 errh->error("explicit encoding required for TrueType fonts");
                 errh->message("(Use %<-e ENCODING%> to choose an encoding. %<-e texnansx%> often works.)");
-                exit(1);
-            } else if (!have_encoding_file) {
+                return;
+            } else if (!jo.have_encoding_file) {
                 errh->warning("no encoding provided");
                 errh->message("(Use %<-e ENCODING%> to choose an encoding. %<-e texnansx%> often works,\nor say %<-e -%> to turn off this warning.)");
             }
 
             // use encoding from font
+            BailErrorHandler bail_errh(&cerrh);
             Cff cff(cff_data, otf.units_per_em(), &bail_errh);
             Cff::FontParent *font = cff.font(PermString(), &bail_errh);
             assert(cff.ok() && font->ok());
             if (Type1Encoding *t1e = font->type1_encoding()) {
                 for (int i = 0; i < 256; i++)
                     dvipsenc.encode(i, (*t1e)[i]);
-            } else
-                errh->fatal("font has no encoding, specify one explicitly");
+            } else {
+                errh->error("font has no encoding, specify one explicitly");
+                return;
+            }
         }
 
         // apply default ligkern commands
-        if (default_ligkern)
+        if (jo.default_ligkern)
             dvipsenc.parse_ligkern(default_ligkerns, 0, ErrorHandler::silent_handler());
 
         // apply command-line ligkern commands and coding scheme
         cerrh.set_landmark("--ligkern command");
-        for (int i = 0; i < ligkern.size(); i++)
-            dvipsenc.parse_ligkern(ligkern[i], 1, &cerrh);
+        for (int i = 0; i < jo.ligkern.size(); i++)
+            dvipsenc.parse_ligkern(jo.ligkern[i], 1, &cerrh);
         cerrh.set_landmark("--position command");
-        for (int i = 0; i < pos.size(); i++)
-            dvipsenc.parse_position(pos[i], 1, &cerrh);
+        for (int i = 0; i < jo.pos.size(); i++)
+            dvipsenc.parse_position(jo.pos[i], 1, &cerrh);
         cerrh.set_landmark("--unicoding command");
-        for (int i = 0; i < unicoding.size(); i++)
-            dvipsenc.parse_unicoding(unicoding[i], 1, &cerrh);
-        if (codingscheme)
-            dvipsenc.set_coding_scheme(codingscheme);
-        if (warn_missing >= 0)
-            dvipsenc.set_warn_missing(warn_missing);
+        for (int i = 0; i < jo.unicoding.size(); i++)
+            dvipsenc.parse_unicoding(jo.unicoding[i], 1, &cerrh);
+        if (jo.codingscheme)
+            dvipsenc.set_coding_scheme(jo.codingscheme);
+        if (jo.warn_missing >= 0)
+            dvipsenc.set_warn_missing(jo.warn_missing);
+
+        // skip the job if its inputs haven't changed since the last run
+        set_family_typeface(*lf->finfo);
+        String stamp_filename, digest;
+        if (automatic && !force) {
+            stamp_filename = job_stamp_filename(jo, *lf->finfo, errh);
+            digest = job_digest(jo, otf, dvipsenc);
+        }
+        if (!stamp_filename || !check_job_stamp(stamp_filename, digest, errh)) {
+            OutputRecord record;
+            int nerrors = errh->nerrors();
+            set_output_record(stamp_filename ? &record : 0);
+            do_file(jo.input_file, *lf->finfo, dvipsenc, jo.literal_encoding, errh);
+            set_output_record(0);
+            if (stamp_filename && errh->nerrors() == nerrors && !no_create)
+                write_job_stamp(stamp_filename, digest, record, errh);
+        }
 
-        do_file(input_file, otf, dvipsenc, literal_encoding, errh);
+        // forget base encodings read for this job
+        for (int i = nbase_encodings; i < base_encodings.size(); i++)
+            delete base_encodings[i];
+        base_encodings.resize(nbase_encodings);
 
     } catch (OpenType::Error e) {
+        set_output_record(0);
         errh->error("unhandled exception %<%s%>", e.description.c_str());
     }
+}
+
+struct BatchJob {
+    JobOptions options;
+    JobSettings settings;
+    String command;
+};
+
+// Split a batch file line into words.  Words are separated by whitespace
+// and may be quoted with '...' or "...".
+static void
+split_batch_line(const char *s, const char *end, Vector<String> &words)
+{
+    while (1) {
+        while (s != end && isspace((unsigned char) *s))
+            s++;
+        if (s == end || *s == '%' || *s == '#')
+            return;
+        StringAccum sa;
+        while (s != end && !isspace((unsigned char) *s)) {
+            if (*s == '\'' || *s == '\"') {
+                char quote = *s;
+                for (s++; s != end && *s != quote; s++)
+                    sa << *s;
+                if (s != end)
+                    s++;
+            } else {
+                sa << *s;
+                s++;
+            }
+        }
+        words.push_back(sa.take_string());
+    }
+}
+
+static void
+read_batch_file(const String &filename, const JobOptions &defaults,
+                const JobSettings &default_settings, Vector<BatchJob> &jobs,
+                ErrorHandler *errh)
+{
+    String str = read_file(filename, errh);
+    String print_filename = (filename == "-" ? "<stdin>" : filename) + ":";
+    int lineno = 1;
+    str.c_str();
+    const char *s_end = str.end();
+    for (const char *s = str.begin(); s != s_end; lineno++) {
+        const char *line = s;
+        while (s != s_end && *s != '\n' && *s != '\r')
+            s++;
+        Vector<String> words;
+        split_batch_line(line, s, words);
+        const char *line_end = s;
+        if (s != s_end && *s == '\r')
+            s++;
+        if (s != s_end && *s == '\n')
+            s++;
+        if (!words.size())
+            continue;
+
+        Vector<const char *> argv;
+        argv.push_back(program_name);
+        for (String *w = words.begin(); w != words.end(); w++)
+            argv.push_back(w->c_str());
+        Clp_Parser *clp = Clp_NewParser(argv.size(), argv.begin(), sizeof(options) / sizeof(options[0]), options);
+        Clp_AddType(clp, CHAR_OPTTYPE, 0, clp_parse_char, 0);
+
+        BatchJob job;
+        job.options = defaults;
+        default_settings.restore();
+        LandmarkErrorHandler lerrh(errh, print_filename + String(lineno));
+        ErrorHandler *jerrh = &lerrh;
+        while (parse_option(clp, Clp_Next(clp), job.options, true, jerrh))
+            /* nada */;
+        Clp_DeleteParser(clp);
+        if (!job.options.input_file)
+            usage_error(jerrh, "no font filename provided");
+
+        job.settings.save();
+        while (line != line_end && isspace((unsigned char) line_end[-1]))
+            line_end--;
+        while (line != line_end && isspace((unsigned char) *line))
+            line++;
+        job.command = String(line, line_end);
+        jobs.push_back(job);
+    }
+}
+
+static void
+start_batch_job(BatchJob &job, const String &base_invocation)
+{
+    job.settings.restore();
+    invocation.clear();
+    invocation << base_invocation << " " << job.command;
+    reset_typeface();
+}
+
+#if HAVE_BATCH_WORKERS
+// Batch workers are child processes.  (Threads would not do: PermString,
+// kpathsea, and the fcntl locks on encoding and map files are all
+// process-wide.)  Each worker reports its jobs' encoding files, map lines,
+// and kpathsea cache changes over a pipe as a series of "LENGTH:DATA"
+// fields; the parent commits them in job order, so the results don't
+// depend on scheduling.
+
+struct BatchResult {
+    Vector<DeferredEncoding> encodings;
+    Vector<String> map_fontnames;
+    Vector<String> map_lines;
+    Vector<String> kpathsea_changes;
+};
+
+static void
+append_field(StringAccum &sa, const String &str)
+{
+    sa << str.length() << ':' << str;
+}
+
+static bool
+take_field(const String &str, int &pos, String &field)
+{
+    int colon = str.find_left(':', pos);
+    if (colon <= pos)
+        return false;
+    int len = 0;
+    for (int i = pos; i < colon; i++)
+        if (isdigit((unsigned char) str[i]))
+            len = 10 * len + str[i] - '0';
+        else
+            return false;
+    if (len > str.length() - colon - 1)
+        return false;
+    field = str.substring(colon + 1, len);
+    pos = colon + 1 + len;
+    return true;
+}
+
+static bool
+take_count_field(const String &str, int &pos, int &count)
+{
+    String field;
+    if (!take_field(str, pos, field) || !field || !isdigit((unsigned char) field[0]))
+        return false;
+    count = atoi(field.c_str());
+    return true;
+}
+
+static void
+unparse_batch_result(StringAccum &sa, int jobno)
+{
+    Vector<String> fontnames, maplines;
+    take_deferred_autofont_map(fontnames, maplines);
+    append_field(sa, String(jobno));
+    append_field(sa, String(deferred_encodings.size()));
+    for (DeferredEncoding *de = deferred_encodings.begin(); de != deferred_encodings.end(); de++) {
+        append_field(sa, de->filename);
+        append_field(sa, de->name);
+        append_field(sa, de->contents);
+    }
+    append_field(sa, String(fontnames.size()));
+    for (int i = 0; i < fontnames.size(); i++) {
+        append_field(sa, fontnames[i]);
+        append_field(sa, maplines[i]);
+    }
+    Vector<String> kpathsea_changes;
+    take_kpathsea_cache_changes(kpathsea_changes);
+    append_field(sa, String(kpathsea_changes.size()));
+    for (String *k = kpathsea_changes.begin(); k != kpathsea_changes.end(); k++)
+        append_field(sa, *k);
+    deferred_encodings.clear();
+}
+
+static bool
+parse_batch_results(const String &str, Vector<BatchResult> &results)
+{
+    int pos = 0;
+    while (pos < str.length()) {
+        int jobno, n;
+        if (!take_count_field(str, pos, jobno) || jobno >= results.size()
+            || !take_count_field(str, pos, n))
+            return false;
+        BatchResult &r = results[jobno];
+        for (int i = 0; i < n; i++) {
+            DeferredEncoding de;
+            if (!take_field(str, pos, de.filename)
+                || !take_field(str, pos, de.name)
+                || !take_field(str, pos, de.contents))
+                return false;
+            r.encodings.push_back(de);
+        }
+        if (!take_count_field(str, pos, n))
+            return false;
+        for (int i = 0; i < n; i++) {
+            String fontname, mapline;
+            if (!take_field(str, pos, fontname) || !take_field(str, pos, mapline))
+                return false;
+            r.map_fontnames.push_back(fontname);
+            r.map_lines.push_back(mapline);
+        }
+        if (!take_count_field(str, pos, n))
+            return false;
+        for (int i = 0; i < n; i++) {
+            String change;
+            if (!take_field(str, pos, change))
+                return false;
+            r.kpathsea_changes.push_back(change);
+        }
+    }
+    return true;
+}
+
+static bool
+write_all(int fd, const char *data, int len)
+{
+    while (len > 0) {
+        ssize_t w = write(fd, data, len);
+        if (w < 0 && errno != EINTR && errno != EAGAIN)
+            return false;
+        else if (w > 0) {
+            data += w;
+            len -= w;
+        }
+    }
+    return true;
+}
+
+struct PieceSizeGreater {
+    const Vector<int> &size;
+    PieceSizeGreater(const Vector<int> &s)
+        : size(s) {
+    }
+    bool operator()(int a, int b) const {
+        return size[a] > size[b];
+    }
+};
+
+// Assign each job to a worker, or to -1 to run in the parent before the
+// workers start.
+static void
+assign_batch_workers(const Vector<BatchJob> &jobs, int nw, Vector<int> &worker)
+{
+    // group the jobs by font
+    HashMap<String, int> group_map(-1);
+    Vector<int> group, group_size;
+    for (const BatchJob *job = jobs.begin(); job != jobs.end(); job++) {
+        int &g = group_map.find_force(job->options.input_file, -1);
+        if (g < 0) {
+            g = group_size.size();
+            group_size.push_back(0);
+        }
+        group.push_back(g);
+        group_size[g]++;
+    }
+    int ngroups = group_size.size();
+
+    // Keep each font's jobs together when there are enough fonts to go
+    // around.  Otherwise split the largest fonts' jobs into pieces for
+    // separate workers.  The first job of a split font runs in the parent,
+    // so the font's Type 1 version is generated, and its font files are
+    // installed, once rather than by several workers at a time.
+    Vector<int> npieces(ngroups, 1);
+    for (int extra = nw - ngroups; extra > 0; extra--) {
+        int best = -1;
+        for (int g = 0; g < ngroups; g++)
+            if (npieces[g] < group_size[g] - 1
+                && (best < 0 || group_size[g] * npieces[best] > group_size[best] * npieces[g]))
+                best = g;
+        if (best < 0)
+            break;
+        npieces[best]++;
+    }
+
+    Vector<int> group_piece0, piece_size, job_piece, seen(ngroups, 0);
+    for (int g = 0; g < ngroups; g++) {
+        group_piece0.push_back(piece_size.size());
+        for (int i = 0; i < npieces[g]; i++)
+            piece_size.push_back(0);
+    }
+    for (int j = 0; j < jobs.size(); j++) {
+        int g = group[j], k = seen[g]++, piece;
+        if (npieces[g] == 1)
+            piece = group_piece0[g];
+        else if (k == 0)
+            piece = -1;
+        else
+            piece = group_piece0[g] + (k - 1) * npieces[g] / (group_size[g] - 1);
+        job_piece.push_back(piece);
+        if (piece >= 0)
+            piece_size[piece]++;
+    }
+
+    // give the largest pieces out first, each to the least loaded worker
+    Vector<int> order, piece_worker(piece_size.size(), 0), load(nw, 0);
+    for (int p = 0; p < piece_size.size(); p++)
+        order.push_back(p);
+    std::stable_sort(order.begin(), order.end(), PieceSizeGreater(piece_size));
+    for (int *p = order.begin(); p != order.end(); p++) {
+        int w = std::min_element(load.begin(), load.end()) - load.begin();
+        piece_worker[*p] = w;
+        load[w] += piece_size[*p];
+    }
+
+    worker.clear();
+    for (int j = 0; j < jobs.size(); j++)
+        worker.push_back(job_piece[j] < 0 ? -1 : piece_worker[job_piece[j]]);
+}
+
+static bool
+run_batch_workers(Vector<BatchJob> &jobs, int nw,
+                  const String &base_invocation, ErrorHandler *errh)
+{
+    Vector<int> worker;
+    assign_batch_workers(jobs, nw, worker);
+
+    // run the jobs assigned to the parent, deferring their results like a
+    // worker's
+    Vector<BatchResult> results(jobs.size(), BatchResult());
+    defer_encodings = true;
+    for (int j = 0; j < jobs.size(); j++)
+        if (worker[j] < 0) {
+            start_batch_job(jobs[j], base_invocation);
+            run_job(jobs[j].options, errh);
+            StringAccum sa;
+            unparse_batch_result(sa, j);
+            parse_batch_results(sa.take_string(), results);
+        }
+    defer_encodings = false;
+
+    // don't let children repeat buffered output
+    fflush(stdout);
+    fflush(stderr);
+
+    Vector<pid_t> pids;
+    Vector<int> fds;
+    Vector<StringAccum> outputs(nw, StringAccum());
+    for (int w = 0; w < nw; w++) {
+        int p[2];
+        if (pipe(p) < 0) {
+            errh->warning("%s during pipe", strerror(errno));
+            errh->message("(Running the remaining batch jobs in this process.)");
+            break;
+        }
+        pid_t child = fork();
+        if (child < 0) {
+            int saved_errno = errno;
+            close(p[0]);
+            close(p[1]);
+            errh->warning("%s during fork", strerror(saved_errno));
+            errh->message("(Running the remaining batch jobs in this process.)");
+            break;
+        } else if (child == 0) {
+            close(p[0]);
+            defer_encodings = true;
+            int before = errh->nerrors();
+            for (int j = 0; j < jobs.size(); j++)
+                if (worker[j] == w) {
+                    start_batch_job(jobs[j], base_invocation);
+                    run_job(jobs[j].options, errh);
+                    StringAccum sa;
+                    unparse_batch_result(sa, j);
+                    if (!write_all(p[1], sa.data(), sa.length()))
+                        errh->error("batch worker: %s", strerror(errno));
+                }
+            close(p[1]);
+            fflush(stdout);
+            fflush(stderr);
+            _exit(errh->nerrors() == before ? 0 : 1);
+        }
+        close(p[1]);
+        pids.push_back(child);
+        fds.push_back(p[0]);
+    }
+
+    // collect worker output
+    int nopen = fds.size();
+    while (nopen > 0) {
+        Vector<struct pollfd> pfds;
+        Vector<int> pfd_worker;
+        for (int w = 0; w < fds.size(); w++)
+            if (fds[w] >= 0) {
+                struct pollfd pfd;
+                pfd.fd = fds[w];
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                pfds.push_back(pfd);
+                pfd_worker.push_back(w);
+            }
+        if (poll(pfds.begin(), pfds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            errh->fatal("poll: %s", strerror(errno));
+        }
+        for (int i = 0; i < pfds.size(); i++)
+            if (pfds[i].revents) {
+                int w = pfd_worker[i];
+                char *x = outputs[w].reserve(8192);
+                ssize_t r = read(fds[w], x, 8192);
+                if (r > 0)
+                    outputs[w].adjust_length(r);
+                else if (r == 0 || (errno != EINTR && errno != EAGAIN)) {
+                    close(fds[w]);
+                    fds[w] = -1;
+                    nopen--;
+                }
+            }
+    }
+
+    bool ok = true;
+    for (int w = 0; w < pids.size(); w++) {
+        int status;
+        pid_t answer;
+        while ((answer = waitpid(pids[w], &status, 0)) < 0 && errno == EINTR)
+            /* try again */;
+        if (answer < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ok = false;
+        if (!parse_batch_results(outputs[w].take_string(), results))
+            errh->error("batch worker %d: bad output", w);
+    }
+
+    // commit results in job order, running jobs whose worker could not
+    // be started here
+    for (int j = 0; j < jobs.size(); j++) {
+        if (worker[j] >= pids.size()) {
+            start_batch_job(jobs[j], base_invocation);
+            run_job(jobs[j].options, errh);
+            continue;
+        }
+        BatchResult *r = &results[j];
+        for (DeferredEncoding *de = r->encodings.begin(); de != r->encodings.end(); de++) {
+            // update_odir needs the encoding directory set up here, too
+            if (automatic)
+                (void) getodir(O_ENCODING, errh);
+            StringAccum contents;
+            contents << de->contents;
+            if (write_encoding_file(de->filename, de->name, contents, errh) == 1)
+                update_odir(O_ENCODING, de->filename, errh);
+        }
+        for (int i = 0; i < r->map_fontnames.size(); i++)
+            update_autofont_map(r->map_fontnames[i], r->map_lines[i], errh);
+        apply_kpathsea_cache_changes(r->kpathsea_changes);
+    }
+    return ok;
+}
+#endif
+
+static bool
+run_batch(Vector<BatchJob> &jobs, const JobSettings &default_settings,
+          ErrorHandler *errh)
+{
+    String base_invocation = invocation.take_string();
+    bool ok = true;
+
+    defer_autofont_map(true);
+#if HAVE_BATCH_WORKERS
+    if (nworkers > 1 && jobs.size() > 1)
+        ok = run_batch_workers(jobs, std::min(nworkers, jobs.size()), base_invocation, errh);
+    else
+#endif
+        for (BatchJob *job = jobs.begin(); job != jobs.end(); job++) {
+            start_batch_job(*job, base_invocation);
+            run_job(job->options, errh);
+        }
+
+    // write the map file once, with the command line's settings
+    default_settings.restore();
+    flush_autofont_map(errh);
+    return ok;
+}
+
+int
+main(int argc, char *argv[])
+{
+#ifndef WIN32
+    handle_sigchld();
+#endif
+    Clp_Parser *clp =
+        Clp_NewParser(argc, (const char * const *)argv, sizeof(options) / sizeof(options[0]), options);
+    Clp_AddType(clp, CHAR_OPTTYPE, 0, clp_parse_char, 0);
+    program_name = Clp_ProgramName(clp);
+#if HAVE_KPATHSEA
+    kpsei_init(argv[0], "lcdftools");
+#endif
+#ifdef HAVE_CTIME
+    {
+        time_t t = time(0);
+        char *c = ctime(&t);
+        current_time = " on " + String(c).substring(0, -1); // get rid of \n
+    }
+#endif
+    for (int i = 0; i < argc; i++)
+        invocation << (i ? " " : "") << argv[i];
+
+    ErrorHandler *errh = ErrorHandler::static_initialize(new FileErrorHandler(stderr, String(program_name) + ": "));
+    JobOptions jo;
+    while (parse_option(clp, Clp_Next(clp), jo, false, errh))
+        /* nada */;
+
+    // set up file names
+    if (!batch_file && !jo.input_file)
+        usage_error(errh, "no font filename provided");
+
+    // read batch file; all jobs are parsed before any files are written
+    JobSettings default_settings;
+    Vector<BatchJob> jobs;
+    if (batch_file) {
+        if (jo.input_file || font_name)
+            usage_error(errh, "font arguments not allowed with %<--batch%>");
+        default_settings.save();
+        read_batch_file(batch_file, jo, default_settings, jobs, errh);
+    }
+
+    // set up output directories
+    if (odirs[NUMODIR]) {
+        for (int i = 0; i < NUMODIR; ++i)
+            if (!odirs[i])
+                odirs[i] = odirs[NUMODIR];
+    }
+    for (int i = 0; i < NUMODIR; ++i)
+        if (odirs[i])
+            setodir(i, odirs[i]);
+
+    // find glyphlist
+    if (!glyphlist_files.size()) {
+#if HAVE_KPATHSEA
+        if (String g = find_kpathsea_file("glyphlist.txt", KPSEI_FMT_MAP)) {
+            glyphlist_files.push_back(g);
+            if (verbose)
+                errh->message("glyphlist.txt found with kpathsea at %s", g.c_str());
+        } else
+#endif
+            glyphlist_files.push_back(GLYPHLISTDIR "/glyphlist.txt");
+#if HAVE_KPATHSEA
+        if (String g = find_kpathsea_file("texglyphlist.txt", KPSEI_FMT_MAP)) {
+            glyphlist_files.push_back(g);
+            if (verbose)
+                errh->message("texglyphlist.txt found with kpathsea at %s", g.c_str());
+        } else
+#endif
+            glyphlist_files.push_back(GLYPHLISTDIR "/texglyphlist.txt");
+    }
+
+    // read glyphlist
+    for (String *g = glyphlist_files.begin(); g < glyphlist_files.end(); g++)
+        if (String s = read_file(*g, errh, true))
+            DvipsEncoding::add_glyphlist(s);
+
+    bool ok = true;
+    if (batch_file)
+        ok = run_batch(jobs, default_settings, errh);
+    else
+        run_job(jo, errh);
+    save_kpathsea_cache(errh);
 
     for (int i = 0; i < allocated_filters.size(); ++i)
         delete allocated_filters[i];
     Clp_DeleteParser(clp);
-    return (errh->nerrors() == 0 ? 0 : 1);
+    return (ok && errh->nerrors() == 0 ? 0 : 1);
 }
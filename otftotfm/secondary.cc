@@ -84,16 +84,38 @@ enum {
 };
 
 
-FontInfo::FontInfo(const Efont::OpenType::Font *otf_, ErrorHandler *errh)
+// Glyph bounds are computed on demand, once per glyph and transformation,
+// and kept as long as the FontInfo, which otftotfm reuses across the jobs of
+// a batch.  Results are exactly those of CharstringBounds::bounds.
+struct FontInfo::BoundsCache {
+    Transform xform;
+    Vector<int> index;          // glyph -> entries offset, or -1
+    Vector<double> entries;     // bounds[0..3], width, ok
+    BoundsCache(const Transform &xf, int nglyphs)
+        : xform(xf), index(nglyphs, -1) {
+    }
+    bool same_transform(const Transform &xf) const {
+        for (int i = 0; i < 6; ++i)
+            if (xform[i] != xf[i])
+                return false;
+        return xform.null() == xf.null();
+    }
+};
+
+FontInfo::FontInfo(const Efont::OpenType::Font *otf_, ErrorHandler *errh,
+                   Efont::Cff *shared_cff_file)
     : otf(otf_), cmap(0), cff_file(0), cff(0), post(0), name(0), _nglyphs(-1),
-      _got_glyph_names(false), _ttb_program(0), _override_is_fixed_pitch(false),
+      _own_cff_file(!shared_cff_file), _got_glyph_names(false), _ttb_program(0), _override_is_fixed_pitch(false),
       _override_italic_angle(false), _override_x_height(x_height_auto)
 {
     cmap = new Efont::OpenType::Cmap(otf->table("cmap"), errh);
     assert(cmap->ok());
 
     if (String cff_string = otf->table("CFF")) {
-        cff_file = new Efont::Cff(cff_string, otf->units_per_em(), errh);
+        if (shared_cff_file)
+            cff_file = shared_cff_file;
+        else
+            cff_file = new Efont::Cff(cff_string, otf->units_per_em(), errh);
         if (!cff_file->ok())
             return;
         Efont::Cff::FontParent *fp = cff_file->font(PermString(), errh);
@@ -122,10 +144,13 @@ FontInfo::FontInfo(const Efont::OpenType::Font *otf_, ErrorHandler *errh)
 FontInfo::~FontInfo()
 {
     delete cmap;
-    delete cff_file;
+    if (_own_cff_file)
+        delete cff_file;
     delete post;
     delete name;
     delete _ttb_program;
+    for (BoundsCache **bc = _bounds_caches.begin(); bc != _bounds_caches.end(); ++bc)
+        delete *bc;
 }
 
 bool
@@ -191,6 +216,41 @@ FontInfo::program() const
     }
 }
 
+bool
+FontInfo::glyph_bounds(Efont::OpenType::Glyph g, const Transform &xform,
+                       double bounds[4], double &width) const
+{
+    if (g < 0 || g >= _nglyphs)
+        return Efont::CharstringBounds::bounds(xform, program()->glyph_context(g), bounds, width);
+
+    BoundsCache *bc = 0;
+    for (BoundsCache **bcp = _bounds_caches.begin(); bcp != _bounds_caches.end() && !bc; ++bcp)
+        if ((*bcp)->same_transform(xform))
+            bc = *bcp;
+    if (!bc) {
+        bc = new BoundsCache(xform, _nglyphs);
+        _bounds_caches.push_back(bc);
+    }
+
+    if (bc->index[g] < 0) {
+        double b[4], w;
+        bool ok = Efont::CharstringBounds::bounds(xform, program()->glyph_context(g), b, w);
+        bc->index[g] = bc->entries.size();
+        for (int i = 0; i < 4; ++i)
+            bc->entries.push_back(b[i]);
+        bc->entries.push_back(w);
+        bc->entries.push_back(ok);
+    }
+
+    const double *e = &bc->entries[bc->index[g]];
+    bounds[0] = e[0];
+    bounds[1] = e[1];
+    bounds[2] = e[2];
+    bounds[3] = e[3];
+    width = e[4];
+    return e[5] != 0;
+}
+
 bool
 FontInfo::is_fixed_pitch() const
 {
@@ -289,9 +349,8 @@ Secondary::encode_uni(int code, PermString name,
     return true;
 }
 
-T1Secondary::T1Secondary(const FontInfo &finfo, const String &font_name,
-                         const String &otf_file_name)
-    : Secondary(finfo), _font_name(font_name), _otf_file_name(otf_file_name),
+T1Secondary::T1Secondary(const FontInfo &finfo, const String &font_name)
+    : Secondary(finfo), _font_name(font_name),
       _units_per_em(finfo.units_per_em()),
       _xheight((int) ceil(finfo.x_height(Transform()))),
       _spacewidth(_units_per_em)
@@ -339,6 +398,7 @@ static String dotlessj_file_name;
 static String
 dotlessj_dvips_include(const String &, const FontInfo &, ErrorHandler *)
 {
+    record_output_file(dotlessj_file_name);
     return "<" + pathname_filename(dotlessj_file_name);
 }
 
@@ -363,7 +423,7 @@ T1Secondary::dotlessj_font(Metrics &metrics, ErrorHandler *errh, Glyph &dj_glyph
         if (metrics.mapped_font_name(i) == dj_name)
             return i;
 
-    if (String filename = installed_type1_dotlessj(_otf_file_name, _finfo.cff->font_name(), (output_flags & G_DOTLESSJ), errh)) {
+    if (String filename = installed_type1_dotlessj(_finfo, _finfo.cff->font_name(), (output_flags & G_DOTLESSJ), errh)) {
 
         // check for special case: "\0" means the font's "j" is already
         // dotless
@@ -656,7 +716,7 @@ char_bounds(double bounds[4], double& width, const FontInfo &finfo,
             const Transform &transform, uint32_t uni)
 {
     if (Efont::OpenType::Glyph g = finfo.cmap->map_uni(uni))
-        return Efont::CharstringBounds::bounds(transform, finfo.program()->glyph_context(g), bounds, width);
+        return finfo.glyph_bounds(g, transform, bounds, width);
     else
         return false;
 }
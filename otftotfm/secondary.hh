@@ -19,7 +19,8 @@ struct FontInfo {
     const Efont::OpenType::Post *post;
     const Efont::OpenType::Name *name;
 
-    FontInfo(const Efont::OpenType::Font *otf, ErrorHandler *);
+    FontInfo(const Efont::OpenType::Font *otf, ErrorHandler *,
+             Efont::Cff *shared_cff_file = 0);
     ~FontInfo();
 
     bool ok() const;
@@ -31,6 +32,8 @@ struct FontInfo {
     int units_per_em() const {
         return program()->units_per_em();
     }
+    bool glyph_bounds(Efont::OpenType::Glyph g, const Transform &xform,
+                      double bounds[4], double &width) const;
 
     bool is_fixed_pitch() const;
     double italic_angle() const;
@@ -50,6 +53,10 @@ struct FontInfo {
         _override_x_height = source;
         _x_height = x_height;
     }
+    void clear_overrides() {
+        _override_is_fixed_pitch = _override_italic_angle = false;
+        _override_x_height = x_height_auto;
+    }
 
     String family_name() const;
     String postscript_name() const;
@@ -57,10 +64,13 @@ struct FontInfo {
   private:
 
     int _nglyphs;
+    bool _own_cff_file;
     mutable Vector<PermString> _glyph_names;
     mutable bool _got_glyph_names;
     mutable Vector<uint32_t> _unicodes;
     mutable Efont::TrueTypeBoundsCharstringProgram *_ttb_program;
+    struct BoundsCache;
+    mutable Vector<BoundsCache *> _bounds_caches;
     bool _override_is_fixed_pitch;
     bool _override_italic_angle;
     bool _is_fixed_pitch;
@@ -109,11 +119,10 @@ class Secondary { public:
 };
 
 class T1Secondary : public Secondary { public:
-    T1Secondary(const FontInfo &, const String &font_name, const String &otf_file_name);
+    T1Secondary(const FontInfo &, const String &font_name);
     int setting(uint32_t uni, SettingSet&, ErrorHandler *);
   private:
     String _font_name;
-    String _otf_file_name;
     int _units_per_em;
     int _xheight;
     int _spacewidth;
@@ -0,0 +1,604 @@
+/* tfmwriter.{cc,hh} -- write TFM and VF files without pltotf/vptovf
+ *
+ * Copyright (c) 2026 Eddie Kohler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+#include "tfmwriter.hh"
+#include <lcdf/error.hh>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+
+enum { UNITY = 0x100000, SENTINEL = 0x7FFFFFFF };
+
+enum { set1 = 128, set_rule = 132, push = 141, pop = 142, right1 = 143,
+       down1 = 157, fnt_num_0 = 171, fnt1 = 235, fnt4 = 238, xxx1 = 239,
+       xxx4 = 242, long_char = 242, fnt_def1 = 243, fnt_def4 = 246,
+       pre = 247, post = 248, id_byte = 202 };
+
+static inline int
+zround(double r)
+{
+    if (r > 2147483647.0)
+        return 2147483647;
+    else if (r < -2147483647.0)
+        return -2147483647;
+    else if (r >= 0.0)
+        return (int) (r + 0.5);
+    else
+        return (int) (r - 0.5);
+}
+
+static inline void
+out4(StringAccum &sa, int x)
+{
+    sa << (char) (x >> 24) << (char) (x >> 16) << (char) (x >> 8) << (char) x;
+}
+
+
+bool
+TfmWriter::parse_real(const char *s, int &result)
+{
+    // pltotf's get_fix
+    bool negative = false;
+    for (; *s == ' ' || *s == '-' || *s == '+'; ++s)
+        if (*s == '-')
+            negative = !negative;
+
+    int acc = 0;
+    for (; isdigit((unsigned char) *s); ++s) {
+        acc = acc * 10 + *s - '0';
+        if (acc >= 2048)
+            return false;
+    }
+    int int_part = acc;
+
+    acc = 0;
+    if (*s == '.') {
+        int fraction_digits[7], j = 0;
+        for (++s; isdigit((unsigned char) *s); ++s)
+            if (j < 7)
+                fraction_digits[j++] = 0x200000 * (*s - '0');
+        while (j > 0)
+            acc = fraction_digits[--j] + acc / 10;
+        acc = (acc + 10) / 20;
+    }
+
+    if (acc >= UNITY && int_part == 2047)
+        return false;
+    result = int_part * UNITY + acc;
+    if (negative)
+        result = -result;
+    return true;
+}
+
+
+TfmWriter::TfmWriter()
+    : _design_size(10 * UNITY), _design_units(UNITY), _bchar(-1),
+      _bchar_label(-1), _packet_mapped(false)
+{
+    memset(_header, 0, sizeof(_header));
+    set_coding_scheme("UNSPECIFIED");
+    set_family("UNSPECIFIED");
+    memset(_exists, 0, sizeof(_exists));
+    memset(_mapped, 0, sizeof(_mapped));
+    for (int c = 0; c < 256; ++c)
+        _remainder[c] = -1;
+}
+
+void
+TfmWriter::set_bcpl(int pos, int size, const String &str)
+{
+    // pltotf's read_BCPL: uppercase, at most size-1 characters
+    int len = std::min(str.length(), size - 1);
+    _header[pos] = len;
+    for (int i = 0; i < len; ++i)
+        _header[pos + 1 + i] = toupper((unsigned char) str[i]);
+    memset(&_header[pos + 1 + len], 0, size - 1 - len);
+}
+
+void
+TfmWriter::set_family(const String &str)
+{
+    set_bcpl(48, 20, str);
+}
+
+void
+TfmWriter::set_coding_scheme(const String &str)
+{
+    set_bcpl(8, 40, str);
+}
+
+void
+TfmWriter::set_param(int p, int x)
+{
+    if (p > _params.size())
+        _params.resize(p, 0);
+    _params[p - 1] = x;
+}
+
+void
+TfmWriter::add_mapped_font(int number, const String &name, int dsize)
+{
+    MappedFont mf;
+    mf.number = number;
+    mf.name = name;
+    mf.dsize = dsize;
+    _fonts.push_back(mf);
+}
+
+
+void
+TfmWriter::add_label(int c)
+{
+    if (c == BOUNDARY)
+        _bchar_label = _ligkern.size() / 4;
+    else
+        _remainder[c] = _ligkern.size() / 4;
+}
+
+void
+TfmWriter::add_lig(int op, int c2, int out)
+{
+    _ligkern.push_back(0);
+    _ligkern.push_back(c2);
+    _ligkern.push_back(op);
+    _ligkern.push_back(out);
+}
+
+void
+TfmWriter::add_kern(int c2, int x)
+{
+    int k = std::find(_kerns.begin(), _kerns.end(), x) - _kerns.begin();
+    if (k == _kerns.size())
+        _kerns.push_back(x);
+    _ligkern.push_back(0);
+    _ligkern.push_back(c2);
+    _ligkern.push_back(128 + (k >> 8));
+    _ligkern.push_back(k & 255);
+}
+
+void
+TfmWriter::add_stop()
+{
+    if (_ligkern.size())
+        _ligkern[_ligkern.size() - 4] = 128;
+}
+
+
+void
+TfmWriter::add_char(int c, int wd, int ht, int dp, int ic)
+{
+    // claims the packet built since the last add_char()
+    _mapped[c] = _packet_mapped;
+    _packet[c] = _packet_sa.take_string();
+    _packet_mapped = false;
+    _exists[c] = true;
+    _dimen[c][DWIDTH] = wd;
+    _dimen[c][DHEIGHT] = ht;
+    _dimen[c][DDEPTH] = dp;
+    _dimen[c][DITALIC] = ic;
+    // pltotf enters a zero width for every character before its CHARWD
+    _dlist[DWIDTH].value.push_back(0);
+    _dlist[DWIDTH].value.push_back(wd);
+    for (int d = DHEIGHT; d < NDIMEN; ++d)
+        if (_dimen[c][d])
+            _dlist[d].value.push_back(_dimen[c][d]);
+}
+
+void
+TfmWriter::add_setchar(int c)
+{
+    _packet_mapped = true;
+    if (c >= 128)
+        _packet_sa << (char) set1;
+    _packet_sa << (char) c;
+}
+
+void
+TfmWriter::add_selectfont(int number)
+{
+    _packet_mapped = true;
+    if (number < 64)
+        _packet_sa << (char) (fnt_num_0 + number);
+    else if (number < 256)
+        _packet_sa << (char) fnt1 << (char) number;
+    else {
+        _packet_sa << (char) fnt4;
+        out4(_packet_sa, number);
+    }
+}
+
+void
+TfmWriter::add_move(int op, int x)
+{
+    // vptovf's vf_fix: the shortest signed encoding
+    _packet_mapped = true;
+    x = scaled(x);
+    int y = (x > 0 ? x : -1 - x), k = 1;
+    for (int t = 127; k < 4 && y > t; t = 256 * t + 255)
+        ++k;
+    _packet_sa << (char) (op + k - 1);
+    for (--k; k >= 0; --k)
+        _packet_sa << (char) (x >> (8 * k));
+}
+
+void
+TfmWriter::add_moveright(int x)
+{
+    add_move(right1, x);
+}
+
+void
+TfmWriter::add_moveup(int x)
+{
+    add_move(down1, -x);
+}
+
+void
+TfmWriter::add_setrule(int ht, int wd)
+{
+    _packet_mapped = true;
+    _packet_sa << (char) set_rule;
+    out4(_packet_sa, scaled(ht));
+    out4(_packet_sa, scaled(wd));
+}
+
+void
+TfmWriter::add_push()
+{
+    _packet_mapped = true;
+    _packet_sa << (char) push;
+}
+
+void
+TfmWriter::add_pop()
+{
+    _packet_mapped = true;
+    _packet_sa << (char) pop;
+}
+
+void
+TfmWriter::add_special(const String &str)
+{
+    _packet_mapped = true;
+    if (str.length() < 256)
+        _packet_sa << (char) xxx1 << (char) str.length();
+    else {
+        _packet_sa << (char) xxx4;
+        out4(_packet_sa, str.length());
+    }
+    _packet_sa << str;
+}
+
+
+int
+TfmWriter::scaled(int x) const
+{
+    if (_design_units != UNITY)
+        x = zround((x / (double) _design_units) * 1048576.0);
+    return x;
+}
+
+void
+TfmWriter::out_scaled(StringAccum &sa, int x, ErrorHandler *errh) const
+{
+    // pltotf's out_scaled
+    if (fabs(x / (double) _design_units) >= 16.0) {
+        errh->warning("the relative dimension %.3f is too large", x / 1048576.0);
+        x = 0;
+    }
+    x = scaled(x);
+    if (x < 0) {
+        sa << (char) 255;
+        x += 0x1000000;
+        if (x <= 0)
+            x = 1;
+    } else {
+        sa << (char) 0;
+        if (x >= 0x1000000)
+            x = 0xFFFFFF;
+    }
+    sa << (char) (x >> 16) << (char) (x >> 8) << (char) x;
+}
+
+
+void
+TfmWriter::DimenList::sort()
+{
+    std::sort(value.begin(), value.end());
+    value.erase(std::unique(value.begin(), value.end()), value.end());
+}
+
+int
+TfmWriter::DimenList::find(int x) const
+{
+    return std::lower_bound(value.begin(), value.end(), x) - value.begin();
+}
+
+int
+TfmWriter::DimenList::index_of(int x) const
+{
+    int i = find(x);
+    return (i < value.size() && value[i] == x ? index[i] : 0);
+}
+
+int
+TfmWriter::DimenList::memory_of(int x) const
+{
+    return memory[find(x)];
+}
+
+int
+TfmWriter::DimenList::min_cover(int d, int &next_d) const
+{
+    // pltotf's min_cover: intervals of length d needed to cover the list
+    int m = 0, p = 0, n = value.size();
+    next_d = SENTINEL;
+    while (p < n) {
+        ++m;
+        long long l = value[p];
+        while (p + 1 < n && value[p + 1] <= l + d)
+            ++p;
+        ++p;
+        long long gap = (p < n ? value[p] : (long long) SENTINEL) - l;
+        if (gap < next_d)
+            next_d = gap;
+    }
+    return m;
+}
+
+int
+TfmWriter::DimenList::shorten(int max, int &excess) const
+{
+    // pltotf's shorten: least interval length that leaves at most max values
+    if (value.size() <= max)
+        return 0;
+    excess = value.size() - max;
+    int d, next_d;
+    min_cover(0, next_d);
+    d = next_d;
+    do {
+        d += d;
+    } while (min_cover(d, next_d) > max);
+    d /= 2;
+    while (min_cover(d, next_d) > max)
+        d = next_d;
+    return d;
+}
+
+int
+TfmWriter::DimenList::set_indices(int d, int &excess)
+{
+    // pltotf's set_indices: each interval is represented by its midpoint
+    int m = 0, p = 0, n = value.size();
+    index.assign(n, 0);
+    memory = value;
+    while (p < n) {
+        ++m;
+        long long l = value[p];
+        index[p] = m;
+        while (p + 1 < n && value[p + 1] <= l + d) {
+            ++p;
+            index[p] = m;
+            if (--excess == 0)
+                d = 0;
+        }
+        memory[p] = l + (value[p] - l) / 2;
+        ++p;
+    }
+    return m;
+}
+
+
+void
+TfmWriter::finish(bool vf, ErrorHandler *errh)
+{
+    int bc = 0, ec = 255;
+    while (bc < 255 && !_exists[bc])
+        ++bc;
+    while (ec > 0 && !_exists[ec])
+        --ec;
+    if (bc > ec)
+        bc = 1;
+
+    // dimension tables
+    static const int max_dimen[] = { 255, 15, 15, 63 };
+    int ndimen[NDIMEN], excess = 0;
+    for (int d = 0; d < NDIMEN; ++d) {
+        DimenList &dl = _dlist[d];
+        dl.sort();
+        int delta = dl.shorten(max_dimen[d], excess);
+        ndimen[d] = dl.set_indices(delta, excess) + 1;
+    }
+
+    // lig/kern program offset; labels past 255 need indirect entries
+    int remainder[256];
+    memcpy(remainder, _remainder, sizeof(remainder));
+    Vector<int> label_rr(1, -1), label_cc(1, -1);
+    for (int c = bc; c <= ec; ++c)
+        if (_remainder[c] >= 0) {
+            int p = label_rr.size();
+            label_rr.push_back(0);
+            label_cc.push_back(0);
+            for (; label_rr[p - 1] > _remainder[c]; --p) {
+                label_rr[p] = label_rr[p - 1];
+                label_cc[p] = label_cc[p - 1];
+            }
+            label_rr[p] = _remainder[c];
+            label_cc[p] = c;
+        }
+    int label_ptr = label_rr.size() - 1;
+
+    bool extra_loc_needed = (_bchar >= 0 && _bchar < 256);
+    int lk_offset = (extra_loc_needed ? 1 : 0);
+    int sort_ptr = label_ptr;
+    if (label_rr[sort_ptr] + lk_offset > 255) {
+        lk_offset = 0;
+        extra_loc_needed = false;
+        do {
+            remainder[label_cc[sort_ptr]] = lk_offset;
+            while (label_rr[sort_ptr - 1] == label_rr[sort_ptr]) {
+                --sort_ptr;
+                remainder[label_cc[sort_ptr]] = lk_offset;
+            }
+            ++lk_offset;
+            --sort_ptr;
+        } while (lk_offset + label_rr[sort_ptr] >= 256);
+    }
+    if (lk_offset > 0)
+        for (; sort_ptr > 0; --sort_ptr)
+            remainder[label_cc[sort_ptr]] += lk_offset;
+
+    Vector<unsigned char> ligkern(_ligkern);
+    if (_bchar_label >= 0) {
+        ligkern.push_back(255);
+        ligkern.push_back(0);
+        ligkern.push_back((_bchar_label + lk_offset) >> 8);
+        ligkern.push_back((_bchar_label + lk_offset) & 255);
+    }
+    int nl = ligkern.size() / 4;
+
+    // header and check sum
+    unsigned char header[72];
+    memcpy(header, _header, sizeof(header));
+    {
+        long long c0 = bc, c1 = ec, c2 = bc, c3 = ec;
+        for (int c = bc; c <= ec; ++c)
+            if (_exists[c]) {
+                long long tw = scaled(_dlist[DWIDTH].memory_of(_dimen[c][DWIDTH]));
+                tw += (c + 4) * 0x400000LL;
+                c0 = (c0 + c0 + tw) % 255;
+                c1 = (c1 + c1 + tw) % 253;
+                c2 = (c2 + c2 + tw) % 251;
+                c3 = (c3 + c3 + tw) % 247;
+            }
+        header[0] = c0;
+        header[1] = c1;
+        header[2] = c2;
+        header[3] = c3;
+    }
+    header[4] = _design_size >> 24;
+    header[5] = _design_size >> 16;
+    header[6] = _design_size >> 8;
+    header[7] = _design_size;
+
+    // TFM file
+    StringAccum sa;
+    int lh = sizeof(header) / 4, nk = _kerns.size(), np = _params.size();
+    int lf = 6 + lh + (ec - bc + 1) + ndimen[DWIDTH] + ndimen[DHEIGHT]
+        + ndimen[DDEPTH] + ndimen[DITALIC] + nl + lk_offset + nk + np;
+    int sizes[12] = { lf, lh, bc, ec, ndimen[DWIDTH], ndimen[DHEIGHT],
+                      ndimen[DDEPTH], ndimen[DITALIC], nl + lk_offset,
+                      nk, 0, np };
+    for (int i = 0; i < 12; ++i)
+        sa << (char) (sizes[i] >> 8) << (char) sizes[i];
+    sa.append((const char *) header, sizeof(header));
+
+    for (int c = bc; c <= ec; ++c)
+        if (_exists[c]) {
+            int tag = (_remainder[c] >= 0 ? 1 : 0);
+            sa << (char) _dlist[DWIDTH].index_of(_dimen[c][DWIDTH])
+               << (char) (_dlist[DHEIGHT].index_of(_dimen[c][DHEIGHT]) * 16
+                          + _dlist[DDEPTH].index_of(_dimen[c][DDEPTH]))
+               << (char) (_dlist[DITALIC].index_of(_dimen[c][DITALIC]) * 4 + tag)
+               << (char) (tag ? remainder[c] : 0);
+        } else
+            sa << '\0' << '\0' << '\0' << '\0';
+
+    for (int d = 0; d < NDIMEN; ++d) {
+        const DimenList &dl = _dlist[d];
+        out_scaled(sa, 0, errh);
+        for (int i = 0; i < dl.value.size(); ++i)
+            if (i + 1 == dl.value.size() || dl.index[i + 1] != dl.index[i])
+                out_scaled(sa, dl.memory[i], errh);
+    }
+
+    if (extra_loc_needed)
+        sa << (char) 255 << (char) _bchar << '\0' << '\0';
+    else
+        for (sort_ptr = 1; sort_ptr <= lk_offset; ++sort_ptr) {
+            int t = label_rr[label_ptr];
+            if (_bchar >= 0 && _bchar < 256)
+                sa << (char) 255 << (char) _bchar;
+            else
+                sa << (char) 254 << '\0';
+            sa << (char) ((t + lk_offset) >> 8) << (char) (t + lk_offset);
+            do {
+                --label_ptr;
+            } while (label_rr[label_ptr] >= t);
+        }
+    sa.append((const char *) ligkern.begin(), ligkern.size());
+
+    for (int k = 0; k < nk; ++k)
+        out_scaled(sa, _kerns[k], errh);
+
+    for (int p = 0; p < np; ++p)
+        if (p == 0)
+            out4(sa, _params[p]);
+        else
+            out_scaled(sa, _params[p], errh);
+
+    _tfm = sa.take_string();
+
+    // VF file
+    if (vf) {
+        sa << (char) pre << (char) id_byte << '\0';
+        sa.append((const char *) header, 8);
+
+        for (const MappedFont *mf = _fonts.begin(); mf != _fonts.end(); ++mf) {
+            if (mf->number < 256)
+                sa << (char) fnt_def1 << (char) mf->number;
+            else {
+                sa << (char) fnt_def4;
+                out4(sa, mf->number);
+            }
+            out4(sa, 0);
+            out4(sa, UNITY);
+            out4(sa, mf->dsize);
+            sa << '\0' << (char) mf->name.length() << mf->name;
+        }
+
+        for (int c = bc; c <= ec; ++c)
+            if (_exists[c]) {
+                String packet = _packet[c];
+                if (!_mapped[c]) {
+                    StringAccum psa;
+                    if (c >= 128)
+                        psa << (char) set1;
+                    psa << (char) c;
+                    packet = psa.take_string();
+                }
+                int x = scaled(_dlist[DWIDTH].memory_of(_dimen[c][DWIDTH]));
+                if (packet.length() < 242 && x >= 0 && x < 0x1000000)
+                    sa << (char) packet.length() << (char) c
+                       << (char) (x >> 16) << (char) (x >> 8) << (char) x;
+                else {
+                    sa << (char) long_char;
+                    out4(sa, packet.length());
+                    out4(sa, c);
+                    out4(sa, x);
+                }
+                sa << packet;
+            }
+
+        do {
+            sa << (char) post;
+        } while (sa.length() % 4 != 0);
+
+        _vf = sa.take_string();
+    } else
+        _vf = String();
+}
@@ -0,0 +1,104 @@
+#ifndef OTFTOTFM_TFMWRITER_HH
+#define OTFTOTFM_TFMWRITER_HH
+#include <lcdf/straccum.hh>
+#include <lcdf/vector.hh>
+class ErrorHandler;
+
+// Builds binary TFM and VF files in memory.  The input is the same
+// information otftotfm writes to a PL or VPL file, and the conversion
+// follows pltotf and vptovf, so the output should match theirs byte for
+// byte.  Dimensions are fix_words in units of DESIGNUNITS, as parsed by
+// parse_real().  VF packet commands apply to the next add_char(); a
+// character without any gets the packet (SETCHAR c).
+
+class TfmWriter { public:
+
+    TfmWriter();
+
+    static bool parse_real(const char *s, int &result);
+
+    enum { LIG = 0, LIG_KEEP_RIGHT = 1, LIG_KEEP_LEFT = 2 };
+    enum { BOUNDARY = 256 };
+
+    void set_family(const String &);
+    void set_coding_scheme(const String &);
+    void set_design_size(int x)         { _design_size = x; }
+    void set_design_units(int x)        { _design_units = x; }
+    void set_param(int p, int x);
+    void set_boundary_char(int c)       { _bchar = c; }
+    void add_mapped_font(int number, const String &name, int dsize);
+
+    void add_label(int c);
+    void add_lig(int op, int c2, int out);
+    void add_kern(int c2, int x);
+    void add_stop();
+
+    void add_setchar(int c);
+    void add_selectfont(int number);
+    void add_moveright(int x);
+    void add_moveup(int x);
+    void add_setrule(int ht, int wd);
+    void add_push();
+    void add_pop();
+    void add_special(const String &);
+    void add_char(int c, int wd, int ht, int dp, int ic);
+
+    void finish(bool vf, ErrorHandler *);
+    const String &tfm_data() const      { return _tfm; }
+    const String &vf_data() const       { return _vf; }
+
+  private:
+
+    enum { NDIMEN = 4, DWIDTH = 0, DHEIGHT = 1, DDEPTH = 2, DITALIC = 3 };
+
+    struct DimenList {
+        Vector<int> value;      // sorted, distinct after sort()
+        Vector<int> index;      // index into the TFM table
+        Vector<int> memory;     // value after set_indices()
+        void sort();
+        int find(int x) const;
+        int min_cover(int d, int &next_d) const;
+        int shorten(int max, int &excess) const;
+        int set_indices(int d, int &excess);
+        int index_of(int x) const;
+        int memory_of(int x) const;
+    };
+
+    struct MappedFont {
+        int number;
+        String name;
+        int dsize;
+    };
+
+    unsigned char _header[72];
+    int _design_size;
+    int _design_units;
+    Vector<int> _params;
+    int _bchar;
+    int _bchar_label;
+
+    bool _exists[256];
+    int _dimen[256][NDIMEN];
+    int _remainder[256];        // lig/kern program start, or -1
+    DimenList _dlist[NDIMEN];
+
+    Vector<unsigned char> _ligkern;
+    Vector<int> _kerns;
+
+    bool _mapped[256];
+    String _packet[256];
+    StringAccum _packet_sa;
+    bool _packet_mapped;
+    Vector<MappedFont> _fonts;
+
+    String _tfm;
+    String _vf;
+
+    void set_bcpl(int pos, int size, const String &);
+    void add_move(int op, int x);
+    int scaled(int x) const;
+    void out_scaled(StringAccum &, int x, ErrorHandler *) const;
+
+};
+
+#endif
@@ -32,36 +32,22 @@
 # include <unistd.h>
 #endif
 
-String
-read_file(String filename, ErrorHandler *errh, bool warning)
+bool
+write_file(const String &filename, const String &data, ErrorHandler *errh)
 {
-    FILE *f;
-    if (!filename || filename == "-") {
-        filename = "<stdin>";
-        f = stdin;
-#if defined(_MSDOS) || defined(_WIN32)
-        // Set the file mode to binary
-        _setmode(_fileno(f), _O_BINARY);
-#endif
-    } else if (!(f = fopen(filename.c_str(), "rb"))) {
-        errh->xmessage((warning ? errh->e_warning : errh->e_error) + ErrorHandler::make_landmark_anno(filename), strerror(errno));
-        return String();
+    if (verbose)
+        errh->message("creating %s", filename.c_str());
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) {
+        errh->error("%s: %s", filename.c_str(), strerror(errno));
+        return false;
     }
-
-    StringAccum sa;
-    int amt;
-    do {
-        if (char *x = sa.reserve(8192)) {
-            amt = fread(x, 1, 8192, f);
-            sa.adjust_length(amt);
-        } else
-            amt = 0;
-    } while (amt != 0);
-    if (!feof(f) || ferror(f))
-        errh->xmessage((warning ? errh->e_warning : errh->e_error) + ErrorHandler::make_landmark_anno(filename), strerror(errno));
-    if (f != stdin)
-        fclose(f);
-    return sa.take_string();
+    ignore_result(fwrite(data.data(), 1, data.length(), f));
+    if (fclose(f) != 0) {
+        errh->error("%s: %s", filename.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
 }
 
 String
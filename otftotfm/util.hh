@@ -1,6 +1,7 @@
 #ifndef OTFTOTFM_UTIL_HH
 #define OTFTOTFM_UTIL_HH
 #include <lcdf/string.hh>
+#include <lcdf/readfile.hh>
 #include <lcdf/globmatch.hh>
 #include <stdio.h>
 class ErrorHandler;
@@ -15,7 +16,7 @@ enum { G_ENCODING = 1, G_METRICS = 2, G_VMETRICS = 4, G_TYPE1 = 8,
 
 extern unsigned output_flags;
 
-String read_file(String filename, ErrorHandler *, bool warn = false);
+bool write_file(const String &filename, const String &data, ErrorHandler *);
 String printable_filename(const String &);
 String pathname_filename(const String &);
 bool same_filename(const String &a, const String &b);
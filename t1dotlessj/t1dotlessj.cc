@@ -17,10 +17,7 @@
 #include <efont/psres.hh>
 #include <efont/t1rw.hh>
 #include <efont/t1font.hh>
-#include <efont/t1item.hh>
-#include <efont/t1csgen.hh>
-#include <efont/t1bounds.hh>
-#include <efont/t1unparser.hh>
+#include <efont/makedotlessj.hh>
 #include <lcdf/clp.h>
 #include <lcdf/error.hh>
 #include <stdlib.h>
@@ -37,7 +34,7 @@
 # include <io.h>
 #endif
 
-// also see otftotfm/automatic.cc
+// also see <efont/makedotlessj.hh>
 enum { EXIT_NORMAL = 0, EXIT_DOTLESSJ_EXISTS = 1, EXIT_J_NODOT = 2,
        EXIT_NO_J = 3, EXIT_ERROR = 4 };
 
@@ -103,127 +100,6 @@ Report bugs to <ekohler@gmail.com>.\n", program_name);
 }
 
 
-// Sectioner
-
-class Sectioner : public Type1CharstringGenInterp { public:
-
-    Sectioner(int precision);
-
-    void act_line(int, const Point &, const Point &);
-    void act_curve(int, const Point &, const Point &, const Point &, const Point &);
-    void act_closepath(int);
-    void act_flex(int, const Point &, const Point &, const Point &, const Point &, const Point &, const Point &, const Point &, double);
-
-    void run(const CharstringContext &g);
-    void undot(PermString, ErrorHandler *);
-    Type1Charstring gen(Type1Font *);
-
-  private:
-
-    CharstringBounds _boundser;
-
-    Vector<String> _sections;
-    Vector<int> _bounds;
-
-    void append_bounds();
-
-};
-
-Sectioner::Sectioner(int precision)
-    : Type1CharstringGenInterp(precision)
-{
-    set_direct_hint_replacement(true);
-}
-
-void
-Sectioner::act_line(int cmd, const Point &p0, const Point &p1)
-{
-    Type1CharstringGenInterp::act_line(cmd, p0, p1);
-    _boundser.act_line(cmd, p0, p1);
-}
-
-void
-Sectioner::act_curve(int cmd, const Point &p0, const Point &p1, const Point &p2, const Point &p3)
-{
-    Type1CharstringGenInterp::act_curve(cmd, p0, p1, p2, p3);
-    _boundser.act_curve(cmd, p0, p1, p2, p3);
-}
-
-void
-Sectioner::act_flex(int cmd, const Point &p0, const Point &p1, const Point &p2, const Point &p3_4, const Point &p5, const Point &p6, const Point &p7, double flex_depth)
-{
-    Type1CharstringGenInterp::act_flex(cmd, p0, p1, p2, p3_4, p5, p6, p7, flex_depth);
-    _boundser.act_flex(cmd, p0, p1, p2, p3_4, p5, p6, p7, flex_depth);
-}
-
-void Sectioner::append_bounds() {
-    double bb[5];
-    _boundser.output(bb, bb[4]);
-    _bounds.push_back((int) floor(bb[0]));
-    _bounds.push_back((int) floor(bb[1]));
-    _bounds.push_back((int) ceil(bb[2]));
-    _bounds.push_back((int) ceil(bb[3]));
-}
-
-void
-Sectioner::act_closepath(int cmd)
-{
-    Type1CharstringGenInterp::act_closepath(cmd);
-    Type1Charstring result;
-    Type1CharstringGenInterp::intermediate_output(result);
-    _sections.push_back(result.data_string());
-    append_bounds();
-    _boundser.clear();
-}
-
-void
-Sectioner::run(const CharstringContext &g)
-{
-    _boundser.clear();
-    Type1Charstring last_section;
-    Type1CharstringGenInterp::run(g, last_section);
-    _sections.push_back(last_section.data_string());
-    append_bounds();
-}
-
-void
-Sectioner::undot(PermString font_name, ErrorHandler *errh)
-{
-    //for (String *s = _sections.begin(); s < _sections.end(); s++)
-    //    fprintf(stderr, "%d  %s\n", s - _sections.begin(), CharstringUnparser::unparse(Type1Charstring(*s)).c_str());
-
-    if (_sections.size() < 3)
-        errh->fatal("<%d>%s: %<j%> is already dotless", -EXIT_J_NODOT, font_name.c_str());
-
-    int topmost = -1;
-    for (int i = 0; i < _sections.size() - 1; i++)
-        if (topmost < 0 || _bounds[i*4 + 1] > _bounds[topmost*4 + 1])
-            topmost = i;
-
-    // check if any sections are below this
-    for (int i = 0; i < _sections.size() - 1; i++)
-        if (_bounds[i*4 + 1] < _bounds[topmost*4 + 1])
-            goto found_below;
-    errh->fatal("<%d>%s: %<j%> is already dotless", -EXIT_J_NODOT, font_name.c_str());
-
-  found_below:
-    _sections[topmost] = String();
-}
-
-Type1Charstring
-Sectioner::gen(Type1Font *font)
-{
-    StringAccum sa;
-    for (String *s = _sections.begin(); s < _sections.end(); s++)
-        sa << *s;
-    Type1Charstring in(sa.take_string()), out;
-    Type1CharstringGenInterp gen(precision());
-    gen.set_hint_replacement_storage(font);
-    gen.run(CharstringContext(program(), &in), out);
-    return out;
-}
-
-
 // MAIN
 
 static Type1Font *
@@ -279,7 +155,6 @@ main(int argc, char *argv[])
     ErrorHandler *errh = ErrorHandler::static_initialize(new FileErrorHandler(stderr));
     const char *input_file = 0;
     FILE *outputf = 0;
-    const char *private_use_dotlessj = "uniF6BE";
     bool binary = true;
     const char *font_name = 0;
 
@@ -357,57 +232,25 @@ particular purpose.\n");
     if (!input_file || strcmp(input_file, "-") == 0)
         input_file = "<stdin>";
 
-    // check for existing dotlessj
-    if (font->glyph("dotlessj"))
+    // make new font
+    String actual_font_name = (font_name ? String(font_name) : font->font_name() + String("LCDFJ"));
+    PermString glyph_name;
+    int status;
+    Type1Font *dotless_font = create_dotlessj_font(font, actual_font_name, &status, &glyph_name);
+    if (status == DOTLESSJ_EXISTS && glyph_name == "dotlessj")
         errh->fatal("<%d>%s: already has a %<dotlessj%> glyph", -EXIT_DOTLESSJ_EXISTS, font->font_name().c_str());
-    else if (font->glyph("uni0237"))
-        errh->fatal("<%d>%s: already has a dotlessj glyph at %<uni0237%>", -EXIT_DOTLESSJ_EXISTS, font->font_name().c_str());
-    else if (font->glyph("u0237"))
-        errh->fatal("<%d>%s: already has a dotlessj glyph at %<u0237%>", -EXIT_DOTLESSJ_EXISTS, font->font_name().c_str());
-    else if (private_use_dotlessj && font->glyph(private_use_dotlessj))
-        errh->fatal("<%d>%s: already has a dotlessj glyph at %<%s%>", -EXIT_DOTLESSJ_EXISTS, font->font_name().c_str(), private_use_dotlessj);
-
-    // check for j
-    Type1Charstring *j_cs = font->glyph("j");
-    if (!j_cs)
-        j_cs = font->glyph("uni006A");
-    if (!j_cs)
-        j_cs = font->glyph("u006A");
-    if (!j_cs)
+    else if (status == DOTLESSJ_EXISTS)
+        errh->fatal("<%d>%s: already has a dotlessj glyph at %<%s%>", -EXIT_DOTLESSJ_EXISTS, font->font_name().c_str(), glyph_name.c_str());
+    else if (status == DOTLESSJ_NO_J)
         errh->fatal("<%d>%s: has no %<j%> glyph to make dotless", -EXIT_NO_J, font->font_name().c_str());
+    else if (status == DOTLESSJ_J_NODOT)
+        errh->fatal("<%d>%s: %<j%> is already dotless", -EXIT_J_NODOT, font->font_name().c_str());
 
-    // make new font
-    String actual_font_name = (font_name ? String(font_name) : font->font_name() + String("LCDFJ"));
     if (actual_font_name.length() > 29 && !font_name) {
         errh->warning("derived font name %<%s%> longer than 29 characters", actual_font_name.c_str());
         errh->message("(Use the %<--name%> option to supply your own name.)");
     }
 
-    Vector<double> xuid_extension;
-    xuid_extension.push_back(0x00237237);
-    Type1Font *dotless_font = Type1Font::skeleton_make_copy(font, actual_font_name, &xuid_extension);
-    dotless_font->skeleton_common_subrs();
-
-    // copy space and .notdef
-    if (Type1Charstring *notdef = font->glyph(".notdef"))
-        dotless_font->add_glyph(Type1Subr::make_glyph(".notdef", *notdef, " |-"));
-    if (Type1Charstring *space = font->glyph("space")) {
-        dotless_font->add_glyph(Type1Subr::make_glyph("space", *space, " |-"));
-        dotless_font->type1_encoding()->put(' ', "space");
-    }
-
-    // create dotless j
-    Sectioner sec(5);
-    sec.run(CharstringContext(font, j_cs));
-    sec.undot(font->font_name(), errh);
-    Type1Subr *dotlessj = Type1Subr::make_glyph("uni0237", sec.gen(dotless_font), " |-");
-    dotless_font->add_glyph(dotlessj);
-    //fprintf(stderr, "!  %s\n", CharstringUnparser::unparse(dotlessj->t1cs()).c_str());
-
-    // encode dotless j
-    dotless_font->type1_encoding()->clear();
-    dotless_font->type1_encoding()->put('j', "uni0237");
-
     // write it to output
     if (!outputf)
         outputf = stdout;
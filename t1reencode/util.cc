@@ -26,38 +26,6 @@
 # include <io.h>
 #endif
 
-String
-read_file(String filename, ErrorHandler *errh, bool warning)
-{
-    FILE *f;
-    if (!filename || filename == "-") {
-        filename = "<stdin>";
-        f = stdin;
-#if defined(_MSDOS) || defined(_WIN32)
-        // Set the file mode to binary
-        _setmode(_fileno(f), _O_BINARY);
-#endif
-    } else if (!(f = fopen(filename.c_str(), "rb"))) {
-        errh->xmessage((warning ? errh->e_warning : errh->e_error) + ErrorHandler::make_landmark_anno(filename), strerror(errno));
-        return String();
-    }
-
-    StringAccum sa;
-    int amt;
-    do {
-        if (char *x = sa.reserve(8192)) {
-            amt = fread(x, 1, 8192, f);
-            sa.adjust_length(amt);
-        } else
-            amt = 0;
-    } while (amt != 0);
-    if (!feof(f) || ferror(f))
-        errh->xmessage((warning ? errh->e_warning : errh->e_error) + ErrorHandler::make_landmark_anno(filename), strerror(errno));
-    if (f != stdin)
-        fclose(f);
-    return sa.take_string();
-}
-
 String
 printable_filename(const String &s)
 {